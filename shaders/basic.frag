@@ -17,6 +17,10 @@ const int RENDER_O3D_COLOR = 2;
 uniform int u_render_mode_flag;
 uniform sampler2D u_color_texture;
 
+// Texture pack page, if u_tex_layer isn't negative.
+uniform int u_tex_layer;
+uniform sampler2DArray u_color_texture_array;
+
 //
 // Using the "barycentric coordinates" trick shown here:
 //   http://codeflow.org/entries/2012/aug/02/easy-wireframe-display-with-barycentric-coordinates/
@@ -36,7 +40,11 @@ void main(void) {
 	// Not a high performance app, so we can afford the branching.
 	if (u_render_mode_flag == RENDER_TEXTURED) {
 		// Texture map, if any.
-		out_color = texture(u_color_texture, v_uv);
+		if (u_tex_layer >= 0) {
+			out_color = texture(u_color_texture_array, vec3(v_uv, float(u_tex_layer)));
+		} else {
+			out_color = texture(u_color_texture, v_uv);
+		}
 	} else if (u_render_mode_flag == RENDER_WIREFRAME) {
 		// Dark green wireframe.
 		out_color = vec4(0.8, 1.0, 0.8, 1.0);
@@ -0,0 +1,704 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: asset_cache.c
+ * Created on: 17/10/26
+ * Brief: Reference-counted cache of loaded assets (models, textures) with LRU eviction under memory budgets.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "asset_cache.h"
+#include "file_utils.h"
+#include "mtf.h"
+#include "o3d.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NOTE: Same as parallel.c, pthreads are POSIX.
+#include <pthread.h>
+
+enum { ASSET_MAX_PATH_LEN = 1024 };
+
+// Initial hash table size. Always a power of two.
+enum { ASSET_MIN_BUCKETS = 64 };
+
+typedef enum asset_state {
+	ASSET_LOADING,
+	ASSET_READY,
+	ASSET_FAILED
+} asset_state_t;
+
+struct asset {
+	asset_t              * hashNext;
+	asset_t              * lruPrev;   // In the LRU list only while unreferenced and ready.
+	asset_t              * lruNext;
+	const asset_loader_t * loader;
+	void                 * data;
+	size_t                 cpuBytes;
+	size_t                 gpuBytes;
+	uint32_t               hash;
+	uint32_t               refCount;
+	asset_state_t          state;
+	char                 * path;      // As first requested; used to read the file.
+	char                   key[];     // Normalized path, then the path itself.
+};
+
+/*
+ * Where the files come from. Archive names are normalized like the
+ * keys and sorted, so they can be looked up with a binary search.
+ */
+typedef struct asset_archive_name {
+	char     * name;
+	uint32_t   entryIndex;
+} asset_archive_name_t;
+
+typedef struct asset_source {
+	char                 * dirPath;   // Null for archives.
+	mtf_file_t             mtf;
+	asset_archive_name_t * names;
+	pthread_mutex_t        mtfLock;   // Reads seek the archive's file.
+} asset_source_t;
+
+struct asset_cache {
+	pthread_mutex_t       lock;
+	pthread_cond_t        loaded;     // Signaled when any asset leaves ASSET_LOADING.
+	asset_t            ** buckets;
+	uint32_t              bucketCount;
+	asset_t             * lruHead;    // Least recently released.
+	asset_t             * lruTail;
+	asset_source_t     ** sources;
+	uint32_t              sourceCount;
+	asset_cache_stats_t   stats;
+};
+
+/* ========================================================
+ * Keys:
+ * ======================================================== */
+
+// "common\meshes\chest.o3d" => "COMMON/MESHES/CHEST.O3D"
+static void asset_normalize_path(const char * path, char * key, size_t maxLen) {
+	size_t n = 0;
+	for (const char * p = path; *p != '\0' && n < maxLen - 1; ++p) {
+		const char ch = (*p == '\\') ? '/' : *p;
+		if (ch == '/' && n != 0 && key[n - 1] == '/') {
+			continue;
+		}
+		key[n++] = (char)toupper((unsigned char)ch);
+	}
+	key[n] = '\0';
+}
+
+// FNV-1a, also mixing in the loader, so one path can be two kinds of asset.
+static uint32_t asset_hash(const char * key, const asset_loader_t * loader) {
+	uint32_t hash = 2166136261u;
+	for (const char * p = key; *p != '\0'; ++p) {
+		hash = (hash ^ (uint8_t)*p) * 16777619u;
+	}
+	const uintptr_t bits = (uintptr_t)loader;
+	hash = (hash ^ (uint32_t)(bits >> 4)) * 16777619u;
+	return hash;
+}
+
+/* ========================================================
+ * asset_cache_create() / asset_cache_destroy():
+ * ======================================================== */
+
+asset_cache_t * asset_cache_create(size_t cpuBudget, size_t gpuBudget) {
+	asset_cache_t * cache = calloc(1, sizeof(*cache));
+	if (cache == NULL) {
+		o3d_set_error("Unable to malloc asset cache!");
+		return NULL;
+	}
+
+	cache->buckets = calloc(ASSET_MIN_BUCKETS, sizeof(cache->buckets[0]));
+	if (cache->buckets == NULL) {
+		free(cache);
+		o3d_set_error("Unable to malloc asset cache!");
+		return NULL;
+	}
+
+	cache->bucketCount     = ASSET_MIN_BUCKETS;
+	cache->stats.cpuBudget = cpuBudget;
+	cache->stats.gpuBudget = gpuBudget;
+
+	pthread_mutex_init(&cache->lock, NULL);
+	pthread_cond_init(&cache->loaded, NULL);
+	return cache;
+}
+
+static void asset_source_free(asset_source_t * source) {
+	if (source->dirPath == NULL) {
+		for (uint32_t e = 0; e < source->mtf.fileEntryCount && source->names != NULL; ++e) {
+			free(source->names[e].name);
+		}
+		free(source->names);
+		mtf_file_close(&source->mtf);
+		pthread_mutex_destroy(&source->mtfLock);
+	}
+	free(source->dirPath);
+	free(source);
+}
+
+void asset_cache_destroy(asset_cache_t * cache) {
+	if (cache == NULL) {
+		return;
+	}
+
+	for (uint32_t b = 0; b < cache->bucketCount; ++b) {
+		asset_t * asset = cache->buckets[b];
+		while (asset != NULL) {
+			asset_t * next = asset->hashNext;
+			assert(asset->refCount == 0 && "Asset handle still out!");
+			if (asset->state == ASSET_READY) {
+				asset->loader->unload(asset->loader->userData, asset->data);
+			}
+			free(asset);
+			asset = next;
+		}
+	}
+
+	for (uint32_t s = 0; s < cache->sourceCount; ++s) {
+		asset_source_free(cache->sources[s]);
+	}
+
+	pthread_cond_destroy(&cache->loaded);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->sources);
+	free(cache->buckets);
+	free(cache);
+}
+
+/* ========================================================
+ * Sources:
+ * ======================================================== */
+
+static bool asset_push_source(asset_cache_t * cache, asset_source_t * source) {
+	pthread_mutex_lock(&cache->lock);
+	asset_source_t ** sources = realloc(cache->sources, (cache->sourceCount + 1) * sizeof(sources[0]));
+	if (sources != NULL) {
+		sources[cache->sourceCount++] = source;
+		cache->sources = sources;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	if (sources == NULL) {
+		return o3d_set_error("Unable to realloc asset sources!");
+	}
+	return true;
+}
+
+bool asset_cache_add_directory(asset_cache_t * cache, const char * path) {
+	assert(cache != NULL);
+	assert(path  != NULL);
+
+	asset_source_t * source = calloc(1, sizeof(*source));
+	const size_t len = strlen(path);
+	if (source == NULL || (source->dirPath = malloc(len + 1)) == NULL) {
+		free(source);
+		return o3d_set_error("Unable to malloc asset source!");
+	}
+
+	memcpy(source->dirPath, path, len + 1);
+	if (!asset_push_source(cache, source)) {
+		asset_source_free(source);
+		return false;
+	}
+	return true;
+}
+
+static int asset_sort_archive_names(const void * a, const void * b) {
+	return strcmp(((const asset_archive_name_t *)a)->name, ((const asset_archive_name_t *)b)->name);
+}
+
+bool asset_cache_add_archive(asset_cache_t * cache, const char * mtfFilename) {
+	assert(cache != NULL);
+	assert(mtfFilename != NULL);
+
+	asset_source_t * source = calloc(1, sizeof(*source));
+	if (source == NULL) {
+		return o3d_set_error("Unable to malloc asset source!");
+	}
+	pthread_mutex_init(&source->mtfLock, NULL);
+
+	if (!mtf_file_open(&source->mtf, mtfFilename)) {
+		asset_source_free(source);
+		return o3d_set_error(mtf_get_last_error());
+	}
+
+	source->names = calloc(source->mtf.fileEntryCount, sizeof(source->names[0]));
+	if (source->names == NULL) {
+		asset_source_free(source);
+		return o3d_set_error("Unable to malloc archive names!");
+	}
+
+	char key[ASSET_MAX_PATH_LEN];
+	for (uint32_t e = 0; e < source->mtf.fileEntryCount; ++e) {
+		asset_normalize_path(source->mtf.fileEntries[e].filename, key, sizeof(key));
+		const size_t len = strlen(key) + 1;
+		if ((source->names[e].name = malloc(len)) == NULL) {
+			asset_source_free(source);
+			return o3d_set_error("Unable to malloc archive names!");
+		}
+		memcpy(source->names[e].name, key, len);
+		source->names[e].entryIndex = e;
+	}
+	qsort(source->names, source->mtf.fileEntryCount, sizeof(source->names[0]), &asset_sort_archive_names);
+
+	if (!asset_push_source(cache, source)) {
+		asset_source_free(source);
+		return false;
+	}
+	return true;
+}
+
+/* ========================================================
+ * asset_cache_read_file():
+ * ======================================================== */
+
+static bool asset_read_from_directory(const asset_source_t * source, const char * path, uint8_t ** data, size_t * size) {
+	char filename[ASSET_MAX_PATH_LEN];
+	if (source->dirPath[0] != '\0') {
+		snprintf(filename, sizeof(filename), "%s/%s", source->dirPath, path);
+	} else {
+		snprintf(filename, sizeof(filename), "%s", path);
+	}
+	for (char * p = filename; *p != '\0'; ++p) {
+		if (*p == '\\') {
+			*p = '/';
+		}
+	}
+
+	file_map_t map;
+	if (!file_map_open(&map, filename)) {
+		file_map_close(&map);
+
+		// file_map_open() refuses empty files, but an empty asset is still there.
+		uint64_t fileSize;
+		int64_t modTime;
+		if (!file_get_info(filename, &fileSize, &modTime) || fileSize != 0) {
+			return false;
+		}
+		map.data = NULL;
+		map.size = 0;
+	}
+
+	// One extra byte, so an empty file never asks malloc() for zero bytes (which can return NULL).
+	*data = malloc((size_t)map.size + 1);
+	if (*data != NULL) {
+		if (map.size != 0) {
+			memcpy(*data, map.data, (size_t)map.size);
+		}
+		*size = (size_t)map.size;
+	}
+	file_map_close(&map);
+	return (*data != NULL);
+}
+
+static bool asset_read_from_archive(asset_source_t * source, const char * key, uint8_t ** data, size_t * size) {
+	asset_archive_name_t search;
+	search.name = (char *)key;
+
+	const asset_archive_name_t * found = bsearch(&search, source->names, source->mtf.fileEntryCount,
+	                                             sizeof(source->names[0]), &asset_sort_archive_names);
+	if (found == NULL) {
+		return false;
+	}
+
+	const mtf_file_entry_t * entry = &source->mtf.fileEntries[found->entryIndex];
+
+	pthread_mutex_lock(&source->mtfLock);
+	const bool success = mtf_file_read_entry(&source->mtf, entry, data);
+	pthread_mutex_unlock(&source->mtfLock);
+
+	if (success) {
+		*size = entry->decompressedSize;
+	}
+	return success;
+}
+
+bool asset_cache_read_file(asset_cache_t * cache, const char * path, uint8_t ** data, size_t * size) {
+	assert(cache != NULL);
+	assert(path  != NULL);
+	assert(data  != NULL);
+	assert(size  != NULL);
+
+	*data = NULL;
+	*size = 0;
+
+	char key[ASSET_MAX_PATH_LEN];
+	asset_normalize_path(path, key, sizeof(key));
+
+	// Sources are only ever appended, and never while assets are
+	// being loaded, so they can be walked without the cache lock.
+	for (uint32_t s = 0; s < cache->sourceCount; ++s) {
+		asset_source_t * source = cache->sources[s];
+		const bool found = (source->dirPath != NULL) ? asset_read_from_directory(source, path, data, size)
+		                                             : asset_read_from_archive(source, key, data, size);
+		if (found) {
+			return true;
+		}
+	}
+
+	// Plain files are the fallback if no sources were added.
+	if (cache->sourceCount == 0) {
+		asset_source_t cwd;
+		memset(&cwd, 0, sizeof(cwd));
+		cwd.dirPath = "";
+		if (asset_read_from_directory(&cwd, path, data, size)) {
+			return true;
+		}
+	}
+
+	return o3d_set_error("Asset file not found in any of the sources!");
+}
+
+/* ========================================================
+ * Hash table / LRU list (cache lock held):
+ * ======================================================== */
+
+static asset_t * asset_find(const asset_cache_t * cache, uint32_t hash, const asset_loader_t * loader, const char * key) {
+	for (asset_t * asset = cache->buckets[hash & (cache->bucketCount - 1)]; asset != NULL; asset = asset->hashNext) {
+		if (asset->hash == hash && asset->loader == loader && strcmp(asset->key, key) == 0) {
+			return asset;
+		}
+	}
+	return NULL;
+}
+
+static void asset_grow_table(asset_cache_t * cache) {
+	const uint32_t newCount = cache->bucketCount * 2;
+	asset_t ** buckets = calloc(newCount, sizeof(buckets[0]));
+	if (buckets == NULL) {
+		return; // Longer chains, but still works.
+	}
+
+	for (uint32_t b = 0; b < cache->bucketCount; ++b) {
+		asset_t * asset = cache->buckets[b];
+		while (asset != NULL) {
+			asset_t * next = asset->hashNext;
+			asset_t ** bucket = &buckets[asset->hash & (newCount - 1)];
+			asset->hashNext = *bucket;
+			*bucket = asset;
+			asset = next;
+		}
+	}
+
+	free(cache->buckets);
+	cache->buckets     = buckets;
+	cache->bucketCount = newCount;
+}
+
+static void asset_insert(asset_cache_t * cache, asset_t * asset) {
+	if (cache->stats.assetCount >= cache->bucketCount) {
+		asset_grow_table(cache);
+	}
+	asset_t ** bucket = &cache->buckets[asset->hash & (cache->bucketCount - 1)];
+	asset->hashNext = *bucket;
+	*bucket = asset;
+	cache->stats.assetCount++;
+}
+
+static void asset_remove(asset_cache_t * cache, asset_t * asset) {
+	asset_t ** link = &cache->buckets[asset->hash & (cache->bucketCount - 1)];
+	while (*link != asset) {
+		assert(*link != NULL);
+		link = &(*link)->hashNext;
+	}
+	*link = asset->hashNext;
+	asset->hashNext = NULL;
+	cache->stats.assetCount--;
+}
+
+static void asset_lru_push(asset_cache_t * cache, asset_t * asset) {
+	asset->lruPrev = cache->lruTail;
+	asset->lruNext = NULL;
+	if (cache->lruTail != NULL) {
+		cache->lruTail->lruNext = asset;
+	} else {
+		cache->lruHead = asset;
+	}
+	cache->lruTail = asset;
+}
+
+static void asset_lru_unlink(asset_cache_t * cache, asset_t * asset) {
+	if (asset->lruPrev != NULL) {
+		asset->lruPrev->lruNext = asset->lruNext;
+	} else {
+		cache->lruHead = asset->lruNext;
+	}
+	if (asset->lruNext != NULL) {
+		asset->lruNext->lruPrev = asset->lruPrev;
+	} else {
+		cache->lruTail = asset->lruPrev;
+	}
+	asset->lruPrev = NULL;
+	asset->lruNext = NULL;
+}
+
+//
+// Takes unreferenced assets out of the cache, oldest first, while over
+// budget (or all of them if `all`). Each budget only evicts assets using
+// some of it, so a texture isn't dropped to make room for models.
+// Returns the evicted assets chained by hashNext, to unload unlocked.
+//
+static asset_t * asset_evict(asset_cache_t * cache, bool all) {
+	asset_cache_stats_t * stats = &cache->stats;
+	asset_t * evicted = NULL;
+
+	asset_t * asset = cache->lruHead;
+	while (asset != NULL) {
+		const bool cpuOver = (stats->cpuBytes > stats->cpuBudget);
+		const bool gpuOver = (stats->gpuBytes > stats->gpuBudget);
+		if (!all && !cpuOver && !gpuOver) {
+			break;
+		}
+
+		asset_t * next = asset->lruNext;
+		if (all || (cpuOver && asset->cpuBytes != 0) || (gpuOver && asset->gpuBytes != 0)) {
+			assert(asset->refCount == 0 && asset->state == ASSET_READY);
+			asset_lru_unlink(cache, asset);
+			asset_remove(cache, asset);
+
+			stats->cpuBytes -= asset->cpuBytes;
+			stats->gpuBytes -= asset->gpuBytes;
+			stats->evictions++;
+
+			asset->hashNext = evicted;
+			evicted = asset;
+		}
+		asset = next;
+	}
+	return evicted;
+}
+
+static void asset_unload_evicted(asset_t * evicted) {
+	while (evicted != NULL) {
+		asset_t * next = evicted->hashNext;
+		evicted->loader->unload(evicted->loader->userData, evicted->data);
+		free(evicted);
+		evicted = next;
+	}
+}
+
+// Drops a reference. Unreferenced failures are forgotten, so the next acquire tries again.
+static void asset_unref(asset_cache_t * cache, asset_t * asset) {
+	assert(asset->refCount != 0);
+	if (--asset->refCount != 0) {
+		return;
+	}
+
+	cache->stats.referencedCount--;
+	if (asset->state == ASSET_READY) {
+		asset_lru_push(cache, asset);
+	} else if (asset->state == ASSET_FAILED) {
+		asset_remove(cache, asset);
+		free(asset);
+	}
+}
+
+/* ========================================================
+ * asset_cache_acquire() / asset_cache_release():
+ * ======================================================== */
+
+asset_t * asset_cache_acquire(asset_cache_t * cache, const asset_loader_t * loader, const char * path) {
+	assert(cache  != NULL);
+	assert(loader != NULL && loader->load != NULL && loader->unload != NULL);
+	assert(path   != NULL);
+
+	char key[ASSET_MAX_PATH_LEN];
+	asset_normalize_path(path, key, sizeof(key));
+	const uint32_t hash = asset_hash(key, loader);
+
+	pthread_mutex_lock(&cache->lock);
+
+	asset_t * asset = asset_find(cache, hash, loader, key);
+	if (asset != NULL) {
+		if (asset->refCount++ == 0) {
+			cache->stats.referencedCount++;
+			if (asset->state == ASSET_READY) {
+				asset_lru_unlink(cache, asset);
+			}
+		}
+
+		if (asset->state == ASSET_LOADING) {
+			cache->stats.sharedLoads++;
+			while (asset->state == ASSET_LOADING) {
+				pthread_cond_wait(&cache->loaded, &cache->lock);
+			}
+		} else {
+			cache->stats.hits++;
+		}
+
+		if (asset->state == ASSET_FAILED) {
+			asset_unref(cache, asset);
+			pthread_mutex_unlock(&cache->lock);
+			o3d_set_error("Asset failed to load!");
+			return NULL;
+		}
+
+		pthread_mutex_unlock(&cache->lock);
+		return asset;
+	}
+
+	// First request: the entry goes in now, in the loading state,
+	// so anyone else asking for it meanwhile waits for this load.
+	const size_t keyLen  = strlen(key) + 1;
+	const size_t pathLen = strlen(path) + 1;
+	asset = calloc(1, sizeof(*asset) + keyLen + pathLen);
+	if (asset == NULL) {
+		pthread_mutex_unlock(&cache->lock);
+		o3d_set_error("Unable to malloc asset!");
+		return NULL;
+	}
+
+	memcpy(asset->key, key, keyLen);
+	asset->path = asset->key + keyLen;
+	memcpy(asset->path, path, pathLen);
+	asset->loader   = loader;
+	asset->hash     = hash;
+	asset->refCount = 1;
+	asset->state    = ASSET_LOADING;
+
+	asset_insert(cache, asset);
+	cache->stats.referencedCount++;
+	cache->stats.misses++;
+	pthread_mutex_unlock(&cache->lock);
+
+	uint8_t * fileData = NULL;
+	size_t fileSize = 0;
+	asset_load_result_t result;
+	memset(&result, 0, sizeof(result));
+
+	bool success = asset_cache_read_file(cache, path, &fileData, &fileSize);
+	if (success) {
+		success = loader->load(loader->userData, path, fileData, fileSize, &result);
+	}
+	free(fileData);
+
+	pthread_mutex_lock(&cache->lock);
+
+	asset_t * evicted = NULL;
+	if (success) {
+		asset->data     = result.data;
+		asset->cpuBytes = result.cpuBytes;
+		asset->gpuBytes = result.gpuBytes;
+		asset->state    = ASSET_READY;
+		cache->stats.cpuBytes += result.cpuBytes;
+		cache->stats.gpuBytes += result.gpuBytes;
+		evicted = asset_evict(cache, false);
+	} else {
+		asset->state = ASSET_FAILED;
+		cache->stats.failures++;
+		asset_unref(cache, asset);
+		asset = NULL;
+	}
+
+	pthread_cond_broadcast(&cache->loaded);
+	pthread_mutex_unlock(&cache->lock);
+
+	asset_unload_evicted(evicted);
+	return asset;
+}
+
+void asset_cache_release(asset_cache_t * cache, asset_t * asset) {
+	assert(cache != NULL);
+	if (asset == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	asset_unref(cache, asset);
+	asset_t * evicted = asset_evict(cache, false);
+	pthread_mutex_unlock(&cache->lock);
+
+	asset_unload_evicted(evicted);
+}
+
+void * asset_get_data(const asset_t * asset) {
+	assert(asset != NULL);
+	return asset->data;
+}
+
+/* ========================================================
+ * Budgets / statistics:
+ * ======================================================== */
+
+void asset_cache_set_budgets(asset_cache_t * cache, size_t cpuBudget, size_t gpuBudget) {
+	assert(cache != NULL);
+
+	pthread_mutex_lock(&cache->lock);
+	cache->stats.cpuBudget = cpuBudget;
+	cache->stats.gpuBudget = gpuBudget;
+	asset_t * evicted = asset_evict(cache, false);
+	pthread_mutex_unlock(&cache->lock);
+
+	asset_unload_evicted(evicted);
+}
+
+void asset_cache_trim(asset_cache_t * cache) {
+	assert(cache != NULL);
+
+	pthread_mutex_lock(&cache->lock);
+	asset_t * evicted = asset_evict(cache, true);
+	pthread_mutex_unlock(&cache->lock);
+
+	asset_unload_evicted(evicted);
+}
+
+void asset_cache_get_stats(asset_cache_t * cache, asset_cache_stats_t * stats) {
+	assert(cache != NULL);
+	assert(stats != NULL);
+
+	pthread_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/* ========================================================
+ * asset_o3d_model_loader:
+ * ======================================================== */
+
+static bool asset_load_o3d_model(void * userData, const char * path, const uint8_t * fileData, size_t fileSize,
+                                 asset_load_result_t * result) {
+	(void)userData;
+	(void)path;
+
+	o3d_model_t * o3d = malloc(sizeof(*o3d));
+	if (o3d == NULL) {
+		return o3d_set_error("Unable to malloc model!");
+	}
+
+	if (!o3d_load_from_memory(o3d, fileData, fileSize, NULL)) {
+		free(o3d);
+		return false;
+	}
+
+	result->data     = o3d;
+	result->cpuBytes = sizeof(*o3d) + ((size_t)o3d->vertexCount * sizeof(o3d_vertex_t)) +
+	                   ((size_t)o3d->faceCount * sizeof(o3d_face_t));
+	result->gpuBytes = 0;
+	return true;
+}
+
+static void asset_unload_o3d_model(void * userData, void * assetData) {
+	(void)userData;
+	o3d_free(assetData);
+	free(assetData);
+}
+
+const asset_loader_t asset_o3d_model_loader = {
+	"model",
+	&asset_load_o3d_model,
+	&asset_unload_o3d_model,
+	NULL
+};
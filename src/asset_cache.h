@@ -0,0 +1,155 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: asset_cache.h
+ * Created on: 17/10/26
+ * Brief: Reference-counted cache of loaded assets (models, textures) with LRU eviction under memory budgets.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_ASSET_CACHE_H
+#define DARKSTONE_ASSET_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ========================================================
+ * Asset cache data structures:
+ * ======================================================== */
+
+/*
+ * Assets are keyed by their archive path, e.g. "COMMON\MESHES\CHEST.O3D".
+ * Keys are compared case-insensitively and with either slash, as in the
+ * game, so the same asset named by two models is only loaded once.
+ * The file data comes from the sources added to the cache (unpacked
+ * directories or MTF archives), searched in the order they were added.
+ */
+typedef struct asset_cache asset_cache_t;
+typedef struct asset       asset_t;
+
+/*
+ * What the loader produced for one asset. The sizes are charged
+ * against the cache budgets until the asset is unloaded.
+ */
+typedef struct asset_load_result {
+	void   * data;
+	size_t   cpuBytes;
+	size_t   gpuBytes;
+} asset_load_result_t;
+
+/*
+ * Turns the raw file data into an asset and back. `load` runs on the thread
+ * that first requested the asset, without holding the cache lock; `unload`
+ * runs on the thread whose acquire/release/trim evicted it. So loaders of
+ * GPU resources should only be used from the thread owning the GL context.
+ */
+typedef struct asset_loader {
+	const char * name; // For messages, e.g. "model".
+	bool (* load)(void * userData, const char * path, const uint8_t * fileData, size_t fileSize, asset_load_result_t * result);
+	void (* unload)(void * userData, void * assetData);
+	void       * userData;
+} asset_loader_t;
+
+typedef struct asset_cache_stats {
+	uint32_t assetCount;       // Loaded or being loaded.
+	uint32_t referencedCount;  // With handles out; never evicted.
+	size_t   cpuBytes;
+	size_t   gpuBytes;
+	size_t   cpuBudget;
+	size_t   gpuBudget;
+	uint64_t hits;             // Acquires of an asset already loaded.
+	uint64_t misses;           // Acquires that had to load it.
+	uint64_t sharedLoads;      // Acquires that waited for another thread loading the same asset.
+	uint64_t failures;
+	uint64_t evictions;
+} asset_cache_stats_t;
+
+// No limit for a budget.
+#define ASSET_CACHE_UNLIMITED ((size_t)-1)
+
+/* ========================================================
+ * Cache functions:
+ * ======================================================== */
+
+/*
+ * New empty cache. Unreferenced assets are evicted, least recently released
+ * first, while either total is over its budget; each budget only evicts the
+ * assets using some of it. Null if out of memory.
+ */
+asset_cache_t * asset_cache_create(size_t cpuBudget, size_t gpuBudget);
+
+/*
+ * Unloads every asset and frees the cache. Handles still
+ * out are invalid afterwards (and trip an assert).
+ */
+void asset_cache_destroy(asset_cache_t * cache);
+
+/*
+ * Adds a directory to read the assets from, e.g. the output of the
+ * MTF unpacker. An empty path uses the keys as file paths directly.
+ * The path is appended as requested, so on disk the case must match.
+ */
+bool asset_cache_add_directory(asset_cache_t * cache, const char * path);
+
+/*
+ * Adds an MTF archive to read the assets from. It stays open until
+ * the cache is destroyed. Reads from it are serialized.
+ */
+bool asset_cache_add_archive(asset_cache_t * cache, const char * mtfFilename);
+
+/*
+ * Reads the file data of `path` from the first source that has it.
+ * The caller must free() `*data`. Thread safe.
+ */
+bool asset_cache_read_file(asset_cache_t * cache, const char * path, uint8_t ** data, size_t * size);
+
+/*
+ * Gets a handle to the asset, loading it with `loader` if not in the cache.
+ * Concurrent requests for the same asset share a single load: the others
+ * wait for it. Null if it failed to load. Thread safe. Every handle
+ * must be given back with asset_cache_release().
+ */
+asset_t * asset_cache_acquire(asset_cache_t * cache, const asset_loader_t * loader, const char * path);
+
+/*
+ * Gives back a handle. The asset stays cached until evicted. Thread safe.
+ */
+void asset_cache_release(asset_cache_t * cache, asset_t * asset);
+
+/*
+ * What the loader returned for the asset.
+ */
+void * asset_get_data(const asset_t * asset);
+
+/*
+ * Changes the budgets, evicting right away if needed.
+ */
+void asset_cache_set_budgets(asset_cache_t * cache, size_t cpuBudget, size_t gpuBudget);
+
+/*
+ * Unloads every asset not referenced, regardless of the budgets.
+ */
+void asset_cache_trim(asset_cache_t * cache);
+
+/*
+ * Snapshot of the cache counters.
+ */
+void asset_cache_get_stats(asset_cache_t * cache, asset_cache_stats_t * stats);
+
+/* ========================================================
+ * Built-in loaders:
+ * ======================================================== */
+
+/*
+ * Loads O3D models. The asset data is an o3d_model_t (see o3d.h).
+ */
+extern const asset_loader_t asset_o3d_model_loader;
+
+#endif // DARKSTONE_ASSET_CACHE_H
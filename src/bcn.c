@@ -0,0 +1,457 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: bcn.c
+ * Created on: 17/10/26
+ * Brief: CPU BC1/BC3 (DXT1/DXT5) block compression encoder and decoder for the cooked textures.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "bcn.h"
+#include "parallel.h"
+
+#include <assert.h>
+#include <string.h>
+
+// SSE2 is part of every x86-64 CPU, so unlike the SSSE3 in tga.c it needs no runtime
+// check. Both paths compute exactly the same blocks; the scalar one is for other CPUs.
+#if defined(__SSE2__) || defined(_M_X64)
+	#define BC_USE_SSE2 1
+	#include <emmintrin.h>
+#else
+	#define BC_USE_SSE2 0
+#endif
+
+// Images with fewer blocks than this are encoded on the calling thread,
+// which is also what happens to the small mipmaps.
+enum { BC_MIN_PARALLEL_BLOCKS = 256 };
+
+/* ========================================================
+ * bc_block_size() / bc_image_size() / bc_image_has_alpha():
+ * ======================================================== */
+
+size_t bc_block_size(bc_format_t format) {
+	return (format == BC_FORMAT_BC1) ? 8 : 16;
+}
+
+size_t bc_image_size(bc_format_t format, uint32_t width, uint32_t height) {
+	const size_t blocksX = (width  + BC_BLOCK_DIM - 1) / BC_BLOCK_DIM;
+	const size_t blocksY = (height + BC_BLOCK_DIM - 1) / BC_BLOCK_DIM;
+	return blocksX * blocksY * bc_block_size(format);
+}
+
+bool bc_image_has_alpha(const uint8_t * rgba, uint32_t width, uint32_t height) {
+	assert(rgba != NULL);
+
+	const size_t pixelCount = (size_t)width * height;
+	for (size_t p = 0; p < pixelCount; ++p) {
+		if (rgba[(p * 4) + 3] != 0xFF) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* ========================================================
+ * Block helpers:
+ * ======================================================== */
+
+static uint16_t bc_pack_565(const int * color) {
+	const int r = ((color[0] * 31) + 127) / 255;
+	const int g = ((color[1] * 63) + 127) / 255;
+	const int b = ((color[2] * 31) + 127) / 255;
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// Replicates the high bits into the low ones, like the GPU expands them.
+static void bc_unpack_565(uint16_t packed, int * color) {
+	const int r = (packed >> 11) & 31;
+	const int g = (packed >> 5)  & 63;
+	const int b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+static void bc_put_u16(uint8_t * dest, uint32_t value) {
+	dest[0] = (uint8_t)(value);
+	dest[1] = (uint8_t)(value >> 8);
+}
+
+static uint32_t bc_get_u16(const uint8_t * src) {
+	return (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+}
+
+// Per channel min and max of the 16 pixels, alpha included.
+static void bc_block_bounds(const uint8_t * block, uint8_t * minColor, uint8_t * maxColor) {
+#if BC_USE_SSE2
+	const __m128i p0 = _mm_loadu_si128((const __m128i *)(block));
+	const __m128i p1 = _mm_loadu_si128((const __m128i *)(block + 16));
+	const __m128i p2 = _mm_loadu_si128((const __m128i *)(block + 32));
+	const __m128i p3 = _mm_loadu_si128((const __m128i *)(block + 48));
+
+	__m128i lo = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+	__m128i hi = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+
+	// Down from 4 pixels to 1.
+	lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+	hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(1, 0, 3, 2)));
+	lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+	hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	const int minPixel = _mm_cvtsi128_si32(lo);
+	const int maxPixel = _mm_cvtsi128_si32(hi);
+	memcpy(minColor, &minPixel, 4);
+	memcpy(maxColor, &maxPixel, 4);
+#else // !BC_USE_SSE2
+	memcpy(minColor, block, 4);
+	memcpy(maxColor, block, 4);
+	for (int p = 1; p < 16; ++p) {
+		for (int c = 0; c < 4; ++c) {
+			const uint8_t value = block[(p * 4) + c];
+			minColor[c] = (value < minColor[c]) ? value : minColor[c];
+			maxColor[c] = (value > maxColor[c]) ? value : maxColor[c];
+		}
+	}
+#endif // BC_USE_SSE2
+}
+
+/*
+ * The box diagonal from min to max only fits colors that grow together.
+ * Channels going the opposite way of the widest one get their ends swapped,
+ * so the endpoints follow the colors of the block rather than a corner.
+ */
+static void bc_orient_bounds(const uint8_t * block, int * minColor, int * maxColor) {
+	int widest = 0;
+	for (int c = 1; c < 3; ++c) {
+		if ((maxColor[c] - minColor[c]) > (maxColor[widest] - minColor[widest])) {
+			widest = c;
+		}
+	}
+
+	int covariance[3] = { 0, 0, 0 };
+	for (int p = 0; p < 16; ++p) {
+		const uint8_t * pixel = &block[p * 4];
+		const int dw = (2 * pixel[widest]) - (minColor[widest] + maxColor[widest]);
+		for (int c = 0; c < 3; ++c) {
+			covariance[c] += ((2 * pixel[c]) - (minColor[c] + maxColor[c])) * dw;
+		}
+	}
+
+	for (int c = 0; c < 3; ++c) {
+		if (covariance[c] < 0) {
+			const int temp = minColor[c];
+			minColor[c] = maxColor[c];
+			maxColor[c] = temp;
+		}
+	}
+}
+
+/*
+ * Projects every pixel onto the line from color1 to color0 and rounds
+ * to the nearest of the 4 palette steps, which are stored out of order:
+ * 0 = color0, 1 = color1, 2 = 2/3 of the way to color0, 3 = 1/3.
+ */
+static uint32_t bc_color_indexes(const uint8_t * block, const int * color0, const int * color1) {
+	static const uint32_t stepToIndex[4] = { 1, 3, 2, 0 };
+
+	const int dir[3] = { color0[0] - color1[0], color0[1] - color1[1], color0[2] - color1[2] };
+	const int lengthSqr = (dir[0] * dir[0]) + (dir[1] * dir[1]) + (dir[2] * dir[2]);
+	const int bias = (color1[0] * dir[0]) + (color1[1] * dir[1]) + (color1[2] * dir[2]);
+	const float scale = 3.0f / (float)lengthSqr;
+
+	uint32_t indexes = 0;
+
+#if BC_USE_SSE2
+	const __m128i zero     = _mm_setzero_si128();
+	const __m128i three    = _mm_set1_epi16(3);
+	const __m128i dirVec   = _mm_setr_epi16((short)dir[0], (short)dir[1], (short)dir[2], 0,
+	                                        (short)dir[0], (short)dir[1], (short)dir[2], 0);
+	const __m128i biasVec  = _mm_set1_epi32(bias);
+	const __m128  scaleVec = _mm_set1_ps(scale);
+	const __m128  half     = _mm_set1_ps(0.5f);
+
+	for (int i = 0; i < 4; ++i) {
+		const __m128i pixels = _mm_loadu_si128((const __m128i *)(block + (i * 16)));
+
+		// r*dr + g*dg and b*db + a*0 for each pixel, then summed.
+		const __m128i dotLo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), dirVec);
+		const __m128i dotHi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), dirVec);
+		const __m128  evens = _mm_shuffle_ps(_mm_castsi128_ps(dotLo), _mm_castsi128_ps(dotHi), _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128  odds  = _mm_shuffle_ps(_mm_castsi128_ps(dotLo), _mm_castsi128_ps(dotHi), _MM_SHUFFLE(3, 1, 3, 1));
+		const __m128i dots  = _mm_sub_epi32(_mm_add_epi32(_mm_castps_si128(evens), _mm_castps_si128(odds)), biasVec);
+
+		const __m128i steps = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(dots), scaleVec), half));
+		const __m128i clamped = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(steps, steps), zero), three);
+
+		int16_t results[8];
+		_mm_storeu_si128((__m128i *)results, clamped);
+		for (int k = 0; k < 4; ++k) {
+			indexes |= stepToIndex[results[k]] << (((i * 4) + k) * 2);
+		}
+	}
+#else // !BC_USE_SSE2
+	for (int p = 0; p < 16; ++p) {
+		const uint8_t * pixel = &block[p * 4];
+		const int dot = (pixel[0] * dir[0]) + (pixel[1] * dir[1]) + (pixel[2] * dir[2]) - bias;
+		int step = (int)(((float)dot * scale) + 0.5f);
+		step = (step < 0) ? 0 : ((step > 3) ? 3 : step);
+		indexes |= stepToIndex[step] << (p * 2);
+	}
+#endif // BC_USE_SSE2
+
+	return indexes;
+}
+
+// BC1 block, or the color half of a BC3 one. Always in 4 color (opaque) mode.
+static void bc_encode_color(const uint8_t * block, const uint8_t * minBounds, const uint8_t * maxBounds, uint8_t * dest) {
+	int minColor[3] = { minBounds[0], minBounds[1], minBounds[2] };
+	int maxColor[3] = { maxBounds[0], maxBounds[1], maxBounds[2] };
+	bc_orient_bounds(block, minColor, maxColor);
+
+	// Insetting the ends by 1/16 of the range lowers the error of the
+	// colors in between, which are the majority, for a bit at the extremes.
+	for (int c = 0; c < 3; ++c) {
+		const int inset = (maxColor[c] - minColor[c]) / 16;
+		minColor[c] += inset;
+		maxColor[c] -= inset;
+	}
+
+	uint16_t packed0 = bc_pack_565(maxColor);
+	uint16_t packed1 = bc_pack_565(minColor);
+
+	// color0 > color1 selects the 4 color mode.
+	if (packed0 < packed1) {
+		const uint16_t temp = packed0;
+		packed0 = packed1;
+		packed1 = temp;
+	}
+
+	uint32_t indexes = 0;
+	if (packed0 != packed1) {
+		int color0[3], color1[3];
+		bc_unpack_565(packed0, color0);
+		bc_unpack_565(packed1, color1);
+		indexes = bc_color_indexes(block, color0, color1);
+	}
+
+	bc_put_u16(dest + 0, packed0);
+	bc_put_u16(dest + 2, packed1);
+	bc_put_u16(dest + 4, indexes & 0xFFFF);
+	bc_put_u16(dest + 6, indexes >> 16);
+}
+
+/*
+ * Alpha half of a BC3 block: alpha0 > alpha1 selects 8 evenly spaced steps
+ * between them, stored out of order like the colors: 0 = alpha0, 1 = alpha1,
+ * then 2..7 going from alpha0 towards alpha1. The min and max are exact,
+ * so fully opaque and fully transparent texels stay so.
+ */
+static void bc_encode_alpha(const uint8_t * block, int minAlpha, int maxAlpha, uint8_t * dest) {
+	const int range = maxAlpha - minAlpha;
+	uint64_t indexes = 0;
+
+	if (range > 0) {
+		for (int p = 0; p < 16; ++p) {
+			const int step  = (((block[(p * 4) + 3] - minAlpha) * 14) + range) / (2 * range);
+			const int index = (step == 7) ? 0 : ((step == 0) ? 1 : (8 - step));
+			indexes |= (uint64_t)index << (p * 3);
+		}
+	}
+
+	dest[0] = (uint8_t)maxAlpha;
+	dest[1] = (uint8_t)minAlpha;
+	for (int i = 0; i < 6; ++i) {
+		dest[2 + i] = (uint8_t)(indexes >> (i * 8));
+	}
+}
+
+/* ========================================================
+ * bc1_encode_block() / bc3_encode_block():
+ * ======================================================== */
+
+void bc1_encode_block(const uint8_t * block, uint8_t * dest) {
+	assert(block != NULL && dest != NULL);
+
+	uint8_t minBounds[4], maxBounds[4];
+	bc_block_bounds(block, minBounds, maxBounds);
+	bc_encode_color(block, minBounds, maxBounds, dest);
+}
+
+void bc3_encode_block(const uint8_t * block, uint8_t * dest) {
+	assert(block != NULL && dest != NULL);
+
+	uint8_t minBounds[4], maxBounds[4];
+	bc_block_bounds(block, minBounds, maxBounds);
+	bc_encode_alpha(block, minBounds[3], maxBounds[3], dest);
+	bc_encode_color(block, minBounds, maxBounds, dest + 8);
+}
+
+/* ========================================================
+ * bc1_decode_block() / bc3_decode_block():
+ * ======================================================== */
+
+// BC1 blocks with color0 <= color1 are in 3 color + transparent black mode.
+// BC3 color blocks are always in 4 color mode, whatever the order.
+static void bc_decode_color(const uint8_t * src, uint8_t * block, bool allowTransparent) {
+	const uint32_t packed0 = bc_get_u16(src + 0);
+	const uint32_t packed1 = bc_get_u16(src + 2);
+	const uint32_t indexes = bc_get_u16(src + 4) | (bc_get_u16(src + 6) << 16);
+
+	int palette[4][4];
+	bc_unpack_565((uint16_t)packed0, palette[0]);
+	bc_unpack_565((uint16_t)packed1, palette[1]);
+	palette[0][3] = 255;
+	palette[1][3] = 255;
+
+	for (int c = 0; c < 3; ++c) {
+		if (packed0 > packed1 || !allowTransparent) {
+			palette[2][c] = ((2 * palette[0][c]) + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + (2 * palette[1][c])) / 3;
+		} else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = (packed0 > packed1 || !allowTransparent) ? 255 : 0;
+
+	for (int p = 0; p < 16; ++p) {
+		const int * color = palette[(indexes >> (p * 2)) & 3];
+		for (int c = 0; c < 4; ++c) {
+			block[(p * 4) + c] = (uint8_t)color[c];
+		}
+	}
+}
+
+void bc1_decode_block(const uint8_t * src, uint8_t * block) {
+	assert(src != NULL && block != NULL);
+	bc_decode_color(src, block, /* allowTransparent = */ true);
+}
+
+void bc3_decode_block(const uint8_t * src, uint8_t * block) {
+	assert(src != NULL && block != NULL);
+	bc_decode_color(src + 8, block, /* allowTransparent = */ false);
+
+	const int alpha0 = src[0];
+	const int alpha1 = src[1];
+
+	// alpha0 <= alpha1 has 6 steps between them plus 0 and 255.
+	int palette[8] = { alpha0, alpha1, 0, 0, 0, 0, 0, 255 };
+	if (alpha0 > alpha1) {
+		for (int i = 2; i < 8; ++i) {
+			palette[i] = (((8 - i) * alpha0) + ((i - 1) * alpha1)) / 7;
+		}
+	} else {
+		for (int i = 2; i < 6; ++i) {
+			palette[i] = (((6 - i) * alpha0) + ((i - 1) * alpha1)) / 5;
+		}
+	}
+
+	uint64_t indexes = 0;
+	for (int i = 0; i < 6; ++i) {
+		indexes |= (uint64_t)src[2 + i] << (i * 8);
+	}
+	for (int p = 0; p < 16; ++p) {
+		block[(p * 4) + 3] = (uint8_t)palette[(indexes >> (p * 3)) & 7];
+	}
+}
+
+/* ========================================================
+ * bc_encode_image() / bc_decode_image():
+ * ======================================================== */
+
+typedef struct bc_encode_job {
+	bc_format_t     format;
+	const uint8_t * rgba;
+	uint32_t        width;
+	uint32_t        height;
+	uint32_t        blocksX;
+	uint8_t       * dest;
+} bc_encode_job_t;
+
+// Copies the block at (x0, y0) out of the image, repeating the edges for partial blocks.
+static void bc_gather_block(const uint8_t * rgba, uint32_t width, uint32_t height,
+                            uint32_t x0, uint32_t y0, uint8_t * block) {
+	for (uint32_t y = 0; y < BC_BLOCK_DIM; ++y) {
+		const uint32_t srcY = ((y0 + y) < height) ? (y0 + y) : (height - 1);
+		const uint8_t * row = rgba + ((size_t)srcY * width * 4);
+
+		if ((x0 + BC_BLOCK_DIM) <= width) {
+			memcpy(&block[y * 16], &row[x0 * 4], 16);
+		} else {
+			for (uint32_t x = 0; x < BC_BLOCK_DIM; ++x) {
+				const uint32_t srcX = ((x0 + x) < width) ? (x0 + x) : (width - 1);
+				memcpy(&block[(y * 16) + (x * 4)], &row[srcX * 4], 4);
+			}
+		}
+	}
+}
+
+// One row of blocks per job.
+static void bc_encode_row_job(void * userData, uint32_t blockRow) {
+	const bc_encode_job_t * job = userData;
+	const size_t blockSize = bc_block_size(job->format);
+	uint8_t * dest = job->dest + ((size_t)blockRow * job->blocksX * blockSize);
+
+	uint8_t block[64];
+	for (uint32_t bx = 0; bx < job->blocksX; ++bx, dest += blockSize) {
+		bc_gather_block(job->rgba, job->width, job->height, bx * BC_BLOCK_DIM, blockRow * BC_BLOCK_DIM, block);
+		if (job->format == BC_FORMAT_BC1) {
+			bc1_encode_block(block, dest);
+		} else {
+			bc3_encode_block(block, dest);
+		}
+	}
+}
+
+void bc_encode_image(bc_format_t format, const uint8_t * rgba, uint32_t width, uint32_t height,
+                     uint8_t * dest, uint32_t threadCount) {
+	assert(rgba != NULL && dest != NULL);
+	assert(width != 0 && height != 0);
+
+	bc_encode_job_t job;
+	job.format  = format;
+	job.rgba    = rgba;
+	job.width   = width;
+	job.height  = height;
+	job.blocksX = (width + BC_BLOCK_DIM - 1) / BC_BLOCK_DIM;
+	job.dest    = dest;
+
+	const uint32_t blocksY = (height + BC_BLOCK_DIM - 1) / BC_BLOCK_DIM;
+	if ((job.blocksX * blocksY) < BC_MIN_PARALLEL_BLOCKS) {
+		threadCount = 1;
+	}
+
+	// The rows still get encoded if the threads fail to start, just serially.
+	parallel_for(blocksY, threadCount, &bc_encode_row_job, &job);
+}
+
+void bc_decode_image(bc_format_t format, const uint8_t * src, uint32_t width, uint32_t height, uint8_t * rgba) {
+	assert(src != NULL && rgba != NULL);
+
+	const size_t blockSize = bc_block_size(format);
+	uint8_t block[64];
+
+	for (uint32_t y0 = 0; y0 < height; y0 += BC_BLOCK_DIM) {
+		for (uint32_t x0 = 0; x0 < width; x0 += BC_BLOCK_DIM, src += blockSize) {
+			if (format == BC_FORMAT_BC1) {
+				bc1_decode_block(src, block);
+			} else {
+				bc3_decode_block(src, block);
+			}
+
+			// Partial blocks only write the pixels inside the image.
+			const uint32_t rowBytes = (((x0 + BC_BLOCK_DIM) <= width) ? BC_BLOCK_DIM : (width - x0)) * 4;
+			for (uint32_t y = 0; y < BC_BLOCK_DIM && (y0 + y) < height; ++y) {
+				memcpy(rgba + ((((size_t)(y0 + y) * width) + x0) * 4), &block[y * 16], rowBytes);
+			}
+		}
+	}
+}
@@ -0,0 +1,95 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: bcn.h
+ * Created on: 17/10/26
+ * Brief: CPU BC1/BC3 (DXT1/DXT5) block compression encoder and decoder for the cooked textures.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_BCN_H
+#define DARKSTONE_BCN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Images are split in 4x4 pixel blocks, each compressed on its own:
+ *
+ *  BC1: two RGB565 endpoints plus a 2-bit index per pixel selecting
+ *       one of 4 colors along the line between them. 8 bytes per block,
+ *       1/8 of RGBA8. Used for the opaque textures.
+ *  BC3: a BC1 color block plus two 8-bit alpha endpoints and a 3-bit
+ *       index per pixel into 8 alphas. 16 bytes per block, 1/4 of RGBA8.
+ *       Used for the textures with any translucency.
+ *
+ * The encoder favors speed over the last bits of quality: endpoints come
+ * from the (inset) bounding box of the block colors, oriented along their
+ * main diagonal, and the pixels are projected onto that line to pick the
+ * indexes. The per-block work uses SSE2 where available and the blocks
+ * are spread over the CPUs. Decoding is only needed without a GPU (and
+ * for measuring the error), since the GL samples the blocks as they are.
+ */
+
+/* ========================================================
+ * Block formats:
+ * ======================================================== */
+
+typedef enum bc_format {
+	BC_FORMAT_BC1 = 1, // RGB, opaque.
+	BC_FORMAT_BC3 = 3  // RGBA, interpolated alpha.
+} bc_format_t;
+
+enum { BC_BLOCK_DIM = 4 }; // Blocks are 4x4 pixels.
+
+/* ========================================================
+ * Block compression functions:
+ * ======================================================== */
+
+/*
+ * Bytes per 4x4 block: 8 for BC1, 16 for BC3.
+ */
+size_t bc_block_size(bc_format_t format);
+
+/*
+ * Compressed size of a width * height image. Partial blocks at the
+ * right and bottom edges take a whole block, like in the GL.
+ */
+size_t bc_image_size(bc_format_t format, uint32_t width, uint32_t height);
+
+/*
+ * True if any of the RGBA pixels is not fully opaque, i.e. the image needs BC3.
+ */
+bool bc_image_has_alpha(const uint8_t * rgba, uint32_t width, uint32_t height);
+
+/*
+ * Single block encoding/decoding. `block` is the 16 RGBA pixels of
+ * the block, row by row (64 bytes). BC1 ignores the alpha.
+ */
+void bc1_encode_block(const uint8_t * block, uint8_t * dest);
+void bc3_encode_block(const uint8_t * block, uint8_t * dest);
+void bc1_decode_block(const uint8_t * src, uint8_t * block);
+void bc3_decode_block(const uint8_t * src, uint8_t * block);
+
+/*
+ * Compresses RGBA pixels (top row first) into `dest`, which must have
+ * bc_image_size() bytes. Blocks are output in rows, left to right, top
+ * to bottom, as glCompressedTexImage2D() takes them. Edge blocks repeat
+ * the last row/column. `threadCount` of 0 uses all the CPUs.
+ */
+void bc_encode_image(bc_format_t format, const uint8_t * rgba, uint32_t width, uint32_t height,
+                     uint8_t * dest, uint32_t threadCount);
+
+/*
+ * Decompresses a whole image back to width * height RGBA pixels.
+ */
+void bc_decode_image(bc_format_t format, const uint8_t * src, uint32_t width, uint32_t height, uint8_t * rgba);
+
+#endif // DARKSTONE_BCN_H
@@ -0,0 +1,30 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: draw_vertex.h
+ * Created on: 17/10/26
+ * Brief: Vertex format drawn by the viewer, shared by the OpenGL and software renderers.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_DRAW_VERTEX_H
+#define DARKSTONE_DRAW_VERTEX_H
+
+/*
+ * Kept free of any GL includes, so the software
+ * rasterizer (sw_raster.h) builds without them.
+ */
+typedef struct gl_draw_vertex {
+	float px, py, pz;  // Position
+	float nx, ny, nz;  // Normal vector
+	float r,  g,  b;   // Vertex RGB color
+	float u,  v;       // Texture coordinates
+} gl_draw_vertex_t;
+
+#endif // DARKSTONE_DRAW_VERTEX_H
@@ -0,0 +1,333 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: file_utils.c
+ * Created on: 17/10/26
+ * Brief: Small file system helpers shared by the command-line tools.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "file_utils.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// NOTE: Same as in mtf.c, these are the POSIX APIs.
+// Windows has its own directory iteration functions,
+// so this will need a fix when porting to Win/VS.
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define FILE_MAP_USE_MMAP 1
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif // __unix__ || __APPLE__
+
+enum { FILE_LIST_MAX_PATH_LEN = 1024 };
+
+/* ========================================================
+ * file_has_extension():
+ * ======================================================== */
+
+bool file_has_extension(const char * path, const char * extension) {
+	assert(path != NULL);
+	assert(extension != NULL);
+
+	const size_t pathLen = strlen(path);
+	const size_t extLen  = strlen(extension);
+	if (extLen > pathLen) {
+		return false;
+	}
+
+	const char * p = path + (pathLen - extLen);
+	for (size_t i = 0; i < extLen; ++i) {
+		if (tolower((unsigned char)p[i]) != tolower((unsigned char)extension[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* ========================================================
+ * file_list_push():
+ * ======================================================== */
+
+static bool file_list_push(file_list_t * list, const char * path) {
+	if (list->count == list->capacity) {
+		const uint32_t newCapacity = (list->capacity != 0) ? (list->capacity * 2) : 256;
+		char ** newPaths = realloc(list->paths, newCapacity * sizeof(list->paths[0]));
+		if (newPaths == NULL) {
+			return false;
+		}
+		list->paths    = newPaths;
+		list->capacity = newCapacity;
+	}
+
+	const size_t len = strlen(path);
+	char * copy = malloc(len + 1);
+	if (copy == NULL) {
+		return false;
+	}
+
+	memcpy(copy, path, len + 1);
+	list->paths[list->count++] = copy;
+	return true;
+}
+
+/* ========================================================
+ * file_list_scan_dir():
+ * ======================================================== */
+
+static bool file_list_scan_dir(file_list_t * list, const char * dirPath, const char * extension) {
+	DIR * dir = opendir(dirPath);
+	if (dir == NULL) {
+		return false;
+	}
+
+	char fullPath[FILE_LIST_MAX_PATH_LEN];
+	struct dirent * dirEntry;
+	bool success = true;
+
+	while ((dirEntry = readdir(dir)) != NULL) {
+		if (strcmp(dirEntry->d_name, ".") == 0 || strcmp(dirEntry->d_name, "..") == 0) {
+			continue;
+		}
+
+		snprintf(fullPath, sizeof(fullPath), "%s/%s", dirPath, dirEntry->d_name);
+
+		struct stat fileStat;
+		if (stat(fullPath, &fileStat) != 0) {
+			continue;
+		}
+
+		if (S_ISDIR(fileStat.st_mode)) {
+			success = file_list_scan_dir(list, fullPath, extension) && success;
+		} else if (extension == NULL || file_has_extension(fullPath, extension)) {
+			success = file_list_push(list, fullPath) && success;
+		}
+	}
+
+	closedir(dir);
+	return success;
+}
+
+/* ========================================================
+ * file_list_add_path():
+ * ======================================================== */
+
+bool file_list_add_path(file_list_t * list, const char * path, const char * extension) {
+	assert(list != NULL);
+	assert(path != NULL && *path != '\0');
+
+	struct stat fileStat;
+	if (stat(path, &fileStat) != 0) {
+		return false;
+	}
+
+	if (S_ISDIR(fileStat.st_mode)) {
+		return file_list_scan_dir(list, path, extension);
+	}
+	return file_list_push(list, path);
+}
+
+/* ========================================================
+ * file_is_directory():
+ * ======================================================== */
+
+bool file_is_directory(const char * path) {
+	assert(path != NULL);
+
+	struct stat fileStat;
+	if (stat(path, &fileStat) != 0) {
+		return false;
+	}
+	return S_ISDIR(fileStat.st_mode);
+}
+
+/* ========================================================
+ * file_get_info():
+ * ======================================================== */
+
+bool file_get_info(const char * path, uint64_t * size, int64_t * modTime) {
+	assert(path != NULL);
+	assert(size != NULL && modTime != NULL);
+
+	struct stat fileStat;
+	if (stat(path, &fileStat) != 0 || S_ISDIR(fileStat.st_mode)) {
+		return false;
+	}
+
+	*size    = (uint64_t)fileStat.st_size;
+	*modTime = (int64_t)fileStat.st_mtime;
+	return true;
+}
+
+/* ========================================================
+ * file_make_path():
+ * ======================================================== */
+
+bool file_make_path(const char * filename) {
+	assert(filename != NULL);
+
+	char dirPath[FILE_LIST_MAX_PATH_LEN];
+	const size_t len = strlen(filename);
+	if (len == 0 || len >= sizeof(dirPath)) {
+		return (len == 0);
+	}
+	memcpy(dirPath, filename, len + 1);
+
+	// Cut at each separator in turn. The leading one of an absolute path is skipped.
+	for (char * p = dirPath + 1; *p != '\0'; ++p) {
+		if (*p != '/') {
+			continue;
+		}
+
+		*p = '\0';
+		if (!file_is_directory(dirPath) && mkdir(dirPath, 0777) != 0 && !file_is_directory(dirPath)) {
+			return false;
+		}
+		*p = '/';
+	}
+	return true;
+}
+
+/* ========================================================
+ * file_list_sort():
+ * ======================================================== */
+
+static int file_list_sort_pred(const void * a, const void * b) {
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+void file_list_sort(file_list_t * list) {
+	assert(list != NULL);
+	if (list->count > 1) {
+		qsort(list->paths, list->count, sizeof(list->paths[0]), &file_list_sort_pred);
+	}
+}
+
+/* ========================================================
+ * file_list_free():
+ * ======================================================== */
+
+void file_list_free(file_list_t * list) {
+	if (list == NULL) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < list->count; ++i) {
+		free(list->paths[i]);
+	}
+
+	free(list->paths);
+	list->paths    = NULL;
+	list->count    = 0;
+	list->capacity = 0;
+}
+
+/* ========================================================
+ * file_map_open() / file_map_close():
+ * ======================================================== */
+
+bool file_map_open(file_map_t * map, const char * filename) {
+	assert(map != NULL);
+	assert(filename != NULL && *filename != '\0');
+
+	map->data     = NULL;
+	map->size     = 0;
+	map->isMapped = false;
+
+#if FILE_MAP_USE_MMAP
+	const int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+
+	void * mapping = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping keeps its own reference to the file.
+
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+
+	map->data     = mapping;
+	map->size     = (uint64_t)fileStat.st_size;
+	map->isMapped = true;
+	return true;
+#else // !FILE_MAP_USE_MMAP
+	FILE * fileIn = fopen(filename, "rb");
+	if (fileIn == NULL) {
+		return false;
+	}
+
+	fseek(fileIn, 0, SEEK_END);
+	const long fileLength = ftell(fileIn);
+	fseek(fileIn, 0, SEEK_SET);
+
+	if (fileLength <= 0) {
+		fclose(fileIn);
+		return false;
+	}
+
+	uint8_t * buffer = malloc(fileLength);
+	if (buffer == NULL || fread(buffer, 1, fileLength, fileIn) != (size_t)fileLength) {
+		free(buffer);
+		fclose(fileIn);
+		return false;
+	}
+
+	fclose(fileIn);
+	map->data = buffer;
+	map->size = (uint64_t)fileLength;
+	return true;
+#endif // FILE_MAP_USE_MMAP
+}
+
+void file_map_close(file_map_t * map) {
+	if (map == NULL || map->data == NULL) {
+		return;
+	}
+
+#if FILE_MAP_USE_MMAP
+	if (map->isMapped) {
+		munmap((void *)map->data, (size_t)map->size);
+	} else {
+		free((void *)map->data);
+	}
+#else // !FILE_MAP_USE_MMAP
+	free((void *)map->data);
+#endif // FILE_MAP_USE_MMAP
+
+	map->data     = NULL;
+	map->size     = 0;
+	map->isMapped = false;
+}
+
+/* ========================================================
+ * clock_seconds():
+ * ======================================================== */
+
+double clock_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
@@ -0,0 +1,111 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: file_utils.h
+ * Created on: 17/10/26
+ * Brief: Small file system helpers shared by the command-line tools.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_FILE_UTILS_H
+#define DARKSTONE_FILE_UTILS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ========================================================
+ * File lists:
+ * ======================================================== */
+
+/*
+ * Flat list of file paths gathered by file_list_add_path().
+ * All the strings are allocated in the heap.
+ */
+typedef struct file_list {
+	char  ** paths;
+	uint32_t count;
+	uint32_t capacity;
+} file_list_t;
+
+/*
+ * Adds `path` to the list. If it is a directory, it is scanned
+ * recursively and every file ending in `extension` (case insensitive,
+ * including the dot, e.g.: ".O3D") is added. Plain files are always
+ * added, regardless of the extension. `extension` may be null to
+ * accept any file found in the directories.
+ */
+bool file_list_add_path(file_list_t * list, const char * path, const char * extension);
+
+/*
+ * Sorts the paths alphabetically. Useful to get a stable processing order.
+ */
+void file_list_sort(file_list_t * list);
+
+/*
+ * Frees all the strings and the list itself.
+ */
+void file_list_free(file_list_t * list);
+
+/*
+ * Case-insensitive test if `path` ends with `extension`.
+ */
+bool file_has_extension(const char * path, const char * extension);
+
+/*
+ * True if `path` exists and is a directory.
+ */
+bool file_is_directory(const char * path);
+
+/*
+ * Size in bytes and last modification time (seconds since the epoch) of a file.
+ */
+bool file_get_info(const char * path, uint64_t * size, int64_t * modTime);
+
+/*
+ * Creates every missing directory leading to `filename` (the last path
+ * component is taken as a file and not created). Existing ones are fine.
+ */
+bool file_make_path(const char * filename);
+
+/* ========================================================
+ * Read-only file mappings:
+ * ======================================================== */
+
+/*
+ * Whole file mapped into memory for reading. Uses mmap() where
+ * available, otherwise falls back to reading the file into a
+ * heap buffer, so the data pointer is always valid either way.
+ */
+typedef struct file_map {
+	const uint8_t * data;
+	uint64_t        size;
+	bool            isMapped; // false if `data` came from malloc().
+} file_map_t;
+
+/*
+ * Maps the whole file. Empty files fail. Safe to call
+ * file_map_close() on the output even if this fails.
+ */
+bool file_map_open(file_map_t * map, const char * filename);
+
+/*
+ * Unmaps/frees the data and clears the struct.
+ */
+void file_map_close(file_map_t * map);
+
+/* ========================================================
+ * Timing:
+ * ======================================================== */
+
+/*
+ * Monotonic clock reading in seconds. Only meaningful as a difference.
+ */
+double clock_seconds(void);
+
+#endif // DARKSTONE_FILE_UTILS_H
@@ -15,6 +15,18 @@
  * ================================================================================================ */
 
 #include "gl_utils.h"
+#include "file_utils.h"
+#include "o3d.h"
+#include "o3d_texcache.h"
+#include "tga.h"
+
+// From EXT_texture_compression_s3tc, which the core profile headers don't have.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+	#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+	#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
 
 /* ========================================================
  * Local application context data:
@@ -26,6 +38,7 @@ static char g_glslVersionDirective[64];
 static GLFWwindow * g_window = NULL;
 static GLFWcursor * g_cursor = NULL;
 static app_callback_f g_userCleanup = NULL;
+static int g_exitCode = EXIT_SUCCESS; // EXIT_FAILURE after a fatal_error().
 
 /* ========================================================
  * GL error checking / error handling:
@@ -62,6 +75,7 @@ void fatal_error(const char * message, ...) {
 	va_end(args);
 	fprintf(stderr, "\n");
 
+	g_exitCode = EXIT_FAILURE;
 	quit_glfw_app();
 }
 
@@ -211,6 +225,14 @@ gl_program_t load_gl_program(const char * vsFile, const char * fsFile) {
 	prog.progHandle       = glProgHandle;
 	prog.u_mvpMatrix      = glGetUniformLocation(glProgHandle, "u_mvp_matrix");
 	prog.u_renderModeFlag = glGetUniformLocation(glProgHandle, "u_render_mode_flag");
+	prog.u_texLayer       = glGetUniformLocation(glProgHandle, "u_tex_layer");
+
+	// Fixed texture units for the samplers, so 2D textures and arrays can be bound together.
+	glUseProgram(glProgHandle);
+	glUniform1i(glGetUniformLocation(glProgHandle, "u_color_texture"), 0);
+	glUniform1i(glGetUniformLocation(glProgHandle, "u_color_texture_array"), 1);
+	glUniform1i(prog.u_texLayer, -1);
+	glUseProgram(0);
 
 	CHECK_GL_ERRORS();
 	return prog;
@@ -329,37 +351,17 @@ void free_gl_vbo(gl_vbo_t * vbo) {
 }
 
 /* ========================================================
- * GL texture loading from image file via STB Image:
+ * GL texture loading from image file (see image.h):
  * ======================================================== */
 
-#define STB_IMAGE_IMPLEMENTATION 1
-#define STB_IMAGE_STATIC         1
-#define STBI_NO_GIF              1
-#define STBI_NO_HDR              1
-#define STBI_NO_PIC              1
-#define STBI_NO_PNM              1
-#define STBI_NO_PSD              1
-#define STBI_NO_LINEAR           1
-#include <stb_image.h>
-
-gl_texture_t load_gl_texture_from_file(const char * filename) {
-	assert(filename  != NULL);
-	assert(*filename != '\0');
-
+// `pixels` is an offset into the bound GL_PIXEL_UNPACK_BUFFER, if any.
+static gl_texture_t create_gl_texture(const void * pixels, uint32_t width, uint32_t height) {
 	gl_texture_t tex = { 0, 0, 0 };
-	int width, height, comps;
-
-	stbi_uc * data = stbi_load(filename, &width, &height, &comps, /* require RGBA */ 4);
-	if (data == NULL) {
-		printf("WARNING: Unable to load texture image \"%s\"!\n", filename);
-		return tex;
-	}
 
 	GLuint glTexHandle = 0;
 	glGenTextures(1, &glTexHandle);
 
 	if (glTexHandle == 0) {
-		stbi_image_free(data);
 		fatal_error("Failed to allocate a new GL texture handle! Possibly out-of-memory!");
 	}
 
@@ -370,12 +372,12 @@ gl_texture_t load_gl_texture_from_file(const char * filename) {
 		/* target   = */ GL_TEXTURE_2D,
 		/* level    = */ 0,
 		/* internal = */ GL_RGBA,
-		/* width    = */ width,
-		/* height   = */ height,
+		/* width    = */ (GLsizei)width,
+		/* height   = */ (GLsizei)height,
 		/* border   = */ 0,
 		/* format   = */ GL_RGBA,
 		/* type     = */ GL_UNSIGNED_BYTE,
-		/* data     = */ data);
+		/* data     = */ pixels);
 
 	if (glGenerateMipmap != NULL) {
 		glGenerateMipmap(GL_TEXTURE_2D);
@@ -388,14 +390,187 @@ gl_texture_t load_gl_texture_from_file(const char * filename) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-	stbi_image_free(data);
-	CHECK_GL_ERRORS();
-
-	printf("Loaded new texture from file \"%s\".\n", filename);
-
 	tex.texHandle = glTexHandle;
 	tex.width     = width;
 	tex.height    = height;
+
+	CHECK_GL_ERRORS();
+	return tex;
+}
+
+static gl_texture_t upload_gl_texture(image_t * image) {
+	const gl_texture_t tex = create_gl_texture(image->pixels, image->width, image->height);
+	image_free(image);
+	return tex;
+}
+
+/*
+ * TGAs are decoded straight into a mapped pixel unpack buffer, which the
+ * texture is then created from, saving the copy through an image_t and
+ * letting the driver do the transfer. Fails if the buffer can't be mapped
+ * or the data is bad, leaving the generic path to try or report it.
+ */
+static bool upload_gl_texture_tga(gl_texture_t * tex, const tga_info_t * tga, const void * fileData, size_t fileSize) {
+	const GLsizeiptr pixelsSize = (GLsizeiptr)tga->width * tga->height * 4;
+
+	GLuint pboHandle = 0;
+	glGenBuffers(1, &pboHandle);
+	if (pboHandle == 0) {
+		return false;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pboHandle);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, pixelsSize, NULL, GL_STREAM_DRAW);
+
+	bool success = false;
+	uint8_t * pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, pixelsSize,
+	                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (pixels != NULL) {
+		const bool decoded = tga_decode(tga, fileData, fileSize, pixels, (size_t)tga->width * 4);
+
+		// Unmapping fails if the buffer contents were lost meanwhile (e.g. a display mode change).
+		if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE && decoded) {
+			*tex = create_gl_texture(/* buffer offset = */ NULL, tga->width, tga->height);
+			success = true;
+		}
+	}
+
+	// The texture upload keeps the buffer alive until done with it.
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glDeleteBuffers(1, &pboHandle);
+	return success;
+}
+
+/*
+ * S3TC is an extension, but every desktop GL 3 driver has it. Only the
+ * core profile way of listing extensions works here (GL_NUM_EXTENSIONS).
+ */
+static bool gl_supports_s3tc(void) {
+	static int supported = -1;
+
+	if (supported < 0) {
+		supported = 0;
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; ++i) {
+			const char * name = (const char *)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (name != NULL && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+				supported = 1;
+				break;
+			}
+		}
+		printf("S3TC texture compression %s.\n", supported ? "available" : "not available");
+	}
+	return supported != 0;
+}
+
+bool load_gl_texture_cooked(gl_texture_t * tex, const char * sourceFilename, size_t * gpuBytes) {
+	assert(tex != NULL);
+	assert(sourceFilename != NULL);
+
+	o3d_texcache_image_t image;
+	if (!o3d_texcache_open(&image, sourceFilename)) {
+		o3d_texcache_close(&image);
+		return false;
+	}
+
+	const bool compressed = (image.format != O3D_TEXCACHE_FORMAT_RGBA8);
+	if (compressed && !gl_supports_s3tc()) {
+		o3d_texcache_close(&image);
+		return false;
+	}
+
+	GLuint glTexHandle = 0;
+	glGenTextures(1, &glTexHandle);
+
+	if (glTexHandle == 0) {
+		fatal_error("Failed to allocate a new GL texture handle! Possibly out-of-memory!");
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, glTexHandle);
+
+	// The levels go up as they are in the file; the mipmaps are precomputed.
+	const GLenum internalFormat = (image.format == BC_FORMAT_BC1) ?
+	                              GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+	size_t totalSize = 0;
+	for (uint32_t m = 0; m < image.mipCount; ++m) {
+		const GLsizei w = (GLsizei)(((image.width  >> m) != 0) ? (image.width  >> m) : 1);
+		const GLsizei h = (GLsizei)(((image.height >> m) != 0) ? (image.height >> m) : 1);
+		if (compressed) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)m, internalFormat, w, h, 0, (GLsizei)image.mipSizes[m], image.mips[m]);
+		} else {
+			glTexImage2D(GL_TEXTURE_2D, (GLint)m, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.mips[m]);
+		}
+		totalSize += image.mipSizes[m];
+	}
+
+	// Same sampling as create_gl_texture().
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.mipCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	tex->texHandle = glTexHandle;
+	tex->width     = image.width;
+	tex->height    = image.height;
+
+	if (gpuBytes != NULL) {
+		*gpuBytes = totalSize;
+	}
+
+	printf("Loaded cooked %s texture for \"%s\".\n", compressed ? "BC" : "RGBA8", sourceFilename);
+	o3d_texcache_close(&image);
+
+	CHECK_GL_ERRORS();
+	return true;
+}
+
+gl_texture_t load_gl_texture_from_file(const char * filename) {
+	assert(filename  != NULL);
+	assert(*filename != '\0');
+
+	gl_texture_t tex = { 0, 0, 0 };
+	if (load_gl_texture_cooked(&tex, filename, NULL)) {
+		return tex;
+	}
+
+	file_map_t map;
+
+	if (!file_map_open(&map, filename)) {
+		file_map_close(&map);
+		printf("WARNING: Unable to open texture image \"%s\"!\n", filename);
+		return tex;
+	}
+
+	tex = load_gl_texture_from_memory(map.data, (size_t)map.size, filename);
+	file_map_close(&map);
+	return tex;
+}
+
+gl_texture_t load_gl_texture_from_memory(const void * fileData, size_t fileSize, const char * name) {
+	assert(fileData != NULL);
+	assert(name     != NULL);
+
+	gl_texture_t tex = { 0, 0, 0 };
+
+	tga_info_t tga;
+	if (tga_read_info(&tga, fileData, fileSize) && upload_gl_texture_tga(&tex, &tga, fileData, fileSize)) {
+		printf("Loaded new TGA texture \"%s\".\n", name);
+		return tex;
+	}
+
+	image_t image;
+	if (!image_load_from_memory(&image, fileData, fileSize)) {
+		printf("WARNING: Unable to decode texture image \"%s\": %s\n", name, o3d_get_last_error());
+		return tex;
+	}
+
+	tex = upload_gl_texture(&image);
+	printf("Loaded new texture \"%s\".\n", name);
 	return tex;
 }
 
@@ -410,6 +585,91 @@ void free_gl_texture(gl_texture_t * tex) {
 	memset(tex, 0, sizeof(*tex));
 }
 
+/* ========================================================
+ * GL texture arrays:
+ * ======================================================== */
+
+gl_texture_array_t create_gl_texture_array(uint32_t width, uint32_t height, uint32_t layerCount) {
+	assert(width != 0 && height != 0 && layerCount != 0);
+
+	gl_texture_array_t tex = { 0, 0, 0, 0 };
+
+	GLuint glTexHandle = 0;
+	glGenTextures(1, &glTexHandle);
+
+	if (glTexHandle == 0) {
+		fatal_error("Failed to allocate a new GL texture handle! Possibly out-of-memory!");
+	}
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, glTexHandle);
+
+	glTexImage3D(
+		/* target   = */ GL_TEXTURE_2D_ARRAY,
+		/* level    = */ 0,
+		/* internal = */ GL_RGBA,
+		/* width    = */ (GLsizei)width,
+		/* height   = */ (GLsizei)height,
+		/* depth    = */ (GLsizei)layerCount,
+		/* border   = */ 0,
+		/* format   = */ GL_RGBA,
+		/* type     = */ GL_UNSIGNED_BYTE,
+		/* data     = */ NULL);
+
+	// Same filtering as the 2D textures.
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glActiveTexture(GL_TEXTURE0);
+
+	tex.texHandle  = glTexHandle;
+	tex.width      = width;
+	tex.height     = height;
+	tex.layerCount = layerCount;
+
+	CHECK_GL_ERRORS();
+	return tex;
+}
+
+void upload_gl_texture_array_layer(const gl_texture_array_t * tex, uint32_t layer, const void * pixels) {
+	assert(tex != NULL && pixels != NULL);
+	assert(layer < tex->layerCount);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tex->texHandle);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)layer, (GLsizei)tex->width, (GLsizei)tex->height, 1,
+	                GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void generate_gl_texture_array_mipmaps(const gl_texture_array_t * tex) {
+	assert(tex != NULL);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tex->texHandle);
+	if (glGenerateMipmap != NULL) {
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	CHECK_GL_ERRORS();
+}
+
+void free_gl_texture_array(gl_texture_array_t * tex) {
+	if (tex == NULL) {
+		return;
+	}
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glDeleteTextures(1, &tex->texHandle);
+
+	memset(tex, 0, sizeof(*tex));
+}
+
 /* ========================================================
  * Miscellaneous / Application management:
  * ======================================================== */
@@ -422,18 +682,19 @@ void set_custom_cursor(void) {
 
 	static const char * CURSOR_IMG_FILE = "cursor24.png";
 
-	int width, height, comps;
-	stbi_uc * data = stbi_load(CURSOR_IMG_FILE, &width, &height, &comps, /* require RGBA */ 4);
-	if (data == NULL) {
-		printf("WARNING: Unable to load texture image \"%s\"!\n", CURSOR_IMG_FILE);
+	image_t cursorImage;
+	if (!image_load_from_file(&cursorImage, CURSOR_IMG_FILE)) {
+		printf("WARNING: Unable to load texture image \"%s\": %s\n", CURSOR_IMG_FILE, o3d_get_last_error());
 		return;
 	}
 
+	// GLFW copies the pixels.
 	GLFWimage image;
-	image.width  = width;
-	image.height = height;
-	image.pixels = data;
+	image.width  = (int)cursorImage.width;
+	image.height = (int)cursorImage.height;
+	image.pixels = cursorImage.pixels;
 	g_cursor = glfwCreateCursor(&image, 0, 0);
+	image_free(&cursorImage);
 
 	if (g_cursor != NULL) {
 		glfwSetCursor(g_window, g_cursor);
@@ -487,6 +748,10 @@ void init_glfw_app(glfw_app_t * app) {
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
 
+	// A hidden window still gets a full context and default framebuffer, which
+	// works anywhere GLFW can open a display, e.g. Mesa's llvmpipe under Xvfb.
+	glfwWindowHint(GLFW_VISIBLE, !app->hidden);
+
 	if (app->windowTitle != NULL) {
 		strncpy(g_windowTitle, app->windowTitle, sizeof(g_windowTitle));
 	} else {
@@ -499,9 +764,11 @@ void init_glfw_app(glfw_app_t * app) {
 	}
 
 	// GLFW input callbacks:
-	glfwSetCursorPosCallback(g_window,   app->mousePosCallback);
-	glfwSetMouseButtonCallback(g_window, app->mouseButtonCallback);
-	glfwSetScrollCallback(g_window,      app->mouseScrollCallback);
+	if (!app->hidden) {
+		glfwSetCursorPosCallback(g_window,   app->mousePosCallback);
+		glfwSetMouseButtonCallback(g_window, app->mouseButtonCallback);
+		glfwSetScrollCallback(g_window,      app->mouseScrollCallback);
+	}
 
 	// Make the drawing context (OpenGL) current for this thread:
 	glfwMakeContextCurrent(g_window);
@@ -510,7 +777,9 @@ void init_glfw_app(glfw_app_t * app) {
 		fatal_error("gl3wInit() failed!");
 	}
 
-	if (app->useCustomCursor) {
+	if (app->hidden) {
+		glfwSwapInterval(0); // Frame times shouldn't wait for the display.
+	} else if (app->useCustomCursor) {
 		set_custom_cursor();
 	}
 
@@ -525,8 +794,13 @@ void init_glfw_app(glfw_app_t * app) {
 	// User initializations run last.
 	app->onInitCallback();
 
-	// Enter the main loop, only breaking it when the user closes the window.
-	while (!glfwWindowShouldClose(g_window)) {
+	// Enter the main loop, only breaking it when the user closes the window
+	// or after the frame limit, if any.
+	for (int frame = 0; !glfwWindowShouldClose(g_window); ++frame) {
+		if (app->frameLimit > 0 && frame >= app->frameLimit) {
+			break;
+		}
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		app->onDrawCallback();
@@ -553,5 +827,5 @@ void quit_glfw_app(void) {
 	}
 
 	glfwTerminate();
-	exit(0);
+	exit(g_exitCode);
 }
@@ -17,6 +17,9 @@
 #ifndef DARKSTONE_GL_UTILS_H
 #define DARKSTONE_GL_UTILS_H
 
+#include "draw_vertex.h"
+#include "image.h"
+
 #include <assert.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -30,13 +33,6 @@
 
 /* ======================================================== */
 
-typedef struct gl_draw_vertex {
-	float px, py, pz;  // Position
-	float nx, ny, nz;  // Normal vector
-	float r,  g,  b;   // Vertex RGB color
-	float u,  v;       // Texture coordinates
-} gl_draw_vertex_t;
-
 typedef struct gl_vbo {
 	GLuint vertCount;  // Size in vertexes
 	GLuint indexCount; // Size in indexes
@@ -49,6 +45,7 @@ typedef struct gl_program {
 	GLuint progHandle;
 	GLint  u_mvpMatrix;
 	GLint  u_renderModeFlag;
+	GLint  u_texLayer;
 } gl_program_t;
 
 typedef struct gl_texture {
@@ -58,6 +55,14 @@ typedef struct gl_texture {
 	// Texture format is always RGBA!
 } gl_texture_t;
 
+typedef struct gl_texture_array {
+	GLuint texHandle;
+	GLuint width;
+	GLuint height;
+	GLuint layerCount;
+	// Also always RGBA.
+} gl_texture_array_t;
+
 // Generic application callback type.
 typedef void (* app_callback_f)(void);
 
@@ -73,6 +78,8 @@ typedef struct glfw_app {
 	GLFWcursorposfun   mousePosCallback;
 	GLFWscrollfun      mouseScrollCallback;
 	bool               useCustomCursor;
+	bool               hidden;      // Invisible window with no input, cursor or vsync, for benchmarks.
+	int                frameLimit;  // Quit after this many frames. 0 runs until the window is closed.
 } glfw_app_t;
 
 /* ========================================================
@@ -99,10 +106,26 @@ gl_vbo_t create_gl_vbo(const void * vertexData, int vertCount, const void * inde
 void setup_gl_vertex_format(void);
 void free_gl_vbo(gl_vbo_t * vbo);
 
-// Image loading via STB image (forces GL_RGBA).
+// Image loading (forces GL_RGBA). TGAs are decoded natively straight into a
+// pixel unpack buffer, other formats go through image.h. `name` is only for messages.
+// Loading from a file uploads its cooked BC1/BC3 copy instead, if up to date.
 gl_texture_t load_gl_texture_from_file(const char * filename);
+gl_texture_t load_gl_texture_from_memory(const void * fileData, size_t fileSize, const char * name);
 void free_gl_texture(gl_texture_t * tex);
 
+// Uploads the cooked copy of an image file (see o3d_texcache.h) with its precomputed mipmaps.
+// False, with nothing created, if there's no up to date copy or it is BC and the GL lacks S3TC.
+// `gpuBytes`, if not null, gets the size of all the levels uploaded.
+bool load_gl_texture_cooked(gl_texture_t * tex, const char * sourceFilename, size_t * gpuBytes);
+
+// GL_TEXTURE_2D_ARRAY, with the layers uploaded one at a time, each width * height RGBA
+// pixels, top row first. Generate the mipmaps once all layers are in. Programs sample
+// arrays from texture unit 1 ("u_color_texture_array"), 2D textures from unit 0.
+gl_texture_array_t create_gl_texture_array(uint32_t width, uint32_t height, uint32_t layerCount);
+void upload_gl_texture_array_layer(const gl_texture_array_t * tex, uint32_t layer, const void * pixels);
+void generate_gl_texture_array_mipmaps(const gl_texture_array_t * tex);
+void free_gl_texture_array(gl_texture_array_t * tex);
+
 // Set the window cursor to the custom sword cursor of Darkstone.
 // (which is loaded from "cursor24.png", assumed to be at the CWD!)
 void set_custom_cursor(void);
@@ -0,0 +1,494 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: image.c
+ * Created on: 17/10/26
+ * Brief: RGBA image loading (native TGA, STB Image for the rest) and PNG writing, without GL dependencies.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "image.h"
+#include "file_utils.h"
+#include "o3d.h"
+#include "tga.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The mipmap filter works on RGBA floats, one pixel per SSE register where available.
+#if defined(__SSE__) || defined(_M_X64)
+	#define IMAGE_USE_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define IMAGE_USE_SSE 0
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION 1
+#define STB_IMAGE_STATIC         1
+#define STBI_NO_GIF              1
+#define STBI_NO_HDR              1
+#define STBI_NO_PIC              1
+#define STBI_NO_PNM              1
+#define STBI_NO_PSD              1
+#define STBI_NO_LINEAR           1
+#include <stb_image.h>
+
+/* ========================================================
+ * image_load_from_file() / image_load_from_memory():
+ * ======================================================== */
+
+static bool image_set_pixels(image_t * image, stbi_uc * data, int width, int height) {
+	if (data == NULL) {
+		// STB's reasons are static strings, so they can be kept as the error.
+		return o3d_set_error(stbi_failure_reason());
+	}
+
+	image->pixels = data;
+	image->width  = (uint32_t)width;
+	image->height = (uint32_t)height;
+	return true;
+}
+
+bool image_load_from_file(image_t * image, const char * filename) {
+	assert(image    != NULL);
+	assert(filename != NULL);
+
+	memset(image, 0, sizeof(*image));
+
+	file_map_t map;
+	if (!file_map_open(&map, filename)) {
+		file_map_close(&map);
+		return o3d_set_error("Unable to open image file!");
+	}
+
+	const bool success = image_load_from_memory(image, map.data, (size_t)map.size);
+	file_map_close(&map);
+	return success;
+}
+
+bool image_load_from_memory(image_t * image, const void * fileData, size_t fileSize) {
+	assert(image    != NULL);
+	assert(fileData != NULL);
+
+	memset(image, 0, sizeof(*image));
+
+	// The game's TGAs go through the native decoder. Anything it rejects falls back to STB.
+	tga_info_t tga;
+	if (tga_read_info(&tga, fileData, fileSize)) {
+		uint8_t * pixels = malloc((size_t)tga.width * tga.height * 4);
+		if (pixels == NULL) {
+			return o3d_set_error("Unable to malloc image pixels!");
+		}
+		if (tga_decode(&tga, fileData, fileSize, pixels, (size_t)tga.width * 4)) {
+			image->pixels = pixels;
+			image->width  = tga.width;
+			image->height = tga.height;
+			return true;
+		}
+		free(pixels);
+	}
+
+	if (fileSize > 0x7FFFFFFF) {
+		return o3d_set_error("Image file too big!");
+	}
+
+	int width, height, comps;
+	stbi_uc * data = stbi_load_from_memory(fileData, (int)fileSize, &width, &height, &comps, /* require RGBA */ 4);
+	return image_set_pixels(image, data, width, height);
+}
+
+void image_free(image_t * image) {
+	if (image == NULL) {
+		return;
+	}
+
+	// stbi_image_free() is plain free() (STBI_FREE is not overridden),
+	// so this covers the pixels from both decoders.
+	free(image->pixels);
+	memset(image, 0, sizeof(*image));
+}
+
+/* ========================================================
+ * image_build_mips() / image_mip_count():
+ * ======================================================== */
+
+// A destination texel covers at most 3 source texels per axis (3 -> 1, 5 -> 2, ...).
+enum { IMAGE_MAX_TAPS = 3 };
+
+typedef struct image_filter_taps {
+	uint32_t first;
+	uint32_t count;
+	float    weights[IMAGE_MAX_TAPS];
+} image_filter_taps_t;
+
+typedef struct image_srgb_tables {
+	float toLinear[256];
+	float midpoints[255]; // Between consecutive toLinear[] entries, for rounding back.
+} image_srgb_tables_t;
+
+static void image_init_srgb_tables(image_srgb_tables_t * tables) {
+	for (int i = 0; i < 256; ++i) {
+		const float c = (float)i / 255.0f;
+		tables->toLinear[i] = (c <= 0.04045f) ? (c / 12.92f) : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+	for (int i = 0; i < 255; ++i) {
+		tables->midpoints[i] = (tables->toLinear[i] + tables->toLinear[i + 1]) * 0.5f;
+	}
+}
+
+// Nearest sRGB byte, measured in linear space.
+static uint8_t image_linear_to_srgb(const image_srgb_tables_t * tables, float value) {
+	int lo = 0;
+	int hi = 255;
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		if (value > tables->midpoints[mid]) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return (uint8_t)lo;
+}
+
+/*
+ * Box filter footprints along one axis. Sizes are scaled by dstSize, so
+ * destination texel d covers [d * srcSize, (d + 1) * srcSize) and source
+ * texel s covers [s * dstSize, (s + 1) * dstSize), all in exact integers.
+ */
+static void image_box_taps(uint32_t srcSize, uint32_t dstSize, image_filter_taps_t * taps) {
+	for (uint32_t d = 0; d < dstSize; ++d) {
+		const uint64_t start = (uint64_t)d * srcSize;
+		const uint64_t end   = start + srcSize;
+
+		image_filter_taps_t * t = &taps[d];
+		t->first = (uint32_t)(start / dstSize);
+		t->count = 0;
+
+		for (uint32_t s = t->first; s < srcSize && ((uint64_t)s * dstSize) < end; ++s) {
+			const uint64_t texelStart = (uint64_t)s * dstSize;
+			const uint64_t texelEnd   = texelStart + dstSize;
+			const uint64_t overlap    = ((texelEnd < end) ? texelEnd : end) - ((texelStart > start) ? texelStart : start);
+
+			assert(t->count < IMAGE_MAX_TAPS);
+			t->weights[t->count++] = (float)overlap / (float)srcSize;
+		}
+	}
+}
+
+// One level down, RGBA floats in and out.
+static void image_filter_level(const float * src, uint32_t srcWidth, float * dest, uint32_t destWidth, uint32_t destHeight,
+                               const image_filter_taps_t * tapsX, const image_filter_taps_t * tapsY) {
+	for (uint32_t y = 0; y < destHeight; ++y) {
+		const image_filter_taps_t * ty = &tapsY[y];
+
+		for (uint32_t x = 0; x < destWidth; ++x, dest += 4) {
+			const image_filter_taps_t * tx = &tapsX[x];
+
+#if IMAGE_USE_SSE
+			__m128 sum = _mm_setzero_ps();
+			for (uint32_t j = 0; j < ty->count; ++j) {
+				const float * row = src + ((((size_t)(ty->first + j) * srcWidth) + tx->first) * 4);
+				for (uint32_t i = 0; i < tx->count; ++i) {
+					const __m128 weight = _mm_set1_ps(ty->weights[j] * tx->weights[i]);
+					sum = _mm_add_ps(sum, _mm_mul_ps(weight, _mm_loadu_ps(row + (i * 4))));
+				}
+			}
+			_mm_storeu_ps(dest, sum);
+#else // !IMAGE_USE_SSE
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (uint32_t j = 0; j < ty->count; ++j) {
+				const float * row = src + ((((size_t)(ty->first + j) * srcWidth) + tx->first) * 4);
+				for (uint32_t i = 0; i < tx->count; ++i) {
+					const float weight = ty->weights[j] * tx->weights[i];
+					for (int c = 0; c < 4; ++c) {
+						sum[c] += weight * row[(i * 4) + c];
+					}
+				}
+			}
+			memcpy(dest, sum, sizeof(sum));
+#endif // IMAGE_USE_SSE
+		}
+	}
+}
+
+static float image_alpha_coverage(const float * pixels, size_t pixelCount, float alphaRef, float scale) {
+	size_t covered = 0;
+	for (size_t p = 0; p < pixelCount; ++p) {
+		covered += ((pixels[(p * 4) + 3] * scale) > alphaRef);
+	}
+	return (float)covered / (float)pixelCount;
+}
+
+// Smallest alpha scale giving the level at least the target coverage. Coverage only grows with the scale.
+static float image_coverage_scale(const float * pixels, size_t pixelCount, float alphaRef, float targetCoverage) {
+	float lo = 0.0f;
+	float hi = 4.0f;
+	for (int i = 0; i < 12; ++i) {
+		const float mid = (lo + hi) * 0.5f;
+		if (image_alpha_coverage(pixels, pixelCount, alphaRef, mid) < targetCoverage) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return hi;
+}
+
+static void image_quantize_level(const image_srgb_tables_t * tables, const float * pixels, size_t pixelCount,
+                                 float alphaScale, uint8_t * dest) {
+	for (size_t p = 0; p < pixelCount; ++p, pixels += 4, dest += 4) {
+		dest[0] = image_linear_to_srgb(tables, pixels[0]);
+		dest[1] = image_linear_to_srgb(tables, pixels[1]);
+		dest[2] = image_linear_to_srgb(tables, pixels[2]);
+
+		const float alpha = pixels[3] * alphaScale;
+		dest[3] = (uint8_t)((alpha >= 1.0f) ? 255 : (int)((alpha * 255.0f) + 0.5f));
+	}
+}
+
+bool image_build_mips(image_t * mips, uint32_t mipCount, const image_t * src, float alphaRef) {
+	assert(mips != NULL);
+	assert(src  != NULL && src->pixels != NULL);
+
+	memset(mips, 0, sizeof(mips[0]) * mipCount);
+	if (mipCount == 0) {
+		return true;
+	}
+
+	image_srgb_tables_t tables;
+	image_init_srgb_tables(&tables);
+
+	// The chain is filtered at full precision; only the output is rounded to bytes.
+	const size_t srcPixelCount = (size_t)src->width * src->height;
+	float * level = malloc(srcPixelCount * 4 * sizeof(float));
+	image_filter_taps_t * taps = malloc(((size_t)src->width + src->height) * sizeof(taps[0]));
+	if (level == NULL || taps == NULL) {
+		free(level);
+		free(taps);
+		return o3d_set_error("Unable to malloc mipmap filtering buffers!");
+	}
+
+	bool hasAlpha = false;
+	for (size_t p = 0; p < srcPixelCount; ++p) {
+		const uint8_t * pixel = &src->pixels[p * 4];
+		level[(p * 4) + 0] = tables.toLinear[pixel[0]];
+		level[(p * 4) + 1] = tables.toLinear[pixel[1]];
+		level[(p * 4) + 2] = tables.toLinear[pixel[2]];
+		level[(p * 4) + 3] = (float)pixel[3] / 255.0f;
+		hasAlpha |= (pixel[3] != 0xFF);
+	}
+
+	// Nothing to preserve if no texel passes the test (scaling would then zero the alpha),
+	// nor if all do, since averages of texels above the reference stay above it.
+	const float targetCoverage = (hasAlpha && alphaRef > 0.0f) ? image_alpha_coverage(level, srcPixelCount, alphaRef, 1.0f) : 0.0f;
+	const bool keepCoverage = (targetCoverage > 0.0f && targetCoverage < 1.0f);
+
+	uint32_t width  = src->width;
+	uint32_t height = src->height;
+	bool success = true;
+
+	for (uint32_t m = 0; m < mipCount; ++m) {
+		const uint32_t nextWidth  = (width  > 1) ? (width  / 2) : 1;
+		const uint32_t nextHeight = (height > 1) ? (height / 2) : 1;
+		const size_t pixelCount = (size_t)nextWidth * nextHeight;
+
+		float * nextLevel = malloc(pixelCount * 4 * sizeof(float));
+		mips[m].pixels = malloc(pixelCount * 4);
+		if (nextLevel == NULL || mips[m].pixels == NULL) {
+			free(nextLevel);
+			success = o3d_set_error("Unable to malloc image pixels!");
+			break;
+		}
+
+		image_filter_taps_t * tapsX = taps;
+		image_filter_taps_t * tapsY = taps + nextWidth;
+		image_box_taps(width,  nextWidth,  tapsX);
+		image_box_taps(height, nextHeight, tapsY);
+		image_filter_level(level, width, nextLevel, nextWidth, nextHeight, tapsX, tapsY);
+
+		// Scaled only for the output; the next level still filters the real alpha.
+		const float alphaScale = keepCoverage ? image_coverage_scale(nextLevel, pixelCount, alphaRef, targetCoverage) : 1.0f;
+		image_quantize_level(&tables, nextLevel, pixelCount, alphaScale, mips[m].pixels);
+		mips[m].width  = nextWidth;
+		mips[m].height = nextHeight;
+
+		free(level);
+		level  = nextLevel;
+		width  = nextWidth;
+		height = nextHeight;
+	}
+
+	free(level);
+	free(taps);
+
+	if (!success) {
+		for (uint32_t m = 0; m < mipCount; ++m) {
+			image_free(&mips[m]);
+		}
+	}
+	return success;
+}
+
+uint32_t image_mip_count(uint32_t width, uint32_t height) {
+	uint32_t count = 1;
+	while (width > 1 || height > 1) {
+		width  = (width  > 1) ? (width  / 2) : 1;
+		height = (height > 1) ? (height / 2) : 1;
+		count++;
+	}
+	return count;
+}
+
+/* ========================================================
+ * image_write_png():
+ * ======================================================== */
+
+// Deflate "stored" blocks hold at most 64K - 1 bytes each.
+enum { PNG_MAX_STORED_BLOCK = 65535 };
+
+static void png_put_u32(uint8_t * dest, uint32_t value) {
+	dest[0] = (uint8_t)(value >> 24);
+	dest[1] = (uint8_t)(value >> 16);
+	dest[2] = (uint8_t)(value >> 8);
+	dest[3] = (uint8_t)(value);
+}
+
+static uint32_t png_crc32(const uint32_t * table, uint32_t crc, const uint8_t * data, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static bool png_write_chunk(FILE * fileOut, const uint32_t * crcTable, const char * type,
+                            const uint8_t * data, uint32_t size) {
+	uint8_t header[8];
+	png_put_u32(header, size);
+	memcpy(header + 4, type, 4);
+
+	uint32_t crc = png_crc32(crcTable, 0xFFFFFFFF, header + 4, 4);
+	crc = png_crc32(crcTable, crc, data, size);
+
+	uint8_t footer[4];
+	png_put_u32(footer, crc ^ 0xFFFFFFFF);
+
+	return fwrite(header, 1, sizeof(header), fileOut) == sizeof(header) &&
+	       (size == 0 || fwrite(data, 1, size, fileOut) == size) &&
+	       fwrite(footer, 1, sizeof(footer), fileOut) == sizeof(footer);
+}
+
+bool image_write_png(const char * filename, const uint8_t * rgba, uint32_t width, uint32_t height) {
+	assert(filename != NULL);
+	assert(rgba     != NULL);
+
+	if (width == 0 || height == 0 || width > 0x3FFFFFFF / height) {
+		return o3d_set_error("Bad PNG image dimensions!");
+	}
+
+	// Every row is prefixed by its filter type, always 0 (none) here.
+	const size_t rowSize   = ((size_t)width * 4) + 1;
+	const size_t rawSize   = rowSize * height;
+	const size_t numBlocks = (rawSize + PNG_MAX_STORED_BLOCK - 1) / PNG_MAX_STORED_BLOCK;
+	const size_t zlibSize  = 2 + (numBlocks * 5) + rawSize + 4;
+
+	if (zlibSize > 0x7FFFFFFF) {
+		return o3d_set_error("PNG image too big!");
+	}
+
+	uint8_t * zlib = malloc(zlibSize);
+	if (zlib == NULL) {
+		return o3d_set_error("Unable to malloc PNG data!");
+	}
+
+	// zlib header: deflate, 32K window, no dictionary, fastest.
+	uint8_t * out = zlib;
+	*out++ = 0x78;
+	*out++ = 0x01;
+
+	uint32_t adlerA = 1;
+	uint32_t adlerB = 0;
+	size_t blockLeft = 0;
+	size_t rawLeft = rawSize;
+
+	for (uint32_t y = 0; y < height; ++y) {
+		const uint8_t * row = rgba + ((size_t)y * width * 4);
+		for (size_t i = 0; i < rowSize; ++i) {
+			if (blockLeft == 0) {
+				blockLeft = (rawLeft < PNG_MAX_STORED_BLOCK) ? rawLeft : PNG_MAX_STORED_BLOCK;
+				rawLeft  -= blockLeft;
+				*out++ = (rawLeft == 0) ? 1 : 0; // BFINAL, BTYPE=00
+				*out++ = (uint8_t)(blockLeft);
+				*out++ = (uint8_t)(blockLeft >> 8);
+				*out++ = (uint8_t)(~blockLeft);
+				*out++ = (uint8_t)(~blockLeft >> 8);
+			}
+
+			const uint8_t byte = (i == 0) ? 0 : row[i - 1];
+			*out++ = byte;
+			--blockLeft;
+
+			adlerA += byte;
+			if (adlerA >= 65521) {
+				adlerA -= 65521;
+			}
+			adlerB += adlerA;
+			if (adlerB >= 65521) {
+				adlerB -= 65521;
+			}
+		}
+	}
+
+	png_put_u32(out, (adlerB << 16) | adlerA);
+	out += 4;
+	assert((size_t)(out - zlib) == zlibSize);
+
+	uint32_t crcTable[256];
+	for (uint32_t n = 0; n < 256; ++n) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; ++k) {
+			c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+		}
+		crcTable[n] = c;
+	}
+
+	// Width, height, 8 bits per channel, RGBA, deflate, adaptive filtering, no interlace.
+	uint8_t ihdr[13];
+	png_put_u32(ihdr + 0, width);
+	png_put_u32(ihdr + 4, height);
+	ihdr[8]  = 8;
+	ihdr[9]  = 6;
+	ihdr[10] = 0;
+	ihdr[11] = 0;
+	ihdr[12] = 0;
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	FILE * fileOut = fopen(filename, "wb");
+	if (fileOut == NULL) {
+		free(zlib);
+		return o3d_set_error("Can't open PNG file for writing!");
+	}
+
+	bool success = fwrite(signature, 1, sizeof(signature), fileOut) == sizeof(signature) &&
+	               png_write_chunk(fileOut, crcTable, "IHDR", ihdr, sizeof(ihdr)) &&
+	               png_write_chunk(fileOut, crcTable, "IDAT", zlib, (uint32_t)zlibSize) &&
+	               png_write_chunk(fileOut, crcTable, "IEND", NULL, 0);
+
+	success = (fclose(fileOut) == 0) && success;
+	free(zlib);
+
+	if (!success) {
+		return o3d_set_error("Failed to write PNG file!");
+	}
+	return true;
+}
@@ -0,0 +1,85 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: image.h
+ * Created on: 17/10/26
+ * Brief: RGBA image loading (native TGA, STB Image for the rest) and PNG writing, without GL dependencies.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_IMAGE_H
+#define DARKSTONE_IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ========================================================
+ * Image data:
+ * ======================================================== */
+
+/*
+ * 8-bit RGBA pixels, tightly packed, top row first. This is also
+ * the row order the textures are uploaded to GL in, so V=0 is the top.
+ */
+typedef struct image {
+	uint8_t * pixels;
+	uint32_t  width;
+	uint32_t  height;
+} image_t;
+
+/* ========================================================
+ * Image functions:
+ * ======================================================== */
+
+/*
+ * Decodes an image file (TGA, PNG, BMP, JPEG), converting it to RGBA.
+ * TGAs use the native decoder in tga.h, the other formats STB Image.
+ * Errors are reported via o3d_set_error(), like the rest of the tools.
+ */
+bool image_load_from_file(image_t * image, const char * filename);
+
+/*
+ * Same as above, but from a file already in memory.
+ */
+bool image_load_from_memory(image_t * image, const void * fileData, size_t fileSize);
+
+/*
+ * Frees the pixels and clears the image. Null pointer is a no-op.
+ */
+void image_free(image_t * image);
+
+/*
+ * Builds the mipmap levels below `src` into `mips`, where mips[i] is level
+ * i + 1: half the size of the one above, rounded down, at least 1. Their
+ * pixels are allocated. Each level is filtered from the full precision one
+ * above it with a box filter covering exactly its area in the source, so odd
+ * sizes are weighted correctly too. Colors are taken as sRGB and averaged
+ * in linear space, so the mipmaps don't get darker; alpha is linear already.
+ *
+ * With `alphaRef` above zero, each level's alpha is scaled so the fraction of
+ * texels above `alphaRef` stays the same as in `src`. Alpha tested geometry
+ * like foliage and fences would otherwise thin out and vanish in the distance.
+ * Images without any alpha are left as they are.
+ */
+bool image_build_mips(image_t * mips, uint32_t mipCount, const image_t * src, float alphaRef);
+
+/*
+ * Number of levels in the full mipmap chain of a width * height image, down to 1x1.
+ */
+uint32_t image_mip_count(uint32_t width, uint32_t height);
+
+/*
+ * Writes RGBA pixels (top row first) as a PNG file. The data is
+ * stored rather than deflated, which keeps the writer trivial; the
+ * files are meant for previews and image diffs, not distribution.
+ */
+bool image_write_png(const char * filename, const uint8_t * rgba, uint32_t width, uint32_t height);
+
+#endif // DARKSTONE_IMAGE_H
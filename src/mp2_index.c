@@ -0,0 +1,325 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: mp2_index.c
+ * Created on: 17/10/26
+ * Brief: MPEG-1/2 Layer II audio frame index, for seeking and clipping the game's MP2 files in place.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "mp2_index.h"
+#include "o3d.h" // o3d_set_error()
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Positional reads where there is POSIX, like the file mappings in file_utils.c.
+#if defined(__unix__) || defined(__APPLE__)
+	#define MP2_INDEX_USE_PREAD 1
+	#include <errno.h>
+	#include <unistd.h>
+#endif // __unix__ || __APPLE__
+
+// Layer II bitrates in kbps, by bitrate index. Index 0 is free format, 15 is invalid.
+static const uint16_t mp2_bitrates_v1[16]  = { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 };
+static const uint16_t mp2_bitrates_lsf[16] = { 0,  8, 16, 24, 32, 40, 48,  56,  64,  80,  96, 112, 128, 144, 160, 0 };
+
+// MPEG-1 sample rates. MPEG-2 halves them and MPEG-2.5 quarters them.
+static const uint32_t mp2_sample_rates[3] = { 44100, 48000, 32000 };
+
+/* ========================================================
+ * mp2_parse_frame_header():
+ * ======================================================== */
+
+bool mp2_parse_frame_header(const uint8_t * bytes, mp2_frame_header_t * header) {
+
+	assert(bytes  != NULL);
+	assert(header != NULL);
+
+	// 11 bits of sync.
+	if (bytes[0] != 0xFF || (bytes[1] & 0xE0) != 0xE0) {
+		return false;
+	}
+
+	const uint32_t versionBits = (bytes[1] >> 3) & 3;
+	const uint32_t layerBits   = (bytes[1] >> 1) & 3;
+	const uint32_t bitrateIdx  = bytes[2] >> 4;
+	const uint32_t rateIdx     = (bytes[2] >> 2) & 3;
+	const uint32_t padding     = (bytes[2] >> 1) & 1;
+	const uint32_t channelMode = bytes[3] >> 6;
+
+	// Version 1 is reserved; layer 2 (binary 10) is Layer II.
+	if (versionBits == 1 || layerBits != 2 || rateIdx == 3) {
+		return false;
+	}
+
+	uint32_t sampleRate = mp2_sample_rates[rateIdx];
+	uint32_t bitrate;
+	switch (versionBits) {
+	case 3 :
+		header->version = 1;
+		bitrate = mp2_bitrates_v1[bitrateIdx];
+		break;
+	case 2 :
+		header->version = 2;
+		bitrate = mp2_bitrates_lsf[bitrateIdx];
+		sampleRate /= 2;
+		break;
+	default :
+		header->version = 25;
+		bitrate = mp2_bitrates_lsf[bitrateIdx];
+		sampleRate /= 4;
+		break;
+	} // switch (versionBits)
+
+	if (bitrate == 0) {
+		return false; // Free format or invalid.
+	}
+
+	header->bitrate    = bitrate;
+	header->sampleRate = sampleRate;
+	header->channels   = (channelMode == 3) ? 1 : 2;
+	header->frameSize  = (144000 * bitrate) / sampleRate + padding;
+	return true;
+}
+
+/* ========================================================
+ * mp2_id3v2_size():
+ * ======================================================== */
+
+static size_t mp2_id3v2_size(const uint8_t * data, size_t size) {
+
+	// "ID3", version, flags, then a 28 bit "syncsafe" size (7 bits per byte).
+	if (size < 10 || memcmp(data, "ID3", 3) != 0) {
+		return 0;
+	}
+	if ((data[6] | data[7] | data[8] | data[9]) & 0x80) {
+		return 0;
+	}
+
+	size_t tagSize = 10 + (((size_t)data[6] << 21) | ((size_t)data[7] << 14) |
+	                       ((size_t)data[8] <<  7) |  (size_t)data[9]);
+	if (data[5] & 0x10) {
+		tagSize += 10; // Footer.
+	}
+	return (tagSize <= size) ? tagSize : 0;
+}
+
+/* ========================================================
+ * mp2_is_frame_at():
+ * ======================================================== */
+
+static bool mp2_is_frame_at(const uint8_t * data, size_t size, size_t offset,
+                            uint32_t sampleRate, mp2_frame_header_t * header) {
+
+	if (offset + 4 > size || !mp2_parse_frame_header(data + offset, header)) {
+		return false;
+	}
+	if (sampleRate != 0 && header->sampleRate != sampleRate) {
+		return false;
+	}
+	return offset + header->frameSize <= size;
+}
+
+/* ========================================================
+ * mp2_index_build():
+ * ======================================================== */
+
+bool mp2_index_build(mp2_index_t * index, const uint8_t * data, size_t size) {
+
+	assert(index != NULL);
+	assert(data  != NULL);
+
+	memset(index, 0, sizeof(*index));
+
+	if (size > UINT32_MAX) {
+		return o3d_set_error("MP2 stream too big for 32 bit frame offsets!");
+	}
+
+	// Start with room for 128kbps frames at 44100Hz (417 bytes), grow as needed.
+	uint32_t capacity = (uint32_t)(size / 417) + 2;
+	uint32_t * offsets = malloc(capacity * sizeof(uint32_t));
+	if (offsets == NULL) {
+		return o3d_set_error("Unable to malloc MP2 frame index!");
+	}
+
+	size_t offset = mp2_id3v2_size(data, size);
+	uint32_t frameCount = 0;
+	uint32_t sampleRate = 0;
+	uint32_t skipped = (uint32_t)offset;
+	mp2_frame_header_t header;
+	mp2_frame_header_t next;
+
+	while (offset + 4 <= size) {
+		if (!mp2_is_frame_at(data, size, offset, sampleRate, &header)) {
+			++offset;
+			++skipped;
+			continue;
+		}
+
+		// Once out of sync (or at the very start), a sync word can just be a
+		// coincidence in the audio data, so require the next frame to match too.
+		const bool synced = (frameCount != 0 && offsets[frameCount] == offset);
+		if (!synced) {
+			const size_t nextOffset = offset + header.frameSize;
+			if (nextOffset + 4 <= size && !mp2_is_frame_at(data, size, nextOffset, header.sampleRate, &next)) {
+				++offset;
+				++skipped;
+				continue;
+			}
+		}
+
+		if (frameCount + 2 > capacity) {
+			capacity *= 2;
+			uint32_t * newOffsets = realloc(offsets, capacity * sizeof(uint32_t));
+			if (newOffsets == NULL) {
+				free(offsets);
+				return o3d_set_error("Unable to realloc MP2 frame index!");
+			}
+			offsets = newOffsets;
+		}
+
+		if (frameCount == 0) {
+			sampleRate       = header.sampleRate;
+			index->channels  = header.channels;
+			index->version   = header.version;
+		}
+
+		offsets[frameCount++] = (uint32_t)offset;
+		offset += header.frameSize;
+		offsets[frameCount]   = (uint32_t)offset; // End of the last frame so far.
+	}
+
+	if (frameCount == 0) {
+		free(offsets);
+		return o3d_set_error("No MPEG Layer II frames found!");
+	}
+
+	// The last few bytes, too short for a header. A trailing ID3v1 tag
+	// or a cut frame were already counted by the scan.
+	skipped += (uint32_t)(size - offset);
+
+	index->frameOffsets = offsets;
+	index->frameCount   = frameCount;
+	index->sampleRate   = sampleRate;
+	index->skippedBytes = skipped;
+	return true;
+}
+
+/* ========================================================
+ * mp2_index_free():
+ * ======================================================== */
+
+void mp2_index_free(mp2_index_t * index) {
+	if (index == NULL) {
+		return;
+	}
+	free(index->frameOffsets);
+	memset(index, 0, sizeof(*index));
+}
+
+/* ========================================================
+ * mp2_index_frame_duration():
+ * ======================================================== */
+
+double mp2_index_frame_duration(const mp2_index_t * index) {
+	assert(index != NULL);
+	if (index->sampleRate == 0) {
+		return 0.0;
+	}
+	return (double)MP2_SAMPLES_PER_FRAME / (double)index->sampleRate;
+}
+
+/* ========================================================
+ * mp2_index_duration():
+ * ======================================================== */
+
+double mp2_index_duration(const mp2_index_t * index) {
+	return index->frameCount * mp2_index_frame_duration(index);
+}
+
+/* ========================================================
+ * mp2_index_frame_at():
+ * ======================================================== */
+
+uint32_t mp2_index_frame_at(const mp2_index_t * index, double seconds) {
+
+	assert(index != NULL);
+	if (index->frameCount == 0 || seconds <= 0.0) {
+		return 0;
+	}
+
+	const double frame = seconds * (double)index->sampleRate / (double)MP2_SAMPLES_PER_FRAME;
+	if (frame >= (double)(index->frameCount - 1)) {
+		return index->frameCount - 1;
+	}
+	return (uint32_t)frame;
+}
+
+/* ========================================================
+ * mp2_index_frame_range():
+ * ======================================================== */
+
+bool mp2_index_frame_range(const mp2_index_t * index, uint32_t firstFrame, uint32_t frameCount,
+                           uint32_t * offset, uint32_t * size) {
+
+	assert(index  != NULL);
+	assert(offset != NULL);
+	assert(size   != NULL);
+
+	if (firstFrame > index->frameCount || frameCount > index->frameCount - firstFrame) {
+		return o3d_set_error("MP2 frame range out of bounds!");
+	}
+
+	*offset = index->frameOffsets[firstFrame];
+	*size   = index->frameOffsets[firstFrame + frameCount] - *offset;
+	return true;
+}
+
+/* ========================================================
+ * mp2_index_read_frames():
+ * ======================================================== */
+
+bool mp2_index_read_frames(const mp2_index_t * index, FILE * file, uint64_t streamOffset,
+                           uint32_t firstFrame, uint32_t frameCount, uint8_t * dest) {
+
+	assert(file != NULL);
+	assert(dest != NULL);
+
+	uint32_t offset;
+	uint32_t size;
+	if (!mp2_index_frame_range(index, firstFrame, frameCount, &offset, &size)) {
+		return false;
+	}
+
+#if MP2_INDEX_USE_PREAD
+	const int fd = fileno(file);
+	off_t position = (off_t)(streamOffset + offset);
+	while (size > 0) {
+		const ssize_t result = pread(fd, dest, size, position);
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			return o3d_set_error("Failed to read MP2 frames!");
+		}
+		dest     += result;
+		position += result;
+		size     -= (uint32_t)result;
+	}
+	return true;
+#else // !MP2_INDEX_USE_PREAD
+	if (fseek(file, (long)(streamOffset + offset), SEEK_SET) != 0 ||
+	    fread(dest, 1, size, file) != size) {
+		return o3d_set_error("Failed to read MP2 frames!");
+	}
+	return true;
+#endif // MP2_INDEX_USE_PREAD
+}
@@ -0,0 +1,117 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: mp2_index.h
+ * Created on: 17/10/26
+ * Brief: MPEG-1/2 Layer II audio frame index, for seeking and clipping the game's MP2 files in place.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_MP2_INDEX_H
+#define DARKSTONE_MP2_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* ========================================================
+ * MP2 frame index:
+ *
+ * The music and voices (MUSIC.MTF, VOICES1.MTF) are plain MPEG
+ * Layer II streams, stored uncompressed in the archives. The
+ * index is built by hopping from one frame header to the next,
+ * so only 4 bytes of each frame are touched, directly on the
+ * entry's bytes in a mapping of the archive. Every Layer II
+ * frame holds 1152 samples per channel, so the time of a frame
+ * is its number times a constant duration and seeking is a
+ * division. Layer II has no bit reservoir either, so any range
+ * of whole frames is a valid stream on its own, which is what
+ * makes clipping by frames possible without decoding.
+ * ======================================================== */
+
+enum { MP2_SAMPLES_PER_FRAME = 1152 };
+
+/*
+ * Fields of one frame header.
+ */
+typedef struct mp2_frame_header {
+	uint32_t version;      // 1 for MPEG-1, 2 for MPEG-2, 25 for MPEG-2.5.
+	uint32_t bitrate;      // In kilobits per second.
+	uint32_t sampleRate;   // In Hertz.
+	uint32_t channels;     // 1 or 2.
+	uint32_t frameSize;    // In bytes, header included.
+} mp2_frame_header_t;
+
+/*
+ * Where each frame starts in the stream. All the frames of a stream must
+ * have the same sample rate; bitrates can vary (the offsets take care of it).
+ */
+typedef struct mp2_index {
+	uint32_t * frameOffsets;  // frameCount + 1: each frame, then the end of the last one.
+	uint32_t   frameCount;
+	uint32_t   sampleRate;
+	uint32_t   channels;
+	uint32_t   version;
+	uint32_t   skippedBytes;  // Tags and junk between or after the frames.
+} mp2_index_t;
+
+/* ========================================================
+ * MP2 index functions:
+ * ======================================================== */
+
+/*
+ * Parses the 4 byte frame header at `bytes`. False if it isn't a valid
+ * Layer II header (free format bitrates are not supported either).
+ */
+bool mp2_parse_frame_header(const uint8_t * bytes, mp2_frame_header_t * header);
+
+/*
+ * Indexes every frame of a stream in memory (e.g. an archive mapping).
+ * A leading ID3v2 tag is skipped and the scan resyncs after junk.
+ */
+bool mp2_index_build(mp2_index_t * index, const uint8_t * data, size_t size);
+
+/*
+ * Frees the offsets and clears the struct.
+ */
+void mp2_index_free(mp2_index_t * index);
+
+/*
+ * Length of the stream, in seconds.
+ */
+double mp2_index_duration(const mp2_index_t * index);
+
+/*
+ * Seconds per frame: MP2_SAMPLES_PER_FRAME / sampleRate.
+ */
+double mp2_index_frame_duration(const mp2_index_t * index);
+
+/*
+ * Frame playing at `seconds`, clamped to the stream. O(1).
+ */
+uint32_t mp2_index_frame_at(const mp2_index_t * index, double seconds);
+
+/*
+ * Byte range, within the stream, of `frameCount` frames from `firstFrame`.
+ */
+bool mp2_index_frame_range(const mp2_index_t * index, uint32_t firstFrame, uint32_t frameCount,
+                           uint32_t * offset, uint32_t * size);
+
+/*
+ * Reads a range of frames with a positional read (pread) of `file`,
+ * where the stream starts at `streamOffset`. Doesn't move the file
+ * position, so threads can share the archive handle. `dest` needs the
+ * size given by mp2_index_frame_range(). Without POSIX, this falls back
+ * to fseek() + fread(), which moves the position and can't be shared.
+ */
+bool mp2_index_read_frames(const mp2_index_t * index, FILE * file, uint64_t streamOffset,
+                           uint32_t firstFrame, uint32_t frameCount, uint8_t * dest);
+
+#endif // DARKSTONE_MP2_INDEX_H
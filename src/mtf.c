@@ -27,11 +27,18 @@
  * mtf_get_last_error()/mtf_error():
  * ======================================================== */
 
-// Some compilers have Thread Local Storage support
-// which can be used to make this error string thread
-// safe, so that parallel file processing wouldn't step
-// in each other's toes when reporting errors...
-static const char * mtfLastErrorStr = "";
+// The error string is Thread Local where the compiler
+// supports it, so that parallel file processing doesn't
+// step in each other's toes when reporting errors...
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+	#define MTF_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+	#define MTF_THREAD_LOCAL __thread
+#else
+	#define MTF_THREAD_LOCAL
+#endif
+
+static MTF_THREAD_LOCAL const char * mtfLastErrorStr = "";
 
 static inline bool mtf_error(const char * message) {
 	mtfLastErrorStr = (message != NULL) ? message : "";
@@ -181,29 +188,17 @@ static inline bool mtf_is_compressed(const mtf_compressed_header_t * header) {
 }
 
 /* ========================================================
- * mtf_decompress_write_file():
+ * mtf_decompress():
  * ======================================================== */
 
-static bool mtf_decompress_write_file(FILE * fileIn, FILE * fileOut, uint32_t decompressedSize,
-                                      const mtf_compressed_header_t * compressedHeader) {
+static bool mtf_decompress(FILE * fileIn, uint8_t * decompressBuffer, uint32_t decompressedSize) {
 
 	// NOTE: `fileIn` must to point past the compressed header!
-	assert(fileIn  != NULL);
-	assert(fileOut != NULL);
-	assert(compressedHeader != NULL);
+	assert(fileIn != NULL);
+	assert(decompressBuffer != NULL);
 	assert(decompressedSize != 0);
 
-	// Would be better as a compile-time assert. I'm just being lazy...
-	assert(sizeof(mtf_compressed_header_t) == 12 && "Unexpected size for this struct!");
-
-	uint8_t * decompressBuffer = malloc(decompressedSize);
-	uint8_t * decompressedPtr  = decompressBuffer;
-
-	if (decompressBuffer == NULL) {
-		return mtf_error("Failed to malloc decompression buffer!");
-	}
-
-	bool hadError = false;
+	uint8_t * decompressedPtr = decompressBuffer;
 	int bytesLeft = decompressedSize;
 
 	// Do one byte at a time. Repeat until we have processed
@@ -222,21 +217,20 @@ static bool mtf_decompress_write_file(FILE * fileIn, FILE * fileOut, uint32_t de
 		// read from the file.
 		uint8_t chunkBits;
 		if (!mtf_read8(fileIn, &chunkBits)) {
-			hadError = true;
-			goto BAIL;
+			return false;
 		}
 
 		// For each bit in the chunk header, staring from
-		// the lower/right-hand bit (little endian)
-		for (int b = 0; b < 8; ++b) {
+		// the lower/right-hand bit (little endian).
+		// The last chunk may have flags to spare; those are ignored.
+		for (int b = 0; b < 8 && bytesLeft > 0; ++b) {
 			int flag = chunkBits & (1 << b);
 
 			// If the bit is set, read the next byte unchanged:
 			if (flag) {
 				uint8_t byte;
 				if (!mtf_read8(fileIn, &byte)) {
-					hadError = true;
-					goto BAIL;
+					return false;
 				}
 
 				*decompressedPtr++ = byte;
@@ -248,8 +242,7 @@ static bool mtf_decompress_write_file(FILE * fileIn, FILE * fileOut, uint32_t de
 				// already read. This seems somewhat similar to RLE compression...
 				uint16_t word;
 				if (!mtf_read16(fileIn, &word)) {
-					hadError = true;
-					goto BAIL;
+					return false;
 				}
 
 				if (word == 0) {
@@ -262,6 +255,14 @@ static bool mtf_decompress_write_file(FILE * fileIn, FILE * fileOut, uint32_t de
 				int count  = (word >> 10);    // Top 6 bits of the word
 				int offset = (word & 0x03FF); // Lower 10 bits of the word
 
+				// Checked before copying, so a corrupt entry can't take us out of the buffer.
+				if (count + 3 > bytesLeft) {
+					return mtf_error("Compressed/decompressed size mismatch!");
+				}
+				if (offset > (int)(decompressedPtr - decompressBuffer)) {
+					return mtf_error("Compressed data references bytes before the start of the file!");
+				}
+
 				// Copy count+3 bytes staring at offset to the end of the decompression buffer,
 				// as explained here: http://wiki.xentax.com/index.php?title=Darkstone
 				for (int n = 0; n < count + 3; ++n) {
@@ -269,27 +270,41 @@ static bool mtf_decompress_write_file(FILE * fileIn, FILE * fileOut, uint32_t de
 					++decompressedPtr;
 					--bytesLeft;
 				}
-
-				if (bytesLeft < 0) {
-					mtf_error("Compressed/decompressed size mismatch!");
-					hadError = true;
-					goto BAIL;
-				}
 			}
 		}
 	}
 
-BAIL:
+	return true;
+}
 
-	if (!hadError) {
-		if (fwrite(decompressBuffer, 1, decompressedSize, fileOut) != decompressedSize) {
-			mtf_error("Failed to write decompressed file data!");
-			hadError = true;
-		}
+/* ========================================================
+ * mtf_decompress_write_file():
+ * ======================================================== */
+
+static bool mtf_decompress_write_file(FILE * fileIn, FILE * fileOut, uint32_t decompressedSize,
+                                      const mtf_compressed_header_t * compressedHeader) {
+
+	// NOTE: `fileIn` must to point past the compressed header!
+	assert(fileIn  != NULL);
+	assert(fileOut != NULL);
+	assert(compressedHeader != NULL);
+	assert(decompressedSize != 0);
+
+	// Would be better as a compile-time assert. I'm just being lazy...
+	assert(sizeof(mtf_compressed_header_t) == 12 && "Unexpected size for this struct!");
+
+	uint8_t * decompressBuffer = malloc(decompressedSize);
+	if (decompressBuffer == NULL) {
+		return mtf_error("Failed to malloc decompression buffer!");
+	}
+
+	bool success = mtf_decompress(fileIn, decompressBuffer, decompressedSize);
+	if (success && fwrite(decompressBuffer, 1, decompressedSize, fileOut) != decompressedSize) {
+		success = mtf_error("Failed to write decompressed file data!");
 	}
 
 	free(decompressBuffer);
-	return !hadError;
+	return success;
 }
 
 /* ========================================================
@@ -510,3 +525,86 @@ bool mtf_file_extract_batch(const char * srcMtfFile, const char * destPath,
 	mtf_file_close(&mtf);
 	return true;
 }
+
+/* ========================================================
+ * mtf_file_read_entry():
+ * ======================================================== */
+
+bool mtf_file_read_entry(mtf_file_t * mtf, const mtf_file_entry_t * entry, uint8_t ** data) {
+
+	assert(mtf  != NULL);
+	assert(entry != NULL);
+	assert(data != NULL);
+
+	*data = NULL;
+	if (mtf->osFileHandle == NULL) {
+		return mtf_error("MTF archive is not open!");
+	}
+
+	// Never a zero-sized malloc, so an empty entry still gets a valid pointer.
+	uint8_t * buffer = malloc((entry->decompressedSize != 0) ? entry->decompressedSize : 1);
+	if (buffer == NULL) {
+		return mtf_error("Failed to malloc MTF entry buffer!");
+	}
+
+	if (entry->decompressedSize == 0) {
+		*data = buffer;
+		return true;
+	}
+
+	// Same as in mtf_file_extract_batch(), the header
+	// tells whether the entry is compressed or not.
+	mtf_compressed_header_t compressedHeader;
+	if (!mtf_read_compressed_header(mtf->osFileHandle, entry->dataOffset, &compressedHeader)) {
+		free(buffer);
+		return mtf_error("Failed to read a compression info header!");
+	}
+
+	bool success;
+	if (mtf_is_compressed(&compressedHeader)) {
+		success = mtf_decompress(mtf->osFileHandle, buffer, entry->decompressedSize);
+	} else if (fseek(mtf->osFileHandle, entry->dataOffset, SEEK_SET) != 0) {
+		success = mtf_error("Can't fseek() entry offset!");
+	} else if (fread(buffer, 1, entry->decompressedSize, mtf->osFileHandle) != entry->decompressedSize) {
+		success = mtf_error("Can't read MTF file entry!");
+	} else {
+		success = true;
+	}
+
+	if (!success) {
+		free(buffer);
+		return false;
+	}
+
+	*data = buffer;
+	return true;
+}
+
+/* ========================================================
+ * mtf_file_entry_is_compressed():
+ * ======================================================== */
+
+bool mtf_file_entry_is_compressed(mtf_file_t * mtf, const mtf_file_entry_t * entry, bool * compressed) {
+
+	assert(mtf != NULL);
+	assert(entry != NULL);
+	assert(compressed != NULL);
+
+	*compressed = false;
+	if (mtf->osFileHandle == NULL) {
+		return mtf_error("MTF archive is not open!");
+	}
+
+	// Nothing stored at all, like in mtf_file_read_entry().
+	if (entry->decompressedSize == 0) {
+		return true;
+	}
+
+	mtf_compressed_header_t compressedHeader;
+	if (!mtf_read_compressed_header(mtf->osFileHandle, entry->dataOffset, &compressedHeader)) {
+		return mtf_error("Failed to read a compression info header!");
+	}
+
+	*compressed = mtf_is_compressed(&compressedHeader);
+	return true;
+}
@@ -66,6 +66,23 @@ bool mtf_file_open(mtf_file_t * mtf, const char * filename);
  */
 void mtf_file_close(mtf_file_t * mtf);
 
+/*
+ * Reads one entry of an archive opened by mtf_file_open() into a new heap
+ * buffer of `entry->decompressedSize` bytes, decompressing it if needed.
+ * The caller must free() `*data`. This seeks the archive's file handle, so
+ * don't read from the same mtf_file_t in several threads at once.
+ */
+bool mtf_file_read_entry(mtf_file_t * mtf, const mtf_file_entry_t * entry, uint8_t ** data);
+
+/*
+ * Tells whether an entry is stored compressed. The ones that are not can be
+ * read in place: their bytes are the `decompressedSize` ones at `dataOffset`
+ * in the archive, so a mapping of the whole archive (see file_map_open()) or
+ * positional reads get to them with no mtf_file_read_entry() copy. This seeks
+ * the archive's file handle, like mtf_file_read_entry().
+ */
+bool mtf_file_entry_is_compressed(mtf_file_t * mtf, const mtf_file_entry_t * entry, bool * compressed);
+
 /*
  * Extract the contents of an MTF archive to normal files
  * in the local file system. Overwrites existing files.
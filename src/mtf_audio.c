@@ -0,0 +1,537 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: mtf_audio.c
+ * Created on: 17/10/26
+ * Brief: Command-line tool to index and clip the MP2 audio inside MTF archives without unpacking them.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "file_utils.h"
+#include "mp2_index.h"
+#include "mtf.h"
+#include "o3d.h"
+#include "pcm.h"
+#include "wav.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Command line options:
+ * ======================================================== */
+
+enum {
+	DEFAULT_MIX_RATE    = 22050,
+	LOUDNESS_BLOCK_SIZE = 4096  // Frames converted at a time when no resampling is needed.
+};
+
+static const float DEFAULT_TARGET_DB = -20.0f;
+
+static struct {
+	float    targetDb;  // RMS level the loudness pass normalizes to.
+	uint32_t mixRate;   // Rate the sounds are measured at.
+	bool     loudness;
+	bool     verbose;
+} options;
+
+static void print_usage(const char * progName) {
+	printf(
+		"\n"
+		"Usage:\n"
+		"$ %s [-v] <mtf_archive>\n"
+		"  Builds the frame index of every MP2 file in the archive, reading the stored\n"
+		"  ones in place from a mapping of the archive, and prints what it found.\n"
+		"  -v prints each file: frames, duration, sample rate and bitrate.\n"
+		"\n"
+		"Usage:\n"
+		"$ %s -l [-t <dbfs>] [-r <rate>] [-v] <mtf_archive>\n"
+		"  Loudness pass over the WAV and SFX sounds of the archive: measures the peak\n"
+		"  and RMS of each one, resampled to the mix rate (-r, default %u Hz), straight\n"
+		"  from the archive, and prints the gain that brings it to the target RMS level\n"
+		"  (-t, default %.0f dBFS), limited so it doesn't clip. -v prints each sound.\n"
+		"\n"
+		"Usage:\n"
+		"$ %s -c <mtf_archive> <mp2_file> <start_seconds> <end_seconds> <output_file>\n"
+		"  Writes the frames of an MP2 file of the archive between two times to a new\n"
+		"  MP2 file, reading only those frames. Names are matched ignoring the case.\n"
+		"\n"
+		"Usage:\n"
+		"$ %s --help | -h\n"
+		"  Prints this help text.\n"
+		"\n",
+	progName, progName, (unsigned)DEFAULT_MIX_RATE, (double)DEFAULT_TARGET_DB, progName, progName);
+}
+
+/* ========================================================
+ * Helpers:
+ * ======================================================== */
+
+static bool same_entry_name(const char * a, const char * b) {
+	for (;; ++a, ++b) {
+		const int ca = (*a == '\\') ? '/' : tolower((unsigned char)*a);
+		const int cb = (*b == '\\') ? '/' : tolower((unsigned char)*b);
+		if (ca != cb) {
+			return false;
+		}
+		if (ca == '\0') {
+			return true;
+		}
+	}
+}
+
+/*
+ * Gets the bytes of an entry. Stored entries point straight into the archive
+ * mapping; compressed ones have to be decompressed first, and `*buffer` gets
+ * the heap copy (null for stored entries). `*inPlace` tells which.
+ */
+static bool entry_bytes(mtf_file_t * mtf, const file_map_t * map, const mtf_file_entry_t * entry,
+                        const uint8_t ** bytes, uint8_t ** buffer, bool * inPlace) {
+
+	bool compressed;
+	*bytes   = NULL;
+	*buffer  = NULL;
+	*inPlace = false;
+
+	// The MTF errors are static strings too, so they can be passed on as they are.
+	if (!mtf_file_entry_is_compressed(mtf, entry, &compressed)) {
+		return o3d_set_error(mtf_get_last_error());
+	}
+
+	if (!compressed) {
+		if ((uint64_t)entry->dataOffset + entry->decompressedSize > map->size) {
+			return o3d_set_error("MTF entry past the end of the archive!");
+		}
+		*bytes   = map->data + entry->dataOffset;
+		*inPlace = true;
+		return true;
+	}
+
+	if (!mtf_file_read_entry(mtf, entry, buffer)) {
+		return o3d_set_error("Failed to read MTF entry!");
+	}
+	*bytes = *buffer;
+	return true;
+}
+
+static bool index_entry(mtf_file_t * mtf, const file_map_t * map, const mtf_file_entry_t * entry,
+                        mp2_index_t * index, uint8_t ** buffer, bool * inPlace) {
+
+	const uint8_t * bytes;
+	if (!entry_bytes(mtf, map, entry, &bytes, buffer, inPlace)) {
+		return false;
+	}
+	return mp2_index_build(index, bytes, entry->decompressedSize);
+}
+
+/* ========================================================
+ * list_audio():
+ * ======================================================== */
+
+static int list_audio(const char * archiveName) {
+
+	mtf_file_t mtf;
+	file_map_t map;
+	memset(&map, 0, sizeof(map));
+
+	if (!mtf_file_open(&mtf, archiveName) || !file_map_open(&map, archiveName)) {
+		fprintf(stderr, "Can't open MTF archive \"%s\"!\n", archiveName);
+		file_map_close(&map);
+		mtf_file_close(&mtf);
+		return EXIT_FAILURE;
+	}
+
+	uint32_t fileCount    = 0;
+	uint32_t inPlaceCount = 0;
+	uint32_t failedCount  = 0;
+	uint64_t frameCount   = 0;
+	uint64_t audioBytes   = 0;
+	uint64_t indexBytes   = 0;
+	double   duration     = 0.0;
+
+	const double startTime = clock_seconds();
+
+	for (uint32_t e = 0; e < mtf.fileEntryCount; ++e) {
+		const mtf_file_entry_t * entry = &mtf.fileEntries[e];
+		if (!file_has_extension(entry->filename, ".MP2")) {
+			continue;
+		}
+
+		mp2_index_t index;
+		uint8_t * buffer;
+		bool inPlace;
+
+		if (!index_entry(&mtf, &map, entry, &index, &buffer, &inPlace)) {
+			fprintf(stderr, "Failed to index \"%s\": %s\n", entry->filename, o3d_get_last_error());
+			free(buffer);
+			failedCount++;
+			continue;
+		}
+
+		if (options.verbose) {
+			const uint32_t kbps = (uint32_t)(((double)(index.frameOffsets[index.frameCount] - index.frameOffsets[0]) * 8.0) /
+			                                 (mp2_index_duration(&index) * 1000.0) + 0.5);
+			printf("%s: %u frames, %.2f s, %u Hz %s, %u kbps%s%s\n", entry->filename, index.frameCount,
+			       mp2_index_duration(&index), index.sampleRate, (index.channels == 1) ? "mono" : "stereo",
+			       kbps, inPlace ? "" : ", compressed", (index.skippedBytes != 0) ? ", with junk/tags" : "");
+		}
+
+		fileCount++;
+		inPlaceCount += inPlace ? 1 : 0;
+		frameCount   += index.frameCount;
+		audioBytes   += entry->decompressedSize;
+		indexBytes   += (index.frameCount + 1) * sizeof(uint32_t);
+		duration     += mp2_index_duration(&index);
+
+		mp2_index_free(&index);
+		free(buffer);
+	}
+
+	const double endTime = clock_seconds();
+
+	printf("%u MP2 files indexed (%u read in place), %u failed, in %.3f s.\n",
+	       fileCount, inPlaceCount, failedCount, endTime - startTime);
+	printf("%llu frames, %.1f minutes of audio, %.2f MB of streams, %.1f KB of indexes.\n",
+	       (unsigned long long)frameCount, duration / 60.0, (double)audioBytes / (1024.0 * 1024.0),
+	       (double)indexBytes / 1024.0);
+
+	file_map_close(&map);
+	mtf_file_close(&mtf);
+	return (failedCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ========================================================
+ * clip_audio():
+ * ======================================================== */
+
+static int clip_audio(const char * archiveName, const char * entryName,
+                      double startTime, double endTime, const char * outputName) {
+
+	mtf_file_t mtf;
+	file_map_t map;
+	memset(&map, 0, sizeof(map));
+
+	if (!mtf_file_open(&mtf, archiveName) || !file_map_open(&map, archiveName)) {
+		fprintf(stderr, "Can't open MTF archive \"%s\"!\n", archiveName);
+		file_map_close(&map);
+		mtf_file_close(&mtf);
+		return EXIT_FAILURE;
+	}
+
+	const mtf_file_entry_t * entry = NULL;
+	for (uint32_t e = 0; e < mtf.fileEntryCount; ++e) {
+		if (same_entry_name(mtf.fileEntries[e].filename, entryName)) {
+			entry = &mtf.fileEntries[e];
+			break;
+		}
+	}
+
+	if (entry == NULL) {
+		fprintf(stderr, "No file \"%s\" in the archive!\n", entryName);
+		file_map_close(&map);
+		mtf_file_close(&mtf);
+		return EXIT_FAILURE;
+	}
+
+	mp2_index_t index;
+	uint8_t * buffer;
+	bool inPlace;
+	if (!index_entry(&mtf, &map, entry, &index, &buffer, &inPlace)) {
+		fprintf(stderr, "Failed to index \"%s\": %s\n", entry->filename, o3d_get_last_error());
+		free(buffer);
+		file_map_close(&map);
+		mtf_file_close(&mtf);
+		return EXIT_FAILURE;
+	}
+
+	// Whole frames covering [start, end).
+	const uint32_t firstFrame = mp2_index_frame_at(&index, startTime);
+	uint32_t lastFrame = mp2_index_frame_at(&index, endTime);
+	if (endTime > startTime && (lastFrame * mp2_index_frame_duration(&index)) < endTime) {
+		lastFrame++;
+	}
+	if (lastFrame <= firstFrame) {
+		lastFrame = firstFrame + 1;
+	}
+	if (lastFrame > index.frameCount) {
+		lastFrame = index.frameCount;
+	}
+
+	const uint32_t clipFrames = lastFrame - firstFrame;
+	uint32_t clipOffset = 0;
+	uint32_t clipSize   = 0;
+	mp2_index_frame_range(&index, firstFrame, clipFrames, &clipOffset, &clipSize);
+
+	int result = EXIT_FAILURE;
+	uint8_t * clip = malloc(clipSize);
+	FILE * outFile = NULL;
+
+	if (clip == NULL) {
+		fprintf(stderr, "Out of memory for %u bytes of frames!\n", clipSize);
+		goto BAIL;
+	}
+
+	// Stored entries: only the clipped frames are read, with one positional read.
+	if (inPlace) {
+		if (!mp2_index_read_frames(&index, mtf.osFileHandle, entry->dataOffset, firstFrame, clipFrames, clip)) {
+			fprintf(stderr, "%s\n", o3d_get_last_error());
+			goto BAIL;
+		}
+	} else {
+		memcpy(clip, buffer + clipOffset, clipSize);
+	}
+
+	outFile = fopen(outputName, "wb");
+	if (outFile == NULL || fwrite(clip, 1, clipSize, outFile) != clipSize) {
+		fprintf(stderr, "Can't write \"%s\"!\n", outputName);
+		goto BAIL;
+	}
+
+	printf("%s: frames %u to %u (%.3f s to %.3f s), %u bytes written to \"%s\".\n", entry->filename,
+	       firstFrame, lastFrame - 1, firstFrame * mp2_index_frame_duration(&index),
+	       lastFrame * mp2_index_frame_duration(&index), clipSize, outputName);
+	result = EXIT_SUCCESS;
+
+BAIL:
+	if (outFile != NULL) {
+		fclose(outFile);
+	}
+	free(clip);
+	mp2_index_free(&index);
+	free(buffer);
+	file_map_close(&map);
+	mtf_file_close(&mtf);
+	return result;
+}
+
+/* ========================================================
+ * loudness_pass():
+ * ======================================================== */
+
+// Scratch float buffers, reused from one sound to the next.
+typedef struct float_buffer {
+	float * data;
+	size_t  capacity;
+} float_buffer_t;
+
+static bool float_buffer_reserve(float_buffer_t * buffer, size_t count) {
+	if (count <= buffer->capacity) {
+		return true;
+	}
+	float * newData = realloc(buffer->data, count * sizeof(float));
+	if (newData == NULL) {
+		return o3d_set_error("Unable to realloc sample buffer!");
+	}
+	buffer->data     = newData;
+	buffer->capacity = count;
+	return true;
+}
+
+/*
+ * Peak and RMS of a sound as it will be mixed. At the mix rate, the frames
+ * go through a small block buffer straight from the view; otherwise the
+ * whole sound is converted, then resampled.
+ */
+static bool measure_sound(const wav_info_t * info, float_buffer_t * samples,
+                          float_buffer_t * resampled, pcm_levels_t * levels) {
+
+	memset(levels, 0, sizeof(*levels));
+
+	if (info->sampleRate == options.mixRate) {
+		if (!float_buffer_reserve(samples, (size_t)LOUDNESS_BLOCK_SIZE * info->channels)) {
+			return false;
+		}
+		for (uint32_t f = 0; f < info->frameCount; f += LOUDNESS_BLOCK_SIZE) {
+			const uint32_t count = (info->frameCount - f < LOUDNESS_BLOCK_SIZE) ? (info->frameCount - f) : LOUDNESS_BLOCK_SIZE;
+			pcm_to_float(info, f, count, samples->data);
+			pcm_levels_add(levels, samples->data, (size_t)count * info->channels);
+		}
+		return true;
+	}
+
+	const uint32_t mixFrames = pcm_resampled_frame_count(info->frameCount, info->sampleRate, options.mixRate);
+	if (!float_buffer_reserve(samples, (size_t)info->frameCount * info->channels) ||
+	    !float_buffer_reserve(resampled, (size_t)mixFrames * info->channels)) {
+		return false;
+	}
+
+	pcm_to_float(info, 0, info->frameCount, samples->data);
+	pcm_resample(samples->data, info->frameCount, info->channels, info->sampleRate, options.mixRate, resampled->data);
+	pcm_levels_add(levels, resampled->data, (size_t)mixFrames * info->channels);
+	return true;
+}
+
+static int loudness_pass(const char * archiveName) {
+
+	mtf_file_t mtf;
+	file_map_t map;
+	memset(&map, 0, sizeof(map));
+
+	if (!mtf_file_open(&mtf, archiveName) || !file_map_open(&map, archiveName)) {
+		fprintf(stderr, "Can't open MTF archive \"%s\"!\n", archiveName);
+		file_map_close(&map);
+		mtf_file_close(&mtf);
+		return EXIT_FAILURE;
+	}
+
+	float_buffer_t samples;
+	float_buffer_t resampled;
+	memset(&samples,   0, sizeof(samples));
+	memset(&resampled, 0, sizeof(resampled));
+
+	uint32_t soundCount   = 0;
+	uint32_t inPlaceCount = 0;
+	uint32_t skippedCount = 0;
+	uint32_t loudCount    = 0; // Limited by their peak.
+	uint32_t silentCount  = 0; // No gain would make these reach the target.
+	uint64_t pcmBytes     = 0;
+	double   duration     = 0.0;
+	double   gainSum      = 0.0;
+
+	const float peakLimitDb = 0.0f;
+	const double startTime  = clock_seconds();
+
+	for (uint32_t e = 0; e < mtf.fileEntryCount; ++e) {
+		const mtf_file_entry_t * entry = &mtf.fileEntries[e];
+		if (!file_has_extension(entry->filename, ".WAV") && !file_has_extension(entry->filename, ".SFX")) {
+			continue;
+		}
+
+		const uint8_t * bytes;
+		uint8_t * buffer;
+		bool inPlace;
+		wav_info_t info;
+		pcm_levels_t levels;
+
+		if (!entry_bytes(&mtf, &map, entry, &bytes, &buffer, &inPlace) ||
+		    !wav_read_info(&info, bytes, entry->decompressedSize) ||
+		    !measure_sound(&info, &samples, &resampled, &levels)) {
+			if (options.verbose) {
+				printf("%s: skipped, %s\n", entry->filename, o3d_get_last_error());
+			}
+			free(buffer);
+			skippedCount++;
+			continue;
+		}
+
+		soundCount++;
+		inPlaceCount += inPlace ? 1 : 0;
+		pcmBytes     += info.dataSize;
+		duration     += wav_duration(&info);
+
+		// Digital silence (what pcm_to_decibels() calls -200 dB) has no gain to speak of.
+		if (levels.peak <= 1e-10f) {
+			if (options.verbose) {
+				printf("%s: %u Hz %u bits %s, %.2f s, silent%s\n",
+				       entry->filename, info.sampleRate, info.bitsPerSample, (info.channels == 1) ? "mono" : "stereo",
+				       wav_duration(&info), info.truncated ? ", truncated" : "");
+			}
+			silentCount++;
+			free(buffer);
+			continue;
+		}
+
+		// Gain to the target RMS, but never past full scale at the peak.
+		const float peakDb = pcm_to_decibels(levels.peak);
+		const float rmsDb  = pcm_to_decibels(pcm_levels_rms(&levels));
+		float gainDb = options.targetDb - rmsDb;
+		const bool limited = (peakDb + gainDb > peakLimitDb);
+		if (limited) {
+			gainDb = peakLimitDb - peakDb;
+		}
+
+		if (options.verbose) {
+			printf("%s: %u Hz %u bits %s, %.2f s, peak %.1f dB, RMS %.1f dB, gain %+.1f dB%s%s\n",
+			       entry->filename, info.sampleRate, info.bitsPerSample, (info.channels == 1) ? "mono" : "stereo",
+			       wav_duration(&info), peakDb, rmsDb, gainDb, limited ? " (peak limited)" : "",
+			       info.truncated ? ", truncated" : "");
+		}
+
+		loudCount += limited ? 1 : 0;
+		gainSum   += gainDb;
+		free(buffer);
+	}
+
+	const double endTime = clock_seconds();
+
+	printf("%u sounds measured (%u read in place), %u skipped, in %.3f s.\n",
+	       soundCount, inPlaceCount, skippedCount, endTime - startTime);
+	if (soundCount != 0) {
+		printf("%.1f minutes of audio, %.2f MB of PCM, at %u Hz.\n",
+		       duration / 60.0, (double)pcmBytes / (1024.0 * 1024.0), options.mixRate);
+	}
+	if (soundCount > silentCount) {
+		printf("Target %.1f dBFS RMS: average gain %+.1f dB, %u sounds limited by their peak.\n",
+		       (double)options.targetDb, gainSum / (soundCount - silentCount), loudCount);
+	}
+	if (silentCount != 0) {
+		printf("%u silent sounds, left out of the gain.\n", silentCount);
+	}
+
+	free(samples.data);
+	free(resampled.data);
+	file_map_close(&map);
+	mtf_file_close(&mtf);
+	return EXIT_SUCCESS;
+}
+
+/* ========================================================
+ * main():
+ * ======================================================== */
+
+int main(int argc, const char * argv[]) {
+
+	if (argc < 2) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Printing help is not treated as an error.
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+		print_usage(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	if (strcmp(argv[1], "-c") == 0) {
+		if (argc != 7) {
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		return clip_audio(argv[2], argv[3], atof(argv[4]), atof(argv[5]), argv[6]);
+	}
+
+	options.targetDb = DEFAULT_TARGET_DB;
+	options.mixRate  = DEFAULT_MIX_RATE;
+	options.loudness = false;
+	options.verbose  = false;
+
+	int argIndex = 1;
+	for (; argIndex < argc - 1; ++argIndex) {
+		if (strcmp(argv[argIndex], "-v") == 0) {
+			options.verbose = true;
+		} else if (strcmp(argv[argIndex], "-l") == 0) {
+			options.loudness = true;
+		} else if (strcmp(argv[argIndex], "-t") == 0 && (argIndex + 1) < argc - 1) {
+			options.targetDb = (float)atof(argv[++argIndex]);
+		} else if (strcmp(argv[argIndex], "-r") == 0 && (argIndex + 1) < argc - 1) {
+			const int rate = atoi(argv[++argIndex]);
+			options.mixRate = (rate > 0) ? (uint32_t)rate : DEFAULT_MIX_RATE;
+		} else {
+			break;
+		}
+	}
+
+	if (argIndex != argc - 1) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	return options.loudness ? loudness_pass(argv[argIndex]) : list_audio(argv[argIndex]);
+}
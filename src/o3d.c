@@ -22,14 +22,21 @@
 #include <string.h>
 
 /* ========================================================
- * o3d_get_last_error()/o3d_error():
+ * o3d_get_last_error()/o3d_set_error():
  * ======================================================== */
 
-// Some compilers have Thread Local Storage support
-// which can be used to make this error string thread
-// safe, so that parallel file processing wouldn't step
-// in each other's toes when reporting errors...
-static const char * o3dLastErrorStr = "";
+// The error string is Thread Local where the compiler
+// supports it, so that parallel file processing doesn't
+// step in each other's toes when reporting errors...
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+	#define O3D_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+	#define O3D_THREAD_LOCAL __thread
+#else
+	#define O3D_THREAD_LOCAL
+#endif
+
+static O3D_THREAD_LOCAL const char * o3dLastErrorStr = "";
 
 static inline bool o3d_error(const char * message) {
 	o3dLastErrorStr = (message != NULL) ? message : "";
@@ -37,6 +44,10 @@ static inline bool o3d_error(const char * message) {
 	return false;
 }
 
+bool o3d_set_error(const char * message) {
+	return o3d_error(message);
+}
+
 const char * o3d_get_last_error(void) {
 	const char * err = o3dLastErrorStr;
 	o3dLastErrorStr = "";
@@ -121,11 +132,163 @@ static inline bool o3d_read32(FILE * fileIn, uint32_t * iword) {
 	return true;
 }
 
+/* ========================================================
+ * o3d_arena_*():
+ * ======================================================== */
+
+struct o3d_arena_block {
+	o3d_arena_block_t * next;
+	size_t              size;  // Usable bytes after the header.
+	size_t              used;
+};
+
+enum { O3D_ARENA_ALIGNMENT = 16 };
+
+static inline uint8_t * o3d_arena_block_data(o3d_arena_block_t * block) {
+	return (uint8_t *)(block + 1);
+}
+
+// Offset of the next aligned allocation in the block.
+static inline size_t o3d_arena_block_top(o3d_arena_block_t * block) {
+	const uintptr_t base = (uintptr_t)o3d_arena_block_data(block);
+	const uintptr_t top  = (base + block->used + (O3D_ARENA_ALIGNMENT - 1)) & ~(uintptr_t)(O3D_ARENA_ALIGNMENT - 1);
+	return (size_t)(top - base);
+}
+
+void o3d_arena_init(o3d_arena_t * arena, size_t blockSize) {
+	assert(arena != NULL);
+	memset(arena, 0, sizeof(*arena));
+	arena->blockSize = (blockSize != 0) ? blockSize : O3D_ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+void o3d_arena_free(o3d_arena_t * arena) {
+	if (arena == NULL) {
+		return;
+	}
+
+	o3d_arena_block_t * block = arena->first;
+	while (block != NULL) {
+		o3d_arena_block_t * next = block->next;
+		free(block);
+		block = next;
+	}
+
+	const size_t blockSize = arena->blockSize;
+	memset(arena, 0, sizeof(*arena));
+	arena->blockSize = blockSize;
+}
+
+void o3d_arena_reset(o3d_arena_t * arena) {
+	assert(arena != NULL);
+
+	for (o3d_arena_block_t * block = arena->first; block != NULL; block = block->next) {
+		block->used = 0;
+	}
+	arena->current   = arena->first;
+	arena->bytesUsed = 0;
+}
+
+void * o3d_arena_alloc(o3d_arena_t * arena, size_t size) {
+	assert(arena != NULL);
+
+	if (arena->blockSize == 0) {
+		arena->blockSize = O3D_ARENA_DEFAULT_BLOCK_SIZE;
+	}
+
+	// Blocks past the current one are always empty. The tail
+	// of the current is wasted if the allocation doesn't fit.
+	o3d_arena_block_t * last = NULL;
+	for (o3d_arena_block_t * block = arena->current; block != NULL; block = block->next) {
+		const size_t top = o3d_arena_block_top(block);
+		if (top <= block->size && size <= block->size - top) {
+			arena->current    = block;
+			arena->bytesUsed += (top - block->used) + size;
+			block->used       = top + size;
+			return o3d_arena_block_data(block) + top;
+		}
+		last = block;
+	}
+
+	const size_t dataSize = (size + O3D_ARENA_ALIGNMENT > arena->blockSize) ? (size + O3D_ARENA_ALIGNMENT) : arena->blockSize;
+	o3d_arena_block_t * block = malloc(sizeof(*block) + dataSize);
+	if (block == NULL) {
+		return NULL;
+	}
+
+	block->next = NULL;
+	block->size = dataSize;
+	block->used = 0;
+
+	// Current is only null while there are no blocks.
+	if (last != NULL) {
+		last->next = block;
+	} else {
+		assert(arena->first == NULL);
+		arena->first = block;
+	}
+
+	arena->blockCount++;
+	arena->current = block;
+
+	const size_t top  = o3d_arena_block_top(block);
+	arena->bytesUsed += top + size;
+	block->used       = top + size;
+	return o3d_arena_block_data(block) + top;
+}
+
+// Gives back everything allocated since the mark, for a failed load.
+static void o3d_arena_rewind(o3d_arena_t * arena, o3d_arena_block_t * markBlock, size_t markUsed, size_t markBytes) {
+	o3d_arena_block_t * block = (markBlock != NULL) ? markBlock->next : arena->first;
+	for (; block != NULL; block = block->next) {
+		block->used = 0;
+	}
+	if (markBlock != NULL) {
+		markBlock->used = markUsed;
+	}
+	arena->current   = (markBlock != NULL) ? markBlock : arena->first;
+	arena->bytesUsed = markBytes;
+}
+
+/* ========================================================
+ * o3d_alloc_model_block():
+ * ======================================================== */
+
+static inline size_t o3d_model_block_size(uint32_t vertexCount, uint32_t faceCount) {
+	return ((size_t)vertexCount * sizeof(o3d_vertex_t)) + ((size_t)faceCount * sizeof(o3d_face_t));
+}
+
+// Allocates the vertexes + faces block and points the model into it.
+static uint8_t * o3d_alloc_model_block(o3d_model_t * o3d, uint32_t vertexCount, uint32_t faceCount, o3d_arena_t * arena) {
+	const size_t blockBytes = o3d_model_block_size(vertexCount, faceCount);
+
+	uint8_t * block;
+	if (arena != NULL) {
+		block = o3d_arena_alloc(arena, blockBytes);
+	} else {
+		block = malloc(blockBytes);
+		o3d->memBlock = block;
+	}
+
+	if (block == NULL) {
+		return NULL;
+	}
+
+	o3d->vertexes    = (o3d_vertex_t *)block;
+	o3d->faces       = (o3d_face_t *)(block + ((size_t)vertexCount * sizeof(o3d_vertex_t)));
+	o3d->vertexCount = vertexCount;
+	o3d->faceCount   = faceCount;
+	return block;
+}
+
 /* ========================================================
  * o3d_load_from_file():
  * ======================================================== */
 
 bool o3d_load_from_file(o3d_model_t * o3d, const char * filename) {
+	return o3d_load_from_file_ex(o3d, filename, NULL);
+}
+
+bool o3d_load_from_file_ex(o3d_model_t * o3d, const char * filename, o3d_arena_t * arena) {
 	assert(o3d != NULL);
 	assert(filename != NULL && *filename != '\0');
 
@@ -133,6 +296,8 @@ bool o3d_load_from_file(o3d_model_t * o3d, const char * filename) {
 	assert(sizeof(o3d_face_t)   == 50);
 	assert(sizeof(o3d_vertex_t) == 12);
 
+	memset(o3d, 0, sizeof(*o3d));
+
 	FILE * fileIn = fopen(filename, "rb");
 	if (fileIn == NULL) {
 		return o3d_error("Can't open input O3D file!");
@@ -143,42 +308,52 @@ bool o3d_load_from_file(o3d_model_t * o3d, const char * filename) {
 	uint32_t unknown     = 0;
 
 	if (!o3d_read32(fileIn, &vertexCount)) {
+		fclose(fileIn);
 		return o3d_error("Can't read vertex count!");
 	}
 
 	if (!o3d_read32(fileIn, &faceCount)) {
+		fclose(fileIn);
 		return o3d_error("Can't read face count!");
 	}
 
+	if (vertexCount == 0) {
+		fclose(fileIn);
+		return o3d_error("O3D model has no vertexes!");
+	}
+
 	// Two 32bit words of unknown contents follow.
 	o3d_read32(fileIn, &unknown);
 	o3d_read32(fileIn, &unknown);
 
-	o3d->vertexes = malloc(vertexCount * sizeof(o3d->vertexes[0]));
-	if (o3d->vertexes == NULL) {
-		o3d_free(o3d);
-		return o3d_error("Unable to malloc model vertexes!");
-	}
+	// The vertexes and faces are stored back-to-back in the
+	// file, so they share one allocation and a single read.
+	const size_t blockBytes = o3d_model_block_size(vertexCount, faceCount);
 
-	o3d->faces = malloc(faceCount * sizeof(o3d->faces[0]));
-	if (o3d->faces == NULL) {
-		o3d_free(o3d);
-		return o3d_error("Unable to malloc model faces!");
-	}
+	o3d_arena_block_t * markBlock = NULL;
+	size_t markUsed  = 0;
+	size_t markBytes = 0;
 
-	o3d->vertexCount = vertexCount;
-	o3d->faceCount   = faceCount;
+	if (arena != NULL) {
+		markBlock = arena->current;
+		markUsed  = (markBlock != NULL) ? markBlock->used : 0;
+		markBytes = arena->bytesUsed;
+	}
 
-	// Next up is the vertex packet:
-	if (fread(o3d->vertexes, sizeof(o3d->vertexes[0]), vertexCount, fileIn) != vertexCount) {
-		o3d_free(o3d);
-		return o3d_error("Failed to read model vertexes!");
+	uint8_t * block = o3d_alloc_model_block(o3d, vertexCount, faceCount, arena);
+	if (block == NULL) {
+		fclose(fileIn);
+		return o3d_error("Unable to malloc model data!");
 	}
 
-	// Model faces follow immediately:
-	if (fread(o3d->faces, sizeof(o3d->faces[0]), faceCount, fileIn) != faceCount) {
+	// Vertex packet, then the model faces immediately after:
+	if (fread(block, 1, blockBytes, fileIn) != blockBytes) {
+		fclose(fileIn);
+		if (arena != NULL) {
+			o3d_arena_rewind(arena, markBlock, markUsed, markBytes);
+		}
 		o3d_free(o3d);
-		return o3d_error("Failed to read model faces!");
+		return o3d_error("Failed to read model vertexes and faces!");
 	}
 
 	// Axis-Aligned bounds and center point / center of mass:
@@ -189,6 +364,47 @@ bool o3d_load_from_file(o3d_model_t * o3d, const char * filename) {
 	return true;
 }
 
+/* ========================================================
+ * o3d_load_from_memory():
+ * ======================================================== */
+
+bool o3d_load_from_memory(o3d_model_t * o3d, const void * data, size_t size, o3d_arena_t * arena) {
+	assert(o3d != NULL);
+	assert(data != NULL || size == 0);
+
+	memset(o3d, 0, sizeof(*o3d));
+
+	// Same layout as the file: vertex count, face count,
+	// two unknown words, then the vertexes and faces.
+	uint32_t header[4];
+	if (size < sizeof(header)) {
+		return o3d_error("O3D data too small for the header!");
+	}
+	memcpy(header, data, sizeof(header));
+
+	const uint32_t vertexCount = header[0];
+	const uint32_t faceCount   = header[1];
+
+	if (vertexCount == 0) {
+		return o3d_error("O3D model has no vertexes!");
+	}
+
+	// Validated before allocating, so there's nothing to give back on failure.
+	const uint64_t blockBytes = ((uint64_t)vertexCount * sizeof(o3d_vertex_t)) + ((uint64_t)faceCount * sizeof(o3d_face_t));
+	if (blockBytes > size - sizeof(header)) {
+		return o3d_error("O3D data is truncated!");
+	}
+
+	uint8_t * block = o3d_alloc_model_block(o3d, vertexCount, faceCount, arena);
+	if (block == NULL) {
+		return o3d_error("Unable to malloc model data!");
+	}
+
+	memcpy(block, (const uint8_t *)data + sizeof(header), (size_t)blockBytes);
+	o3d_compute_aabb_center_pt(o3d);
+	return true;
+}
+
 /* ========================================================
  * o3d_free():
  * ======================================================== */
@@ -198,17 +414,14 @@ void o3d_free(o3d_model_t * o3d) {
 		return;
 	}
 
-	if (o3d->vertexes != NULL) {
-		free(o3d->vertexes);
-		o3d->vertexes = NULL;
-		o3d->vertexCount = 0;
-	}
+	// Null for arena models. The vertexes and faces point into it.
+	free(o3d->memBlock);
 
-	if (o3d->faces != NULL) {
-		free(o3d->faces);
-		o3d->faces = NULL;
-		o3d->faceCount = 0;
-	}
+	o3d->memBlock    = NULL;
+	o3d->vertexes    = NULL;
+	o3d->faces       = NULL;
+	o3d->vertexCount = 0;
+	o3d->faceCount   = 0;
 
 	o3d_clear_aabb_center_pt(o3d);
 }
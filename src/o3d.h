@@ -18,6 +18,7 @@
 #define DARKSTONE_O3D_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* ========================================================
@@ -95,6 +96,10 @@ typedef struct o3d_face {
 // face.index[3] will be set to this value for a triangle.
 enum { O3D_INVALID_FACE_INDEX = UINT16_MAX };
 
+// Multiply the raw face texture coordinates by this
+// to get normalized [0,1] UVs (see o3d_face_t::texCoords).
+#define O3D_TEXCOORD_SCALE (1.0f / 256.0f)
+
 /*
  * Axis Aligned Bounding Box computed from
  * the model vertexes. This is not read from
@@ -107,10 +112,16 @@ typedef struct o3d_aabb {
 
 /*
  * A complete O3D model.
+ *
+ * The vertexes and faces share a single allocation, sized from the
+ * file header: `memBlock`, with the faces right after the vertexes.
+ * If the model was loaded into an arena, `memBlock` is null and the
+ * memory belongs to the arena instead.
  */
 typedef struct o3d_model {
 	o3d_vertex_t * vertexes;
 	o3d_face_t   * faces;
+	void         * memBlock;
 	uint32_t       vertexCount;
 	uint32_t       faceCount;
 	o3d_aabb_t     aabb;
@@ -119,6 +130,24 @@ typedef struct o3d_model {
 
 #pragma pack (pop)
 
+/*
+ * Bump allocator for loading many models at once (e.g. all the models
+ * of a level). Memory is taken from large blocks, chained as needed,
+ * and only given back all at once by o3d_arena_reset()/o3d_arena_free(),
+ * so there's no need to o3d_free() each model loaded into it.
+ */
+typedef struct o3d_arena_block o3d_arena_block_t;
+typedef struct o3d_arena {
+	o3d_arena_block_t * first;
+	o3d_arena_block_t * current;    // Allocating from this one. Following blocks are free.
+	size_t              blockSize;  // Of new blocks. Larger allocations get a block of their own.
+	size_t              bytesUsed;  // Allocated since the last reset.
+	uint32_t            blockCount;
+} o3d_arena_t;
+
+// Default o3d_arena_t::blockSize if zero is given to o3d_arena_init().
+enum { O3D_ARENA_DEFAULT_BLOCK_SIZE = 1024 * 1024 };
+
 /* ========================================================
  * Model importer functions:
  * ======================================================== */
@@ -132,11 +161,52 @@ typedef struct o3d_model {
  */
 bool o3d_load_from_file(o3d_model_t * o3d, const char * filename);
 
+/*
+ * Same as o3d_load_from_file(), but the model memory comes from `arena`
+ * if not null. The model is then valid until the arena is reset or freed.
+ * A failed load gives back the arena memory it took.
+ */
+bool o3d_load_from_file_ex(o3d_model_t * o3d, const char * filename, o3d_arena_t * arena);
+
+/*
+ * Same as o3d_load_from_file_ex(), but parses a model already in memory, such
+ * as an MTF archive entry (see mtf_file_read_entry()). The vertexes and faces
+ * are copied, so `data` can be freed right after.
+ */
+bool o3d_load_from_memory(o3d_model_t * o3d, const void * data, size_t size, o3d_arena_t * arena);
+
 /*
  * Cleanup a model previously importer by o3d_load_from_file().
+ * For models in an arena this only clears the struct.
  */
 void o3d_free(o3d_model_t * o3d);
 
+/* ========================================================
+ * Arena functions:
+ * ======================================================== */
+
+/*
+ * Sets up an empty arena. Blocks are only allocated when first needed.
+ * Zero `blockSize` for O3D_ARENA_DEFAULT_BLOCK_SIZE.
+ */
+void o3d_arena_init(o3d_arena_t * arena, size_t blockSize);
+
+/*
+ * Frees all the blocks. Every model loaded into the arena becomes invalid.
+ */
+void o3d_arena_free(o3d_arena_t * arena);
+
+/*
+ * Makes all the memory available again without freeing the blocks.
+ * Every model loaded into the arena becomes invalid.
+ */
+void o3d_arena_reset(o3d_arena_t * arena);
+
+/*
+ * Allocates `size` bytes aligned to 16. Null if out of memory.
+ */
+void * o3d_arena_alloc(o3d_arena_t * arena, size_t size);
+
 /*
  * o3d_load_from_file() will set a global string with
  * an error description if something goes wrong. You can
@@ -147,4 +217,12 @@ void o3d_free(o3d_model_t * o3d);
  */
 const char * o3d_get_last_error(void);
 
+/*
+ * Sets the error string returned by o3d_get_last_error().
+ * Used by the other o3d_* modules to report errors through
+ * the same channel. `message` must be a string literal or
+ * otherwise outlive the call. Always returns false.
+ */
+bool o3d_set_error(const char * message);
+
 #endif // DARKSTONE_O3D_H
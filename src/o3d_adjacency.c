@@ -0,0 +1,263 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_adjacency.c
+ * Created on: 17/10/26
+ * Brief: Half-edge face adjacency for O3D models with mixed triangle and quadrilateral faces.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_adjacency.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Edge key radix sort:
+ * ======================================================== */
+
+//
+// Undirected edge key: lower vertex in the high 16 bits. O3D
+// indexes are 16 bits, so the pair always fits in 32 bits.
+//
+static inline uint32_t adj_edge_key(uint32_t a, uint32_t b) {
+	return (a < b) ? ((a << 16) | b) : ((b << 16) | a);
+}
+
+//
+// LSD radix sort of the (key, half-edge) pairs, 8 bits per pass.
+// Passes where every key has the same digit are skipped, which is
+// common for the upper bytes of small models. Stable, so the edges
+// of each key stay in half-edge order. Returns the sorted buffers.
+//
+static void adj_radix_sort(uint32_t ** keys, uint32_t ** values, uint32_t ** tempKeys,
+                           uint32_t ** tempValues, uint32_t count) {
+	uint32_t counts[256];
+
+	for (uint32_t shift = 0; shift < 32; shift += 8) {
+		memset(counts, 0, sizeof(counts));
+
+		const uint32_t * srcKeys = *keys;
+		for (uint32_t i = 0; i < count; ++i) {
+			counts[(srcKeys[i] >> shift) & 0xFF]++;
+		}
+		if (counts[(srcKeys[0] >> shift) & 0xFF] == count) {
+			continue;
+		}
+
+		uint32_t sum = 0;
+		for (uint32_t d = 0; d < 256; ++d) {
+			const uint32_t c = counts[d];
+			counts[d] = sum;
+			sum += c;
+		}
+
+		const uint32_t * srcValues = *values;
+		uint32_t * dstKeys   = *tempKeys;
+		uint32_t * dstValues = *tempValues;
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t pos = counts[(srcKeys[i] >> shift) & 0xFF]++;
+			dstKeys[pos]   = srcKeys[i];
+			dstValues[pos] = srcValues[i];
+		}
+
+		// Swap the buffers.
+		uint32_t * t;
+		t = *keys;   *keys   = *tempKeys;   *tempKeys   = t;
+		t = *values; *values = *tempValues; *tempValues = t;
+	}
+}
+
+/* ========================================================
+ * o3d_adjacency_build_from_streams():
+ * ======================================================== */
+
+bool o3d_adjacency_build_from_streams(o3d_adjacency_t * adj, const o3d_face_streams_t * streams, uint32_t vertexCount) {
+	assert(adj     != NULL);
+	assert(streams != NULL);
+	assert(vertexCount <= 65536);
+
+	memset(adj, 0, sizeof(*adj));
+
+	const uint32_t faceCount = streams->faceCount;
+	adj->faceCount   = faceCount;
+	adj->vertexCount = vertexCount;
+
+	adj->faceFirstEdge = malloc(((size_t)faceCount + 1) * sizeof(adj->faceFirstEdge[0]));
+	adj->vertexEdge    = malloc(((size_t)vertexCount + 1) * sizeof(adj->vertexEdge[0]));
+	if (adj->faceFirstEdge == NULL || adj->vertexEdge == NULL) {
+		o3d_adjacency_free(adj);
+		return o3d_set_error("Unable to malloc adjacency!");
+	}
+
+	// Count the half-edges of the valid faces first.
+	uint32_t halfEdgeCount = 0;
+	for (uint32_t f = 0; f < faceCount; ++f) {
+		uint8_t corners[4];
+		const uint32_t cornerCount = o3d_face_corners(&streams->indexes[f], vertexCount, corners);
+		adj->faceFirstEdge[f] = halfEdgeCount;
+		if (cornerCount != 0) {
+			halfEdgeCount += cornerCount;
+		} else {
+			adj->invalidFaceCount++;
+		}
+	}
+	adj->faceFirstEdge[faceCount] = halfEdgeCount;
+	adj->halfEdgeCount = halfEdgeCount;
+
+	if (halfEdgeCount == 0) {
+		o3d_adjacency_free(adj);
+		return o3d_set_error("Model has no valid faces!");
+	}
+
+	adj->edgeOrigin = malloc(halfEdgeCount * sizeof(adj->edgeOrigin[0]));
+	adj->edgeFace   = malloc(halfEdgeCount * sizeof(adj->edgeFace[0]));
+	adj->edgeTwin   = malloc(halfEdgeCount * sizeof(adj->edgeTwin[0]));
+
+	// Sort buffers. Two sets, the radix sort ping-pongs between them.
+	uint32_t * sortMemory = malloc((size_t)halfEdgeCount * 4 * sizeof(uint32_t));
+
+	if (adj->edgeOrigin == NULL || adj->edgeFace == NULL || adj->edgeTwin == NULL || sortMemory == NULL) {
+		free(sortMemory);
+		o3d_adjacency_free(adj);
+		return o3d_set_error("Unable to malloc adjacency!");
+	}
+
+	uint32_t * keys       = sortMemory;
+	uint32_t * values     = keys   + halfEdgeCount;
+	uint32_t * tempKeys   = values + halfEdgeCount;
+	uint32_t * tempValues = tempKeys + halfEdgeCount;
+
+	for (uint32_t f = 0; f < faceCount; ++f) {
+		const uint32_t first = adj->faceFirstEdge[f];
+		const uint32_t count = adj->faceFirstEdge[f + 1] - first;
+		if (count == 0) {
+			continue;
+		}
+
+		// Around the corners left after collapsing the repeated ones.
+		const o3d_face_indexes_t * face = &streams->indexes[f];
+		uint8_t corners[4];
+		o3d_face_corners(face, vertexCount, corners);
+
+		for (uint32_t c = 0; c < count; ++c) {
+			const uint32_t e = first + c;
+			const uint32_t a = face->index[corners[c]];
+			const uint32_t b = face->index[corners[(c + 1 == count) ? 0 : (c + 1)]];
+
+			adj->edgeOrigin[e] = a;
+			adj->edgeFace[e]   = f;
+			adj->edgeTwin[e]   = O3D_ADJ_BORDER;
+			keys[e]   = adj_edge_key(a, b);
+			values[e] = e;
+		}
+	}
+
+	adj_radix_sort(&keys, &values, &tempKeys, &tempValues, halfEdgeCount);
+
+	// Runs of the same key are the half-edges of one undirected edge.
+	// The non-manifold list reuses the spare sort buffer; there are
+	// never more non-manifold edges than half-edges.
+	uint32_t * nonManifold = tempKeys;
+	uint32_t nonManifoldCount = 0;
+
+	for (uint32_t i = 0; i < halfEdgeCount; ) {
+		uint32_t end = i + 1;
+		while (end < halfEdgeCount && keys[end] == keys[i]) {
+			++end;
+		}
+
+		const uint32_t run = end - i;
+		adj->edgeCount++;
+
+		if (run == 1) {
+			adj->borderEdgeCount++;
+		} else {
+			const uint32_t e0 = values[i];
+			const uint32_t e1 = values[i + 1];
+			if (run == 2 && adj->edgeOrigin[e0] != adj->edgeOrigin[e1]) {
+				adj->edgeTwin[e0] = e1;
+				adj->edgeTwin[e1] = e0;
+			} else {
+				for (uint32_t k = i; k < end; ++k) {
+					adj->edgeTwin[values[k]] = O3D_ADJ_NON_MANIFOLD;
+				}
+				nonManifold[nonManifoldCount++] = e0;
+			}
+		}
+
+		i = end;
+	}
+
+	if (nonManifoldCount != 0) {
+		adj->nonManifoldEdges = malloc(nonManifoldCount * sizeof(adj->nonManifoldEdges[0]));
+		if (adj->nonManifoldEdges == NULL) {
+			free(sortMemory);
+			o3d_adjacency_free(adj);
+			return o3d_set_error("Unable to malloc adjacency!");
+		}
+		memcpy(adj->nonManifoldEdges, nonManifold, nonManifoldCount * sizeof(nonManifold[0]));
+		adj->nonManifoldEdgeCount = nonManifoldCount;
+	}
+
+	free(sortMemory);
+
+	// One outgoing half-edge per vertex. Border ones win, so that walking
+	// around a border vertex can start at one end of its fan.
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		adj->vertexEdge[v] = O3D_ADJ_NONE;
+	}
+	for (uint32_t e = 0; e < halfEdgeCount; ++e) {
+		uint32_t * slot = &adj->vertexEdge[adj->edgeOrigin[e]];
+		if (*slot == O3D_ADJ_NONE || adj->edgeTwin[e] == O3D_ADJ_BORDER) {
+			*slot = e;
+		}
+	}
+
+	return true;
+}
+
+/* ========================================================
+ * o3d_build_adjacency():
+ * ======================================================== */
+
+bool o3d_build_adjacency(o3d_adjacency_t * adj, const o3d_model_t * o3d) {
+	assert(adj != NULL);
+	assert(o3d != NULL);
+
+	memset(adj, 0, sizeof(*adj));
+
+	o3d_face_streams_t streams;
+	if (!o3d_face_streams_build(&streams, o3d, NULL)) {
+		return false;
+	}
+
+	const bool success = o3d_adjacency_build_from_streams(adj, &streams, o3d->vertexCount);
+	o3d_face_streams_free(&streams);
+	return success;
+}
+
+/* ========================================================
+ * o3d_adjacency_free():
+ * ======================================================== */
+
+void o3d_adjacency_free(o3d_adjacency_t * adj) {
+	if (adj == NULL) {
+		return;
+	}
+
+	free(adj->faceFirstEdge);
+	free(adj->edgeOrigin);
+	free(adj->edgeFace);
+	free(adj->edgeTwin);
+	free(adj->vertexEdge);
+	free(adj->nonManifoldEdges);
+	memset(adj, 0, sizeof(*adj));
+}
@@ -0,0 +1,108 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_adjacency.h
+ * Created on: 17/10/26
+ * Brief: Half-edge face adjacency for O3D models with mixed triangle and quadrilateral faces.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_ADJACENCY_H
+#define DARKSTONE_O3D_ADJACENCY_H
+
+#include "o3d.h"
+#include "o3d_faces.h"
+
+/* ========================================================
+ * Half-edge structure:
+ * ======================================================== */
+
+/*
+ * Each face has one half-edge per corner, going from that corner to the
+ * next, stored contiguously: the half-edges of face f are the range
+ * [faceFirstEdge[f], faceFirstEdge[f + 1]). Invalid faces have none.
+ * Faces are not split, quads keep their 4 edges. Repeated corners are
+ * collapsed first (o3d_face_corners()), so a quad a,b,c,c has 3 edges.
+ */
+typedef struct o3d_adjacency {
+	uint32_t * faceFirstEdge;     // faceCount + 1 entries.
+	uint32_t * edgeOrigin;        // Per half-edge: vertex it starts at.
+	uint32_t * edgeFace;          // Per half-edge: face it belongs to.
+	uint32_t * edgeTwin;          // Per half-edge: opposite half-edge, or O3D_ADJ_BORDER / O3D_ADJ_NON_MANIFOLD.
+	uint32_t * vertexEdge;        // Per vertex: an outgoing half-edge (a border one if any), or O3D_ADJ_NONE.
+	uint32_t * nonManifoldEdges;  // One half-edge of each non-manifold edge.
+	uint32_t   faceCount;
+	uint32_t   vertexCount;
+	uint32_t   halfEdgeCount;
+	uint32_t   edgeCount;         // Undirected edges.
+	uint32_t   borderEdgeCount;
+	uint32_t   nonManifoldEdgeCount;
+	uint32_t   invalidFaceCount;
+} o3d_adjacency_t;
+
+// Special edgeTwin / vertexEdge values.
+enum {
+	O3D_ADJ_NONE         = UINT32_MAX,
+	O3D_ADJ_BORDER       = UINT32_MAX,     // Edge used by a single face.
+	O3D_ADJ_NON_MANIFOLD = UINT32_MAX - 1  // Edge used by 3+ faces, or twice in the same direction.
+};
+
+/* ========================================================
+ * Adjacency functions:
+ * ======================================================== */
+
+/*
+ * Builds the half-edges of a model. Edges are matched by radix sorting
+ * their vertex pairs, so this is linear in the number of faces.
+ * Non-manifold edges are reported in `nonManifoldEdges` and left unlinked.
+ * You can still call o3d_adjacency_free() even if this fails.
+ */
+bool o3d_build_adjacency(o3d_adjacency_t * adj, const o3d_model_t * o3d);
+
+/*
+ * Same, from split face streams (only the index stream is read).
+ */
+bool o3d_adjacency_build_from_streams(o3d_adjacency_t * adj, const o3d_face_streams_t * streams, uint32_t vertexCount);
+
+/*
+ * Frees all the arrays.
+ */
+void o3d_adjacency_free(o3d_adjacency_t * adj);
+
+/*
+ * Next/previous half-edge around the same face.
+ */
+static inline uint32_t o3d_adjacency_next(const o3d_adjacency_t * adj, uint32_t edge) {
+	const uint32_t face  = adj->edgeFace[edge];
+	const uint32_t first = adj->faceFirstEdge[face];
+	return (edge + 1 < adj->faceFirstEdge[face + 1]) ? (edge + 1) : first;
+}
+
+static inline uint32_t o3d_adjacency_prev(const o3d_adjacency_t * adj, uint32_t edge) {
+	const uint32_t face  = adj->edgeFace[edge];
+	const uint32_t first = adj->faceFirstEdge[face];
+	return (edge > first) ? (edge - 1) : (adj->faceFirstEdge[face + 1] - 1);
+}
+
+/*
+ * Vertex the half-edge points to.
+ */
+static inline uint32_t o3d_adjacency_dest(const o3d_adjacency_t * adj, uint32_t edge) {
+	return adj->edgeOrigin[o3d_adjacency_next(adj, edge)];
+}
+
+/*
+ * Face on the other side of the edge, or O3D_ADJ_NONE if border or non-manifold.
+ */
+static inline uint32_t o3d_adjacency_neighbor(const o3d_adjacency_t * adj, uint32_t edge) {
+	const uint32_t twin = adj->edgeTwin[edge];
+	return (twin < O3D_ADJ_NON_MANIFOLD) ? adj->edgeFace[twin] : O3D_ADJ_NONE;
+}
+
+#endif // DARKSTONE_O3D_ADJACENCY_H
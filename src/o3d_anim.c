@@ -0,0 +1,534 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_anim.c
+ * Created on: 17/10/26
+ * Brief: Skeletal animation: skeletons, SoA keyframe clips, pose evaluation and CPU skinning.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_anim.h"
+#include "o3d_animpack.h"
+#include "parallel.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Sampling goes 4 joints per register (SoA), skinning one vertex per register (the matrix columns).
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define O3D_ANIM_USE_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define O3D_ANIM_USE_SSE 0
+#endif
+
+// Vertexes skinned per job, and the least worth starting the threads for.
+enum {
+	ANIM_SKIN_RANGE         = 4096,
+	ANIM_MIN_PARALLEL_VERTS = 16384
+};
+
+static inline uint32_t anim_pad_joints(uint32_t jointCount) {
+	return (jointCount + (O3D_ANIM_WIDTH - 1)) & ~(uint32_t)(O3D_ANIM_WIDTH - 1);
+}
+
+static inline uint8_t * anim_align(void * ptr) {
+	const uintptr_t aligned = ((uintptr_t)ptr + (O3D_ANIM_ALIGNMENT - 1)) & ~(uintptr_t)(O3D_ANIM_ALIGNMENT - 1);
+	return (uint8_t *)aligned;
+}
+
+// Points the 7 component arrays at consecutive `arrayLength` float runs from `floats`.
+static void anim_joint_soa_setup(o3d_joint_soa_t * soa, float * floats, size_t arrayLength) {
+	soa->rotX = floats;
+	soa->rotY = soa->rotX + arrayLength;
+	soa->rotZ = soa->rotY + arrayLength;
+	soa->rotW = soa->rotZ + arrayLength;
+	soa->posX = soa->rotW + arrayLength;
+	soa->posY = soa->posX + arrayLength;
+	soa->posZ = soa->posY + arrayLength;
+}
+
+// a * b, both affine.
+static void anim_transform_mul(const o3d_transform_t * a, const o3d_transform_t * b, o3d_transform_t * out) {
+	for (int r = 0; r < 3; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			out->m[r][c] = (a->m[r][0] * b->m[0][c]) + (a->m[r][1] * b->m[1][c]) + (a->m[r][2] * b->m[2][c]);
+		}
+		out->m[r][3] += a->m[r][3];
+	}
+}
+
+/* ========================================================
+ * o3d_skeleton_alloc() / o3d_skeleton_free():
+ * ======================================================== */
+
+bool o3d_skeleton_alloc(o3d_skeleton_t * skeleton, uint32_t jointCount) {
+	assert(skeleton != NULL);
+
+	memset(skeleton, 0, sizeof(*skeleton));
+
+	if (jointCount == 0 || jointCount > O3D_ANIM_MAX_JOINTS) {
+		return o3d_set_error("Bad skeleton joint count!");
+	}
+
+	const size_t blockBytes = jointCount * (sizeof(int32_t) + sizeof(o3d_vertex_t) + sizeof(o3d_transform_t));
+	uint8_t * block = malloc(blockBytes);
+	if (block == NULL) {
+		return o3d_set_error("Unable to malloc skeleton!");
+	}
+
+	skeleton->memBlock      = block;
+	skeleton->inverseBind   = (o3d_transform_t *)block;
+	skeleton->bindPositions = (o3d_vertex_t *)(skeleton->inverseBind + jointCount);
+	skeleton->parents       = (int32_t *)(skeleton->bindPositions + jointCount);
+	skeleton->jointCount    = jointCount;
+
+	for (uint32_t j = 0; j < jointCount; ++j) {
+		skeleton->parents[j] = -1;
+		memset(&skeleton->bindPositions[j], 0, sizeof(o3d_vertex_t));
+		o3d_transform_identity(&skeleton->inverseBind[j]);
+	}
+	return true;
+}
+
+void o3d_skeleton_free(o3d_skeleton_t * skeleton) {
+	if (skeleton == NULL) {
+		return;
+	}
+
+	free(skeleton->memBlock);
+	memset(skeleton, 0, sizeof(*skeleton));
+}
+
+/* ========================================================
+ * o3d_skin_alloc() / o3d_skin_free():
+ * ======================================================== */
+
+bool o3d_skin_alloc(o3d_skin_t * skin, const o3d_vertex_t * positions, uint32_t vertexCount) {
+	assert(skin      != NULL);
+	assert(positions != NULL || vertexCount == 0);
+
+	memset(skin, 0, sizeof(*skin));
+
+	if (vertexCount == 0) {
+		return o3d_set_error("Nothing to skin!");
+	}
+
+	uint8_t * block = malloc(vertexCount * (sizeof(o3d_vertex_t) + sizeof(o3d_skin_weights_t)));
+	if (block == NULL) {
+		return o3d_set_error("Unable to malloc skin!");
+	}
+
+	skin->memBlock      = block;
+	skin->weights       = (o3d_skin_weights_t *)block;
+	skin->bindPositions = (o3d_vertex_t *)(skin->weights + vertexCount);
+	skin->vertexCount   = vertexCount;
+
+	memcpy(skin->bindPositions, positions, vertexCount * sizeof(o3d_vertex_t));
+	memset(skin->weights, 0, vertexCount * sizeof(o3d_skin_weights_t));
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		skin->weights[v].weights[0] = 1.0f;
+	}
+	return true;
+}
+
+void o3d_skin_free(o3d_skin_t * skin) {
+	if (skin == NULL) {
+		return;
+	}
+
+	free(skin->memBlock);
+	memset(skin, 0, sizeof(*skin));
+}
+
+/* ========================================================
+ * o3d_anim_clip_alloc() / o3d_anim_clip_free():
+ * ======================================================== */
+
+bool o3d_anim_clip_alloc(o3d_anim_clip_t * clip, uint32_t jointCount, uint32_t keyCount, float sampleRate) {
+	assert(clip != NULL);
+
+	memset(clip, 0, sizeof(*clip));
+
+	if (jointCount == 0 || jointCount > O3D_ANIM_MAX_JOINTS || keyCount < 2 || !(sampleRate > 0.0f)) {
+		return o3d_set_error("Bad animation clip dimensions!");
+	}
+
+	const uint32_t paddedJointCount = anim_pad_joints(jointCount);
+	const size_t arrayLength = (size_t)keyCount * paddedJointCount;
+
+	void * block = malloc((arrayLength * 7 * sizeof(float)) + O3D_ANIM_ALIGNMENT);
+	if (block == NULL) {
+		return o3d_set_error("Unable to malloc animation clip!");
+	}
+
+	clip->memBlock         = block;
+	clip->jointCount       = jointCount;
+	clip->paddedJointCount = paddedJointCount;
+	clip->keyCount         = keyCount;
+	clip->sampleRate       = sampleRate;
+	clip->duration         = (float)(keyCount - 1) / sampleRate;
+
+	// The array lengths are a multiple of the SIMD width, so aligning the first is enough.
+	anim_joint_soa_setup(&clip->keys, (float *)anim_align(block), arrayLength);
+
+	// Identity everywhere, so the padding joints sample to something sane.
+	memset(clip->keys.rotX, 0, arrayLength * 7 * sizeof(float));
+	for (size_t i = 0; i < arrayLength; ++i) {
+		clip->keys.rotW[i] = 1.0f;
+	}
+	return true;
+}
+
+void o3d_anim_clip_free(o3d_anim_clip_t * clip) {
+	if (clip == NULL) {
+		return;
+	}
+
+	free(clip->memBlock);
+	memset(clip, 0, sizeof(*clip));
+}
+
+/* ========================================================
+ * o3d_anim_pose_init() / o3d_anim_pose_free():
+ * ======================================================== */
+
+bool o3d_anim_pose_init(o3d_anim_pose_t * pose, const o3d_skeleton_t * skeleton) {
+	assert(pose     != NULL);
+	assert(skeleton != NULL);
+
+	memset(pose, 0, sizeof(*pose));
+
+	if (skeleton->jointCount == 0) {
+		return o3d_set_error("Skeleton has no joints!");
+	}
+
+	// Skin matrices first, they are the ones that need the alignment.
+	const uint32_t paddedJointCount = anim_pad_joints(skeleton->jointCount);
+	const size_t blockBytes = (paddedJointCount * sizeof(o3d_skin_matrix_t)) +
+	                          (paddedJointCount * 7 * sizeof(float)) +
+	                          (paddedJointCount * sizeof(o3d_transform_t)) + O3D_ANIM_ALIGNMENT;
+
+	void * block = malloc(blockBytes);
+	if (block == NULL) {
+		return o3d_set_error("Unable to malloc animation pose!");
+	}
+	memset(block, 0, blockBytes);
+
+	pose->memBlock         = block;
+	pose->jointCount       = skeleton->jointCount;
+	pose->paddedJointCount = paddedJointCount;
+	pose->skin             = (o3d_skin_matrix_t *)anim_align(block);
+	anim_joint_soa_setup(&pose->local, (float *)(pose->skin + paddedJointCount), paddedJointCount);
+	pose->model            = (o3d_transform_t *)(pose->local.posZ + paddedJointCount);
+	return true;
+}
+
+void o3d_anim_pose_free(o3d_anim_pose_t * pose) {
+	if (pose == NULL) {
+		return;
+	}
+
+	free(pose->memBlock);
+	memset(pose, 0, sizeof(*pose));
+}
+
+/* ========================================================
+ * o3d_anim_clip_sample():
+ * ======================================================== */
+
+void o3d_anim_clip_sample(const o3d_anim_clip_t * clip, float time, o3d_anim_pose_t * pose) {
+	assert(clip != NULL);
+	assert(pose != NULL);
+	assert(pose->paddedJointCount == clip->paddedJointCount);
+
+	float t = fmodf(time, clip->duration);
+	if (t < 0.0f) {
+		t += clip->duration;
+	}
+
+	const float keyPos = t * clip->sampleRate;
+	uint32_t key = (uint32_t)keyPos;
+	if (key > clip->keyCount - 2) {
+		key = clip->keyCount - 2;
+	}
+	float frac = keyPos - (float)key;
+	frac = (frac < 0.0f) ? 0.0f : ((frac > 1.0f) ? 1.0f : frac);
+
+	const size_t k0 = (size_t)key * clip->paddedJointCount;
+	const size_t k1 = k0 + clip->paddedJointCount;
+	const o3d_joint_soa_t * keys = &clip->keys;
+	o3d_joint_soa_t * out = &pose->local;
+
+	#if O3D_ANIM_USE_SSE
+	const __m128 f        = _mm_set1_ps(frac);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	for (uint32_t j = 0; j < clip->paddedJointCount; j += O3D_ANIM_WIDTH) {
+		const __m128 ax = _mm_load_ps(&keys->rotX[k0 + j]), bx = _mm_load_ps(&keys->rotX[k1 + j]);
+		const __m128 ay = _mm_load_ps(&keys->rotY[k0 + j]), by = _mm_load_ps(&keys->rotY[k1 + j]);
+		const __m128 az = _mm_load_ps(&keys->rotZ[k0 + j]), bz = _mm_load_ps(&keys->rotZ[k1 + j]);
+		const __m128 aw = _mm_load_ps(&keys->rotW[k0 + j]), bw = _mm_load_ps(&keys->rotW[k1 + j]);
+
+		// Shortest path: flip the second quaternion if they are on opposite hemispheres.
+		const __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+		                              _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+		const __m128 flip = _mm_and_ps(dot, signMask);
+
+		const __m128 rx = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(bx, flip), ax), f));
+		const __m128 ry = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(by, flip), ay), f));
+		const __m128 rz = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(bz, flip), az), f));
+		const __m128 rw = _mm_add_ps(aw, _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(bw, flip), aw), f));
+
+		const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)),
+		                                          _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw))));
+		_mm_store_ps(&out->rotX[j], _mm_div_ps(rx, len));
+		_mm_store_ps(&out->rotY[j], _mm_div_ps(ry, len));
+		_mm_store_ps(&out->rotZ[j], _mm_div_ps(rz, len));
+		_mm_store_ps(&out->rotW[j], _mm_div_ps(rw, len));
+
+		const __m128 px = _mm_load_ps(&keys->posX[k0 + j]);
+		const __m128 py = _mm_load_ps(&keys->posY[k0 + j]);
+		const __m128 pz = _mm_load_ps(&keys->posZ[k0 + j]);
+		_mm_store_ps(&out->posX[j], _mm_add_ps(px, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&keys->posX[k1 + j]), px), f)));
+		_mm_store_ps(&out->posY[j], _mm_add_ps(py, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&keys->posY[k1 + j]), py), f)));
+		_mm_store_ps(&out->posZ[j], _mm_add_ps(pz, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&keys->posZ[k1 + j]), pz), f)));
+	}
+	#else // !O3D_ANIM_USE_SSE
+	for (uint32_t j = 0; j < clip->paddedJointCount; ++j) {
+		const float ax = keys->rotX[k0 + j], ay = keys->rotY[k0 + j], az = keys->rotZ[k0 + j], aw = keys->rotW[k0 + j];
+		float bx = keys->rotX[k1 + j], by = keys->rotY[k1 + j], bz = keys->rotZ[k1 + j], bw = keys->rotW[k1 + j];
+
+		const float dot = ((ax * bx) + (ay * by)) + ((az * bz) + (aw * bw));
+		if (signbit(dot)) {
+			bx = -bx; by = -by; bz = -bz; bw = -bw;
+		}
+
+		const float rx = ax + ((bx - ax) * frac);
+		const float ry = ay + ((by - ay) * frac);
+		const float rz = az + ((bz - az) * frac);
+		const float rw = aw + ((bw - aw) * frac);
+
+		const float len = sqrtf(((rx * rx) + (ry * ry)) + ((rz * rz) + (rw * rw)));
+		out->rotX[j] = rx / len;
+		out->rotY[j] = ry / len;
+		out->rotZ[j] = rz / len;
+		out->rotW[j] = rw / len;
+
+		out->posX[j] = keys->posX[k0 + j] + ((keys->posX[k1 + j] - keys->posX[k0 + j]) * frac);
+		out->posY[j] = keys->posY[k0 + j] + ((keys->posY[k1 + j] - keys->posY[k0 + j]) * frac);
+		out->posZ[j] = keys->posZ[k0 + j] + ((keys->posZ[k1 + j] - keys->posZ[k0 + j]) * frac);
+	}
+	#endif // O3D_ANIM_USE_SSE
+}
+
+/* ========================================================
+ * o3d_anim_pose_build_matrices():
+ * ======================================================== */
+
+void o3d_anim_pose_build_matrices(o3d_anim_pose_t * pose, const o3d_skeleton_t * skeleton) {
+	assert(pose     != NULL);
+	assert(skeleton != NULL);
+	assert(pose->jointCount == skeleton->jointCount);
+
+	const o3d_joint_soa_t * local = &pose->local;
+
+	for (uint32_t j = 0; j < pose->jointCount; ++j) {
+		const float x = local->rotX[j], y = local->rotY[j], z = local->rotZ[j], w = local->rotW[j];
+		const float xx = x * x, yy = y * y, zz = z * z;
+		const float xy = x * y, xz = x * z, yz = y * z;
+		const float wx = w * x, wy = w * y, wz = w * z;
+
+		o3d_transform_t localXform;
+		localXform.m[0][0] = 1.0f - 2.0f * (yy + zz);
+		localXform.m[0][1] = 2.0f * (xy - wz);
+		localXform.m[0][2] = 2.0f * (xz + wy);
+		localXform.m[0][3] = local->posX[j];
+		localXform.m[1][0] = 2.0f * (xy + wz);
+		localXform.m[1][1] = 1.0f - 2.0f * (xx + zz);
+		localXform.m[1][2] = 2.0f * (yz - wx);
+		localXform.m[1][3] = local->posY[j];
+		localXform.m[2][0] = 2.0f * (xz - wy);
+		localXform.m[2][1] = 2.0f * (yz + wx);
+		localXform.m[2][2] = 1.0f - 2.0f * (xx + yy);
+		localXform.m[2][3] = local->posZ[j];
+
+		// Parents come first, so theirs are already in model space.
+		const int32_t parent = skeleton->parents[j];
+		if (parent >= 0) {
+			anim_transform_mul(&pose->model[parent], &localXform, &pose->model[j]);
+		} else {
+			pose->model[j] = localXform;
+		}
+
+		o3d_transform_t skinXform;
+		anim_transform_mul(&pose->model[j], &skeleton->inverseBind[j], &skinXform);
+
+		o3d_skin_matrix_t * skin = &pose->skin[j];
+		for (int c = 0; c < 4; ++c) {
+			skin->cols[c][0] = skinXform.m[0][c];
+			skin->cols[c][1] = skinXform.m[1][c];
+			skin->cols[c][2] = skinXform.m[2][c];
+			skin->cols[c][3] = 0.0f;
+		}
+	}
+}
+
+/* ========================================================
+ * o3d_anim_skin_vertexes():
+ * ======================================================== */
+
+void o3d_anim_skin_vertexes(const o3d_skin_t * skin, const o3d_anim_pose_t * pose,
+                            uint32_t firstVertex, uint32_t count, o3d_vertex_t * dest) {
+	assert(skin != NULL);
+	assert(pose != NULL);
+	assert(dest != NULL || count == 0);
+	assert(firstVertex + count <= skin->vertexCount);
+
+	const o3d_vertex_t       * src     = skin->bindPositions + firstVertex;
+	const o3d_skin_weights_t * weights = skin->weights + firstVertex;
+
+	for (uint32_t v = 0; v < count; ++v) {
+		const o3d_skin_weights_t * w = &weights[v];
+
+		#if O3D_ANIM_USE_SSE
+		// Blend the matrices, then transform once: c0 * x + c1 * y + c2 * z + c3.
+		const __m128 w0 = _mm_set1_ps(w->weights[0]);
+		const o3d_skin_matrix_t * m0 = &pose->skin[w->joints[0]];
+		__m128 c0 = _mm_mul_ps(w0, _mm_load_ps(m0->cols[0]));
+		__m128 c1 = _mm_mul_ps(w0, _mm_load_ps(m0->cols[1]));
+		__m128 c2 = _mm_mul_ps(w0, _mm_load_ps(m0->cols[2]));
+		__m128 c3 = _mm_mul_ps(w0, _mm_load_ps(m0->cols[3]));
+
+		for (int i = 1; i < O3D_ANIM_MAX_WEIGHTS; ++i) {
+			const __m128 wi = _mm_set1_ps(w->weights[i]);
+			const o3d_skin_matrix_t * mi = &pose->skin[w->joints[i]];
+			c0 = _mm_add_ps(c0, _mm_mul_ps(wi, _mm_load_ps(mi->cols[0])));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(wi, _mm_load_ps(mi->cols[1])));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(wi, _mm_load_ps(mi->cols[2])));
+			c3 = _mm_add_ps(c3, _mm_mul_ps(wi, _mm_load_ps(mi->cols[3])));
+		}
+
+		const __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(src[v].x)), _mm_mul_ps(c1, _mm_set1_ps(src[v].y))),
+		                            _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(src[v].z)), c3));
+
+		float result[4];
+		_mm_storeu_ps(result, p);
+		dest[v].x = result[0];
+		dest[v].y = result[1];
+		dest[v].z = result[2];
+		#else // !O3D_ANIM_USE_SSE
+		float c[4][3];
+		const o3d_skin_matrix_t * m0 = &pose->skin[w->joints[0]];
+		for (int col = 0; col < 4; ++col) {
+			for (int row = 0; row < 3; ++row) {
+				c[col][row] = w->weights[0] * m0->cols[col][row];
+			}
+		}
+
+		for (int i = 1; i < O3D_ANIM_MAX_WEIGHTS; ++i) {
+			const o3d_skin_matrix_t * mi = &pose->skin[w->joints[i]];
+			for (int col = 0; col < 4; ++col) {
+				for (int row = 0; row < 3; ++row) {
+					c[col][row] += w->weights[i] * mi->cols[col][row];
+				}
+			}
+		}
+
+		const float x = src[v].x, y = src[v].y, z = src[v].z;
+		dest[v].x = ((c[0][0] * x) + (c[1][0] * y)) + ((c[2][0] * z) + c[3][0]);
+		dest[v].y = ((c[0][1] * x) + (c[1][1] * y)) + ((c[2][1] * z) + c[3][1]);
+		dest[v].z = ((c[0][2] * x) + (c[1][2] * y)) + ((c[2][2] * z) + c[3][2]);
+		#endif // O3D_ANIM_USE_SSE
+	}
+}
+
+/* ========================================================
+ * o3d_anim_update_instances():
+ * ======================================================== */
+
+typedef struct anim_update_job {
+	o3d_anim_instance_t * instances;
+	uint32_t            * firstRange;  // Prefix sum of the skinning ranges, instanceCount + 1 entries.
+	uint32_t              instanceCount;
+} anim_update_job_t;
+
+static void anim_pose_job(void * userData, uint32_t instanceIndex) {
+	const anim_update_job_t * job = userData;
+	const o3d_anim_instance_t * inst = &job->instances[instanceIndex];
+
+	if (inst->packedClip != NULL) {
+		o3d_animpack_sample(inst->packedClip, inst->time, inst->pose);
+	} else {
+		o3d_anim_clip_sample(inst->clip, inst->time, inst->pose);
+	}
+	o3d_anim_pose_build_matrices(inst->pose, inst->skeleton);
+}
+
+static void anim_skin_job(void * userData, uint32_t rangeIndex) {
+	const anim_update_job_t * job = userData;
+
+	// Last instance whose first range is at or before this one.
+	uint32_t lo = 0;
+	uint32_t hi = job->instanceCount;
+	while ((hi - lo) > 1) {
+		const uint32_t mid = (lo + hi) / 2;
+		if (job->firstRange[mid] <= rangeIndex) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	const o3d_anim_instance_t * inst = &job->instances[lo];
+	const uint32_t first = (rangeIndex - job->firstRange[lo]) * ANIM_SKIN_RANGE;
+	const uint32_t left  = inst->skin->vertexCount - first;
+	const uint32_t count = (left < ANIM_SKIN_RANGE) ? left : ANIM_SKIN_RANGE;
+
+	o3d_anim_skin_vertexes(inst->skin, inst->pose, first, count, inst->skinnedPositions + first);
+}
+
+bool o3d_anim_update_instances(o3d_anim_instance_t * instances, uint32_t instanceCount, uint32_t threadCount) {
+	assert(instances != NULL || instanceCount == 0);
+
+	if (instanceCount == 0) {
+		return true;
+	}
+
+	anim_update_job_t job;
+	job.instances     = instances;
+	job.instanceCount = instanceCount;
+	job.firstRange    = malloc((instanceCount + 1) * sizeof(uint32_t));
+
+	if (job.firstRange == NULL) {
+		return o3d_set_error("Unable to malloc animation jobs!");
+	}
+
+	uint64_t totalVerts = 0;
+	job.firstRange[0] = 0;
+	for (uint32_t i = 0; i < instanceCount; ++i) {
+		const uint32_t vertexCount = instances[i].skin->vertexCount;
+		job.firstRange[i + 1] = job.firstRange[i] + ((vertexCount + ANIM_SKIN_RANGE - 1) / ANIM_SKIN_RANGE);
+		totalVerts += vertexCount;
+	}
+
+	if (totalVerts < ANIM_MIN_PARALLEL_VERTS) {
+		threadCount = 1;
+	}
+
+	// Every pose has to be done before any skinning, since the
+	// ranges of one instance may run on different threads.
+	parallel_for(instanceCount, threadCount, &anim_pose_job, &job);
+	parallel_for(job.firstRange[instanceCount], threadCount, &anim_skin_job, &job);
+
+	free(job.firstRange);
+	return true;
+}
@@ -0,0 +1,225 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_anim.h
+ * Created on: 17/10/26
+ * Brief: Skeletal animation: skeletons, SoA keyframe clips, pose evaluation and CPU skinning.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_ANIM_H
+#define DARKSTONE_O3D_ANIM_H
+
+#include "o3d.h"
+#include "o3d_scene.h"
+
+/* ========================================================
+ * Skeletal animation:
+ *
+ * The game keeps its skinned characters in DATA/SKELETONS,
+ * in three formats per set: .B3D (the skinned mesh), .SKA
+ * (the skeleton) and .ANB (the animations).
+ *
+ * NOT DONE: loaders for those formats. Their layouts are not
+ * reverse engineered yet, so nothing here reads game data.
+ * This module is only the runtime side they will feed, which
+ * a loader fills with o3d_skeleton_alloc(), o3d_skin_alloc()
+ * and o3d_anim_clip_alloc(): skeletons, keyframe clips, pose
+ * sampling and linear blend skinning. Until the loaders are
+ * written, o3d_testrig.h makes procedural stand-in data to
+ * exercise it with.
+ *
+ * Keyframes are stored SoA: one array per component, with
+ * the joints of a key next to each other, so sampling blends
+ * O3D_ANIM_WIDTH joints at a time. Poses are evaluated per
+ * instance and skinning is split in vertex ranges, both
+ * spread over the CPUs by o3d_anim_update_instances().
+ * ======================================================== */
+
+enum {
+	O3D_ANIM_WIDTH       = 4,  // Joints per SIMD register.
+	O3D_ANIM_ALIGNMENT   = 16,
+	O3D_ANIM_MAX_WEIGHTS = 4,  // Joint influences per vertex.
+	O3D_ANIM_MAX_JOINTS  = 256 // Joint indexes are bytes.
+};
+
+/*
+ * Joint hierarchy at the bind pose. Parents always
+ * come before their children; roots have parent -1.
+ */
+typedef struct o3d_skeleton {
+	int32_t         * parents;
+	o3d_vertex_t    * bindPositions; // Model space position of each joint.
+	o3d_transform_t * inverseBind;   // Model space to joint space, at the bind pose.
+	void            * memBlock;      // Single allocation for the arrays.
+	uint32_t          jointCount;
+} o3d_skeleton_t;
+
+/*
+ * Local joint transforms (rotation quaternion + translation),
+ * one array per component, O3D_ANIM_ALIGNMENT aligned.
+ */
+typedef struct o3d_joint_soa {
+	float * rotX;
+	float * rotY;
+	float * rotZ;
+	float * rotW;
+	float * posX;
+	float * posY;
+	float * posZ;
+} o3d_joint_soa_t;
+
+/*
+ * Animation clip, sampled at a fixed rate. Each component array holds
+ * keyCount * paddedJointCount floats: key 0 for all the joints, then key 1...
+ * The last key is the pose at `duration`, so looping clips repeat the first.
+ */
+typedef struct o3d_anim_clip {
+	o3d_joint_soa_t keys;
+	void          * memBlock;
+	uint32_t        jointCount;
+	uint32_t        paddedJointCount; // Multiple of O3D_ANIM_WIDTH.
+	uint32_t        keyCount;         // At least 2.
+	float           sampleRate;       // Keys per second.
+	float           duration;         // (keyCount - 1) / sampleRate.
+} o3d_anim_clip_t;
+
+/*
+ * Column-major 4x3 skinning matrix: the X, Y, Z axes and the translation,
+ * each padded to 4 floats (the 4th is zero), so a column is one SIMD load.
+ */
+typedef struct o3d_skin_matrix {
+	float cols[4][4];
+} o3d_skin_matrix_t;
+
+/*
+ * One evaluated pose: the sampled local transforms, then the
+ * model space joint matrices and the skinning matrices.
+ */
+typedef struct o3d_anim_pose {
+	o3d_joint_soa_t     local;
+	o3d_transform_t   * model;        // Joint to model space.
+	o3d_skin_matrix_t * skin;         // model * inverseBind.
+	void              * memBlock;
+	uint32_t            jointCount;
+	uint32_t            paddedJointCount;
+} o3d_anim_pose_t;
+
+/*
+ * Per vertex joint influences. Unused slots have zero weight.
+ */
+typedef struct o3d_skin_weights {
+	uint8_t joints[O3D_ANIM_MAX_WEIGHTS];
+	float   weights[O3D_ANIM_MAX_WEIGHTS]; // Sum to 1.
+} o3d_skin_weights_t;
+
+/*
+ * Bind pose vertexes of a skinned mesh and their influences.
+ */
+typedef struct o3d_skin {
+	o3d_vertex_t       * bindPositions;
+	o3d_skin_weights_t * weights;
+	void               * memBlock;
+	uint32_t             vertexCount;
+} o3d_skin_t;
+
+// Compressed clips, see o3d_animpack.h.
+struct o3d_animpack_clip;
+
+/*
+ * One animated character: what it plays, where it is in the clip and where
+ * its skinned vertexes go (skin->vertexCount of them). The pose is scratch
+ * space, allocated with o3d_anim_pose_init() for the skeleton.
+ */
+typedef struct o3d_anim_instance {
+	const o3d_skeleton_t           * skeleton;
+	const o3d_anim_clip_t          * clip;
+	const struct o3d_animpack_clip * packedClip; // Sampled instead of `clip` if not null.
+	const o3d_skin_t               * skin;
+	o3d_anim_pose_t                * pose;
+	o3d_vertex_t                   * skinnedPositions;
+	float                            time;       // Seconds. Wraps around the clip duration.
+} o3d_anim_instance_t;
+
+/* ========================================================
+ * Skeleton and skin functions:
+ * ======================================================== */
+
+/*
+ * Allocates a skeleton of `jointCount` roots at the origin, with identity
+ * inverse binds, for a loader to fill in.
+ */
+bool o3d_skeleton_alloc(o3d_skeleton_t * skeleton, uint32_t jointCount);
+
+/*
+ * Frees the skeleton arrays and clears the struct.
+ */
+void o3d_skeleton_free(o3d_skeleton_t * skeleton);
+
+/*
+ * Allocates a skin over a copy of `positions`, every vertex bound to joint 0
+ * with full weight, for a loader to fill in.
+ */
+bool o3d_skin_alloc(o3d_skin_t * skin, const o3d_vertex_t * positions, uint32_t vertexCount);
+
+/*
+ * Frees the skin arrays and clears the struct.
+ */
+void o3d_skin_free(o3d_skin_t * skin);
+
+/* ========================================================
+ * Clip and pose functions:
+ * ======================================================== */
+
+/*
+ * Allocates a clip with all the keys at the identity (jointCount > 0, keyCount >= 2).
+ */
+bool o3d_anim_clip_alloc(o3d_anim_clip_t * clip, uint32_t jointCount, uint32_t keyCount, float sampleRate);
+
+/*
+ * Frees the key arrays and clears the struct.
+ */
+void o3d_anim_clip_free(o3d_anim_clip_t * clip);
+
+/*
+ * Allocates the scratch space to evaluate poses of a skeleton.
+ */
+bool o3d_anim_pose_init(o3d_anim_pose_t * pose, const o3d_skeleton_t * skeleton);
+
+/*
+ * Frees the pose arrays and clears the struct.
+ */
+void o3d_anim_pose_free(o3d_anim_pose_t * pose);
+
+/*
+ * Samples the clip at `time` (wrapped around its duration) into pose->local,
+ * blending the two nearest keys (nlerp for the rotations).
+ */
+void o3d_anim_clip_sample(const o3d_anim_clip_t * clip, float time, o3d_anim_pose_t * pose);
+
+/*
+ * Concatenates the local transforms down the hierarchy into
+ * pose->model, then multiplies in the inverse bind for pose->skin.
+ */
+void o3d_anim_pose_build_matrices(o3d_anim_pose_t * pose, const o3d_skeleton_t * skeleton);
+
+/*
+ * Linear blend skinning of the vertexes [firstVertex, firstVertex + count) into `dest`.
+ */
+void o3d_anim_skin_vertexes(const o3d_skin_t * skin, const o3d_anim_pose_t * pose,
+                            uint32_t firstVertex, uint32_t count, o3d_vertex_t * dest);
+
+/*
+ * Samples, builds the matrices and skins every instance, over `threadCount`
+ * threads (0 for all the CPUs): first one job per pose, then the vertexes
+ * of all the instances in ranges, so a single big mesh also goes wide.
+ */
+bool o3d_anim_update_instances(o3d_anim_instance_t * instances, uint32_t instanceCount, uint32_t threadCount);
+
+#endif // DARKSTONE_O3D_ANIM_H
@@ -0,0 +1,574 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_animpack.c
+ * Created on: 17/10/26
+ * Brief: Compressed animation clips: quantized, key-reduced segments with random-access sampling.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_animpack.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+	ANIMPACK_SEG_FRAMES = O3D_ANIMPACK_SEGMENT_KEYS,
+	ANIMPACK_SEG_STEP   = O3D_ANIMPACK_SEGMENT_KEYS - 1, // Frames between segment starts.
+	ANIMPACK_ROT_BITS   = 10,
+	ANIMPACK_ROT_MAX    = (1 << ANIMPACK_ROT_BITS) - 1,
+	ANIMPACK_POS_MAX    = 65535
+};
+
+static const float ANIMPACK_SQRT2 = 1.41421356237309504880f;
+
+// What a segment header points to.
+typedef struct animpack_segment_header {
+	uint32_t rangesOffset;
+	uint32_t rotsOffset;
+	uint32_t possOffset;
+} animpack_segment_header_t;
+
+static inline size_t animpack_align4(size_t offset) {
+	return (offset + 3) & ~(size_t)3;
+}
+
+/* ========================================================
+ * Quaternion helpers:
+ * ======================================================== */
+
+// Smallest-three: the largest component is rebuilt from the others, so it's
+// made positive (q and -q are the same rotation) and only its index is kept.
+static uint32_t animpack_encode_quat(const float q[4]) {
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; ++i) {
+		if (fabsf(q[i]) > fabsf(q[largest])) {
+			largest = i;
+		}
+	}
+
+	const float sign = (q[largest] < 0.0f) ? -1.0f : 1.0f;
+	uint32_t code = largest << (ANIMPACK_ROT_BITS * 3);
+
+	for (uint32_t i = 0, slot = 2; i < 4; ++i) {
+		if (i == largest) {
+			continue;
+		}
+		// The others are within +/- 1/sqrt(2).
+		float n = ((q[i] * sign * ANIMPACK_SQRT2) * 0.5f) + 0.5f;
+		n = (n < 0.0f) ? 0.0f : ((n > 1.0f) ? 1.0f : n);
+		code |= (uint32_t)((n * (float)ANIMPACK_ROT_MAX) + 0.5f) << (ANIMPACK_ROT_BITS * slot);
+		slot--;
+	}
+	return code;
+}
+
+static void animpack_decode_quat(uint32_t code, float q[4]) {
+	const uint32_t largest = code >> (ANIMPACK_ROT_BITS * 3);
+	float sumSqr = 0.0f;
+
+	for (uint32_t i = 0, slot = 2; i < 4; ++i) {
+		if (i == largest) {
+			continue;
+		}
+		const uint32_t bits = (code >> (ANIMPACK_ROT_BITS * slot)) & ANIMPACK_ROT_MAX;
+		q[i] = ((((float)bits / (float)ANIMPACK_ROT_MAX) * 2.0f) - 1.0f) * (1.0f / ANIMPACK_SQRT2);
+		sumSqr += q[i] * q[i];
+		slot--;
+	}
+	q[largest] = (sumSqr < 1.0f) ? sqrtf(1.0f - sumSqr) : 0.0f;
+}
+
+// Same blend as o3d_anim_clip_sample(): shortest path nlerp.
+static void animpack_nlerp(const float a[4], const float b[4], float t, float out[4]) {
+	const float dot = ((a[0] * b[0]) + (a[1] * b[1])) + ((a[2] * b[2]) + (a[3] * b[3]));
+	const float sign = (dot < 0.0f) ? -1.0f : 1.0f;
+
+	float lenSqr = 0.0f;
+	for (int i = 0; i < 4; ++i) {
+		out[i] = a[i] + (((b[i] * sign) - a[i]) * t);
+		lenSqr += out[i] * out[i];
+	}
+
+	const float invLen = 1.0f / sqrtf(lenSqr);
+	for (int i = 0; i < 4; ++i) {
+		out[i] *= invLen;
+	}
+}
+
+// Angle between two unit quaternions, in radians.
+static float animpack_quat_angle(const float a[4], const float b[4]) {
+	float dot = fabsf((a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]) + (a[3] * b[3]));
+	dot = (dot > 1.0f) ? 1.0f : dot;
+	return 2.0f * acosf(dot);
+}
+
+static float animpack_distance(const float a[3], const float b[3]) {
+	const float dx = a[0] - b[0];
+	const float dy = a[1] - b[1];
+	const float dz = a[2] - b[2];
+	return sqrtf((dx * dx) + (dy * dy) + (dz * dz));
+}
+
+/* ========================================================
+ * Key reduction:
+ * ======================================================== */
+
+// One joint track over the frames of a segment: the source values and
+// their quantized copies, which is what the keys kept will hold.
+typedef struct animpack_track {
+	float    rot[ANIMPACK_SEG_FRAMES][4];
+	float    rotQuant[ANIMPACK_SEG_FRAMES][4];
+	uint32_t rotCodes[ANIMPACK_SEG_FRAMES];
+	float    pos[ANIMPACK_SEG_FRAMES][3];
+	float    posQuant[ANIMPACK_SEG_FRAMES][3];
+	uint16_t posCodes[ANIMPACK_SEG_FRAMES][3];
+	float    posMin[3];
+	float    posExtent[3];
+} animpack_track_t;
+
+static bool animpack_rot_span_fits(const animpack_track_t * track, uint32_t first, uint32_t last, float tolerance) {
+	for (uint32_t f = first + 1; f < last; ++f) {
+		float q[4];
+		animpack_nlerp(track->rotQuant[first], track->rotQuant[last], (float)(f - first) / (float)(last - first), q);
+		if (animpack_quat_angle(q, track->rot[f]) > tolerance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool animpack_pos_span_fits(const animpack_track_t * track, uint32_t first, uint32_t last, float tolerance) {
+	for (uint32_t f = first + 1; f < last; ++f) {
+		const float t = (float)(f - first) / (float)(last - first);
+		float p[3];
+		for (int i = 0; i < 3; ++i) {
+			p[i] = track->posQuant[first][i] + ((track->posQuant[last][i] - track->posQuant[first][i]) * t);
+		}
+		if (animpack_distance(p, track->pos[f]) > tolerance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Greedy: each span grows until interpolating across it breaks the tolerance,
+// then the frame before becomes a key. Returns the number of keys in `frames`.
+static uint32_t animpack_reduce_track(const animpack_track_t * track, uint32_t frameCount, bool rotation,
+                                      float tolerance, uint8_t * frames) {
+	assert(frameCount >= 2);
+
+	// A track that doesn't move needs just its first key.
+	bool constant = true;
+	for (uint32_t f = 1; f < frameCount && constant; ++f) {
+		constant = rotation ? (animpack_quat_angle(track->rotQuant[0], track->rot[f]) <= tolerance) :
+		                      (animpack_distance(track->posQuant[0], track->pos[f]) <= tolerance);
+	}
+
+	uint32_t keyCount = 0;
+	frames[keyCount++] = 0;
+	if (constant) {
+		return keyCount;
+	}
+
+	uint32_t first = 0;
+	for (uint32_t last = 2; last < frameCount; ++last) {
+		const bool fits = rotation ? animpack_rot_span_fits(track, first, last, tolerance) :
+		                             animpack_pos_span_fits(track, first, last, tolerance);
+		if (!fits) {
+			first = last - 1;
+			frames[keyCount++] = (uint8_t)first;
+		}
+	}
+	frames[keyCount++] = (uint8_t)(frameCount - 1);
+	return keyCount;
+}
+
+/* ========================================================
+ * Segment encoding:
+ * ======================================================== */
+
+static uint32_t animpack_segment_frames(const o3d_animpack_clip_t * packed, uint32_t segment) {
+	const uint32_t left = packed->keyCount - (segment * ANIMPACK_SEG_STEP);
+	return (left < ANIMPACK_SEG_FRAMES) ? left : ANIMPACK_SEG_FRAMES;
+}
+
+static void animpack_load_track(const o3d_anim_clip_t * clip, uint32_t joint, uint32_t firstKey,
+                                uint32_t frameCount, animpack_track_t * track) {
+	for (int i = 0; i < 3; ++i) {
+		track->posMin[i]    =  HUGE_VALF;
+		track->posExtent[i] = -HUGE_VALF; // Max until the end of the loop.
+	}
+
+	for (uint32_t f = 0; f < frameCount; ++f) {
+		const size_t k = ((size_t)(firstKey + f) * clip->paddedJointCount) + joint;
+		float * q = track->rot[f];
+		q[0] = clip->keys.rotX[k];
+		q[1] = clip->keys.rotY[k];
+		q[2] = clip->keys.rotZ[k];
+		q[3] = clip->keys.rotW[k];
+
+		const float len = sqrtf((q[0] * q[0]) + (q[1] * q[1]) + (q[2] * q[2]) + (q[3] * q[3]));
+		for (int i = 0; i < 4; ++i) {
+			q[i] = (len > 0.0f) ? (q[i] / len) : ((i == 3) ? 1.0f : 0.0f);
+		}
+
+		track->rotCodes[f] = animpack_encode_quat(q);
+		animpack_decode_quat(track->rotCodes[f], track->rotQuant[f]);
+
+		track->pos[f][0] = clip->keys.posX[k];
+		track->pos[f][1] = clip->keys.posY[k];
+		track->pos[f][2] = clip->keys.posZ[k];
+		for (int i = 0; i < 3; ++i) {
+			track->posMin[i]    = fminf(track->posMin[i], track->pos[f][i]);
+			track->posExtent[i] = fmaxf(track->posExtent[i], track->pos[f][i]);
+		}
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		track->posExtent[i] -= track->posMin[i];
+	}
+
+	for (uint32_t f = 0; f < frameCount; ++f) {
+		for (int i = 0; i < 3; ++i) {
+			const float n = (track->posExtent[i] > 0.0f) ? ((track->pos[f][i] - track->posMin[i]) / track->posExtent[i]) : 0.0f;
+			track->posCodes[f][i] = (uint16_t)((n * (float)ANIMPACK_POS_MAX) + 0.5f);
+			track->posQuant[f][i] = track->posMin[i] + ((float)track->posCodes[f][i] * (track->posExtent[i] / (float)ANIMPACK_POS_MAX));
+		}
+	}
+}
+
+// Largest a segment can get, with every key kept.
+static size_t animpack_max_segment_size(uint32_t jointCount) {
+	const size_t header = sizeof(animpack_segment_header_t) + (jointCount * 2) + (jointCount * ANIMPACK_SEG_FRAMES * 2);
+	return animpack_align4(header) + (jointCount * 6 * sizeof(float)) +
+	       (jointCount * ANIMPACK_SEG_FRAMES * sizeof(uint32_t)) +
+	       animpack_align4(jointCount * ANIMPACK_SEG_FRAMES * 3 * sizeof(uint16_t));
+}
+
+// Writes one segment at `dest` and returns its size, a multiple of 4.
+static size_t animpack_write_segment(const o3d_anim_clip_t * clip, const o3d_animpack_params_t * params,
+                                     uint32_t firstKey, uint32_t frameCount, animpack_track_t * track,
+                                     uint8_t * scratch, uint8_t * dest, uint32_t * keysKept) {
+	const uint32_t jointCount = clip->jointCount;
+
+	// First pass picks the keys, so the section sizes are known. The
+	// frames of joint j go in scratch[j * 2 * ANIMPACK_SEG_FRAMES], rotations then positions.
+	uint8_t * counts = dest + sizeof(animpack_segment_header_t);
+	uint32_t rotTotal = 0;
+	uint32_t posTotal = 0;
+	uint32_t frameBytes = 0;
+
+	for (uint32_t j = 0; j < jointCount; ++j) {
+		uint8_t * frames = &scratch[j * 2 * ANIMPACK_SEG_FRAMES];
+		animpack_load_track(clip, j, firstKey, frameCount, track);
+		counts[(j * 2) + 0] = (uint8_t)animpack_reduce_track(track, frameCount, true,  params->rotTolerance, frames);
+		counts[(j * 2) + 1] = (uint8_t)animpack_reduce_track(track, frameCount, false, params->posTolerance,
+		                                                     frames + ANIMPACK_SEG_FRAMES);
+		rotTotal   += counts[(j * 2) + 0];
+		posTotal   += counts[(j * 2) + 1];
+		frameBytes += counts[(j * 2) + 0] + counts[(j * 2) + 1];
+	}
+	*keysKept += rotTotal + posTotal;
+
+	animpack_segment_header_t header;
+	header.rangesOffset = (uint32_t)animpack_align4(sizeof(header) + (jointCount * 2) + frameBytes);
+	header.rotsOffset   = header.rangesOffset + (jointCount * 6 * sizeof(float));
+	header.possOffset   = header.rotsOffset + (rotTotal * sizeof(uint32_t));
+	memcpy(dest, &header, sizeof(header));
+
+	const size_t size = animpack_align4(header.possOffset + (posTotal * 3 * sizeof(uint16_t)));
+	memset(dest + sizeof(header) + (jointCount * 2), 0, size - (sizeof(header) + (jointCount * 2)));
+
+	// Second pass writes the keys kept.
+	uint8_t  * frameOut = counts + (jointCount * 2);
+	float    * rangeOut = (float *)(dest + header.rangesOffset);
+	uint32_t * rotOut   = (uint32_t *)(dest + header.rotsOffset);
+	uint16_t * posOut   = (uint16_t *)(dest + header.possOffset);
+
+	for (uint32_t j = 0; j < jointCount; ++j) {
+		const uint8_t * rotFrames = &scratch[j * 2 * ANIMPACK_SEG_FRAMES];
+		const uint8_t * posFrames = rotFrames + ANIMPACK_SEG_FRAMES;
+		const uint32_t rotCount = counts[(j * 2) + 0];
+		const uint32_t posCount = counts[(j * 2) + 1];
+
+		animpack_load_track(clip, j, firstKey, frameCount, track);
+
+		memcpy(frameOut, rotFrames, rotCount);
+		frameOut += rotCount;
+		memcpy(frameOut, posFrames, posCount);
+		frameOut += posCount;
+
+		for (int i = 0; i < 3; ++i) {
+			rangeOut[i]     = track->posMin[i];
+			rangeOut[i + 3] = track->posExtent[i];
+		}
+		rangeOut += 6;
+
+		for (uint32_t k = 0; k < rotCount; ++k) {
+			*rotOut++ = track->rotCodes[rotFrames[k]];
+		}
+		for (uint32_t k = 0; k < posCount; ++k) {
+			memcpy(posOut, track->posCodes[posFrames[k]], 3 * sizeof(uint16_t));
+			posOut += 3;
+		}
+	}
+
+	return size;
+}
+
+/* ========================================================
+ * Sampling:
+ * ======================================================== */
+
+// Key pair bracketing `frame` and the blend between them.
+static uint32_t animpack_find_key(const uint8_t * frames, uint32_t keyCount, float frame, float * t) {
+	if (keyCount == 1) {
+		*t = 0.0f;
+		return 0;
+	}
+
+	uint32_t k = 0;
+	while ((k + 2) < keyCount && (float)frames[k + 1] <= frame) {
+		++k;
+	}
+
+	const float span = (float)(frames[k + 1] - frames[k]);
+	const float blend = (frame - (float)frames[k]) / span;
+	*t = (blend < 0.0f) ? 0.0f : ((blend > 1.0f) ? 1.0f : blend);
+	return k;
+}
+
+// Samples at a fractional key index, reading only the segment holding it.
+static void animpack_sample_frame(const o3d_animpack_clip_t * packed, float frame, o3d_joint_soa_t * out) {
+	uint32_t segment = (uint32_t)(frame / (float)ANIMPACK_SEG_STEP);
+	if (segment >= packed->segmentCount) {
+		segment = packed->segmentCount - 1;
+	}
+	const float localFrame = frame - (float)(segment * ANIMPACK_SEG_STEP);
+
+	const uint8_t * seg = packed->data + packed->segmentOffsets[segment];
+	animpack_segment_header_t header;
+	memcpy(&header, seg, sizeof(header));
+
+	const uint8_t  * counts = seg + sizeof(header);
+	const uint8_t  * frames = counts + (packed->jointCount * 2);
+	const float    * ranges = (const float *)(seg + header.rangesOffset);
+	const uint32_t * rots   = (const uint32_t *)(seg + header.rotsOffset);
+	const uint16_t * poss   = (const uint16_t *)(seg + header.possOffset);
+
+	for (uint32_t j = 0; j < packed->jointCount; ++j) {
+		const uint32_t rotCount = counts[(j * 2) + 0];
+		const uint32_t posCount = counts[(j * 2) + 1];
+		const uint8_t * rotFrames = frames;
+		const uint8_t * posFrames = frames + rotCount;
+
+		float t;
+		uint32_t k = animpack_find_key(rotFrames, rotCount, localFrame, &t);
+
+		float q[4];
+		animpack_decode_quat(rots[k], q);
+		if (rotCount > 1) {
+			float q1[4];
+			animpack_decode_quat(rots[k + 1], q1);
+			animpack_nlerp(q, q1, t, q);
+		}
+		out->rotX[j] = q[0];
+		out->rotY[j] = q[1];
+		out->rotZ[j] = q[2];
+		out->rotW[j] = q[3];
+
+		k = animpack_find_key(posFrames, posCount, localFrame, &t);
+		const uint16_t * p0 = &poss[k * 3];
+		const uint16_t * p1 = (posCount > 1) ? (p0 + 3) : p0;
+
+		float p[3];
+		for (int i = 0; i < 3; ++i) {
+			const float scale = ranges[i + 3] / (float)ANIMPACK_POS_MAX;
+			const float a = ranges[i] + ((float)p0[i] * scale);
+			const float b = ranges[i] + ((float)p1[i] * scale);
+			p[i] = a + ((b - a) * t);
+		}
+		out->posX[j] = p[0];
+		out->posY[j] = p[1];
+		out->posZ[j] = p[2];
+
+		frames += rotCount + posCount;
+		ranges += 6;
+		rots   += rotCount;
+		poss   += posCount * 3;
+	}
+}
+
+void o3d_animpack_sample(const o3d_animpack_clip_t * packed, float time, o3d_anim_pose_t * pose) {
+	assert(packed != NULL);
+	assert(pose   != NULL);
+	assert(pose->paddedJointCount == packed->paddedJointCount);
+
+	float t = fmodf(time, packed->duration);
+	if (t < 0.0f) {
+		t += packed->duration;
+	}
+
+	float frame = t * packed->sampleRate;
+	if (frame > (float)(packed->keyCount - 1)) {
+		frame = (float)(packed->keyCount - 1);
+	}
+	animpack_sample_frame(packed, frame, &pose->local);
+}
+
+/* ========================================================
+ * o3d_animpack_default_params() / o3d_animpack_build():
+ * ======================================================== */
+
+void o3d_animpack_default_params(o3d_animpack_params_t * params) {
+	assert(params != NULL);
+
+	params->rotTolerance = 0.005f;
+	params->posTolerance = 0.0f;
+}
+
+// Compares the packed clip against every source key.
+static bool animpack_measure_error(const o3d_animpack_clip_t * packed, const o3d_anim_clip_t * clip,
+                                   o3d_animpack_stats_t * stats) {
+	float * floats = malloc(clip->jointCount * 7 * sizeof(float));
+	if (floats == NULL) {
+		return o3d_set_error("Unable to malloc animation samples!");
+	}
+
+	o3d_joint_soa_t sampled;
+	sampled.rotX = floats;
+	sampled.rotY = sampled.rotX + clip->jointCount;
+	sampled.rotZ = sampled.rotY + clip->jointCount;
+	sampled.rotW = sampled.rotZ + clip->jointCount;
+	sampled.posX = sampled.rotW + clip->jointCount;
+	sampled.posY = sampled.posX + clip->jointCount;
+	sampled.posZ = sampled.posY + clip->jointCount;
+
+	stats->maxRotError = 0.0f;
+	stats->maxPosError = 0.0f;
+
+	for (uint32_t k = 0; k < clip->keyCount; ++k) {
+		animpack_sample_frame(packed, (float)k, &sampled);
+
+		for (uint32_t j = 0; j < clip->jointCount; ++j) {
+			const size_t i = ((size_t)k * clip->paddedJointCount) + j;
+			const float a[4] = { sampled.rotX[j], sampled.rotY[j], sampled.rotZ[j], sampled.rotW[j] };
+			float b[4] = { clip->keys.rotX[i], clip->keys.rotY[i], clip->keys.rotZ[i], clip->keys.rotW[i] };
+			const float len = sqrtf((b[0] * b[0]) + (b[1] * b[1]) + (b[2] * b[2]) + (b[3] * b[3]));
+			for (int c = 0; c < 4; ++c) {
+				b[c] /= len;
+			}
+
+			const float pa[3] = { sampled.posX[j], sampled.posY[j], sampled.posZ[j] };
+			const float pb[3] = { clip->keys.posX[i], clip->keys.posY[i], clip->keys.posZ[i] };
+
+			stats->maxRotError = fmaxf(stats->maxRotError, animpack_quat_angle(a, b));
+			stats->maxPosError = fmaxf(stats->maxPosError, animpack_distance(pa, pb));
+		}
+	}
+
+	free(floats);
+	return true;
+}
+
+bool o3d_animpack_build(o3d_animpack_clip_t * packed, const o3d_anim_clip_t * clip,
+                        const o3d_animpack_params_t * params, o3d_animpack_stats_t * stats) {
+	assert(packed != NULL);
+	assert(clip   != NULL);
+
+	memset(packed, 0, sizeof(*packed));
+
+	if (clip->jointCount == 0 || clip->keyCount < 2) {
+		return o3d_set_error("Empty animation clip!");
+	}
+
+	o3d_animpack_params_t localParams;
+	if (params != NULL) {
+		localParams = *params;
+	} else {
+		o3d_animpack_default_params(&localParams);
+	}
+
+	if (!(localParams.posTolerance > 0.0f)) {
+		float largest = 0.0f;
+		for (uint32_t k = 0; k < clip->keyCount; ++k) {
+			const size_t base = (size_t)k * clip->paddedJointCount;
+			for (uint32_t j = 0; j < clip->jointCount; ++j) {
+				largest = fmaxf(largest, fabsf(clip->keys.posX[base + j]));
+				largest = fmaxf(largest, fabsf(clip->keys.posY[base + j]));
+				largest = fmaxf(largest, fabsf(clip->keys.posZ[base + j]));
+			}
+		}
+		localParams.posTolerance = (largest > 0.0f) ? (largest * 1e-4f) : 1e-6f;
+	}
+
+	packed->jointCount       = clip->jointCount;
+	packed->paddedJointCount = clip->paddedJointCount;
+	packed->keyCount         = clip->keyCount;
+	packed->segmentCount     = (clip->keyCount - 1 + ANIMPACK_SEG_STEP - 1) / ANIMPACK_SEG_STEP;
+	packed->sampleRate       = clip->sampleRate;
+	packed->duration         = clip->duration;
+
+	// Room for the worst case, shrunk once the real size is known.
+	const size_t maxSize = animpack_max_segment_size(clip->jointCount) * packed->segmentCount;
+	packed->data           = malloc(maxSize);
+	packed->segmentOffsets = malloc((packed->segmentCount + 1) * sizeof(uint32_t));
+	uint8_t * scratch      = malloc(clip->jointCount * 2 * ANIMPACK_SEG_FRAMES);
+	animpack_track_t * track = malloc(sizeof(*track));
+
+	if (packed->data == NULL || packed->segmentOffsets == NULL || scratch == NULL || track == NULL) {
+		free(scratch);
+		free(track);
+		o3d_animpack_free(packed);
+		return o3d_set_error("Unable to malloc packed animation clip!");
+	}
+
+	uint32_t keysKept = 0;
+	size_t offset = 0;
+	for (uint32_t s = 0; s < packed->segmentCount; ++s) {
+		packed->segmentOffsets[s] = (uint32_t)offset;
+		offset += animpack_write_segment(clip, &localParams, s * ANIMPACK_SEG_STEP, animpack_segment_frames(packed, s),
+		                                 track, scratch, packed->data + offset, &keysKept);
+	}
+	packed->segmentOffsets[packed->segmentCount] = (uint32_t)offset;
+	packed->dataSize = offset;
+
+	free(scratch);
+	free(track);
+
+	uint8_t * shrunk = realloc(packed->data, offset);
+	if (shrunk != NULL) {
+		packed->data = shrunk;
+	}
+
+	if (stats != NULL) {
+		stats->rawBytes    = (size_t)clip->keyCount * clip->jointCount * 7 * sizeof(float);
+		stats->packedBytes = packed->dataSize + ((packed->segmentCount + 1) * sizeof(uint32_t));
+		stats->rawKeys     = clip->keyCount * clip->jointCount * 2;
+		stats->packedKeys  = keysKept;
+		if (!animpack_measure_error(packed, clip, stats)) {
+			o3d_animpack_free(packed);
+			return false;
+		}
+	}
+	return true;
+}
+
+void o3d_animpack_free(o3d_animpack_clip_t * packed) {
+	if (packed == NULL) {
+		return;
+	}
+
+	free(packed->data);
+	free(packed->segmentOffsets);
+	memset(packed, 0, sizeof(*packed));
+}
@@ -0,0 +1,118 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_animpack.h
+ * Created on: 17/10/26
+ * Brief: Compressed animation clips: quantized, key-reduced segments with random-access sampling.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_ANIMPACK_H
+#define DARKSTONE_O3D_ANIMPACK_H
+
+#include "o3d_anim.h"
+
+/* ========================================================
+ * Packed animation clips:
+ *
+ * A clip (see o3d_anim.h) is cooked into fixed-size segments
+ * of O3D_ANIMPACK_SEGMENT_KEYS keys, with neighbors sharing
+ * their boundary key, so any time falls entirely inside one
+ * segment and sampling it reads nothing else. Inside each
+ * segment, every joint track keeps only the keys needed to
+ * rebuild the others by interpolation within the tolerances:
+ *
+ *  - Rotations: smallest-three quaternions, the index of the
+ *    largest component in 2 bits and the other three in 10
+ *    bits each, 4 bytes per key (instead of 16).
+ *  - Translations: 16 bits per axis, relative to the range
+ *    of the joint in the segment, 6 bytes per key (instead of 12).
+ *
+ * Tracks that don't move in a segment keep a single key.
+ *
+ * Segment layout, all in one run of bytes:
+ *
+ * +--------------------------------------------+
+ * | uint32 rangesOffset, rotsOffset, possOffset|
+ * | uint8  rotKeyCount, posKeyCount  per joint |
+ * | uint8  rot key frames, pos key frames  ... |
+ * |--------------------------------------------|
+ * | float  posMin[3], posExtent[3]  per joint  | <- rangesOffset
+ * |--------------------------------------------|
+ * | uint32 rotations, joint after joint        | <- rotsOffset
+ * |--------------------------------------------|
+ * | uint16 positions[3], joint after joint     | <- possOffset
+ * +--------------------------------------------+
+ * ======================================================== */
+
+enum {
+	O3D_ANIMPACK_SEGMENT_KEYS = 16  // Including the one shared with the next segment.
+};
+
+/*
+ * Cooking options.
+ */
+typedef struct o3d_animpack_params {
+	float rotTolerance;         // Max rotation error, in radians.
+	float posTolerance;         // Max translation error, in model units. 0 for 1/10000 of the largest in the clip.
+} o3d_animpack_params_t;
+
+/*
+ * Packed clip. Sample it with o3d_animpack_sample().
+ */
+typedef struct o3d_animpack_clip {
+	uint8_t  * data;            // All the segments, back to back, 4 byte aligned.
+	uint32_t * segmentOffsets;  // segmentCount + 1 offsets into `data`.
+	size_t     dataSize;
+	uint32_t   jointCount;
+	uint32_t   paddedJointCount; // Of the poses it samples into.
+	uint32_t   keyCount;
+	uint32_t   segmentCount;
+	float      sampleRate;
+	float      duration;
+} o3d_animpack_clip_t;
+
+/*
+ * Results of packing a clip, for reporting.
+ */
+typedef struct o3d_animpack_stats {
+	size_t   rawBytes;          // Float keys of the source clip (real joints only).
+	size_t   packedBytes;       // Segment data and offsets.
+	uint32_t rawKeys;           // Rotation + translation keys of the source clip.
+	uint32_t packedKeys;        // The ones kept, over all the segments.
+	float    maxRotError;       // Measured at every source key, in radians.
+	float    maxPosError;
+} o3d_animpack_stats_t;
+
+/* ========================================================
+ * Packed clip functions:
+ * ======================================================== */
+
+/*
+ * Fills in the defaults: 0.005 radians (about 0.3 degrees), automatic translation tolerance.
+ */
+void o3d_animpack_default_params(o3d_animpack_params_t * params);
+
+/*
+ * Cooks `clip` into `packed`. Null `params` for the defaults. `stats` may be null.
+ */
+bool o3d_animpack_build(o3d_animpack_clip_t * packed, const o3d_anim_clip_t * clip,
+                        const o3d_animpack_params_t * params, o3d_animpack_stats_t * stats);
+
+/*
+ * Frees the packed data and clears the struct.
+ */
+void o3d_animpack_free(o3d_animpack_clip_t * packed);
+
+/*
+ * Same as o3d_anim_clip_sample(), from the one segment holding `time`.
+ */
+void o3d_animpack_sample(const o3d_animpack_clip_t * packed, float time, o3d_anim_pose_t * pose);
+
+#endif // DARKSTONE_O3D_ANIMPACK_H
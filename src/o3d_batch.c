@@ -0,0 +1,176 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_batch.c
+ * Created on: 17/10/26
+ * Brief: Merges many O3D meshes into shared buffers, batched by texture, for drawing whole levels.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_batch.h"
+
+#include <assert.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * o3d_batch_merge_meshes():
+ * ======================================================== */
+
+bool o3d_batch_merge_meshes(o3d_mesh_t * out, const o3d_mesh_t * const * meshes,
+                            const o3d_transform_t * transforms, uint32_t meshCount) {
+	assert(out    != NULL);
+	assert(meshes != NULL);
+
+	memset(out, 0, sizeof(*out));
+
+	uint64_t totalVertexes   = 0;
+	uint64_t totalIndexes    = 0;
+	uint64_t totalPositions  = 0;
+	for (uint32_t m = 0; m < meshCount; ++m) {
+		totalVertexes  += meshes[m]->vertexCount;
+		totalIndexes   += meshes[m]->indexCount;
+		totalPositions += meshes[m]->positionCount;
+	}
+
+	if (totalIndexes == 0) {
+		return o3d_set_error("No triangles to batch!");
+	}
+	if (totalVertexes > UINT32_MAX || totalIndexes > UINT32_MAX || totalPositions > UINT32_MAX) {
+		return o3d_set_error("Too much geometry for a single batch set!");
+	}
+
+	out->vertexes    = malloc(totalVertexes * sizeof(out->vertexes[0]));
+	out->positionIds = malloc(totalVertexes * sizeof(out->positionIds[0]));
+	out->indexes     = malloc(totalIndexes  * sizeof(out->indexes[0]));
+	out->texNumbers  = malloc((totalIndexes / 3) * sizeof(out->texNumbers[0]));
+
+	if (out->vertexes == NULL || out->positionIds == NULL || out->indexes == NULL || out->texNumbers == NULL) {
+		o3d_mesh_free(out);
+		return o3d_set_error("Unable to malloc batch buffers!");
+	}
+
+	o3d_aabb_t * aabb = &out->aabb;
+	aabb->mins.x = aabb->mins.y = aabb->mins.z =  FLT_MAX;
+	aabb->maxs.x = aabb->maxs.y = aabb->maxs.z = -FLT_MAX;
+
+	uint32_t vertexBase   = 0;
+	uint32_t indexBase    = 0;
+	uint32_t positionBase = 0;
+
+	for (uint32_t m = 0; m < meshCount; ++m) {
+		const o3d_mesh_t * mesh = meshes[m];
+		const o3d_transform_t * xform = (transforms != NULL) ? &transforms[m] : NULL;
+
+		for (uint32_t v = 0; v < mesh->vertexCount; ++v) {
+			o3d_mesh_vertex_t * dst = &out->vertexes[vertexBase + v];
+			*dst = mesh->vertexes[v];
+
+			if (xform != NULL) {
+				const float x = dst->px, y = dst->py, z = dst->pz;
+				dst->px = (xform->m[0][0] * x) + (xform->m[0][1] * y) + (xform->m[0][2] * z) + xform->m[0][3];
+				dst->py = (xform->m[1][0] * x) + (xform->m[1][1] * y) + (xform->m[1][2] * z) + xform->m[1][3];
+				dst->pz = (xform->m[2][0] * x) + (xform->m[2][1] * y) + (xform->m[2][2] * z) + xform->m[2][3];
+			}
+
+			aabb->mins.x = (dst->px < aabb->mins.x) ? dst->px : aabb->mins.x;
+			aabb->mins.y = (dst->py < aabb->mins.y) ? dst->py : aabb->mins.y;
+			aabb->mins.z = (dst->pz < aabb->mins.z) ? dst->pz : aabb->mins.z;
+			aabb->maxs.x = (dst->px > aabb->maxs.x) ? dst->px : aabb->maxs.x;
+			aabb->maxs.y = (dst->py > aabb->maxs.y) ? dst->py : aabb->maxs.y;
+			aabb->maxs.z = (dst->pz > aabb->maxs.z) ? dst->pz : aabb->maxs.z;
+
+			// Positions of different meshes are never shared.
+			out->positionIds[vertexBase + v] = mesh->positionIds[v] + positionBase;
+		}
+
+		for (uint32_t i = 0; i < mesh->indexCount; ++i) {
+			out->indexes[indexBase + i] = mesh->indexes[i] + vertexBase;
+		}
+		memcpy(&out->texNumbers[indexBase / 3], mesh->texNumbers,
+		       o3d_mesh_triangle_count(mesh) * sizeof(out->texNumbers[0]));
+
+		vertexBase   += mesh->vertexCount;
+		indexBase    += mesh->indexCount;
+		positionBase += mesh->positionCount;
+	}
+
+	out->vertexCount   = vertexBase;
+	out->indexCount    = indexBase;
+	out->positionCount = positionBase;
+
+	// Each mesh is usually already grouped; the stable sort keeps
+	// their triangle order within the merged groups.
+	if (!o3d_mesh_group_by_texture(out) || !o3d_mesh_optimize(out)) {
+		o3d_mesh_free(out);
+		return false;
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3d_batch_build_scene():
+ * ======================================================== */
+
+bool o3d_batch_build_scene(o3d_mesh_t * out, const o3d_scene_t * scene) {
+	assert(out   != NULL);
+	assert(scene != NULL);
+
+	memset(out, 0, sizeof(*out));
+
+	if (scene->instanceCount == 0) {
+		return o3d_set_error("Scene has no instances to batch!");
+	}
+
+	// Built on first use: 0 = not yet, 1 = built, 2 = failed.
+	o3d_mesh_t * modelMeshes = calloc(scene->modelCount, sizeof(modelMeshes[0]));
+	uint8_t * meshStates = calloc(scene->modelCount, sizeof(meshStates[0]));
+	const o3d_mesh_t ** instanceMeshes = malloc(scene->instanceCount * sizeof(instanceMeshes[0]));
+	o3d_transform_t * transforms = malloc(scene->instanceCount * sizeof(transforms[0]));
+
+	bool success = (modelMeshes != NULL && meshStates != NULL && instanceMeshes != NULL && transforms != NULL);
+	if (!success) {
+		o3d_set_error("Unable to malloc scene batch buffers!");
+	}
+
+	// Models without any valid faces are left out.
+	uint32_t instanceCount = 0;
+	for (uint32_t i = 0; i < scene->instanceCount && success; ++i) {
+		const o3d_instance_t * inst = &scene->instances[i];
+		const uint32_t m = inst->modelIndex;
+
+		if (meshStates[m] == 0) {
+			meshStates[m] = o3d_mesh_build(&modelMeshes[m], &scene->models[m]) ? 1 : 2;
+		}
+		if (meshStates[m] != 1) {
+			continue;
+		}
+
+		instanceMeshes[instanceCount] = &modelMeshes[m];
+		transforms[instanceCount] = inst->transform;
+		++instanceCount;
+	}
+
+	if (success) {
+		success = o3d_batch_merge_meshes(out, instanceMeshes, transforms, instanceCount);
+	}
+
+	if (modelMeshes != NULL) {
+		for (uint32_t m = 0; m < scene->modelCount; ++m) {
+			o3d_mesh_free(&modelMeshes[m]);
+		}
+	}
+
+	free(modelMeshes);
+	free(meshStates);
+	free(instanceMeshes);
+	free(transforms);
+	return success;
+}
@@ -0,0 +1,47 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_batch.h
+ * Created on: 17/10/26
+ * Brief: Merges many O3D meshes into shared buffers, batched by texture, for drawing whole levels.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_BATCH_H
+#define DARKSTONE_O3D_BATCH_H
+
+#include "o3d_mesh.h"
+#include "o3d_scene.h"
+
+/* ========================================================
+ * Batch building functions:
+ *
+ * The output is a regular o3d_mesh_t, grouped by texture:
+ * each group is one draw batch (a texNumber with its own
+ * contiguous index and vertex ranges), so a whole level
+ * is drawn with one call per distinct texture.
+ * ======================================================== */
+
+/*
+ * Concatenates the meshes into one vertex and index buffer, placing each with
+ * its transform (null `transforms` for all identity, or one per mesh). The same
+ * mesh may be listed several times. Then groups the triangles by texNumber and
+ * optimizes each group (o3d_mesh_group_by_texture() + o3d_mesh_optimize()).
+ * Free the output with o3d_mesh_free().
+ */
+bool o3d_batch_merge_meshes(o3d_mesh_t * out, const o3d_mesh_t * const * meshes,
+                            const o3d_transform_t * transforms, uint32_t meshCount);
+
+/*
+ * Same, for all the instances of a scene. Builds the
+ * mesh of each scene model once, however many instances.
+ */
+bool o3d_batch_build_scene(o3d_mesh_t * out, const o3d_scene_t * scene);
+
+#endif // DARKSTONE_O3D_BATCH_H
@@ -0,0 +1,866 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_bvh.c
+ * Created on: 17/10/26
+ * Brief: Bounding Volume Hierarchy over O3D triangles, for ray and closest-point queries.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_bvh.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Slab tests do a whole box per instruction with SSE, where available.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define O3D_BVH_USE_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define O3D_BVH_USE_SSE 0
+#endif
+
+/* ========================================================
+ * Build parameters:
+ * ======================================================== */
+
+enum {
+	BVH_BIN_COUNT     = 16,
+	BVH_MIN_LEAF_SIZE = 2,  // Never split nodes with this many triangles or fewer.
+	BVH_MAX_LEAF_SIZE = 8   // Split even if the SAH says otherwise.
+};
+
+// Cost of visiting a node, relative to one triangle test.
+static const float BVH_TRAVERSAL_COST = 1.0f;
+
+/* ========================================================
+ * Small vector helpers:
+ * ======================================================== */
+
+static inline float vec3_dot(const float a[3], const float b[3]) {
+	return (a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]);
+}
+
+static inline void vec3_cross(float out[3], const float a[3], const float b[3]) {
+	out[0] = (a[1] * b[2]) - (a[2] * b[1]);
+	out[1] = (a[2] * b[0]) - (a[0] * b[2]);
+	out[2] = (a[0] * b[1]) - (a[1] * b[0]);
+}
+
+static inline void vec3_sub(float out[3], const float a[3], const float b[3]) {
+	out[0] = a[0] - b[0];
+	out[1] = a[1] - b[1];
+	out[2] = a[2] - b[2];
+}
+
+/* ========================================================
+ * Builder:
+ * ======================================================== */
+
+typedef struct bvh_prim {
+	float mins[3];
+	float maxs[3];
+	float centroid[3];
+} bvh_prim_t;
+
+typedef struct bvh_bin {
+	float    mins[3];
+	float    maxs[3];
+	uint32_t count;
+} bvh_bin_t;
+
+typedef struct bvh_builder {
+	const bvh_prim_t * prims;
+	uint32_t         * order;  // Triangle permutation. Leaves reference ranges of it.
+	o3d_bvh_node_t   * nodes;
+	uint32_t           nodeCount;
+	uint32_t           depth;
+} bvh_builder_t;
+
+static inline void bvh_bounds_reset(float mins[3], float maxs[3]) {
+	mins[0] = mins[1] = mins[2] =  FLT_MAX;
+	maxs[0] = maxs[1] = maxs[2] = -FLT_MAX;
+}
+
+static inline void bvh_bounds_grow(float mins[3], float maxs[3], const float pMins[3], const float pMaxs[3]) {
+	for (int i = 0; i < 3; ++i) {
+		mins[i] = (pMins[i] < mins[i]) ? pMins[i] : mins[i];
+		maxs[i] = (pMaxs[i] > maxs[i]) ? pMaxs[i] : maxs[i];
+	}
+}
+
+static inline float bvh_half_area(const float mins[3], const float maxs[3]) {
+	const float dx = maxs[0] - mins[0];
+	const float dy = maxs[1] - mins[1];
+	const float dz = maxs[2] - mins[2];
+	return (dx * dy) + (dy * dz) + (dz * dx);
+}
+
+static void bvh_make_leaf(o3d_bvh_node_t * node, uint32_t first, uint32_t count) {
+	node->offset = first;
+	node->count  = count;
+}
+
+static void bvh_build_node(bvh_builder_t * builder, uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth) {
+	o3d_bvh_node_t * node = &builder->nodes[nodeIndex];
+	const bvh_prim_t * prims = builder->prims;
+	uint32_t * order = builder->order;
+
+	if (depth > builder->depth) {
+		builder->depth = depth;
+	}
+
+	float cMins[3], cMaxs[3];
+	bvh_bounds_reset(node->mins, node->maxs);
+	bvh_bounds_reset(cMins, cMaxs);
+
+	for (uint32_t i = first; i < first + count; ++i) {
+		const bvh_prim_t * prim = &prims[order[i]];
+		bvh_bounds_grow(node->mins, node->maxs, prim->mins, prim->maxs);
+		bvh_bounds_grow(cMins, cMaxs, prim->centroid, prim->centroid);
+	}
+
+	if (count <= BVH_MIN_LEAF_SIZE || depth >= O3D_BVH_MAX_DEPTH) {
+		bvh_make_leaf(node, first, count);
+		return;
+	}
+
+	//
+	// Binned SAH: bin the centroids along each axis and
+	// evaluate a split plane between each pair of bins.
+	//
+	int   bestAxis  = -1;
+	int   bestSplit = 0;
+	float bestCost  = FLT_MAX;
+
+	for (int axis = 0; axis < 3; ++axis) {
+		const float extent = cMaxs[axis] - cMins[axis];
+		if (extent <= 0.0f) {
+			continue;
+		}
+
+		bvh_bin_t bins[BVH_BIN_COUNT];
+		for (int b = 0; b < BVH_BIN_COUNT; ++b) {
+			bvh_bounds_reset(bins[b].mins, bins[b].maxs);
+			bins[b].count = 0;
+		}
+
+		const float scale = (float)BVH_BIN_COUNT * (1.0f - 1e-5f) / extent;
+		for (uint32_t i = first; i < first + count; ++i) {
+			const bvh_prim_t * prim = &prims[order[i]];
+			const int b = (int)((prim->centroid[axis] - cMins[axis]) * scale);
+			bvh_bounds_grow(bins[b].mins, bins[b].maxs, prim->mins, prim->maxs);
+			bins[b].count++;
+		}
+
+		// Sweep from the right to get the cost of each right side:
+		float rightArea[BVH_BIN_COUNT];
+		uint32_t rightCount[BVH_BIN_COUNT];
+		float rMins[3], rMaxs[3];
+		uint32_t rCount = 0;
+		bvh_bounds_reset(rMins, rMaxs);
+
+		for (int b = BVH_BIN_COUNT - 1; b > 0; --b) {
+			bvh_bounds_grow(rMins, rMaxs, bins[b].mins, bins[b].maxs);
+			rCount += bins[b].count;
+			rightArea[b]  = (rCount != 0) ? bvh_half_area(rMins, rMaxs) : 0.0f;
+			rightCount[b] = rCount;
+		}
+
+		// Then from the left, combining both:
+		float lMins[3], lMaxs[3];
+		uint32_t lCount = 0;
+		bvh_bounds_reset(lMins, lMaxs);
+
+		for (int b = 0; b < BVH_BIN_COUNT - 1; ++b) {
+			bvh_bounds_grow(lMins, lMaxs, bins[b].mins, bins[b].maxs);
+			lCount += bins[b].count;
+			if (lCount == 0 || rightCount[b + 1] == 0) {
+				continue;
+			}
+
+			const float cost = (bvh_half_area(lMins, lMaxs) * (float)lCount) +
+			                   (rightArea[b + 1] * (float)rightCount[b + 1]);
+			if (cost < bestCost) {
+				bestCost  = cost;
+				bestAxis  = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	uint32_t mid;
+	if (bestAxis < 0) {
+		// All centroids coincide. Nothing to gain from
+		// splitting, unless the leaf would be too big.
+		if (count <= BVH_MAX_LEAF_SIZE) {
+			bvh_make_leaf(node, first, count);
+			return;
+		}
+		mid = first + (count / 2);
+	} else {
+		const float parentArea = bvh_half_area(node->mins, node->maxs);
+		const float splitCost  = BVH_TRAVERSAL_COST + ((parentArea > 0.0f) ? (bestCost / parentArea) : 0.0f);
+
+		if (splitCost >= (float)count && count <= BVH_MAX_LEAF_SIZE) {
+			bvh_make_leaf(node, first, count);
+			return;
+		}
+
+		// Partition the range in place by the chosen bin:
+		const float extent = cMaxs[bestAxis] - cMins[bestAxis];
+		const float scale  = (float)BVH_BIN_COUNT * (1.0f - 1e-5f) / extent;
+		uint32_t i = first;
+		uint32_t j = first + count;
+
+		while (i < j) {
+			const int b = (int)((prims[order[i]].centroid[bestAxis] - cMins[bestAxis]) * scale);
+			if (b <= bestSplit) {
+				++i;
+			} else {
+				const uint32_t tmp = order[i];
+				order[i] = order[--j];
+				order[j] = tmp;
+			}
+		}
+		mid = i;
+		assert(mid > first && mid < first + count);
+	}
+
+	// Left child goes right after its parent; right child after the whole left subtree.
+	const uint32_t leftIndex = builder->nodeCount++;
+	assert(leftIndex == nodeIndex + 1);
+	bvh_build_node(builder, leftIndex, first, mid - first, depth + 1);
+
+	const uint32_t rightIndex = builder->nodeCount++;
+	node->offset = rightIndex;
+	node->count  = 0;
+	bvh_build_node(builder, rightIndex, mid, (first + count) - mid, depth + 1);
+}
+
+//
+// Common part of both build functions. Takes ownership of `triangles`,
+// which are in input order, and reorders them to match the leaves.
+//
+static bool bvh_build_common(o3d_bvh_t * bvh, o3d_bvh_triangle_t * triangles, uint32_t triangleCount) {
+	if (triangleCount == 0) {
+		free(triangles);
+		return o3d_set_error("No valid triangles to build a BVH from!");
+	}
+
+	bvh_prim_t * prims = malloc(triangleCount * sizeof(prims[0]));
+	uint32_t   * order = malloc(triangleCount * sizeof(order[0]));
+	bvh->nodes = malloc(((triangleCount * 2) - 1) * sizeof(bvh->nodes[0]));
+	bvh->triangles = malloc(triangleCount * sizeof(bvh->triangles[0]));
+
+	if (prims == NULL || order == NULL || bvh->nodes == NULL || bvh->triangles == NULL) {
+		free(prims);
+		free(order);
+		free(triangles);
+		o3d_bvh_free(bvh);
+		return o3d_set_error("Unable to malloc BVH build buffers!");
+	}
+
+	for (uint32_t t = 0; t < triangleCount; ++t) {
+		const o3d_bvh_triangle_t * tri = &triangles[t];
+		bvh_prim_t * prim = &prims[t];
+
+		for (int i = 0; i < 3; ++i) {
+			const float p0 = tri->v0[i];
+			const float p1 = tri->v0[i] + tri->edge1[i];
+			const float p2 = tri->v0[i] + tri->edge2[i];
+			prim->mins[i] = fminf(p0, fminf(p1, p2));
+			prim->maxs[i] = fmaxf(p0, fmaxf(p1, p2));
+			prim->centroid[i] = (prim->mins[i] + prim->maxs[i]) * 0.5f;
+		}
+		order[t] = t;
+	}
+
+	bvh_builder_t builder;
+	builder.prims     = prims;
+	builder.order     = order;
+	builder.nodes     = bvh->nodes;
+	builder.nodeCount = 1;
+	builder.depth     = 0;
+
+	bvh_build_node(&builder, 0, 0, triangleCount, 1);
+
+	for (uint32_t t = 0; t < triangleCount; ++t) {
+		bvh->triangles[t] = triangles[order[t]];
+	}
+
+	bvh->nodeCount     = builder.nodeCount;
+	bvh->triangleCount = triangleCount;
+	bvh->depth         = builder.depth;
+
+	// Give back the unused tail of the worst case node allocation.
+	o3d_bvh_node_t * nodes = realloc(bvh->nodes, bvh->nodeCount * sizeof(bvh->nodes[0]));
+	if (nodes != NULL) {
+		bvh->nodes = nodes;
+	}
+
+	free(prims);
+	free(order);
+	free(triangles);
+	return true;
+}
+
+static inline void bvh_set_triangle(o3d_bvh_triangle_t * tri, const float * p0, const float * p1,
+                                    const float * p2, uint32_t faceIndex) {
+	tri->v0[0] = p0[0];
+	tri->v0[1] = p0[1];
+	tri->v0[2] = p0[2];
+	vec3_sub(tri->edge1, p1, p0);
+	vec3_sub(tri->edge2, p2, p0);
+	tri->faceIndex = faceIndex;
+}
+
+/* ========================================================
+ * o3d_bvh_build():
+ * ======================================================== */
+
+bool o3d_bvh_build(o3d_bvh_t * bvh, const o3d_model_t * o3d) {
+	assert(bvh != NULL);
+	assert(o3d != NULL);
+
+	memset(bvh, 0, sizeof(*bvh));
+
+	o3d_face_streams_t streams;
+	if (!o3d_face_streams_build(&streams, o3d, NULL)) {
+		return false;
+	}
+
+	const bool success = o3d_bvh_build_from_streams(bvh, &streams, o3d->vertexes, o3d->vertexCount);
+	o3d_face_streams_free(&streams);
+	return success;
+}
+
+bool o3d_bvh_build_from_streams(o3d_bvh_t * bvh, const o3d_face_streams_t * streams,
+                                const o3d_vertex_t * vertexes, uint32_t vertexCount) {
+	assert(bvh      != NULL);
+	assert(streams  != NULL);
+	assert(vertexes != NULL);
+
+	memset(bvh, 0, sizeof(*bvh));
+
+	// Worst case of all faces being quadrilaterals.
+	o3d_bvh_triangle_t * triangles = malloc(((size_t)streams->faceCount * 2 + 1) * sizeof(triangles[0]));
+	if (triangles == NULL) {
+		return o3d_set_error("Unable to malloc BVH triangles!");
+	}
+
+	// Only the index stream is read from the faces.
+	uint32_t triangleCount = 0;
+	for (uint32_t f = 0; f < streams->faceCount; ++f) {
+		const o3d_face_indexes_t * face = &streams->indexes[f];
+		uint8_t corners[4];
+		const uint32_t cornerCount = o3d_face_corners(face, vertexCount, corners);
+		if (cornerCount == 0) {
+			continue;
+		}
+		const bool isQuad = (cornerCount == 4);
+
+		const float * p[4];
+		for (uint32_t c = 0; c < cornerCount; ++c) {
+			p[c] = &vertexes[face->index[corners[c]]].x;
+		}
+
+		// Quads split as 0,1,3 and 3,1,2, like the viewer and o3d_mesh_build().
+		if (isQuad) {
+			bvh_set_triangle(&triangles[triangleCount++], p[0], p[1], p[3], f);
+			bvh_set_triangle(&triangles[triangleCount++], p[3], p[1], p[2], f);
+		} else {
+			bvh_set_triangle(&triangles[triangleCount++], p[0], p[1], p[2], f);
+		}
+	}
+
+	return bvh_build_common(bvh, triangles, triangleCount);
+}
+
+/* ========================================================
+ * o3d_bvh_build_from_triangles():
+ * ======================================================== */
+
+bool o3d_bvh_build_from_triangles(o3d_bvh_t * bvh, const void * positions, size_t stride, uint32_t vertexCount,
+                                  const uint32_t * indexes, uint32_t indexCount) {
+	assert(bvh       != NULL);
+	assert(positions != NULL);
+	assert(indexes   != NULL);
+	assert(stride >= 3 * sizeof(float));
+
+	memset(bvh, 0, sizeof(*bvh));
+
+	const uint32_t inputTriangles = indexCount / 3;
+	o3d_bvh_triangle_t * triangles = malloc(((size_t)inputTriangles + 1) * sizeof(triangles[0]));
+	if (triangles == NULL) {
+		return o3d_set_error("Unable to malloc BVH triangles!");
+	}
+
+	const uint8_t * base = positions;
+	uint32_t triangleCount = 0;
+
+	for (uint32_t t = 0; t < inputTriangles; ++t) {
+		const uint32_t * tri = &indexes[t * 3];
+		if (tri[0] >= vertexCount || tri[1] >= vertexCount || tri[2] >= vertexCount) {
+			continue;
+		}
+
+		bvh_set_triangle(&triangles[triangleCount++],
+		                 (const float *)(base + tri[0] * stride),
+		                 (const float *)(base + tri[1] * stride),
+		                 (const float *)(base + tri[2] * stride), t);
+	}
+
+	return bvh_build_common(bvh, triangles, triangleCount);
+}
+
+/* ========================================================
+ * o3d_bvh_build_from_soa():
+ * ======================================================== */
+
+bool o3d_bvh_build_from_soa(o3d_bvh_t * bvh, const o3d_vertex_soa_t * soa,
+                            const uint32_t * indexes, uint32_t indexCount) {
+	assert(bvh     != NULL);
+	assert(soa     != NULL);
+	assert(indexes != NULL);
+
+	memset(bvh, 0, sizeof(*bvh));
+
+	const uint32_t inputTriangles = indexCount / 3;
+	o3d_bvh_triangle_t * triangles = malloc(((size_t)inputTriangles + 1) * sizeof(triangles[0]));
+	if (triangles == NULL) {
+		return o3d_set_error("Unable to malloc BVH triangles!");
+	}
+
+	uint32_t triangleCount = 0;
+	for (uint32_t t = 0; t < inputTriangles; ++t) {
+		const uint32_t * tri = &indexes[t * 3];
+		if (tri[0] >= soa->count || tri[1] >= soa->count || tri[2] >= soa->count) {
+			continue;
+		}
+
+		const float p0[3] = { soa->x[tri[0]], soa->y[tri[0]], soa->z[tri[0]] };
+		const float p1[3] = { soa->x[tri[1]], soa->y[tri[1]], soa->z[tri[1]] };
+		const float p2[3] = { soa->x[tri[2]], soa->y[tri[2]], soa->z[tri[2]] };
+		bvh_set_triangle(&triangles[triangleCount++], p0, p1, p2, t);
+	}
+
+	return bvh_build_common(bvh, triangles, triangleCount);
+}
+
+/* ========================================================
+ * o3d_bvh_free():
+ * ======================================================== */
+
+void o3d_bvh_free(o3d_bvh_t * bvh) {
+	if (bvh == NULL) {
+		return;
+	}
+
+	free(bvh->nodes);
+	free(bvh->triangles);
+	memset(bvh, 0, sizeof(*bvh));
+}
+
+/* ========================================================
+ * Ray traversal:
+ * ======================================================== */
+
+typedef struct bvh_ray {
+	float origin[3];
+	float dir[3];
+	float invDir[3];
+	#if O3D_BVH_USE_SSE
+	__m128 originV;
+	__m128 invDirV;
+	#endif // O3D_BVH_USE_SSE
+} bvh_ray_t;
+
+typedef struct bvh_stack_entry {
+	uint32_t node;
+	float    dist; // Entry distance (rays) or squared box distance (closest point).
+} bvh_stack_entry_t;
+
+static void bvh_ray_init(bvh_ray_t * ray, const o3d_vertex_t * origin, const o3d_vertex_t * dir) {
+	ray->origin[0] = origin->x;
+	ray->origin[1] = origin->y;
+	ray->origin[2] = origin->z;
+	ray->dir[0] = dir->x;
+	ray->dir[1] = dir->y;
+	ray->dir[2] = dir->z;
+
+	// Zero direction components give infinities, which the slab test handles.
+	for (int i = 0; i < 3; ++i) {
+		ray->invDir[i] = 1.0f / ray->dir[i];
+	}
+
+	#if O3D_BVH_USE_SSE
+	ray->originV = _mm_setr_ps(ray->origin[0], ray->origin[1], ray->origin[2], 0.0f);
+	ray->invDirV = _mm_setr_ps(ray->invDir[0], ray->invDir[1], ray->invDir[2], 0.0f);
+	#endif // O3D_BVH_USE_SSE
+}
+
+//
+// Slab test. On a hit, `tEnter` gets the distance where the ray enters the box.
+//
+static inline bool bvh_ray_box(const bvh_ray_t * ray, const o3d_bvh_node_t * node, float tMax, float * tEnter) {
+	#if O3D_BVH_USE_SSE
+	// The 4th lane (offset/count) is loaded but never read back.
+	const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->mins), ray->originV), ray->invDirV);
+	const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->maxs), ray->originV), ray->invDirV);
+	// A ray parallel to a slab and starting on one of its planes gets 0 * inf = NaN there.
+	// Such an axis doesn't clip the ray, so its lane is replaced by -inf/+inf before the
+	// reductions below, which would otherwise let the NaN through or drop the other axes.
+	const __m128 ordered = _mm_cmpord_ps(t1, t2);
+	const __m128 tNear = _mm_or_ps(_mm_and_ps(ordered, _mm_min_ps(t1, t2)), _mm_andnot_ps(ordered, _mm_set1_ps(-INFINITY)));
+	const __m128 tFar  = _mm_or_ps(_mm_and_ps(ordered, _mm_max_ps(t1, t2)), _mm_andnot_ps(ordered, _mm_set1_ps(INFINITY)));
+
+	__m128 enter = _mm_max_ss(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(1, 1, 1, 1)));
+	enter = _mm_max_ss(enter, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(2, 2, 2, 2)));
+	enter = _mm_max_ss(enter, _mm_setzero_ps());
+
+	__m128 exit = _mm_min_ss(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(1, 1, 1, 1)));
+	exit = _mm_min_ss(exit, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(2, 2, 2, 2)));
+	exit = _mm_min_ss(exit, _mm_set_ss(tMax));
+
+	*tEnter = _mm_cvtss_f32(enter);
+	return _mm_comile_ss(enter, exit) != 0;
+	#else // !O3D_BVH_USE_SSE
+	float enter = 0.0f;
+	float exit  = tMax;
+	for (int i = 0; i < 3; ++i) {
+		const float t1 = (node->mins[i] - ray->origin[i]) * ray->invDir[i];
+		const float t2 = (node->maxs[i] - ray->origin[i]) * ray->invDir[i];
+		if (isnan(t1) || isnan(t2)) {
+			continue; // Parallel to the slab and on one of its planes, as above.
+		}
+		enter = fmaxf(enter, fminf(t1, t2));
+		exit  = fminf(exit,  fmaxf(t1, t2));
+	}
+	*tEnter = enter;
+	return enter <= exit;
+	#endif // O3D_BVH_USE_SSE
+}
+
+//
+// Moller-Trumbore ray/triangle test, double sided.
+//
+static inline bool bvh_ray_triangle(const bvh_ray_t * ray, const o3d_bvh_triangle_t * tri,
+                                    float tMax, float * tOut, float * uOut, float * vOut) {
+	float pvec[3], tvec[3], qvec[3];
+
+	vec3_cross(pvec, ray->dir, tri->edge2);
+	const float det = vec3_dot(tri->edge1, pvec);
+	if (fabsf(det) < 1e-12f) {
+		return false;
+	}
+
+	const float invDet = 1.0f / det;
+	vec3_sub(tvec, ray->origin, tri->v0);
+
+	const float u = vec3_dot(tvec, pvec) * invDet;
+	if (u < 0.0f || u > 1.0f) {
+		return false;
+	}
+
+	vec3_cross(qvec, tvec, tri->edge1);
+	const float v = vec3_dot(ray->dir, qvec) * invDet;
+	if (v < 0.0f || (u + v) > 1.0f) {
+		return false;
+	}
+
+	const float t = vec3_dot(tri->edge2, qvec) * invDet;
+	if (t < 0.0f || t > tMax) {
+		return false;
+	}
+
+	*tOut = t;
+	*uOut = u;
+	*vOut = v;
+	return true;
+}
+
+//
+// Shared by the first hit and any hit queries. Children are
+// visited near to far, so first hit can cull most of the tree
+// once the closest hit so far gets short.
+//
+static bool bvh_trace(const o3d_bvh_t * bvh, const bvh_ray_t * ray, float tMax, bool anyHit, o3d_bvh_hit_t * hit) {
+	bvh_stack_entry_t stack[O3D_BVH_MAX_DEPTH];
+	uint32_t stackSize = 0;
+	bool found = false;
+
+	float tEnter;
+	if (bvh->nodeCount == 0 || !bvh_ray_box(ray, &bvh->nodes[0], tMax, &tEnter)) {
+		return false;
+	}
+
+	uint32_t nodeIndex = 0;
+	for (;;) {
+		const o3d_bvh_node_t * node = &bvh->nodes[nodeIndex];
+
+		if (node->count != 0) {
+			for (uint32_t i = node->offset; i < node->offset + node->count; ++i) {
+				float t, u, v;
+				if (bvh_ray_triangle(ray, &bvh->triangles[i], tMax, &t, &u, &v)) {
+					found = true;
+					if (anyHit) {
+						return true;
+					}
+					tMax = t;
+					hit->t = t;
+					hit->u = u;
+					hit->v = v;
+					hit->triangle  = i;
+					hit->faceIndex = bvh->triangles[i].faceIndex;
+				}
+			}
+		} else {
+			const uint32_t left  = nodeIndex + 1;
+			const uint32_t right = node->offset;
+			float tLeft, tRight;
+			const bool hitLeft  = bvh_ray_box(ray, &bvh->nodes[left],  tMax, &tLeft);
+			const bool hitRight = bvh_ray_box(ray, &bvh->nodes[right], tMax, &tRight);
+
+			if (hitLeft && hitRight) {
+				const bool leftFirst = (tLeft <= tRight);
+				assert(stackSize < O3D_BVH_MAX_DEPTH);
+				stack[stackSize].node = leftFirst ? right  : left;
+				stack[stackSize].dist = leftFirst ? tRight : tLeft;
+				++stackSize;
+				nodeIndex = leftFirst ? left : right;
+				continue;
+			}
+			if (hitLeft || hitRight) {
+				nodeIndex = hitLeft ? left : right;
+				continue;
+			}
+		}
+
+		// Pop, skipping the boxes now behind the closest hit.
+		for (;;) {
+			if (stackSize == 0) {
+				return found;
+			}
+			--stackSize;
+			if (stack[stackSize].dist <= tMax) {
+				break;
+			}
+		}
+		nodeIndex = stack[stackSize].node;
+	}
+}
+
+/* ========================================================
+ * o3d_bvh_ray_first_hit():
+ * ======================================================== */
+
+bool o3d_bvh_ray_first_hit(const o3d_bvh_t * bvh, const o3d_vertex_t * origin, const o3d_vertex_t * dir,
+                           float tMax, o3d_bvh_hit_t * hit) {
+	assert(bvh    != NULL);
+	assert(origin != NULL);
+	assert(dir    != NULL);
+	assert(hit    != NULL);
+
+	bvh_ray_t ray;
+	bvh_ray_init(&ray, origin, dir);
+	return bvh_trace(bvh, &ray, tMax, false, hit);
+}
+
+/* ========================================================
+ * o3d_bvh_ray_any_hit():
+ * ======================================================== */
+
+bool o3d_bvh_ray_any_hit(const o3d_bvh_t * bvh, const o3d_vertex_t * origin, const o3d_vertex_t * dir, float tMax) {
+	assert(bvh    != NULL);
+	assert(origin != NULL);
+	assert(dir    != NULL);
+
+	bvh_ray_t ray;
+	bvh_ray_init(&ray, origin, dir);
+	return bvh_trace(bvh, &ray, tMax, true, NULL);
+}
+
+/* ========================================================
+ * Closest point queries:
+ * ======================================================== */
+
+//
+// Squared distance from the point to the box (zero if inside).
+//
+static inline float bvh_box_distance_sq(const o3d_bvh_node_t * node, const float p[3]) {
+	#if O3D_BVH_USE_SSE
+	const __m128 point = _mm_setr_ps(p[0], p[1], p[2], 0.0f);
+	__m128 d = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node->mins), point),
+	                      _mm_sub_ps(point, _mm_loadu_ps(node->maxs)));
+	d = _mm_max_ps(d, _mm_setzero_ps());
+	d = _mm_mul_ps(d, d);
+
+	__m128 sum = _mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1)));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 2, 2, 2)));
+	return _mm_cvtss_f32(sum);
+	#else // !O3D_BVH_USE_SSE
+	float sum = 0.0f;
+	for (int i = 0; i < 3; ++i) {
+		const float d = fmaxf(fmaxf(node->mins[i] - p[i], p[i] - node->maxs[i]), 0.0f);
+		sum += d * d;
+	}
+	return sum;
+	#endif // O3D_BVH_USE_SSE
+}
+
+//
+// Barycentrics (s along edge1, t along edge2) of the closest point on a
+// triangle, from Real-Time Collision Detection (Ericson), section 5.1.5.
+//
+static void bvh_closest_barycentrics(const o3d_bvh_triangle_t * tri, const float p[3], float * s, float * t) {
+	const float * ab = tri->edge1;
+	const float * ac = tri->edge2;
+	float ap[3], bp[3], cp[3];
+
+	vec3_sub(ap, p, tri->v0);
+	const float d1 = vec3_dot(ab, ap);
+	const float d2 = vec3_dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		*s = 0.0f; *t = 0.0f; // Vertex A
+		return;
+	}
+
+	vec3_sub(bp, ap, ab);
+	const float d3 = vec3_dot(ab, bp);
+	const float d4 = vec3_dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) {
+		*s = 1.0f; *t = 0.0f; // Vertex B
+		return;
+	}
+
+	const float vc = (d1 * d4) - (d3 * d2);
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		*s = d1 / (d1 - d3); *t = 0.0f; // Edge AB
+		return;
+	}
+
+	vec3_sub(cp, ap, ac);
+	const float d5 = vec3_dot(ab, cp);
+	const float d6 = vec3_dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) {
+		*s = 0.0f; *t = 1.0f; // Vertex C
+		return;
+	}
+
+	const float vb = (d5 * d2) - (d1 * d6);
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		*s = 0.0f; *t = d2 / (d2 - d6); // Edge AC
+		return;
+	}
+
+	const float va = (d3 * d6) - (d5 * d4);
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		*t = (d4 - d3) / ((d4 - d3) + (d5 - d6)); // Edge BC
+		*s = 1.0f - *t;
+		return;
+	}
+
+	// Inside the face.
+	const float denom = 1.0f / (va + vb + vc);
+	*s = vb * denom;
+	*t = vc * denom;
+}
+
+static inline void bvh_closest_on_triangle(const o3d_bvh_triangle_t * tri, const float p[3], float out[3]) {
+	float s, t;
+	bvh_closest_barycentrics(tri, p, &s, &t);
+	for (int i = 0; i < 3; ++i) {
+		out[i] = tri->v0[i] + (tri->edge1[i] * s) + (tri->edge2[i] * t);
+	}
+}
+
+/* ========================================================
+ * o3d_bvh_closest_point():
+ * ======================================================== */
+
+bool o3d_bvh_closest_point(const o3d_bvh_t * bvh, const o3d_vertex_t * point, float maxDistance,
+                           o3d_bvh_closest_t * result) {
+	assert(bvh    != NULL);
+	assert(point  != NULL);
+	assert(result != NULL);
+
+	const float p[3] = { point->x, point->y, point->z };
+	float bestDistSq = maxDistance * maxDistance;
+	bool found = false;
+
+	bvh_stack_entry_t stack[O3D_BVH_MAX_DEPTH];
+	uint32_t stackSize = 0;
+
+	if (bvh->nodeCount == 0 || bvh_box_distance_sq(&bvh->nodes[0], p) > bestDistSq) {
+		return false;
+	}
+
+	uint32_t nodeIndex = 0;
+	for (;;) {
+		const o3d_bvh_node_t * node = &bvh->nodes[nodeIndex];
+
+		if (node->count != 0) {
+			for (uint32_t i = node->offset; i < node->offset + node->count; ++i) {
+				float closest[3], delta[3];
+				bvh_closest_on_triangle(&bvh->triangles[i], p, closest);
+				vec3_sub(delta, closest, p);
+
+				const float distSq = vec3_dot(delta, delta);
+				if (distSq <= bestDistSq) {
+					found = true;
+					bestDistSq = distSq;
+					result->point.x   = closest[0];
+					result->point.y   = closest[1];
+					result->point.z   = closest[2];
+					result->triangle  = i;
+					result->faceIndex = bvh->triangles[i].faceIndex;
+				}
+			}
+		} else {
+			const uint32_t left  = nodeIndex + 1;
+			const uint32_t right = node->offset;
+			const float dLeft  = bvh_box_distance_sq(&bvh->nodes[left],  p);
+			const float dRight = bvh_box_distance_sq(&bvh->nodes[right], p);
+			const bool nearLeft  = (dLeft  <= bestDistSq);
+			const bool nearRight = (dRight <= bestDistSq);
+
+			if (nearLeft && nearRight) {
+				const bool leftFirst = (dLeft <= dRight);
+				assert(stackSize < O3D_BVH_MAX_DEPTH);
+				stack[stackSize].node = leftFirst ? right  : left;
+				stack[stackSize].dist = leftFirst ? dRight : dLeft;
+				++stackSize;
+				nodeIndex = leftFirst ? left : right;
+				continue;
+			}
+			if (nearLeft || nearRight) {
+				nodeIndex = nearLeft ? left : right;
+				continue;
+			}
+		}
+
+		for (;;) {
+			if (stackSize == 0) {
+				if (found) {
+					result->distance = sqrtf(bestDistSq);
+				}
+				return found;
+			}
+			--stackSize;
+			if (stack[stackSize].dist <= bestDistSq) {
+				break;
+			}
+		}
+		nodeIndex = stack[stackSize].node;
+	}
+}
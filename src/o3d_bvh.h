@@ -0,0 +1,142 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_bvh.h
+ * Created on: 17/10/26
+ * Brief: Bounding Volume Hierarchy over O3D triangles, for ray and closest-point queries.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_BVH_H
+#define DARKSTONE_O3D_BVH_H
+
+#include "o3d.h"
+#include "o3d_faces.h"
+#include "o3d_soa.h"
+
+#include <stddef.h>
+
+/* ========================================================
+ * BVH data structures:
+ * ======================================================== */
+
+/*
+ * Flattened BVH node (32 bytes, two per cache line). Nodes are stored
+ * in depth-first order, so the left child of an inner node is always
+ * the next node in the array and only the right child is stored.
+ */
+typedef struct o3d_bvh_node {
+	float    mins[3];
+	uint32_t offset;    // Leaf: first triangle. Inner node: index of the right child.
+	float    maxs[3];
+	uint32_t count;     // Leaf: number of triangles. Zero for inner nodes.
+} o3d_bvh_node_t;
+
+/*
+ * Triangle in the ready-to-intersect form used by the leaves.
+ * Triangles are reordered so that each leaf's are contiguous.
+ */
+typedef struct o3d_bvh_triangle {
+	float    v0[3];
+	float    edge1[3];  // v1 - v0
+	float    edge2[3];  // v2 - v0
+	uint32_t faceIndex; // Source face (o3d_bvh_build) or triangle (the other builds).
+} o3d_bvh_triangle_t;
+
+typedef struct o3d_bvh {
+	o3d_bvh_node_t     * nodes;     // nodes[0] is the root.
+	o3d_bvh_triangle_t * triangles;
+	uint32_t             nodeCount;
+	uint32_t             triangleCount;
+	uint32_t             depth;     // Deepest leaf; the root is depth 1.
+} o3d_bvh_t;
+
+/*
+ * Result of o3d_bvh_ray_first_hit().
+ * The hit point is v0 + edge1 * u + edge2 * v.
+ */
+typedef struct o3d_bvh_hit {
+	float    t;         // Distance along the ray, in units of the direction length.
+	float    u, v;      // Barycentrics of the hit in the triangle.
+	uint32_t triangle;  // Index into o3d_bvh_t::triangles.
+	uint32_t faceIndex; // Copy of the triangle's faceIndex.
+} o3d_bvh_hit_t;
+
+/*
+ * Result of o3d_bvh_closest_point().
+ */
+typedef struct o3d_bvh_closest {
+	o3d_vertex_t point;
+	float        distance;
+	uint32_t     triangle;
+	uint32_t     faceIndex;
+} o3d_bvh_closest_t;
+
+// Traversal stack size. Builds stop splitting nodes past this depth.
+enum { O3D_BVH_MAX_DEPTH = 64 };
+
+/* ========================================================
+ * BVH functions:
+ * ======================================================== */
+
+/*
+ * Builds a BVH over the faces of a model (quads split as 0,1,3 and 3,1,2).
+ * Repeated corners are collapsed and invalid faces skipped (o3d_face_corners()).
+ * Nodes are split with the Surface Area Heuristic, evaluated over 16 bins of the
+ * centroid bounds.
+ */
+bool o3d_bvh_build(o3d_bvh_t * bvh, const o3d_model_t * o3d);
+
+/*
+ * Same, but reading the faces from split streams (see o3d_faces.h).
+ * Only the index stream is touched.
+ */
+bool o3d_bvh_build_from_streams(o3d_bvh_t * bvh, const o3d_face_streams_t * streams,
+                                const o3d_vertex_t * vertexes, uint32_t vertexCount);
+
+/*
+ * Same, but from an indexed triangle list. `positions` points to the XYZ floats
+ * of the first vertex and `stride` is the size in bytes of each vertex, so this
+ * works with o3d_mesh_t vertexes directly, or with merged level geometry.
+ */
+bool o3d_bvh_build_from_triangles(o3d_bvh_t * bvh, const void * positions, size_t stride, uint32_t vertexCount,
+                                  const uint32_t * indexes, uint32_t indexCount);
+
+/*
+ * Same, from SoA positions (o3d_soa.h).
+ */
+bool o3d_bvh_build_from_soa(o3d_bvh_t * bvh, const o3d_vertex_soa_t * soa,
+                            const uint32_t * indexes, uint32_t indexCount);
+
+/*
+ * Frees the memory of a BVH. Safe to call on a zeroed or failed BVH.
+ */
+void o3d_bvh_free(o3d_bvh_t * bvh);
+
+/*
+ * Nearest intersection along the ray in the range [0, tMax]. Both sides of
+ * the triangles are hit. `dir` need not be normalized. Returns false on a miss.
+ */
+bool o3d_bvh_ray_first_hit(const o3d_bvh_t * bvh, const o3d_vertex_t * origin, const o3d_vertex_t * dir,
+                           float tMax, o3d_bvh_hit_t * hit);
+
+/*
+ * Whether the ray hits anything in [0, tMax]. Stops at the first hit found,
+ * so this is the one to use for occlusion/shadow rays.
+ */
+bool o3d_bvh_ray_any_hit(const o3d_bvh_t * bvh, const o3d_vertex_t * origin, const o3d_vertex_t * dir, float tMax);
+
+/*
+ * Closest point on the triangles to `point`, within `maxDistance`.
+ * Returns false if no triangle is that close.
+ */
+bool o3d_bvh_closest_point(const o3d_bvh_t * bvh, const o3d_vertex_t * point, float maxDistance,
+                           o3d_bvh_closest_t * result);
+
+#endif // DARKSTONE_O3D_BVH_H
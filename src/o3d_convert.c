@@ -0,0 +1,660 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_convert.c
+ * Created on: 17/10/26
+ * Brief: Conversion of cooked O3D meshes to Wavefront OBJ and binary glTF 2.0 (GLB).
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_convert.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest text of a single formatted number, with some slack.
+enum { CONVERT_MAX_NUMBER_LEN = 32 };
+
+// Of a material name or texture URI.
+enum { CONVERT_MAX_NAME_LEN = 256 };
+
+/* ========================================================
+ * o3d_out_init() / o3d_out_free() / o3d_out_reset():
+ * ======================================================== */
+
+void o3d_out_init(o3d_out_buffer_t * buf) {
+	assert(buf != NULL);
+	memset(buf, 0, sizeof(*buf));
+}
+
+void o3d_out_free(o3d_out_buffer_t * buf) {
+	if (buf == NULL) {
+		return;
+	}
+
+	free(buf->data);
+	memset(buf, 0, sizeof(*buf));
+}
+
+void o3d_out_reset(o3d_out_buffer_t * buf) {
+	assert(buf != NULL);
+	buf->size   = 0;
+	buf->failed = false;
+}
+
+/* ========================================================
+ * o3d_out_reserve():
+ * ======================================================== */
+
+bool o3d_out_reserve(o3d_out_buffer_t * buf, size_t extra) {
+	assert(buf != NULL);
+
+	if (buf->failed) {
+		return false;
+	}
+	if (buf->capacity - buf->size >= extra) {
+		return true;
+	}
+
+	size_t newCapacity = (buf->capacity != 0) ? (buf->capacity * 2) : 4096;
+	while (newCapacity - buf->size < extra) {
+		newCapacity *= 2;
+	}
+
+	char * data = realloc(buf->data, newCapacity);
+	if (data == NULL) {
+		buf->failed = true;
+		return false;
+	}
+
+	buf->data     = data;
+	buf->capacity = newCapacity;
+	return true;
+}
+
+/* ========================================================
+ * o3d_out_bytes() / o3d_out_string():
+ * ======================================================== */
+
+void o3d_out_bytes(o3d_out_buffer_t * buf, const void * data, size_t size) {
+	if (!o3d_out_reserve(buf, size)) {
+		return;
+	}
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+}
+
+void o3d_out_string(o3d_out_buffer_t * buf, const char * str) {
+	assert(str != NULL);
+	o3d_out_bytes(buf, str, strlen(str));
+}
+
+static inline void convert_out_char(o3d_out_buffer_t * buf, char ch) {
+	if (o3d_out_reserve(buf, 1)) {
+		buf->data[buf->size++] = ch;
+	}
+}
+
+/* ========================================================
+ * o3d_out_uint() / o3d_out_float():
+ * ======================================================== */
+
+static inline char * convert_format_uint(char * p, uint64_t value) {
+	char digits[20];
+	int count = 0;
+	do {
+		digits[count++] = (char)('0' + (value % 10));
+		value /= 10;
+	} while (value != 0);
+
+	while (count > 0) {
+		*p++ = digits[--count];
+	}
+	return p;
+}
+
+//
+// Fixed point with 6 decimal places, rounded, trailing zeros removed.
+// Well under the precision of the O3D positions and UVs that matters,
+// and several times faster than going through printf's "%g".
+//
+static inline char * convert_format_float(char * p, float value) {
+	const double v = (double)value;
+
+	if ((v - v) != 0.0) {
+		// NaN or infinity. Neither OBJ nor JSON have a spelling for these.
+		*p++ = '0';
+		return p;
+	}
+
+	if (v >= 1e9 || v <= -1e9) {
+		return p + snprintf(p, CONVERT_MAX_NUMBER_LEN, "%.9g", v);
+	}
+
+	const bool negative = (v < 0.0);
+	const uint64_t scaled = (uint64_t)((negative ? -v : v) * 1e6 + 0.5);
+	if (scaled == 0) {
+		*p++ = '0';
+		return p; // No "-0".
+	}
+
+	if (negative) {
+		*p++ = '-';
+	}
+	p = convert_format_uint(p, scaled / 1000000);
+
+	uint32_t fraction = (uint32_t)(scaled % 1000000);
+	if (fraction != 0) {
+		int places = 6;
+		while ((fraction % 10) == 0) {
+			fraction /= 10;
+			--places;
+		}
+
+		*p++ = '.';
+		for (int i = places - 1; i >= 0; --i) {
+			p[i] = (char)('0' + (fraction % 10));
+			fraction /= 10;
+		}
+		p += places;
+	}
+	return p;
+}
+
+void o3d_out_uint(o3d_out_buffer_t * buf, uint32_t value) {
+	if (o3d_out_reserve(buf, CONVERT_MAX_NUMBER_LEN)) {
+		buf->size = (size_t)(convert_format_uint(buf->data + buf->size, value) - buf->data);
+	}
+}
+
+void o3d_out_float(o3d_out_buffer_t * buf, float value) {
+	if (o3d_out_reserve(buf, CONVERT_MAX_NUMBER_LEN)) {
+		buf->size = (size_t)(convert_format_float(buf->data + buf->size, value) - buf->data);
+	}
+}
+
+/* ========================================================
+ * o3d_out_write_file():
+ * ======================================================== */
+
+bool o3d_out_write_file(const o3d_out_buffer_t * buf, const char * filename) {
+	assert(buf != NULL);
+	assert(filename != NULL && *filename != '\0');
+
+	if (buf->failed) {
+		return o3d_set_error("Ran out of memory formatting the output file!");
+	}
+
+	FILE * fileOut = fopen(filename, "wb");
+	if (fileOut == NULL) {
+		return o3d_set_error("Can't open output file for writing!");
+	}
+
+	const bool written = (buf->size == 0) || (fwrite(buf->data, 1, buf->size, fileOut) == buf->size);
+	const bool closed  = (fclose(fileOut) == 0);
+
+	if (!written || !closed) {
+		return o3d_set_error("Failed to write output file!");
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3d_export_texture_name():
+ * ======================================================== */
+
+void o3d_export_texture_name(const char * path, char * name, size_t maxLen) {
+	assert(path != NULL);
+	assert(name != NULL && maxLen != 0);
+
+	// MTF paths use backslashes, unpacked ones forward slashes.
+	const char * base = path;
+	for (const char * p = path; *p != '\0'; ++p) {
+		if (*p == '/' || *p == '\\') {
+			base = p + 1;
+		}
+	}
+
+	size_t len = 0;
+	for (; base[len] != '\0' && len < maxLen - 1; ++len) {
+		const char ch = base[len];
+		const bool safe = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+		                  (ch >= '0' && ch <= '9') || ch == '.' || ch == '-' || ch == '_';
+		name[len] = safe ? ch : '_';
+	}
+	name[len] = '\0';
+}
+
+/* ========================================================
+ * Material helpers:
+ * ======================================================== */
+
+// "tex0015"
+static void convert_material_name(char * name, size_t maxLen, uint32_t texNumber) {
+	snprintf(name, maxLen, "tex%04u", texNumber);
+}
+
+// Texture URI of a group's material, or false if it has no texture.
+static bool convert_texture_uri(const o3d_export_textures_t * textures, uint32_t texNumber, char * uri, size_t maxLen) {
+	if (textures == NULL || textures->registry == NULL) {
+		return false;
+	}
+
+	const char * path = o3d_texreg_find_any(textures->registry, texNumber, textures->variant);
+	if (path == NULL) {
+		return false;
+	}
+
+	char name[CONVERT_MAX_NAME_LEN];
+	o3d_export_texture_name(path, name, sizeof(name));
+	snprintf(uri, maxLen, "%s%s", (textures->uriPrefix != NULL) ? textures->uriPrefix : "", name);
+	return true;
+}
+
+static bool convert_check_mesh(const o3d_mesh_t * mesh) {
+	if (mesh->groups == NULL) {
+		return o3d_set_error("Mesh must be grouped by texture before exporting!");
+	}
+	if (mesh->indexCount == 0 || mesh->vertexCount == 0) {
+		return o3d_set_error("Mesh has no triangles to export!");
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3d_export_obj():
+ * ======================================================== */
+
+bool o3d_export_obj(o3d_out_buffer_t * obj, o3d_out_buffer_t * mtl, const o3d_mesh_t * mesh,
+                    const char * mtlFilename, const o3d_export_textures_t * textures, bool colors) {
+	assert(obj  != NULL);
+	assert(mtl  != NULL);
+	assert(mesh != NULL);
+	assert(mtlFilename != NULL);
+
+	if (!convert_check_mesh(mesh)) {
+		return false;
+	}
+
+	// Rough upper bound, so the loops below don't keep reallocating.
+	const size_t perVertex = 3 * CONVERT_MAX_NUMBER_LEN + (colors ? 3 * 10 : 0) + 2 * CONVERT_MAX_NUMBER_LEN;
+	o3d_out_reserve(obj, 128 + (size_t)mesh->vertexCount * perVertex + (size_t)(mesh->indexCount / 3) * 72);
+
+	o3d_out_string(obj, "# Darkstone O3D mesh, ");
+	o3d_out_uint(obj, mesh->vertexCount);
+	o3d_out_string(obj, " vertexes, ");
+	o3d_out_uint(obj, o3d_mesh_triangle_count(mesh));
+	o3d_out_string(obj, " triangles\nmtllib ");
+	o3d_out_string(obj, mtlFilename);
+	convert_out_char(obj, '\n');
+
+	for (uint32_t v = 0; v < mesh->vertexCount; ++v) {
+		const o3d_mesh_vertex_t * vert = &mesh->vertexes[v];
+		o3d_out_string(obj, "v ");
+		o3d_out_float(obj, vert->px);
+		convert_out_char(obj, ' ');
+		o3d_out_float(obj, vert->py);
+		convert_out_char(obj, ' ');
+		o3d_out_float(obj, vert->pz);
+		if (colors) {
+			convert_out_char(obj, ' ');
+			o3d_out_float(obj, vert->color.r * (1.0f / 255.0f));
+			convert_out_char(obj, ' ');
+			o3d_out_float(obj, vert->color.g * (1.0f / 255.0f));
+			convert_out_char(obj, ' ');
+			o3d_out_float(obj, vert->color.b * (1.0f / 255.0f));
+		}
+		convert_out_char(obj, '\n');
+	}
+
+	for (uint32_t v = 0; v < mesh->vertexCount; ++v) {
+		const o3d_mesh_vertex_t * vert = &mesh->vertexes[v];
+		o3d_out_string(obj, "vt ");
+		o3d_out_float(obj, vert->u);
+		convert_out_char(obj, ' ');
+		o3d_out_float(obj, 1.0f - vert->v);
+		convert_out_char(obj, '\n');
+	}
+
+	char name[CONVERT_MAX_NAME_LEN];
+	char uri[CONVERT_MAX_NAME_LEN];
+
+	o3d_out_string(mtl, "# Darkstone O3D materials\n");
+
+	for (uint32_t g = 0; g < mesh->groupCount; ++g) {
+		const o3d_mesh_group_t * group = &mesh->groups[g];
+		convert_material_name(name, sizeof(name), group->texNumber);
+
+		o3d_out_string(obj, "usemtl ");
+		o3d_out_string(obj, name);
+		convert_out_char(obj, '\n');
+
+		// OBJ indexes are 1-based, and each vertex has its own UV, so both are the same.
+		const uint32_t * indexes = &mesh->indexes[group->firstIndex];
+		for (uint32_t i = 0; i < group->indexCount; i += 3) {
+			convert_out_char(obj, 'f');
+			for (uint32_t c = 0; c < 3; ++c) {
+				convert_out_char(obj, ' ');
+				o3d_out_uint(obj, indexes[i + c] + 1);
+				convert_out_char(obj, '/');
+				o3d_out_uint(obj, indexes[i + c] + 1);
+			}
+			convert_out_char(obj, '\n');
+		}
+
+		o3d_out_string(mtl, "\nnewmtl ");
+		o3d_out_string(mtl, name);
+		o3d_out_string(mtl, "\nKd 1 1 1\nKs 0 0 0\nillum 1\n");
+		if (convert_texture_uri(textures, group->texNumber, uri, sizeof(uri))) {
+			o3d_out_string(mtl, "map_Kd ");
+			o3d_out_string(mtl, uri);
+			convert_out_char(mtl, '\n');
+		}
+	}
+
+	if (obj->failed || mtl->failed) {
+		return o3d_set_error("Ran out of memory formatting the OBJ!");
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3d_export_glb() helpers:
+ * ======================================================== */
+
+// GLB container constants, from the glTF 2.0 spec.
+enum {
+	GLB_MAGIC           = 0x46546C67, // "glTF"
+	GLB_VERSION         = 2,
+	GLB_CHUNK_JSON      = 0x4E4F534A, // "JSON"
+	GLB_CHUNK_BIN       = 0x004E4942, // "BIN\0"
+	GLTF_UNSIGNED_BYTE  = 5121,
+	GLTF_UNSIGNED_SHORT = 5123,
+	GLTF_UNSIGNED_INT   = 5125,
+	GLTF_FLOAT          = 5126,
+	GLTF_ARRAY_BUFFER   = 34962,
+	GLTF_ELEMENT_BUFFER = 34963
+};
+
+static void convert_out_u32(o3d_out_buffer_t * buf, uint32_t value) {
+	// GLB is little endian, same as every machine this runs on.
+	o3d_out_bytes(buf, &value, sizeof(value));
+}
+
+static void convert_out_padding(o3d_out_buffer_t * buf, char pad) {
+	while ((buf->size % 4) != 0 && !buf->failed) {
+		convert_out_char(buf, pad);
+	}
+}
+
+// Quoted JSON string. Non-ASCII is replaced, since the
+// MTF names are not UTF-8 (see mtf_fix_filepath()).
+static void convert_out_json_string(o3d_out_buffer_t * buf, const char * str) {
+	convert_out_char(buf, '"');
+	for (const unsigned char * p = (const unsigned char *)str; *p != '\0'; ++p) {
+		if (*p == '"' || *p == '\\') {
+			convert_out_char(buf, '\\');
+			convert_out_char(buf, (char)*p);
+		} else if (*p < 0x20 || *p >= 0x80) {
+			convert_out_char(buf, '_');
+		} else {
+			convert_out_char(buf, (char)*p);
+		}
+	}
+	convert_out_char(buf, '"');
+}
+
+static void convert_out_json_buffer_view(o3d_out_buffer_t * json, size_t offset, size_t length, uint32_t target, bool last) {
+	o3d_out_string(json, "{\"buffer\":0,\"byteOffset\":");
+	o3d_out_uint(json, (uint32_t)offset);
+	o3d_out_string(json, ",\"byteLength\":");
+	o3d_out_uint(json, (uint32_t)length);
+	o3d_out_string(json, ",\"target\":");
+	o3d_out_uint(json, target);
+	o3d_out_string(json, last ? "}" : "},");
+}
+
+/* ========================================================
+ * o3d_export_glb():
+ * ======================================================== */
+
+bool o3d_export_glb(o3d_out_buffer_t * glb, const o3d_mesh_t * mesh, const char * name,
+                    const o3d_export_textures_t * textures, bool colors) {
+	assert(glb  != NULL);
+	assert(mesh != NULL);
+	assert(name != NULL);
+
+	// The GLB chunks are aligned relative to the start of the file.
+	assert(glb->size == 0 && "Expected an empty buffer!");
+
+	if (!convert_check_mesh(mesh)) {
+		return false;
+	}
+
+	const uint32_t vertexCount = mesh->vertexCount;
+
+	// glTF forbids the largest value of the index type, it is reserved for primitive restart.
+	const bool shortIndexes = (vertexCount < UINT16_MAX);
+	const size_t indexSize  = shortIndexes ? sizeof(uint16_t) : sizeof(uint32_t);
+
+	// Binary chunk layout. Every section size is a multiple of 4, except maybe the indexes at the end.
+	const size_t positionsOffset = 0;
+	const size_t positionsSize   = (size_t)vertexCount * 3 * sizeof(float);
+	const size_t texCoordsOffset = positionsOffset + positionsSize;
+	const size_t texCoordsSize   = (size_t)vertexCount * 2 * sizeof(float);
+	const size_t colorsOffset    = texCoordsOffset + texCoordsSize;
+	const size_t colorsSize      = colors ? ((size_t)vertexCount * 4) : 0;
+	const size_t indexesOffset   = colorsOffset + colorsSize;
+	const size_t indexesSize     = (size_t)mesh->indexCount * indexSize;
+	const size_t binSize         = (indexesOffset + indexesSize + 3) & ~(size_t)3;
+
+	if (binSize > UINT32_MAX / 2) {
+		return o3d_set_error("Mesh is too big for a GLB file!");
+	}
+
+	// Exact position bounds; the spec requires them for POSITION.
+	float mins[3] = { mesh->vertexes[0].px, mesh->vertexes[0].py, mesh->vertexes[0].pz };
+	float maxs[3] = { mins[0], mins[1], mins[2] };
+	for (uint32_t v = 1; v < vertexCount; ++v) {
+		const float p[3] = { mesh->vertexes[v].px, mesh->vertexes[v].py, mesh->vertexes[v].pz };
+		for (int a = 0; a < 3; ++a) {
+			mins[a] = (p[a] < mins[a]) ? p[a] : mins[a];
+			maxs[a] = (p[a] > maxs[a]) ? p[a] : maxs[a];
+		}
+	}
+
+	//
+	// JSON chunk:
+	//
+	o3d_out_buffer_t json;
+	o3d_out_init(&json);
+	o3d_out_reserve(&json, 1024 + (size_t)mesh->groupCount * 512);
+
+	o3d_out_string(&json, "{\"asset\":{\"version\":\"2.0\",\"generator\":\"Darkstone o3d_export\"},"
+	                      "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0,\"name\":");
+	convert_out_json_string(&json, name);
+	o3d_out_string(&json, "}],\"meshes\":[{\"name\":");
+	convert_out_json_string(&json, name);
+	o3d_out_string(&json, ",\"primitives\":[");
+
+	// Accessors 0-1(2) are the vertex attributes, then one index accessor per group.
+	const uint32_t firstIndexAccessor = colors ? 3 : 2;
+	for (uint32_t g = 0; g < mesh->groupCount; ++g) {
+		o3d_out_string(&json, colors ? "{\"attributes\":{\"POSITION\":0,\"TEXCOORD_0\":1,\"COLOR_0\":2},\"indices\":"
+		                             : "{\"attributes\":{\"POSITION\":0,\"TEXCOORD_0\":1},\"indices\":");
+		o3d_out_uint(&json, firstIndexAccessor + g);
+		o3d_out_string(&json, ",\"material\":");
+		o3d_out_uint(&json, g);
+		o3d_out_string(&json, (g + 1 < mesh->groupCount) ? "}," : "}");
+	}
+	o3d_out_string(&json, "]}],\"materials\":[");
+
+	// One material per group. Groups have distinct texNumbers, so each textured one has its own image.
+	char matName[CONVERT_MAX_NAME_LEN];
+	char uri[CONVERT_MAX_NAME_LEN];
+	uint32_t textureCount = 0;
+
+	for (uint32_t g = 0; g < mesh->groupCount; ++g) {
+		const uint32_t texNumber = mesh->groups[g].texNumber;
+		convert_material_name(matName, sizeof(matName), texNumber);
+
+		o3d_out_string(&json, "{\"name\":");
+		convert_out_json_string(&json, matName);
+		o3d_out_string(&json, ",\"pbrMetallicRoughness\":{");
+		if (convert_texture_uri(textures, texNumber, uri, sizeof(uri))) {
+			o3d_out_string(&json, "\"baseColorTexture\":{\"index\":");
+			o3d_out_uint(&json, textureCount++);
+			o3d_out_string(&json, "},");
+		}
+		o3d_out_string(&json, "\"metallicFactor\":0}");
+		o3d_out_string(&json, (g + 1 < mesh->groupCount) ? "}," : "}");
+	}
+	o3d_out_string(&json, "],");
+
+	if (textureCount != 0) {
+		o3d_out_string(&json, "\"textures\":[");
+		for (uint32_t t = 0; t < textureCount; ++t) {
+			o3d_out_string(&json, "{\"source\":");
+			o3d_out_uint(&json, t);
+			o3d_out_string(&json, (t + 1 < textureCount) ? "}," : "}");
+		}
+
+		o3d_out_string(&json, "],\"images\":[");
+		uint32_t imageCount = 0;
+		for (uint32_t g = 0; g < mesh->groupCount; ++g) {
+			if (!convert_texture_uri(textures, mesh->groups[g].texNumber, uri, sizeof(uri))) {
+				continue;
+			}
+			o3d_out_string(&json, "{\"uri\":");
+			convert_out_json_string(&json, uri);
+			o3d_out_string(&json, (++imageCount < textureCount) ? "}," : "}");
+		}
+		o3d_out_string(&json, "],");
+	}
+
+	o3d_out_string(&json, "\"buffers\":[{\"byteLength\":");
+	o3d_out_uint(&json, (uint32_t)binSize);
+	o3d_out_string(&json, "}],\"bufferViews\":[");
+	convert_out_json_buffer_view(&json, positionsOffset, positionsSize, GLTF_ARRAY_BUFFER, false);
+	convert_out_json_buffer_view(&json, texCoordsOffset, texCoordsSize, GLTF_ARRAY_BUFFER, false);
+	if (colors) {
+		convert_out_json_buffer_view(&json, colorsOffset, colorsSize, GLTF_ARRAY_BUFFER, false);
+	}
+	convert_out_json_buffer_view(&json, indexesOffset, indexesSize, GLTF_ELEMENT_BUFFER, true);
+
+	o3d_out_string(&json, "],\"accessors\":[{\"bufferView\":0,\"componentType\":");
+	o3d_out_uint(&json, GLTF_FLOAT);
+	o3d_out_string(&json, ",\"count\":");
+	o3d_out_uint(&json, vertexCount);
+	// Validators compare these to the data exactly, so no rounding here.
+	char bounds[6 * CONVERT_MAX_NUMBER_LEN];
+	snprintf(bounds, sizeof(bounds), ",\"type\":\"VEC3\",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]",
+	         (double)mins[0], (double)mins[1], (double)mins[2], (double)maxs[0], (double)maxs[1], (double)maxs[2]);
+	o3d_out_string(&json, bounds);
+
+	o3d_out_string(&json, "},{\"bufferView\":1,\"componentType\":");
+	o3d_out_uint(&json, GLTF_FLOAT);
+	o3d_out_string(&json, ",\"count\":");
+	o3d_out_uint(&json, vertexCount);
+	o3d_out_string(&json, ",\"type\":\"VEC2\"}");
+
+	if (colors) {
+		o3d_out_string(&json, ",{\"bufferView\":2,\"componentType\":");
+		o3d_out_uint(&json, GLTF_UNSIGNED_BYTE);
+		o3d_out_string(&json, ",\"normalized\":true,\"count\":");
+		o3d_out_uint(&json, vertexCount);
+		o3d_out_string(&json, ",\"type\":\"VEC4\"}");
+	}
+
+	const uint32_t indexView = colors ? 3 : 2;
+	for (uint32_t g = 0; g < mesh->groupCount; ++g) {
+		const o3d_mesh_group_t * group = &mesh->groups[g];
+		o3d_out_string(&json, ",{\"bufferView\":");
+		o3d_out_uint(&json, indexView);
+		o3d_out_string(&json, ",\"byteOffset\":");
+		o3d_out_uint(&json, (uint32_t)(group->firstIndex * indexSize));
+		o3d_out_string(&json, ",\"componentType\":");
+		o3d_out_uint(&json, shortIndexes ? GLTF_UNSIGNED_SHORT : GLTF_UNSIGNED_INT);
+		o3d_out_string(&json, ",\"count\":");
+		o3d_out_uint(&json, group->indexCount);
+		o3d_out_string(&json, ",\"type\":\"SCALAR\"}");
+	}
+	o3d_out_string(&json, "]}");
+
+	// The JSON chunk is padded with spaces, the binary one with zeros.
+	convert_out_padding(&json, ' ');
+	if (json.failed) {
+		o3d_out_free(&json);
+		return o3d_set_error("Ran out of memory formatting the glTF JSON!");
+	}
+
+	//
+	// File: header, JSON chunk, BIN chunk.
+	//
+	const size_t totalSize = 12 + 8 + json.size + 8 + binSize;
+	o3d_out_reserve(glb, totalSize);
+
+	convert_out_u32(glb, GLB_MAGIC);
+	convert_out_u32(glb, GLB_VERSION);
+	convert_out_u32(glb, (uint32_t)totalSize);
+
+	convert_out_u32(glb, (uint32_t)json.size);
+	convert_out_u32(glb, GLB_CHUNK_JSON);
+	o3d_out_bytes(glb, json.data, json.size);
+	o3d_out_free(&json);
+
+	convert_out_u32(glb, (uint32_t)binSize);
+	convert_out_u32(glb, GLB_CHUNK_BIN);
+
+	if (!o3d_out_reserve(glb, binSize)) {
+		return o3d_set_error("Ran out of memory formatting the GLB!");
+	}
+
+	// Reserved above, so the sections are written in place.
+	uint8_t * bin = (uint8_t *)glb->data + glb->size;
+	float * positions = (float *)(bin + positionsOffset);
+	float * texCoords = (float *)(bin + texCoordsOffset);
+
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		const o3d_mesh_vertex_t * vert = &mesh->vertexes[v];
+		positions[v * 3 + 0] = vert->px;
+		positions[v * 3 + 1] = vert->py;
+		positions[v * 3 + 2] = vert->pz;
+		texCoords[v * 2 + 0] = vert->u;
+		texCoords[v * 2 + 1] = vert->v;
+	}
+
+	if (colors) {
+		// BGRA to RGBA. Alpha is forced opaque; it doesn't look meaningful in the O3Ds.
+		uint8_t * rgba = bin + colorsOffset;
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			const o3d_color_t * color = &mesh->vertexes[v].color;
+			rgba[v * 4 + 0] = color->r;
+			rgba[v * 4 + 1] = color->g;
+			rgba[v * 4 + 2] = color->b;
+			rgba[v * 4 + 3] = 255;
+		}
+	}
+
+	if (shortIndexes) {
+		uint16_t * indexes = (uint16_t *)(bin + indexesOffset);
+		for (uint32_t i = 0; i < mesh->indexCount; ++i) {
+			indexes[i] = (uint16_t)mesh->indexes[i];
+		}
+	} else {
+		memcpy(bin + indexesOffset, mesh->indexes, indexesSize);
+	}
+
+	memset(bin + indexesOffset + indexesSize, 0, binSize - (indexesOffset + indexesSize));
+	glb->size += binSize;
+
+	assert(glb->size % 4 == 0);
+	return true;
+}
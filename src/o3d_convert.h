@@ -0,0 +1,119 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_convert.h
+ * Created on: 17/10/26
+ * Brief: Conversion of cooked O3D meshes to Wavefront OBJ and binary glTF 2.0 (GLB).
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_CONVERT_H
+#define DARKSTONE_O3D_CONVERT_H
+
+#include "o3d_mesh.h"
+#include "o3d_texreg.h"
+
+#include <stdio.h>
+
+/* ========================================================
+ * Output buffer:
+ * ======================================================== */
+
+/*
+ * Growable memory buffer the files are formatted into, then
+ * written with a single fwrite(). Running out of memory sets
+ * `failed` and turns further appends into no-ops, so callers
+ * only have to check once at the end.
+ */
+typedef struct o3d_out_buffer {
+	char   * data;
+	size_t   size;
+	size_t   capacity;
+	bool     failed;
+} o3d_out_buffer_t;
+
+/*
+ * Clears the buffer. Same as zeroing it.
+ */
+void o3d_out_init(o3d_out_buffer_t * buf);
+
+/*
+ * Frees the memory and clears the buffer.
+ */
+void o3d_out_free(o3d_out_buffer_t * buf);
+
+/*
+ * Empties the buffer and clears `failed`, keeping the memory for reuse.
+ */
+void o3d_out_reset(o3d_out_buffer_t * buf);
+
+/*
+ * Makes room for `extra` more bytes. Sets `failed` and returns false if out of memory.
+ */
+bool o3d_out_reserve(o3d_out_buffer_t * buf, size_t extra);
+
+/*
+ * Appenders. Floats are written with up to 6 decimal places and without
+ * trailing zeros, by hand rather than with printf; values too large for
+ * that fall back to "%.9g". No separators are added.
+ */
+void o3d_out_bytes(o3d_out_buffer_t * buf, const void * data, size_t size);
+void o3d_out_string(o3d_out_buffer_t * buf, const char * str);
+void o3d_out_uint(o3d_out_buffer_t * buf, uint32_t value);
+void o3d_out_float(o3d_out_buffer_t * buf, float value);
+
+/*
+ * Writes the whole buffer to a new file. Fails if the buffer has `failed`.
+ */
+bool o3d_out_write_file(const o3d_out_buffer_t * buf, const char * filename);
+
+/* ========================================================
+ * Exporters:
+ * ======================================================== */
+
+/*
+ * How the exported materials refer to the textures. Each mesh group is
+ * a material, and its texNumber is looked up in the registry (K/R naming,
+ * see o3d_texreg.h). The output references the texture filename without
+ * the directories, made safe by o3d_export_texture_name(), and prefixed by
+ * `uriPrefix`, so it is up to the caller to place the textures there.
+ */
+typedef struct o3d_export_textures {
+	const o3d_texreg_t * registry;    // Optional. Materials have no textures without it.
+	const char         * uriPrefix;   // Optional. E.g.: "textures/".
+	o3d_texreg_variant_t variant;     // Preferred variant; the other one is the fallback.
+} o3d_export_textures_t;
+
+/*
+ * Writes a mesh as OBJ text into `obj` and its materials as MTL into `mtl`.
+ * `mtlFilename` is what the OBJ's "mtllib" refers to. The mesh must be grouped
+ * (o3d_mesh_group_by_texture()). V is flipped for the OBJ bottom-left origin.
+ * Face colors are written as vertex colors ("v x y z r g b") if `colors` is set.
+ */
+bool o3d_export_obj(o3d_out_buffer_t * obj, o3d_out_buffer_t * mtl, const o3d_mesh_t * mesh,
+                    const char * mtlFilename, const o3d_export_textures_t * textures, bool colors);
+
+/*
+ * Writes a mesh as a binary glTF 2.0 file into `glb`, which must be empty:
+ * one node and mesh with a primitive per group, positions, UVs and, if
+ * `colors` is set, COLOR_0. The mesh must be grouped. The images are
+ * external URIs to the original TGAs, which is outside the core spec
+ * (PNG/JPEG only), but most importers accept it.
+ */
+bool o3d_export_glb(o3d_out_buffer_t * glb, const o3d_mesh_t * mesh, const char * name,
+                    const o3d_export_textures_t * textures, bool colors);
+
+/*
+ * Filename part of a texture path (MTF or local), with anything other than
+ * ASCII letters, digits, '.', '-' and '_' replaced by '_', so it can be used
+ * both as a file name and a URI. Truncated to fit `maxLen` including the null.
+ */
+void o3d_export_texture_name(const char * path, char * name, size_t maxLen);
+
+#endif // DARKSTONE_O3D_CONVERT_H
@@ -0,0 +1,493 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_cooked.c
+ * Created on: 17/10/26
+ * Brief: Compact cooked mesh format (.O3DC) that can be memory mapped and uploaded as-is.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_cooked.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Half-float conversion:
+ * ======================================================== */
+
+uint16_t o3dc_float_to_half(float f) {
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+
+	const uint32_t sign = (x >> 16) & 0x8000;
+	const uint32_t rawExp = (x >> 23) & 0xFF;
+	uint32_t mant = x & 0x7FFFFF;
+	const int32_t exp = (int32_t)rawExp - 127 + 15;
+
+	if (rawExp == 0xFF) {
+		// Inf or NaN (keep NaNs quiet).
+		return (uint16_t)(sign | 0x7C00 | (mant != 0 ? 0x200 : 0));
+	}
+	if (exp >= 31) {
+		// Too big, clamps to infinity.
+		return (uint16_t)(sign | 0x7C00);
+	}
+
+	if (exp <= 0) {
+		// Denormal half or underflow to zero.
+		if (exp < -10) {
+			return (uint16_t)sign;
+		}
+
+		mant |= 0x800000;
+		const uint32_t shift = (uint32_t)(14 - exp);
+		uint32_t half = mant >> shift;
+
+		// Round to nearest even:
+		const uint32_t rem = mant & ((1u << shift) - 1);
+		const uint32_t mid = 1u << (shift - 1);
+		if (rem > mid || (rem == mid && (half & 1))) {
+			++half;
+		}
+		return (uint16_t)(sign | half);
+	}
+
+	uint32_t half = sign | ((uint32_t)exp << 10) | (mant >> 13);
+
+	// Round to nearest even. A carry into the exponent is the correct result.
+	const uint32_t rem = mant & 0x1FFF;
+	if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) {
+		++half;
+	}
+	return (uint16_t)half;
+}
+
+float o3dc_half_to_float(uint16_t h) {
+	const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exp  = (h >> 10) & 0x1F;
+	uint32_t mant = h & 0x3FF;
+	uint32_t bits;
+
+	if (exp == 0) {
+		if (mant == 0) {
+			bits = sign;
+		} else {
+			// Renormalize the denormal.
+			exp = 1;
+			while ((mant & 0x400) == 0) {
+				mant <<= 1;
+				--exp;
+			}
+			mant &= 0x3FF;
+			bits = sign | ((exp + 112) << 23) | (mant << 13);
+		}
+	} else if (exp == 31) {
+		bits = sign | 0x7F800000 | (mant << 13);
+	} else {
+		bits = sign | ((exp + 112) << 23) | (mant << 13);
+	}
+
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+/* ========================================================
+ * Position quantization:
+ * ======================================================== */
+
+static inline uint16_t o3dc_quantize(float value, float minVal, float invExtent) {
+	float q = (value - minVal) * invExtent * 65535.0f + 0.5f;
+	if (q < 0.0f)     { q = 0.0f;     }
+	if (q > 65535.0f) { q = 65535.0f; }
+	return (uint16_t)q;
+}
+
+void o3dc_get_dequantization(const o3dc_header_t * header, float scale[3], float bias[3]) {
+	assert(header != NULL);
+	for (int i = 0; i < 3; ++i) {
+		scale[i] = (header->boundsMaxs[i] - header->boundsMins[i]) * (1.0f / 65535.0f);
+		bias[i]  = header->boundsMins[i];
+	}
+}
+
+void o3dc_decode_vertex(const o3dc_header_t * header, const o3dc_vertex_t * in, o3d_mesh_vertex_t * out) {
+	assert(header != NULL && in != NULL && out != NULL);
+
+	float scale[3], bias[3];
+	o3dc_get_dequantization(header, scale, bias);
+
+	out->px    = (float)in->qx * scale[0] + bias[0];
+	out->py    = (float)in->qy * scale[1] + bias[1];
+	out->pz    = (float)in->qz * scale[2] + bias[2];
+	out->u     = o3dc_half_to_float(in->u);
+	out->v     = o3dc_half_to_float(in->v);
+	out->color = in->color;
+}
+
+/* ========================================================
+ * o3dc_write_file():
+ * ======================================================== */
+
+static inline uint32_t o3dc_align(uint32_t offset) {
+	return (offset + (O3DC_SECTION_ALIGN - 1)) & ~(uint32_t)(O3DC_SECTION_ALIGN - 1);
+}
+
+static void o3dc_compute_bounds(const o3d_mesh_t * mesh, uint32_t firstIndex, uint32_t indexCount,
+                                float mins[3], float maxs[3]) {
+	const float INF = 1e30f;
+	mins[0] = mins[1] = mins[2] =  INF;
+	maxs[0] = maxs[1] = maxs[2] = -INF;
+
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		const o3d_mesh_vertex_t * v = &mesh->vertexes[mesh->indexes[firstIndex + i]];
+		const float p[3] = { v->px, v->py, v->pz };
+		for (int c = 0; c < 3; ++c) {
+			mins[c] = (p[c] < mins[c]) ? p[c] : mins[c];
+			maxs[c] = (p[c] > maxs[c]) ? p[c] : maxs[c];
+		}
+	}
+}
+
+/*
+ * Texture pack entry of each vertex, from the group of the triangles using it.
+ * Vertexes are never shared by different textures (see o3d_mesh_build()).
+ */
+static const o3d_texpack_entry_t ** o3dc_vertex_texpack_entries(const o3d_mesh_t * mesh, const o3d_texpack_t * texPack) {
+	const o3d_texpack_entry_t ** entries = calloc(mesh->vertexCount, sizeof(*entries));
+	if (entries == NULL) {
+		return NULL;
+	}
+
+	for (uint32_t g = 0; g < mesh->groupCount; ++g) {
+		const o3d_mesh_group_t * group = &mesh->groups[g];
+		const o3d_texpack_entry_t * entry = o3d_texpack_find(texPack, group->texNumber);
+		for (uint32_t i = 0; i < group->indexCount; ++i) {
+			entries[mesh->indexes[group->firstIndex + i]] = entry;
+		}
+	}
+	return entries;
+}
+
+bool o3dc_write_file(const o3d_mesh_t * mesh, const o3d_vertex_t * center,
+                     const o3d_texpack_t * texPack, const char * filename) {
+	assert(mesh != NULL);
+	assert(center != NULL);
+	assert(filename != NULL && *filename != '\0');
+
+	// Should be static asserts instead...
+	assert(sizeof(o3dc_header_t) % O3DC_SECTION_ALIGN == 0);
+	assert(sizeof(o3dc_group_t)  == 48);
+	assert(sizeof(o3dc_vertex_t) == 16);
+
+	if (mesh->groupCount == 0 || mesh->groups == NULL) {
+		return o3d_set_error("Mesh must be grouped by texture before writing an O3DC!");
+	}
+
+	const bool index32 = (mesh->vertexCount > UINT16_MAX);
+	const uint32_t indexSize = index32 ? 4 : 2;
+
+	o3dc_header_t header;
+	memset(&header, 0, sizeof(header));
+
+	header.magic          = O3DC_MAGIC;
+	header.version        = O3DC_VERSION;
+	header.flags          = (index32 ? O3DC_FLAG_INDEX32 : 0) | ((texPack != NULL) ? O3DC_FLAG_TEXPACK : 0);
+	header.vertexCount    = mesh->vertexCount;
+	header.indexCount     = mesh->indexCount;
+	header.groupCount     = mesh->groupCount;
+	header.groupsOffset   = o3dc_align(sizeof(o3dc_header_t));
+	header.vertexesOffset = o3dc_align(header.groupsOffset + mesh->groupCount * sizeof(o3dc_group_t));
+	header.indexesOffset  = o3dc_align(header.vertexesOffset + mesh->vertexCount * sizeof(o3dc_vertex_t));
+	header.fileSize       = o3dc_align(header.indexesOffset + mesh->indexCount * indexSize);
+
+	o3dc_compute_bounds(mesh, 0, mesh->indexCount, header.boundsMins, header.boundsMaxs);
+
+	header.center[0] = center->x;
+	header.center[1] = center->y;
+	header.center[2] = center->z;
+
+	// Build the whole file in memory, then write it in one go.
+	uint8_t * fileData = calloc(1, header.fileSize);
+	if (fileData == NULL) {
+		return o3d_set_error("Unable to malloc O3DC file buffer!");
+	}
+
+	const o3d_texpack_entry_t ** texPackEntries = NULL;
+	if (texPack != NULL) {
+		texPackEntries = o3dc_vertex_texpack_entries(mesh, texPack);
+		if (texPackEntries == NULL) {
+			free(fileData);
+			return o3d_set_error("Unable to malloc O3DC texture pack entries!");
+		}
+	}
+
+	float invExtent[3];
+	for (int c = 0; c < 3; ++c) {
+		const float extent = header.boundsMaxs[c] - header.boundsMins[c];
+		invExtent[c] = (extent > 0.0f) ? (1.0f / extent) : 0.0f;
+	}
+
+	float radiusSqr = 0.0f;
+	o3dc_vertex_t * outVerts = (o3dc_vertex_t *)(fileData + header.vertexesOffset);
+
+	for (uint32_t v = 0; v < mesh->vertexCount; ++v) {
+		const o3d_mesh_vertex_t * in = &mesh->vertexes[v];
+		o3dc_vertex_t * out = &outVerts[v];
+
+		out->qx    = o3dc_quantize(in->px, header.boundsMins[0], invExtent[0]);
+		out->qy    = o3dc_quantize(in->py, header.boundsMins[1], invExtent[1]);
+		out->qz    = o3dc_quantize(in->pz, header.boundsMins[2], invExtent[2]);
+		float texU = in->u;
+		float texV = in->v;
+		if (texPackEntries != NULL && texPackEntries[v] != NULL) {
+			o3d_texpack_remap_uv(texPack, texPackEntries[v], &texU, &texV);
+		}
+
+		out->u     = o3dc_float_to_half(texU);
+		out->v     = o3dc_float_to_half(texV);
+		out->color = in->color;
+
+		const float dx = in->px - center->x;
+		const float dy = in->py - center->y;
+		const float dz = in->pz - center->z;
+		const float distSqr = (dx * dx) + (dy * dy) + (dz * dz);
+		radiusSqr = (distSqr > radiusSqr) ? distSqr : radiusSqr;
+	}
+
+	free(texPackEntries);
+	header.radius = sqrtf(radiusSqr);
+	memcpy(fileData, &header, sizeof(header));
+
+	o3dc_group_t * outGroups = (o3dc_group_t *)(fileData + header.groupsOffset);
+	for (uint32_t g = 0; g < mesh->groupCount; ++g) {
+		const o3d_mesh_group_t * in = &mesh->groups[g];
+		o3dc_group_t * out = &outGroups[g];
+
+		out->texNumber   = in->texNumber;
+		out->firstIndex  = in->firstIndex;
+		out->indexCount  = in->indexCount;
+		out->firstVertex = in->firstVertex;
+		out->vertexCount = in->vertexCount;
+		o3dc_compute_bounds(mesh, in->firstIndex, in->indexCount, out->boundsMins, out->boundsMaxs);
+
+		if (texPack != NULL) {
+			const o3d_texpack_entry_t * entry = o3d_texpack_find(texPack, in->texNumber);
+			out->texPage  = (entry != NULL) ? entry->page  : O3DC_TEXPACK_NONE;
+			out->texLayer = (entry != NULL) ? entry->layer : 0;
+		}
+	}
+
+	if (index32) {
+		memcpy(fileData + header.indexesOffset, mesh->indexes, mesh->indexCount * sizeof(uint32_t));
+	} else {
+		uint16_t * outIndexes = (uint16_t *)(fileData + header.indexesOffset);
+		for (uint32_t i = 0; i < mesh->indexCount; ++i) {
+			outIndexes[i] = (uint16_t)mesh->indexes[i];
+		}
+	}
+
+	FILE * fileOut = fopen(filename, "wb");
+	if (fileOut == NULL) {
+		free(fileData);
+		return o3d_set_error("Can't open output O3DC file!");
+	}
+
+	const bool success = (fwrite(fileData, 1, header.fileSize, fileOut) == header.fileSize);
+	fclose(fileOut);
+	free(fileData);
+
+	if (!success) {
+		return o3d_set_error("Failed to write O3DC file data!");
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3dc_load_from_file():
+ * ======================================================== */
+
+static inline bool o3dc_section_ok(uint32_t offset, uint64_t sectionSize, uint64_t fileSize) {
+	return (offset % O3DC_SECTION_ALIGN) == 0 && ((uint64_t)offset + sectionSize) <= fileSize;
+}
+
+static inline uint32_t o3dc_get_index(const void * indexes, bool index32, uint32_t i) {
+	return index32 ? ((const uint32_t *)indexes)[i] : ((const uint16_t *)indexes)[i];
+}
+
+// True if every index in the range references a vertex in [firstVertex, firstVertex + vertexCount).
+static bool o3dc_indexes_in_range(const void * indexes, bool index32, uint32_t firstIndex, uint32_t indexCount,
+                                  uint32_t firstVertex, uint32_t vertexCount) {
+	for (uint32_t i = firstIndex; i < firstIndex + indexCount; ++i) {
+		if ((o3dc_get_index(indexes, index32, i) - firstVertex) >= vertexCount) {
+			return false; // Also catches indexes below firstVertex, with the unsigned wrap.
+		}
+	}
+	return true;
+}
+
+// Checks the header, sections, groups and indexes, then points `file` into `data`.
+static bool o3dc_validate(o3dc_file_t * file, const uint8_t * data, uint64_t fileSize) {
+	if (fileSize < sizeof(o3dc_header_t)) {
+		return o3d_set_error("O3DC file is too small to have a header!");
+	}
+
+	const o3dc_header_t * header = (const o3dc_header_t *)data;
+	if (header->magic != O3DC_MAGIC || header->version != O3DC_VERSION) {
+		return o3d_set_error("Not an O3DC file or unsupported version!");
+	}
+
+	if (header->fileSize != fileSize) {
+		return o3d_set_error("O3DC file size mismatch! File truncated?");
+	}
+
+	const uint64_t groupsSize  = (uint64_t)header->groupCount  * sizeof(o3dc_group_t);
+	const uint64_t vertexSize  = (uint64_t)header->vertexCount * sizeof(o3dc_vertex_t);
+	const uint64_t indexesSize = (uint64_t)header->indexCount  * o3dc_index_size(header);
+
+	if (!o3dc_section_ok(header->groupsOffset,   groupsSize,  fileSize) ||
+	    !o3dc_section_ok(header->vertexesOffset, vertexSize,  fileSize) ||
+	    !o3dc_section_ok(header->indexesOffset,  indexesSize, fileSize)) {
+		return o3d_set_error("Bad O3DC section offsets!");
+	}
+
+	if ((header->indexCount % 3) != 0) {
+		return o3d_set_error("O3DC index count is not a multiple of 3!");
+	}
+
+	// The indexes are checked once here, so the renderer and
+	// o3dc_build_mesh() can use them without any bounds checks.
+	const o3dc_group_t * groups  = (const o3dc_group_t *)(data + header->groupsOffset);
+	const void         * indexes = data + header->indexesOffset;
+	const bool           index32 = (header->flags & O3DC_FLAG_INDEX32) != 0;
+
+	for (uint32_t g = 0; g < header->groupCount; ++g) {
+		if ((uint64_t)groups[g].firstIndex + groups[g].indexCount > header->indexCount ||
+		    (uint64_t)groups[g].firstVertex + groups[g].vertexCount > header->vertexCount) {
+			return o3d_set_error("Bad O3DC group range!");
+		}
+		if (!o3dc_indexes_in_range(indexes, index32, groups[g].firstIndex, groups[g].indexCount,
+		                           groups[g].firstVertex, groups[g].vertexCount)) {
+			return o3d_set_error("O3DC index out of its group's vertex range!");
+		}
+	}
+
+	// Ungrouped files are drawn in a single call, so check them all.
+	if (header->groupCount == 0 && !o3dc_indexes_in_range(indexes, index32, 0, header->indexCount, 0, header->vertexCount)) {
+		return o3d_set_error("O3DC index out of the vertex range!");
+	}
+
+	file->header   = header;
+	file->groups   = groups;
+	file->vertexes = (const o3dc_vertex_t *)(data + header->vertexesOffset);
+	file->indexes  = indexes;
+	return true;
+}
+
+bool o3dc_load_from_file(o3dc_file_t * file, const char * filename) {
+	assert(file != NULL);
+	assert(filename != NULL && *filename != '\0');
+
+	memset(file, 0, sizeof(*file));
+
+	if (!file_map_open(&file->map, filename)) {
+		return o3d_set_error("Can't open input O3DC file!");
+	}
+
+	if (!o3dc_validate(file, file->map.data, file->map.size)) {
+		o3dc_close(file);
+		return false;
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3dc_build_mesh():
+ * ======================================================== */
+
+bool o3dc_build_mesh(const o3dc_file_t * file, o3d_mesh_t * mesh) {
+	assert(file != NULL && file->header != NULL);
+	assert(mesh != NULL);
+
+	memset(mesh, 0, sizeof(*mesh));
+
+	const o3dc_header_t * header = file->header;
+	const uint32_t triangleCount = header->indexCount / 3;
+	const bool     index32       = (header->flags & O3DC_FLAG_INDEX32) != 0;
+
+	// At least one element each, so an empty file isn't mistaken for out-of-memory.
+	mesh->vertexes    = malloc((header->vertexCount + 1) * sizeof(mesh->vertexes[0]));
+	mesh->positionIds = malloc((header->vertexCount + 1) * sizeof(mesh->positionIds[0]));
+	mesh->indexes     = malloc((header->indexCount  + 1) * sizeof(mesh->indexes[0]));
+	mesh->texNumbers  = malloc((triangleCount + 1) * sizeof(mesh->texNumbers[0]));
+	mesh->groups      = malloc((header->groupCount + 1) * sizeof(mesh->groups[0]));
+
+	if (mesh->vertexes == NULL || mesh->positionIds == NULL || mesh->indexes == NULL ||
+	    mesh->texNumbers == NULL || mesh->groups == NULL) {
+		o3d_mesh_free(mesh);
+		return o3d_set_error("Unable to malloc O3DC mesh data!");
+	}
+
+	// The source positions aren't kept in the cooked
+	// file, so each vertex is its own position here.
+	for (uint32_t v = 0; v < header->vertexCount; ++v) {
+		o3dc_decode_vertex(header, &file->vertexes[v], &mesh->vertexes[v]);
+		mesh->positionIds[v] = v;
+	}
+
+	for (uint32_t i = 0; i < header->indexCount; ++i) {
+		mesh->indexes[i] = o3dc_get_index(file->indexes, index32, i);
+	}
+
+	memset(mesh->texNumbers, 0, triangleCount * sizeof(mesh->texNumbers[0]));
+	for (uint32_t g = 0; g < header->groupCount; ++g) {
+		const o3dc_group_t * in = &file->groups[g];
+		o3d_mesh_group_t * out = &mesh->groups[g];
+
+		out->texNumber   = in->texNumber;
+		out->firstIndex  = in->firstIndex;
+		out->indexCount  = in->indexCount;
+		out->firstVertex = in->firstVertex;
+		out->vertexCount = in->vertexCount;
+
+		for (uint32_t t = in->firstIndex / 3; t < (in->firstIndex + in->indexCount) / 3; ++t) {
+			mesh->texNumbers[t] = (uint16_t)in->texNumber;
+		}
+	}
+
+	mesh->vertexCount   = header->vertexCount;
+	mesh->indexCount    = header->indexCount;
+	mesh->positionCount = header->vertexCount;
+	mesh->groupCount    = header->groupCount;
+
+	mesh->aabb.mins.x = header->boundsMins[0];
+	mesh->aabb.mins.y = header->boundsMins[1];
+	mesh->aabb.mins.z = header->boundsMins[2];
+	mesh->aabb.maxs.x = header->boundsMaxs[0];
+	mesh->aabb.maxs.y = header->boundsMaxs[1];
+	mesh->aabb.maxs.z = header->boundsMaxs[2];
+	return true;
+}
+
+/* ========================================================
+ * o3dc_close():
+ * ======================================================== */
+
+void o3dc_close(o3dc_file_t * file) {
+	if (file == NULL) {
+		return;
+	}
+
+	file_map_close(&file->map);
+	memset(file, 0, sizeof(*file));
+}
@@ -0,0 +1,172 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_cooked.h
+ * Created on: 17/10/26
+ * Brief: Compact cooked mesh format (.O3DC) that can be memory mapped and uploaded as-is.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_COOKED_H
+#define DARKSTONE_O3D_COOKED_H
+
+#include "file_utils.h"
+#include "o3d_mesh.h"
+#include "o3d_texpack.h"
+
+/* ========================================================
+ * O3DC file layout:
+ * ======================================================== */
+
+//
+// Byte-order: LITTLE ENDIAN.
+//
+// +---------------------+
+// | o3dc_header_t       |
+// |---------------------|
+// | o3dc_group_t[]      | <- header.groupsOffset
+// |---------------------|
+// | o3dc_vertex_t[]     | <- header.vertexesOffset
+// |---------------------|
+// | uint16/32 indexes[] | <- header.indexesOffset
+// +---------------------+
+//
+// Every section starts at an O3DC_SECTION_ALIGN boundary and
+// the file size is also padded to it, so the vertex and index
+// sections can be handed to the GL straight from the mapping.
+//
+
+#define O3DC_MAGIC 0x4344334Fu // "O3DC" in file byte order.
+
+enum {
+	O3DC_VERSION       = 1,
+	O3DC_SECTION_ALIGN = 16,
+
+	// Set if the indexes are 32 bits. Otherwise they are 16 bits,
+	// which is the case for every model with less than 64K vertexes.
+	O3DC_FLAG_INDEX32  = 1 << 0,
+
+	// Set if the UVs are in texture pack space (see o3d_texpack.h),
+	// to be drawn with the groups' texPage and texLayer.
+	O3DC_FLAG_TEXPACK  = 1 << 1,
+	O3DC_TEXPACK_NONE  = 0xFFFF
+};
+
+typedef struct o3dc_header {
+	uint32_t magic;                // O3DC_MAGIC
+	uint16_t version;              // O3DC_VERSION
+	uint16_t flags;                // O3DC_FLAG_*
+	uint32_t fileSize;             // Total size in bytes, including padding.
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t groupCount;
+	uint32_t groupsOffset;         // Absolute file offsets of each section.
+	uint32_t vertexesOffset;
+	uint32_t indexesOffset;
+	uint32_t reserved;
+	float    boundsMins[3];        // Model AABB. Also the position dequantization range.
+	float    boundsMaxs[3];
+	float    center[3];            // Center point / center of mass of the source O3D.
+	float    radius;               // Bounding sphere radius around `center`.
+} o3dc_header_t;
+
+typedef struct o3dc_group {
+	uint32_t texNumber;            // Texture/material index. See o3d_face_t::texNumber.
+	uint32_t firstIndex;           // Index range of the group.
+	uint32_t indexCount;
+	uint32_t firstVertex;          // Vertex range referenced by the group.
+	uint32_t vertexCount;
+	float    boundsMins[3];        // AABB of the group's vertexes.
+	float    boundsMaxs[3];
+	uint16_t texPage;              // Texture pack page and layer, if O3DC_FLAG_TEXPACK, otherwise zero.
+	uint16_t texLayer;             // texPage is O3DC_TEXPACK_NONE if the texture isn't in the pack.
+} o3dc_group_t;
+
+typedef struct o3dc_vertex {
+	uint16_t    qx, qy, qz;        // Positions quantized to unorm16 inside the model AABB.
+	uint16_t    reserved;          // Zero. Pads the position to 8 bytes for the vertex fetch.
+	uint16_t    u, v;              // Half-float UVs, already scaled by O3D_TEXCOORD_SCALE, or page UVs.
+	o3d_color_t color;             // BGRA8, same as o3d_face_t::color.
+} o3dc_vertex_t;
+
+/*
+ * A loaded O3DC file. All pointers alias the file mapping.
+ */
+typedef struct o3dc_file {
+	file_map_t            map;
+	const o3dc_header_t * header;
+	const o3dc_group_t  * groups;
+	const o3dc_vertex_t * vertexes;
+	const void          * indexes;   // uint16_t or uint32_t, see o3dc_index_size().
+} o3dc_file_t;
+
+/* ========================================================
+ * Converter / loader functions:
+ * ======================================================== */
+
+/*
+ * Writes a mesh to an O3DC file. The mesh must be grouped with
+ * o3d_mesh_group_by_texture() first; it is usually also optimized
+ * with o3d_mesh_optimize(), so the groups have compact vertex ranges.
+ * `center` is the model center point, as computed by the O3D loader.
+ * If `texPack` is not null, the UVs are remapped to its pages and the
+ * file gets O3DC_FLAG_TEXPACK. Groups with textures not in the pack
+ * keep their UVs, so they can still be drawn with their own texture.
+ */
+bool o3dc_write_file(const o3d_mesh_t * mesh, const o3d_vertex_t * center,
+                     const o3d_texpack_t * texPack, const char * filename);
+
+/*
+ * Maps an O3DC file and validates the header, section bounds and every
+ * index against its group's vertex range (or the vertex count if not
+ * grouped), so the data can be drawn as-is. Nothing is copied or
+ * converted. Safe to call o3dc_close() on failure.
+ */
+bool o3dc_load_from_file(o3dc_file_t * file, const char * filename);
+
+/*
+ * Decodes a loaded file back into a grouped o3d_mesh_t, for the code
+ * that works on meshes (e.g. the viewer). The cooked file doesn't keep
+ * the source positions, so every vertex gets its own positionId.
+ * Free it with o3d_mesh_free().
+ */
+bool o3dc_build_mesh(const o3dc_file_t * file, o3d_mesh_t * mesh);
+
+/*
+ * Unmaps a file opened by o3dc_load_from_file().
+ */
+void o3dc_close(o3dc_file_t * file);
+
+/*
+ * Size in bytes of each index: 2 or 4.
+ */
+static inline uint32_t o3dc_index_size(const o3dc_header_t * header) {
+	return (header->flags & O3DC_FLAG_INDEX32) ? 4 : 2;
+}
+
+/*
+ * Scale and bias to get back the positions: pos = q * scale + bias.
+ * The unorm16 [0,65535] range is folded into the scale, so it can also
+ * be applied to GL_UNSIGNED_SHORT attributes fetched as non-normalized.
+ */
+void o3dc_get_dequantization(const o3dc_header_t * header, float scale[3], float bias[3]);
+
+/*
+ * Decodes a single vertex. Mostly for tools and debugging; the
+ * renderer is expected to do the same on the GPU.
+ */
+void o3dc_decode_vertex(const o3dc_header_t * header, const o3dc_vertex_t * in, o3d_mesh_vertex_t * out);
+
+/*
+ * IEEE 754 half precision conversions used for the UVs.
+ */
+uint16_t o3dc_float_to_half(float f);
+float o3dc_half_to_float(uint16_t h);
+
+#endif // DARKSTONE_O3D_COOKED_H
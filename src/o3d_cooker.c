@@ -0,0 +1,618 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_cooker.c
+ * Created on: 17/10/26
+ * Brief: Command-line tool to batch cook Darkstone O3D models into optimized indexed meshes.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "file_utils.h"
+#include "o3d.h"
+#include "o3d_adjacency.h"
+#include "o3d_batch.h"
+#include "o3d_bvh.h"
+#include "o3d_cooked.h"
+#include "o3d_faces.h"
+#include "o3d_mesh.h"
+#include "o3d_scene.h"
+#include "o3d_simplify.h"
+#include "o3d_soa.h"
+#include "o3d_texpack.h"
+#include "o3d_vcache.h"
+#include "parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Command line options / totals:
+ * ======================================================== */
+
+enum { MAX_PATH_LEN = 1024 };
+
+static struct {
+	uint32_t cacheSize;
+	uint32_t lodCount;
+	uint32_t threadCount;
+	bool     verbose;
+	bool     writeCooked;
+	bool     buildBvh;
+	uint32_t sceneCount;
+	const o3d_texpack_t * texPack; // Null unless given with -t.
+} options;
+
+static struct {
+	uint32_t modelsCooked;
+	uint32_t modelsFailed;
+	uint64_t triangles;
+	uint64_t invalidFaces;
+	uint64_t positions;
+	uint64_t weldedPositions;
+	uint64_t borderEdges;
+	uint64_t nonManifoldEdges;
+	uint32_t nonManifoldModels;
+	double   adjacencyTime;
+	uint64_t transformedBefore;
+	uint64_t transformedAfter;
+	uint64_t referencedBefore;
+	uint64_t referencedAfter;
+	uint64_t sourceBytes;
+	uint64_t cookedBytes;
+	uint64_t lodTriangles[O3D_MAX_LODS];
+	uint64_t bvhNodes;
+	uint32_t bvhMaxDepth;
+	double   bvhBuildTime;
+} totals;
+
+/*
+ * Outcome of cooking one file. Models are cooked in parallel,
+ * so each job writes its own result and the totals are summed
+ * afterwards, in file order.
+ */
+typedef struct cook_result {
+	bool               success;
+	o3d_vcache_stats_t before;
+	o3d_vcache_stats_t after;
+	uint32_t           vertexCount;
+	uint32_t           invalidFaces;
+	uint32_t           positionCount;
+	uint32_t           weldedPositions;
+	uint32_t           borderEdges;
+	uint32_t           nonManifoldEdges;
+	double             adjacencyTime;
+	uint32_t           lodTriangles[O3D_MAX_LODS];
+	float              lodErrors[O3D_MAX_LODS];
+	uint64_t           sourceBytes;
+	uint64_t           cookedBytes;
+	uint32_t           bvhNodes;
+	uint32_t           bvhDepth;
+	double             bvhBuildTime;
+} cook_result_t;
+
+static void print_usage(const char * progName) {
+	printf(
+		"\n"
+		"Usage:\n"
+		"$ %s [options] <o3d_file_or_dir> [more files or dirs...]\n"
+		"  Builds an indexed mesh for each O3D model, optimizes it for the\n"
+		"  post-transform vertex cache and vertex fetch, then prints the\n"
+		"  ACMR/ATVR before and after. Directories are scanned recursively.\n"
+		"\n"
+		"Options:\n"
+		"  -c <n>  FIFO cache size used for the statistics (default %d).\n"
+		"  -l <n>  Generate <n> simplified LODs, each with half the triangles of the previous (max %d).\n"
+		"  -j <n>  Number of threads to cook with (default: one per CPU).\n"
+		"  -b      Also build a BVH for each model and print its statistics.\n"
+		"  -s <d>  Load directory <d> as a level scene and print its spatial index statistics.\n"
+		"  -v      Print statistics for every model, not just the totals.\n"
+		"  -w      Write a cooked .O3DC file next to each source O3D,\n"
+		"          plus a _LOD<n>.O3DC for each LOD.\n"
+		"  -t <f>  Remap the cooked UVs to the texture pack layout <f> (.O3TP, see o3d_texpacker).\n"
+		"\n"
+		"Usage:\n"
+		"$ %s --help | -h\n"
+		"  Prints this help text.\n"
+		"\n",
+	progName, O3D_VCACHE_DEFAULT_FIFO_SIZE, O3D_MAX_LODS - 1, progName);
+}
+
+/* ========================================================
+ * write_cooked_model():
+ * ======================================================== */
+
+static bool write_cooked_model(const char * filename, uint32_t lodIndex, const o3d_model_t * o3d,
+                               const o3d_mesh_t * mesh, cook_result_t * result) {
+	// "A1.O3D" => "A1.O3DC" or "A1_LOD1.O3DC"
+	char cookedFilename[MAX_PATH_LEN];
+	const size_t len = strlen(filename);
+	const int baseLen = (int)(file_has_extension(filename, ".O3D") ? (len - 4) : len);
+
+	if (lodIndex == 0) {
+		snprintf(cookedFilename, sizeof(cookedFilename), "%.*s.O3DC", baseLen, filename);
+	} else {
+		snprintf(cookedFilename, sizeof(cookedFilename), "%.*s_LOD%u.O3DC", baseLen, filename, lodIndex);
+	}
+
+	if (!o3dc_write_file(mesh, &o3d->centerPoint, options.texPack, cookedFilename)) {
+		fprintf(stderr, "Failed to write \"%s\": %s\n", cookedFilename, o3d_get_last_error());
+		return false;
+	}
+
+	// Reload to make sure it round trips and to get the final size.
+	o3dc_file_t cooked;
+	if (!o3dc_load_from_file(&cooked, cookedFilename)) {
+		fprintf(stderr, "Failed to reload \"%s\": %s\n", cookedFilename, o3d_get_last_error());
+		return false;
+	}
+
+	// LODs are extra data, so only the full mesh counts for the size comparison.
+	if (lodIndex == 0) {
+		result->sourceBytes = 16 + (o3d->vertexCount * sizeof(o3d_vertex_t)) + (o3d->faceCount * sizeof(o3d_face_t));
+		result->cookedBytes = cooked.header->fileSize;
+	}
+
+	o3dc_close(&cooked);
+	return true;
+}
+
+/* ========================================================
+ * print_scene_stats():
+ * ======================================================== */
+
+static bool print_scene_stats(const char * path) {
+	o3d_scene_t scene;
+	o3d_scene_init(&scene);
+
+	const double startTime = clock_seconds();
+	const bool success = o3d_scene_load_directory(&scene, path);
+	const double elapsed = clock_seconds() - startTime;
+
+	if (!success) {
+		fprintf(stderr, "Scene \"%s\": %s\n", path, o3d_get_last_error());
+	}
+
+	printf("Scene \"%s\": %u models, %u instances, %u octree nodes, depth %u. Loaded in %.3f seconds.\n",
+	       path, scene.modelCount, scene.instanceCount, scene.nodeCount, scene.depth, elapsed);
+	printf("Scene bounds: (%.2f, %.2f, %.2f) (%.2f, %.2f, %.2f)\n",
+	       scene.bounds.mins.x, scene.bounds.mins.y, scene.bounds.mins.z,
+	       scene.bounds.maxs.x, scene.bounds.maxs.y, scene.bounds.maxs.z);
+
+	// Draw calls needed for the whole level, one per texture.
+	if (scene.instanceCount != 0) {
+		o3d_mesh_t batches;
+		const double batchStart = clock_seconds();
+		if (o3d_batch_build_scene(&batches, &scene)) {
+			printf("Scene batches: %u draws, %u vertexes, %u triangles. Built in %.3f seconds.\n",
+			       batches.groupCount, batches.vertexCount, o3d_mesh_triangle_count(&batches),
+			       clock_seconds() - batchStart);
+		} else {
+			fprintf(stderr, "Scene \"%s\" batches: %s\n", path, o3d_get_last_error());
+		}
+		o3d_mesh_free(&batches);
+	}
+
+	o3d_scene_free(&scene);
+	return success;
+}
+
+/* ========================================================
+ * cook_lods():
+ * ======================================================== */
+
+static bool cook_lods(const char * filename, const o3d_model_t * o3d, const o3d_mesh_t * mesh, cook_result_t * result) {
+	float ratios[O3D_MAX_LODS];
+	o3d_lod_t lods[O3D_MAX_LODS];
+
+	float ratio = 1.0f;
+	for (uint32_t l = 0; l < options.lodCount; ++l) {
+		ratio *= 0.5f;
+		ratios[l] = ratio;
+	}
+
+	if (!o3d_simplify_lod_chain(mesh, ratios, options.lodCount, lods)) {
+		fprintf(stderr, "Failed to simplify \"%s\": %s\n", filename, o3d_get_last_error());
+		return false;
+	}
+
+	bool success = true;
+	for (uint32_t l = 0; l < options.lodCount; ++l) {
+		result->lodTriangles[l] = lods[l].indexCount / 3;
+		result->lodErrors[l]    = lods[l].error;
+
+		if (options.writeCooked && success) {
+			o3d_mesh_t lodMesh;
+			if (!o3d_lod_to_mesh(mesh, &lods[l], &lodMesh)) {
+				fprintf(stderr, "Failed to build LOD %u for \"%s\": %s\n", l + 1, filename, o3d_get_last_error());
+				success = false;
+			} else {
+				success = write_cooked_model(filename, l + 1, o3d, &lodMesh, result);
+				o3d_mesh_free(&lodMesh);
+			}
+		}
+		o3d_lod_free(&lods[l]);
+	}
+
+	return success;
+}
+
+/* ========================================================
+ * weld_model_positions():
+ * ======================================================== */
+
+// Points the faces at a single copy of the positions that the O3DC quantization can't tell
+// apart (within half a step on the shortest axis), so the mesh build merges their corners.
+// Repeated positions would otherwise show up as seams and border edges to the simplifier.
+static bool weld_model_positions(o3d_model_t * o3d, const o3d_vertex_soa_t * soa, cook_result_t * result) {
+	if (o3d->vertexCount == 0) {
+		return true;
+	}
+
+	o3d_aabb_t bounds;
+	o3d_vertex_soa_bounds(soa, &bounds);
+
+	const float extents[3] = {
+		bounds.maxs.x - bounds.mins.x,
+		bounds.maxs.y - bounds.mins.y,
+		bounds.maxs.z - bounds.mins.z
+	};
+
+	// Flat axes have no quantization steps to go by.
+	float shortest = 0.0f;
+	for (int c = 0; c < 3; ++c) {
+		if (extents[c] > 0.0f && (shortest == 0.0f || extents[c] < shortest)) {
+			shortest = extents[c];
+		}
+	}
+	const float epsilon = 0.5f * (shortest / (float)UINT16_MAX);
+
+	uint32_t * remap = malloc(o3d->vertexCount * sizeof(remap[0]));
+	if (remap == NULL) {
+		return o3d_set_error("Unable to malloc weld remap!");
+	}
+
+	const uint32_t uniqueCount = o3d_vertex_soa_weld(soa, epsilon, remap);
+	if (uniqueCount == 0) {
+		free(remap);
+		return false;
+	}
+
+	for (uint32_t f = 0; f < o3d->faceCount; ++f) {
+		uint16_t * index = o3d->faces[f].index;
+		for (int c = 0; c < 4; ++c) {
+			// Invalid indexes are left for the face validation to reject.
+			if (index[c] < o3d->vertexCount) {
+				index[c] = (uint16_t)remap[index[c]];
+			}
+		}
+	}
+
+	result->weldedPositions = o3d->vertexCount - uniqueCount;
+	free(remap);
+	return true;
+}
+
+/* ========================================================
+ * build_model_bvh():
+ * ======================================================== */
+
+static void build_model_bvh(const char * filename, const o3d_vertex_soa_t * soa, const o3d_mesh_t * mesh,
+                            cook_result_t * result) {
+	const double startTime = clock_seconds();
+
+	// Same triangles as the mesh, indexing the source positions.
+	uint32_t * positionIndexes = malloc((mesh->indexCount + 1) * sizeof(positionIndexes[0]));
+	if (positionIndexes == NULL) {
+		fprintf(stderr, "Failed to build BVH for \"%s\": Out of memory!\n", filename);
+		return;
+	}
+	for (uint32_t i = 0; i < mesh->indexCount; ++i) {
+		positionIndexes[i] = mesh->positionIds[mesh->indexes[i]];
+	}
+
+	o3d_bvh_t bvh;
+	if (!o3d_bvh_build_from_soa(&bvh, soa, positionIndexes, mesh->indexCount)) {
+		fprintf(stderr, "Failed to build BVH for \"%s\": %s\n", filename, o3d_get_last_error());
+	} else {
+		result->bvhBuildTime = clock_seconds() - startTime;
+		result->bvhNodes     = bvh.nodeCount;
+		result->bvhDepth     = bvh.depth;
+		o3d_bvh_free(&bvh);
+	}
+	free(positionIndexes);
+}
+
+/* ========================================================
+ * cook_model():
+ * ======================================================== */
+
+static bool cook_model(const char * filename, cook_result_t * result) {
+	o3d_model_t o3d;
+	memset(&o3d, 0, sizeof(o3d));
+
+	// The positions are also split in SoA form for the weld and the BVH build.
+	o3d_vertex_soa_t soa;
+	if (!o3d_load_from_file_soa(&o3d, &soa, filename, NULL)) {
+		fprintf(stderr, "Failed to load O3D \"%s\": %s\n", filename, o3d_get_last_error());
+		o3d_free(&o3d);
+		return false;
+	}
+
+	result->positionCount = o3d.vertexCount;
+	if (!weld_model_positions(&o3d, &soa, result)) {
+		fprintf(stderr, "Failed to weld the positions of \"%s\": %s\n", filename, o3d_get_last_error());
+		o3d_vertex_soa_free(&soa);
+		o3d_free(&o3d);
+		return false;
+	}
+
+	// Split the faces once; the mesh and the BVH builds both walk them.
+	o3d_face_streams_t streams;
+	if (!o3d_face_streams_build(&streams, &o3d, NULL)) {
+		fprintf(stderr, "Failed to read faces of \"%s\": %s\n", filename, o3d_get_last_error());
+		o3d_vertex_soa_free(&soa);
+		o3d_free(&o3d);
+		return false;
+	}
+
+	result->invalidFaces = o3d.faceCount - o3d_face_streams_validate(&streams, o3d.vertexCount, NULL);
+
+	// Cheap enough to always build, just to report borders and non-manifold edges.
+	o3d_adjacency_t adj;
+	const double adjStart = clock_seconds();
+	if (o3d_adjacency_build_from_streams(&adj, &streams, o3d.vertexCount)) {
+		result->adjacencyTime    = clock_seconds() - adjStart;
+		result->borderEdges      = adj.borderEdgeCount;
+		result->nonManifoldEdges = adj.nonManifoldEdgeCount;
+	}
+	o3d_adjacency_free(&adj);
+
+	o3d_mesh_t mesh;
+	if (!o3d_mesh_build_from_streams(&mesh, &streams, &o3d)) {
+		fprintf(stderr, "Failed to build mesh for \"%s\": %s\n", filename, o3d_get_last_error());
+		o3d_face_streams_free(&streams);
+		o3d_vertex_soa_free(&soa);
+		o3d_free(&o3d);
+		return false;
+	}
+	o3d_face_streams_free(&streams);
+
+	o3d_vcache_analyze(&result->before, mesh.indexes, mesh.indexCount, mesh.vertexCount, options.cacheSize);
+
+	// One draw per texture, so group before optimizing inside each group.
+	if (!o3d_mesh_group_by_texture(&mesh) || !o3d_mesh_optimize(&mesh)) {
+		fprintf(stderr, "Failed to optimize mesh for \"%s\": %s\n", filename, o3d_get_last_error());
+		o3d_mesh_free(&mesh);
+		o3d_vertex_soa_free(&soa);
+		o3d_free(&o3d);
+		return false;
+	}
+
+	o3d_vcache_analyze(&result->after, mesh.indexes, mesh.indexCount, mesh.vertexCount, options.cacheSize);
+	result->vertexCount = mesh.vertexCount;
+
+	if (options.buildBvh) {
+		build_model_bvh(filename, &soa, &mesh, result);
+	}
+	o3d_vertex_soa_free(&soa);
+
+	bool success = true;
+	if (options.writeCooked) {
+		success = write_cooked_model(filename, 0, &o3d, &mesh, result);
+	}
+	if (options.lodCount != 0 && success) {
+		success = cook_lods(filename, &o3d, &mesh, result);
+	}
+
+	o3d_mesh_free(&mesh);
+	o3d_free(&o3d);
+	return success;
+}
+
+typedef struct cook_jobs {
+	const file_list_t * files;
+	cook_result_t     * results;
+} cook_jobs_t;
+
+static void cook_model_job(void * userData, uint32_t jobIndex) {
+	cook_jobs_t * jobs = userData;
+	cook_result_t * result = &jobs->results[jobIndex];
+	result->success = cook_model(jobs->files->paths[jobIndex], result);
+}
+
+/* ========================================================
+ * main():
+ * ======================================================== */
+
+int main(int argc, const char * argv[]) {
+	if (argc < 2) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Printing help is not treated as an error.
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+		print_usage(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	options.cacheSize   = O3D_VCACHE_DEFAULT_FIFO_SIZE;
+	options.lodCount    = 0;
+	options.threadCount = 0;
+	options.verbose     = false;
+	options.writeCooked = false;
+	options.buildBvh    = false;
+	options.sceneCount  = 0;
+	options.texPack     = NULL;
+
+	o3d_texpack_t texPack;
+	memset(&texPack, 0, sizeof(texPack));
+
+	file_list_t files;
+	memset(&files, 0, sizeof(files));
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-c") == 0 && (i + 1) < argc) {
+			const int size = atoi(argv[++i]);
+			options.cacheSize = (size > 0) ? (uint32_t)size : O3D_VCACHE_DEFAULT_FIFO_SIZE;
+		} else if (strcmp(argv[i], "-l") == 0 && (i + 1) < argc) {
+			const int count = atoi(argv[++i]);
+			options.lodCount = (count > 0) ? (uint32_t)count : 0;
+			if (options.lodCount > O3D_MAX_LODS - 1) {
+				options.lodCount = O3D_MAX_LODS - 1;
+			}
+		} else if (strcmp(argv[i], "-j") == 0 && (i + 1) < argc) {
+			const int count = atoi(argv[++i]);
+			options.threadCount = (count > 0) ? (uint32_t)count : 0;
+		} else if (strcmp(argv[i], "-v") == 0) {
+			options.verbose = true;
+		} else if (strcmp(argv[i], "-w") == 0) {
+			options.writeCooked = true;
+		} else if (strcmp(argv[i], "-b") == 0) {
+			options.buildBvh = true;
+		} else if (strcmp(argv[i], "-t") == 0 && (i + 1) < argc) {
+			o3d_texpack_free(&texPack);
+			if (!o3d_texpack_load_file(&texPack, argv[++i])) {
+				fprintf(stderr, "Failed to load texture pack \"%s\": %s\n", argv[i], o3d_get_last_error());
+				file_list_free(&files);
+				return EXIT_FAILURE;
+			}
+			options.texPack = &texPack;
+		} else if (strcmp(argv[i], "-s") == 0 && (i + 1) < argc) {
+			if (!print_scene_stats(argv[++i])) {
+				totals.modelsFailed++;
+			}
+			options.sceneCount++;
+		} else if (!file_list_add_path(&files, argv[i], ".O3D")) {
+			fprintf(stderr, "Can't read input path \"%s\"!\n", argv[i]);
+		}
+	}
+
+	if (files.count == 0) {
+		file_list_free(&files);
+		o3d_texpack_free(&texPack);
+		// Just printing scene statistics is fine.
+		if (options.sceneCount != 0) {
+			return (totals.modelsFailed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		fprintf(stderr, "No O3D files to cook!\n");
+		return EXIT_FAILURE;
+	}
+
+	file_list_sort(&files);
+
+	cook_jobs_t jobs;
+	jobs.files   = &files;
+	jobs.results = calloc(files.count, sizeof(cook_result_t));
+	if (jobs.results == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		file_list_free(&files);
+		o3d_texpack_free(&texPack);
+		return EXIT_FAILURE;
+	}
+
+	const double startTime = clock_seconds();
+
+	if (!parallel_for(files.count, options.threadCount, &cook_model_job, &jobs)) {
+		fprintf(stderr, "Failed to start all the worker threads; cooked with fewer.\n");
+	}
+
+	for (uint32_t f = 0; f < files.count; ++f) {
+		const cook_result_t * result = &jobs.results[f];
+		if (!result->success) {
+			totals.modelsFailed++;
+			continue;
+		}
+
+		if (options.verbose) {
+			printf("%-48s %6u tris %6u verts | ACMR %.3f -> %.3f | ATVR %.3f -> %.3f\n",
+			       files.paths[f], result->before.triangleCount, result->vertexCount,
+			       result->before.acmr, result->after.acmr, result->before.atvr, result->after.atvr);
+			for (uint32_t l = 0; l < options.lodCount; ++l) {
+				printf("    LOD%u: %6u tris, error %f\n", l + 1, result->lodTriangles[l], result->lodErrors[l]);
+			}
+			if (result->nonManifoldEdges != 0) {
+				printf("    %u non-manifold edges, %u border edges\n", result->nonManifoldEdges, result->borderEdges);
+			}
+			if (options.buildBvh) {
+				printf("    BVH: %u nodes, depth %u, built in %.3f ms\n",
+				       result->bvhNodes, result->bvhDepth, result->bvhBuildTime * 1000.0);
+			}
+		}
+
+		totals.modelsCooked++;
+		totals.triangles         += result->before.triangleCount;
+		totals.invalidFaces      += result->invalidFaces;
+		totals.positions         += result->positionCount;
+		totals.weldedPositions   += result->weldedPositions;
+		totals.borderEdges       += result->borderEdges;
+		totals.nonManifoldEdges  += result->nonManifoldEdges;
+		totals.nonManifoldModels += (result->nonManifoldEdges != 0);
+		totals.adjacencyTime     += result->adjacencyTime;
+		totals.transformedBefore += result->before.transformedCount;
+		totals.transformedAfter  += result->after.transformedCount;
+		totals.referencedBefore  += result->vertexCount; // Welded vertexes are all referenced.
+		totals.referencedAfter   += result->vertexCount;
+		totals.sourceBytes       += result->sourceBytes;
+		totals.cookedBytes       += result->cookedBytes;
+		for (uint32_t l = 0; l < options.lodCount; ++l) {
+			totals.lodTriangles[l] += result->lodTriangles[l];
+		}
+		totals.bvhNodes     += result->bvhNodes;
+		totals.bvhBuildTime += result->bvhBuildTime;
+		if (result->bvhDepth > totals.bvhMaxDepth) {
+			totals.bvhMaxDepth = result->bvhDepth;
+		}
+	}
+
+	const double elapsed = clock_seconds() - startTime;
+
+	if (totals.triangles != 0) {
+		printf("Cooked %u models (%u failed) in %.3f seconds. %llu triangles.\n",
+		       totals.modelsCooked, totals.modelsFailed, elapsed,
+		       (unsigned long long)totals.triangles);
+		if (totals.invalidFaces != 0) {
+			printf("Skipped %llu invalid faces (bad vertex indexes or fewer than 3 distinct vertexes).\n",
+			       (unsigned long long)totals.invalidFaces);
+		}
+		if (totals.weldedPositions != 0) {
+			printf("Welded %llu of %llu positions (closer than half an O3DC quantization step).\n",
+			       (unsigned long long)totals.weldedPositions, (unsigned long long)totals.positions);
+		}
+		printf("Adjacency: %llu border edges, %llu non-manifold edges in %u models, %.3f ms total build time\n",
+		       (unsigned long long)totals.borderEdges, (unsigned long long)totals.nonManifoldEdges,
+		       totals.nonManifoldModels, totals.adjacencyTime * 1000.0);
+		printf("ACMR (FIFO %u): %.3f -> %.3f\n", options.cacheSize,
+		       (double)totals.transformedBefore / (double)totals.triangles,
+		       (double)totals.transformedAfter  / (double)totals.triangles);
+		printf("ATVR (FIFO %u): %.3f -> %.3f\n", options.cacheSize,
+		       (double)totals.transformedBefore / (double)totals.referencedBefore,
+		       (double)totals.transformedAfter  / (double)totals.referencedAfter);
+		for (uint32_t l = 0; l < options.lodCount; ++l) {
+			printf("LOD%u: %llu triangles (%.1f%%)\n", l + 1, (unsigned long long)totals.lodTriangles[l],
+			       ((double)totals.lodTriangles[l] / (double)totals.triangles) * 100.0);
+		}
+		if (options.buildBvh) {
+			printf("BVH: %llu nodes, max depth %u, %.3f ms total build time\n",
+			       (unsigned long long)totals.bvhNodes, totals.bvhMaxDepth, totals.bvhBuildTime * 1000.0);
+		}
+	}
+
+	if (totals.cookedBytes != 0) {
+		printf("O3D size: %.2f KB, O3DC size: %.2f KB (%.1f%%)\n",
+		       (double)totals.sourceBytes / 1024.0, (double)totals.cookedBytes / 1024.0,
+		       ((double)totals.cookedBytes / (double)totals.sourceBytes) * 100.0);
+	}
+
+	free(jobs.results);
+	file_list_free(&files);
+	o3d_texpack_free(&texPack);
+	return (totals.modelsFailed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
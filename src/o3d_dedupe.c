@@ -0,0 +1,213 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_dedupe.c
+ * Created on: 17/10/26
+ * Brief: Command-line tool to find duplicate O3D meshes and write an instancing table.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "file_utils.h"
+#include "o3d.h"
+#include "o3d_geohash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Command line options:
+ * ======================================================== */
+
+static const float DEFAULT_EPSILON = 0.01f;
+
+static struct {
+	float        epsilon;
+	const char * tableFilename;
+	bool         verbose;
+} options;
+
+static void print_usage(const char * progName) {
+	printf(
+		"\n"
+		"Usage:\n"
+		"$ %s [options] <o3d_file_or_dir> [more files or dirs...]\n"
+		"  Hashes the geometry of every O3D model, clusters the identical and\n"
+		"  near-identical ones (also if moved to another place) and prints how\n"
+		"  much could be saved by loading each unique mesh only once.\n"
+		"  Directories are scanned recursively.\n"
+		"\n"
+		"Options:\n"
+		"  -e <f>  Position tolerance of near-identical meshes (default %g, 0 for exact).\n"
+		"  -o <f>  Write the instancing table to file <f> (CSV).\n"
+		"  -v      Print every duplicate found.\n"
+		"\n"
+		"Usage:\n"
+		"$ %s --help | -h\n"
+		"  Prints this help text.\n"
+		"\n",
+	progName, (double)DEFAULT_EPSILON, progName);
+}
+
+static const char * match_name(o3d_dedupe_match_t match) {
+	switch (match) {
+	case O3D_DEDUPE_UNIQUE : return "unique";
+	case O3D_DEDUPE_EXACT  : return "exact";
+	case O3D_DEDUPE_NEAR   : return "near";
+	default                : return "?";
+	} // switch (match)
+}
+
+/* ========================================================
+ * write_instancing_table():
+ * ======================================================== */
+
+static bool write_instancing_table(const char * filename, const o3d_dedupe_t * dedupe, char ** paths) {
+	FILE * fileOut = fopen(filename, "wt");
+	if (fileOut == NULL) {
+		fprintf(stderr, "Can't open \"%s\" for writing!\n", filename);
+		return false;
+	}
+
+	// One row per model: draw `unique` translated by the offset in its place.
+	fprintf(fileOut, "model,unique,match,offset_x,offset_y,offset_z,max_error\n");
+	for (uint32_t e = 0; e < dedupe->entryCount; ++e) {
+		const o3d_dedupe_entry_t * entry = &dedupe->entries[e];
+		fprintf(fileOut, "\"%s\",\"%s\",%s,%.9g,%.9g,%.9g,%.9g\n",
+		        paths[e], paths[entry->uniqueModel], match_name(entry->match),
+		        (double)entry->offset[0], (double)entry->offset[1], (double)entry->offset[2],
+		        (double)entry->maxError);
+	}
+
+	const bool success = (ferror(fileOut) == 0);
+	fclose(fileOut);
+
+	if (!success) {
+		fprintf(stderr, "Failed to write \"%s\"!\n", filename);
+	}
+	return success;
+}
+
+/* ========================================================
+ * main():
+ * ======================================================== */
+
+int main(int argc, const char * argv[]) {
+	if (argc < 2) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Printing help is not treated as an error.
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+		print_usage(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	options.epsilon       = DEFAULT_EPSILON;
+	options.tableFilename = NULL;
+	options.verbose       = false;
+
+	file_list_t files;
+	memset(&files, 0, sizeof(files));
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-e") == 0 && (i + 1) < argc) {
+			const float eps = (float)atof(argv[++i]);
+			options.epsilon = (eps > 0.0f) ? eps : 0.0f;
+		} else if (strcmp(argv[i], "-o") == 0 && (i + 1) < argc) {
+			options.tableFilename = argv[++i];
+		} else if (strcmp(argv[i], "-v") == 0) {
+			options.verbose = true;
+		} else if (!file_list_add_path(&files, argv[i], ".O3D")) {
+			fprintf(stderr, "Can't read input path \"%s\"!\n", argv[i]);
+		}
+	}
+
+	if (files.count == 0) {
+		file_list_free(&files);
+		fprintf(stderr, "No O3D files to process!\n");
+		return EXIT_FAILURE;
+	}
+
+	file_list_sort(&files);
+
+	// All the models are needed at once for the comparisons, so
+	// load them into one arena. Failed ones are left out of the table.
+	o3d_arena_t arena;
+	o3d_arena_init(&arena, 0);
+
+	o3d_model_t * models = calloc(files.count, sizeof(models[0]));
+	char ** paths = malloc(files.count * sizeof(paths[0]));
+	if (models == NULL || paths == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		free(models);
+		free(paths);
+		file_list_free(&files);
+		return EXIT_FAILURE;
+	}
+
+	uint32_t modelCount  = 0;
+	uint32_t failedCount = 0;
+	uint64_t totalBytes  = 0;
+
+	for (uint32_t f = 0; f < files.count; ++f) {
+		o3d_model_t * o3d = &models[modelCount];
+		if (!o3d_load_from_file_ex(o3d, files.paths[f], &arena)) {
+			fprintf(stderr, "Failed to load O3D \"%s\": %s\n", files.paths[f], o3d_get_last_error());
+			failedCount++;
+			continue;
+		}
+		totalBytes += (o3d->vertexCount * sizeof(o3d_vertex_t)) + (o3d->faceCount * sizeof(o3d_face_t));
+		paths[modelCount++] = files.paths[f];
+	}
+
+	int exitCode = (failedCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	o3d_dedupe_t dedupe;
+	if (modelCount == 0 || !o3d_dedupe_build(&dedupe, models, modelCount, options.epsilon)) {
+		fprintf(stderr, "Nothing to deduplicate: %s\n", o3d_get_last_error());
+		exitCode = EXIT_FAILURE;
+	} else {
+		uint64_t uniqueBytes = 0;
+		for (uint32_t m = 0; m < modelCount; ++m) {
+			const o3d_dedupe_entry_t * entry = &dedupe.entries[m];
+			if (entry->match == O3D_DEDUPE_UNIQUE) {
+				uniqueBytes += (models[m].vertexCount * sizeof(o3d_vertex_t)) + (models[m].faceCount * sizeof(o3d_face_t));
+			} else if (options.verbose) {
+				printf("%-48s = %s (%s, offset %g %g %g, error %g)\n",
+				       paths[m], paths[entry->uniqueModel], match_name(entry->match),
+				       (double)entry->offset[0], (double)entry->offset[1], (double)entry->offset[2],
+				       (double)entry->maxError);
+			}
+		}
+
+		printf("%u models (%u failed): %u unique, %u exact duplicates, %u near duplicates.\n",
+		       modelCount, failedCount, dedupe.uniqueCount, dedupe.exactCount, dedupe.nearCount);
+		printf("Geometry size: %.2f KB, unique: %.2f KB (%.1f%%)\n",
+		       (double)totalBytes / 1024.0, (double)uniqueBytes / 1024.0,
+		       ((double)uniqueBytes / (double)totalBytes) * 100.0);
+
+		if (options.tableFilename != NULL) {
+			if (write_instancing_table(options.tableFilename, &dedupe, paths)) {
+				printf("Instancing table written to \"%s\".\n", options.tableFilename);
+			} else {
+				exitCode = EXIT_FAILURE;
+			}
+		}
+		o3d_dedupe_free(&dedupe);
+	}
+
+	// No o3d_free() needed, the models are all in the arena.
+	o3d_arena_free(&arena);
+	free(models);
+	free(paths);
+	file_list_free(&files);
+	return exitCode;
+}
@@ -0,0 +1,626 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_export.c
+ * Created on: 17/10/26
+ * Brief: Command line tool that batch converts O3D models to OBJ or binary glTF (GLB).
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "file_utils.h"
+#include "mtf.h"
+#include "o3d.h"
+#include "o3d_convert.h"
+#include "o3d_mesh.h"
+#include "o3d_texreg.h"
+#include "parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Command line options / totals:
+ * ======================================================== */
+
+enum { MAX_PATH_LEN = 1024 };
+
+// Archives open at once, given as inputs or with -t.
+enum { MAX_ARCHIVES = 32 };
+
+static const char * const DEFAULT_OUTPUT_DIR = "export";
+
+static struct {
+	const char         * outputDir;
+	uint32_t             threadCount;
+	o3d_texreg_variant_t variant;
+	bool                 glb;
+	bool                 colors;
+	bool                 copyTextures;
+	bool                 verbose;
+} options;
+
+/*
+ * One model to convert. Models from an MTF are read into memory
+ * up front, since the archive's file can't be shared by the threads.
+ */
+typedef struct export_job {
+	char    * name;        // Output path relative to the output directory, without extension.
+	char    * path;        // Source file, or null if the model is in `data`.
+	uint8_t * data;
+	uint32_t  dataSize;
+} export_job_t;
+
+/*
+ * Outcome of converting one model, written by its job.
+ */
+typedef struct export_result {
+	bool       success;
+	uint32_t   triangles;
+	uint64_t   bytesWritten;
+	uint16_t * texNumbers; // Used by the model, one per mesh group.
+	uint32_t   texCount;
+} export_result_t;
+
+typedef struct export_jobs {
+	export_job_t        * jobs;
+	export_result_t     * results;
+	uint32_t              count;
+	uint32_t              capacity;
+	const o3d_texreg_t  * textures;
+} export_jobs_t;
+
+static void print_usage(const char * progName) {
+	printf(
+		"\n"
+		"Usage:\n"
+		"$ %s [options] <o3d_file_dir_or_mtf> [more files, dirs or MTFs...]\n"
+		"  Converts every O3D model to binary glTF 2.0 (.glb) or Wavefront OBJ.\n"
+		"  Directories are scanned recursively. For MTF archives, every O3D in it\n"
+		"  is converted and its TGAs are also used for the textures. The output\n"
+		"  mirrors the input paths under the output directory, and the textures\n"
+		"  used are copied to its \"textures\" subdirectory.\n"
+		"\n"
+		"Options:\n"
+		"  -f <fmt>  Output format, \"glb\" (default) or \"obj\".\n"
+		"  -o <dir>  Output directory (default \"%s\").\n"
+		"  -t <p>    Texture directory or MTF archive to find the K/R textures in.\n"
+		"  -r        Prefer the \"R\" texture variants (default \"K\").\n"
+		"  -c        Also export the face colors as vertex colors.\n"
+		"  -n        Don't copy the textures, only reference them.\n"
+		"  -j <n>    Number of threads to convert with (default: one per CPU).\n"
+		"  -v        Print every model converted.\n"
+		"\n"
+		"Usage:\n"
+		"$ %s --help | -h\n"
+		"  Prints this help text.\n"
+		"\n",
+	progName, DEFAULT_OUTPUT_DIR, progName);
+}
+
+/* ========================================================
+ * Archive list:
+ * ======================================================== */
+
+static mtf_file_t archives[MAX_ARCHIVES];
+static uint32_t   archiveCount;
+
+static mtf_file_t * open_archive(const char * filename) {
+	if (archiveCount == MAX_ARCHIVES) {
+		fprintf(stderr, "Too many MTF archives, ignoring \"%s\"!\n", filename);
+		return NULL;
+	}
+
+	mtf_file_t * mtf = &archives[archiveCount];
+	if (!mtf_file_open(mtf, filename)) {
+		fprintf(stderr, "Can't open MTF \"%s\": %s\n", filename, mtf_get_last_error());
+		mtf_file_close(mtf);
+		return NULL;
+	}
+
+	archiveCount++;
+	return mtf;
+}
+
+static int compare_entry_name(const void * key, const void * entry) {
+	return strcmp((const char *)key, ((const mtf_file_entry_t *)entry)->filename);
+}
+
+// Archive entry with the given name, from any of the open archives.
+static const mtf_file_entry_t * find_archive_entry(const char * filename, mtf_file_t ** mtf) {
+	for (uint32_t a = 0; a < archiveCount; ++a) {
+		// Sorted by mtf_file_open(), so a binary search works.
+		const mtf_file_entry_t * entry = bsearch(filename, archives[a].fileEntries, archives[a].fileEntryCount,
+		                                         sizeof(mtf_file_entry_t), &compare_entry_name);
+		if (entry != NULL) {
+			*mtf = &archives[a];
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static void close_archives(void) {
+	for (uint32_t a = 0; a < archiveCount; ++a) {
+		mtf_file_close(&archives[a]);
+	}
+	archiveCount = 0;
+}
+
+/* ========================================================
+ * Job list:
+ * ======================================================== */
+
+//
+// "./LEVEL1A/MESHES/M00.O3D" or "LEVEL1A\MESHES\M00.O3D" => "LEVEL1A/MESHES/M00"
+// Absolute paths and ".." are dropped, so the output always lands under the output directory.
+//
+static char * make_output_name(const char * path) {
+	const size_t len = strlen(path);
+	char * name = malloc(len + 1);
+	if (name == NULL) {
+		return NULL;
+	}
+
+	size_t n = 0;
+	const char * p = path;
+	while (*p != '\0') {
+		const char * end = p;
+		while (*end != '\0' && *end != '/' && *end != '\\') {
+			++end;
+		}
+
+		const size_t partLen = (size_t)(end - p);
+		const bool skip = (partLen == 0) || (partLen == 1 && p[0] == '.') || (partLen == 2 && p[0] == '.' && p[1] == '.');
+		if (!skip) {
+			if (n != 0) {
+				name[n++] = '/';
+			}
+			for (size_t i = 0; i < partLen; ++i) {
+				// Same as the unpacker, extended ASCII doesn't make good filenames.
+				name[n++] = ((unsigned char)p[i] < 128) ? p[i] : '?';
+			}
+		}
+		p = (*end != '\0') ? (end + 1) : end;
+	}
+	name[n] = '\0';
+
+	if (n > 4 && file_has_extension(name, ".O3D")) {
+		name[n - 4] = '\0';
+	}
+	return name;
+}
+
+static export_job_t * add_job(export_jobs_t * jobs, const char * sourceName) {
+	if (jobs->count == jobs->capacity) {
+		const uint32_t newCapacity = (jobs->capacity != 0) ? (jobs->capacity * 2) : 256;
+		export_job_t * newJobs = realloc(jobs->jobs, newCapacity * sizeof(jobs->jobs[0]));
+		if (newJobs == NULL) {
+			return NULL;
+		}
+		jobs->jobs     = newJobs;
+		jobs->capacity = newCapacity;
+	}
+
+	export_job_t * job = &jobs->jobs[jobs->count];
+	memset(job, 0, sizeof(*job));
+	job->name = make_output_name(sourceName);
+	if (job->name == NULL) {
+		return NULL;
+	}
+
+	jobs->count++;
+	return job;
+}
+
+static bool add_file_jobs(export_jobs_t * jobs, const file_list_t * files) {
+	for (uint32_t f = 0; f < files->count; ++f) {
+		export_job_t * job = add_job(jobs, files->paths[f]);
+		const size_t len = strlen(files->paths[f]) + 1;
+		if (job == NULL || (job->path = malloc(len)) == NULL) {
+			fprintf(stderr, "Out of memory!\n");
+			return false;
+		}
+		memcpy(job->path, files->paths[f], len);
+	}
+	return true;
+}
+
+// Reads every O3D in the archive. This is the serial part of converting an MTF.
+static bool add_archive_jobs(export_jobs_t * jobs, mtf_file_t * mtf, const char * mtfFilename) {
+	bool success = true;
+	for (uint32_t e = 0; e < mtf->fileEntryCount; ++e) {
+		const mtf_file_entry_t * entry = &mtf->fileEntries[e];
+		if (!file_has_extension(entry->filename, ".O3D")) {
+			continue;
+		}
+
+		uint8_t * data;
+		if (!mtf_file_read_entry(mtf, entry, &data)) {
+			fprintf(stderr, "Failed to read \"%s\" from \"%s\": %s\n", entry->filename, mtfFilename, mtf_get_last_error());
+			success = false;
+			continue;
+		}
+
+		export_job_t * job = add_job(jobs, entry->filename);
+		if (job == NULL) {
+			free(data);
+			fprintf(stderr, "Out of memory!\n");
+			return false;
+		}
+		job->data     = data;
+		job->dataSize = entry->decompressedSize;
+	}
+	return success;
+}
+
+static void free_jobs(export_jobs_t * jobs) {
+	for (uint32_t j = 0; j < jobs->count; ++j) {
+		free(jobs->jobs[j].name);
+		free(jobs->jobs[j].path);
+		free(jobs->jobs[j].data);
+	}
+	if (jobs->results != NULL) {
+		for (uint32_t j = 0; j < jobs->count; ++j) {
+			free(jobs->results[j].texNumbers);
+		}
+	}
+	free(jobs->jobs);
+	free(jobs->results);
+	memset(jobs, 0, sizeof(*jobs));
+}
+
+/* ========================================================
+ * export_model():
+ * ======================================================== */
+
+static bool write_output(const char * filename, const o3d_out_buffer_t * buf, export_result_t * result) {
+	if (!o3d_out_write_file(buf, filename)) {
+		fprintf(stderr, "Failed to write \"%s\": %s\n", filename, o3d_get_last_error());
+		return false;
+	}
+	result->bytesWritten += buf->size;
+	return true;
+}
+
+static bool export_mesh(const export_job_t * job, const o3d_mesh_t * mesh, const o3d_texreg_t * textures,
+                        export_result_t * result) {
+	char filename[MAX_PATH_LEN];
+	snprintf(filename, sizeof(filename), "%s/%s%s", options.outputDir, job->name, options.glb ? ".glb" : ".obj");
+	if (!file_make_path(filename)) {
+		fprintf(stderr, "Can't create the output directory for \"%s\"!\n", filename);
+		return false;
+	}
+
+	// The textures all go in one directory at the top of the output, so step up out of the model's.
+	char uriPrefix[MAX_PATH_LEN];
+	size_t prefixLen = 0;
+	for (const char * p = job->name; *p != '\0'; ++p) {
+		if (*p == '/' && prefixLen + 3 < sizeof(uriPrefix) - sizeof("textures/")) {
+			memcpy(&uriPrefix[prefixLen], "../", 3);
+			prefixLen += 3;
+		}
+	}
+	memcpy(&uriPrefix[prefixLen], "textures/", sizeof("textures/"));
+
+	o3d_export_textures_t exportTextures;
+	exportTextures.registry  = textures;
+	exportTextures.uriPrefix = uriPrefix;
+	exportTextures.variant   = options.variant;
+
+	const char * baseName = strrchr(job->name, '/');
+	baseName = (baseName != NULL) ? (baseName + 1) : job->name;
+
+	char mtlName[MAX_PATH_LEN];
+	snprintf(mtlName, sizeof(mtlName), "%s.mtl", baseName);
+
+	o3d_out_buffer_t buf;
+	o3d_out_buffer_t mtl;
+	o3d_out_init(&buf);
+	o3d_out_init(&mtl);
+
+	const bool exported = options.glb ? o3d_export_glb(&buf, mesh, baseName, &exportTextures, options.colors)
+	                                  : o3d_export_obj(&buf, &mtl, mesh, mtlName, &exportTextures, options.colors);
+	bool success = false;
+	if (!exported) {
+		fprintf(stderr, "Failed to export \"%s\": %s\n", job->name, o3d_get_last_error());
+	} else if (write_output(filename, &buf, result)) {
+		success = true;
+		if (!options.glb) {
+			// Next to the OBJ, as "mtllib" refers to it.
+			snprintf(filename, sizeof(filename), "%s/%s.mtl", options.outputDir, job->name);
+			success = write_output(filename, &mtl, result);
+		}
+	}
+
+	o3d_out_free(&mtl);
+	o3d_out_free(&buf);
+	return success;
+}
+
+static bool export_model(const export_job_t * job, const o3d_texreg_t * textures, export_result_t * result) {
+	o3d_model_t o3d;
+	const bool loaded = (job->path != NULL) ? o3d_load_from_file(&o3d, job->path)
+	                                        : o3d_load_from_memory(&o3d, job->data, job->dataSize, NULL);
+	if (!loaded) {
+		fprintf(stderr, "Failed to load O3D \"%s\": %s\n", job->name, o3d_get_last_error());
+		o3d_free(&o3d);
+		return false;
+	}
+
+	// Only grouped, not optimized. The DCC tools reorder everything on import anyway.
+	o3d_mesh_t mesh;
+	if (!o3d_mesh_build(&mesh, &o3d) || !o3d_mesh_group_by_texture(&mesh)) {
+		fprintf(stderr, "Failed to build mesh for \"%s\": %s\n", job->name, o3d_get_last_error());
+		o3d_mesh_free(&mesh);
+		o3d_free(&o3d);
+		return false;
+	}
+	o3d_free(&o3d);
+
+	bool success = export_mesh(job, &mesh, textures, result);
+	if (success) {
+		result->triangles = o3d_mesh_triangle_count(&mesh);
+		result->texNumbers = malloc(mesh.groupCount * sizeof(result->texNumbers[0]));
+		if (result->texNumbers != NULL) {
+			for (uint32_t g = 0; g < mesh.groupCount; ++g) {
+				result->texNumbers[g] = (uint16_t)mesh.groups[g].texNumber;
+			}
+			result->texCount = mesh.groupCount;
+		}
+	}
+
+	o3d_mesh_free(&mesh);
+	return success;
+}
+
+static void export_model_job(void * userData, uint32_t jobIndex) {
+	export_jobs_t * jobs = userData;
+	export_result_t * result = &jobs->results[jobIndex];
+	result->success = export_model(&jobs->jobs[jobIndex], jobs->textures, result);
+}
+
+/* ========================================================
+ * copy_textures():
+ * ======================================================== */
+
+static bool copy_texture(const char * path, const char * destFilename) {
+	mtf_file_t * mtf = NULL;
+	const mtf_file_entry_t * entry = find_archive_entry(path, &mtf);
+
+	FILE * fileOut = fopen(destFilename, "wb");
+	if (fileOut == NULL) {
+		fprintf(stderr, "Can't open \"%s\" for writing!\n", destFilename);
+		return false;
+	}
+
+	bool success;
+	if (entry != NULL) {
+		uint8_t * data;
+		success = mtf_file_read_entry(mtf, entry, &data);
+		if (success) {
+			success = (fwrite(data, 1, entry->decompressedSize, fileOut) == entry->decompressedSize);
+			free(data);
+		} else {
+			fprintf(stderr, "Failed to read \"%s\": %s\n", path, mtf_get_last_error());
+		}
+	} else {
+		file_map_t map;
+		success = file_map_open(&map, path);
+		if (success) {
+			success = (fwrite(map.data, 1, (size_t)map.size, fileOut) == map.size);
+		} else {
+			fprintf(stderr, "Can't read texture \"%s\"!\n", path);
+		}
+		file_map_close(&map);
+	}
+
+	if (fclose(fileOut) != 0) {
+		success = false;
+	}
+	return success;
+}
+
+// Copies each texture used by the exported models once, serially,
+// since the archives can't be read from several threads.
+static uint32_t copy_textures(const export_jobs_t * jobs, uint32_t * failedCount) {
+	bool * used = calloc(O3D_TEXREG_MAX_TEX_NUMBER + 1, sizeof(bool));
+	if (used == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		(*failedCount)++;
+		return 0;
+	}
+
+	for (uint32_t j = 0; j < jobs->count; ++j) {
+		const export_result_t * result = &jobs->results[j];
+		for (uint32_t t = 0; t < result->texCount; ++t) {
+			if (result->texNumbers[t] <= O3D_TEXREG_MAX_TEX_NUMBER) {
+				used[result->texNumbers[t]] = true;
+			}
+		}
+	}
+
+	char name[256];
+	char filename[MAX_PATH_LEN + 256];
+	uint32_t copiedCount = 0;
+
+	for (uint32_t t = 0; t <= O3D_TEXREG_MAX_TEX_NUMBER; ++t) {
+		const char * path = used[t] ? o3d_texreg_find_any(jobs->textures, t, options.variant) : NULL;
+		if (path == NULL) {
+			continue;
+		}
+
+		// Same name the exporters reference it by.
+		o3d_export_texture_name(path, name, sizeof(name));
+		snprintf(filename, sizeof(filename), "%s/textures/%s", options.outputDir, name);
+
+		if (file_make_path(filename) && copy_texture(path, filename)) {
+			copiedCount++;
+		} else {
+			fprintf(stderr, "Failed to copy texture \"%s\" to \"%s\"!\n", path, filename);
+			(*failedCount)++;
+		}
+	}
+
+	free(used);
+	return copiedCount;
+}
+
+/* ========================================================
+ * main():
+ * ======================================================== */
+
+int main(int argc, const char * argv[]) {
+	if (argc < 2) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Printing help is not treated as an error.
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+		print_usage(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	options.outputDir    = DEFAULT_OUTPUT_DIR;
+	options.threadCount  = 0;
+	options.variant      = O3D_TEXREG_K;
+	options.glb          = true;
+	options.colors       = false;
+	options.copyTextures = true;
+	options.verbose      = false;
+
+	export_jobs_t jobs;
+	memset(&jobs, 0, sizeof(jobs));
+
+	o3d_texreg_t textures;
+	o3d_texreg_init(&textures);
+
+	file_list_t files;
+	memset(&files, 0, sizeof(files));
+
+	uint32_t failedCount = 0;
+	const double startTime = clock_seconds();
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-f") == 0 && (i + 1) < argc) {
+			++i;
+			if (strcmp(argv[i], "glb") == 0) {
+				options.glb = true;
+			} else if (strcmp(argv[i], "obj") == 0) {
+				options.glb = false;
+			} else {
+				fprintf(stderr, "Unknown output format \"%s\", using glb.\n", argv[i]);
+			}
+		} else if (strcmp(argv[i], "-o") == 0 && (i + 1) < argc) {
+			options.outputDir = argv[++i];
+		} else if (strcmp(argv[i], "-t") == 0 && (i + 1) < argc) {
+			const char * path = argv[++i];
+			bool success;
+			if (file_has_extension(path, ".MTF")) {
+				const mtf_file_t * mtf = open_archive(path);
+				success = (mtf != NULL) && o3d_texreg_build_from_mtf(&textures, mtf);
+			} else {
+				success = o3d_texreg_build_from_directory(&textures, path);
+			}
+			if (!success) {
+				fprintf(stderr, "Can't read textures from \"%s\"! %s\n", path, o3d_get_last_error());
+			}
+		} else if (strcmp(argv[i], "-r") == 0) {
+			options.variant = O3D_TEXREG_R;
+		} else if (strcmp(argv[i], "-c") == 0) {
+			options.colors = true;
+		} else if (strcmp(argv[i], "-n") == 0) {
+			options.copyTextures = false;
+		} else if (strcmp(argv[i], "-j") == 0 && (i + 1) < argc) {
+			const int count = atoi(argv[++i]);
+			options.threadCount = (count > 0) ? (uint32_t)count : 0;
+		} else if (strcmp(argv[i], "-v") == 0) {
+			options.verbose = true;
+		} else if (file_has_extension(argv[i], ".MTF") && !file_is_directory(argv[i])) {
+			mtf_file_t * mtf = open_archive(argv[i]);
+			if (mtf == NULL || !add_archive_jobs(&jobs, mtf, argv[i])) {
+				failedCount++;
+			}
+			if (mtf != NULL && !o3d_texreg_build_from_mtf(&textures, mtf)) {
+				fprintf(stderr, "Can't read textures from \"%s\"! %s\n", argv[i], o3d_get_last_error());
+			}
+		} else if (!file_list_add_path(&files, argv[i], ".O3D")) {
+			fprintf(stderr, "Can't read input path \"%s\"!\n", argv[i]);
+		}
+	}
+
+	file_list_sort(&files);
+	if (!add_file_jobs(&jobs, &files)) {
+		failedCount++;
+	}
+	file_list_free(&files);
+
+	if (jobs.count == 0) {
+		fprintf(stderr, "No O3D files to export!\n");
+		free_jobs(&jobs);
+		o3d_texreg_free(&textures);
+		close_archives();
+		return EXIT_FAILURE;
+	}
+
+	const double readTime = clock_seconds() - startTime;
+
+	jobs.textures = &textures;
+	jobs.results  = calloc(jobs.count, sizeof(export_result_t));
+	if (jobs.results == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		free_jobs(&jobs);
+		o3d_texreg_free(&textures);
+		close_archives();
+		return EXIT_FAILURE;
+	}
+
+	if (!parallel_for(jobs.count, options.threadCount, &export_model_job, &jobs)) {
+		fprintf(stderr, "Failed to start all the worker threads; exported with fewer.\n");
+	}
+
+	uint32_t exportedCount = 0;
+	uint64_t triangles     = 0;
+	uint64_t bytesWritten  = 0;
+
+	for (uint32_t j = 0; j < jobs.count; ++j) {
+		const export_result_t * result = &jobs.results[j];
+		if (!result->success) {
+			failedCount++;
+			continue;
+		}
+		if (options.verbose) {
+			printf("%-48s %6u tris, %8llu bytes\n", jobs.jobs[j].name, result->triangles,
+			       (unsigned long long)result->bytesWritten);
+		}
+		exportedCount++;
+		triangles    += result->triangles;
+		bytesWritten += result->bytesWritten;
+	}
+
+	const uint32_t texturesCopied = options.copyTextures ? copy_textures(&jobs, &failedCount) : 0;
+	const double elapsed = clock_seconds() - startTime;
+
+	printf("Exported %u models to %s in %.3f seconds (%.3f reading the inputs). %llu triangles, %.2f MB written.\n",
+	       exportedCount, options.glb ? "GLB" : "OBJ", elapsed, readTime,
+	       (unsigned long long)triangles, (double)bytesWritten / (1024.0 * 1024.0));
+	if (textures.textureCount != 0) {
+		printf("%u textures registered, %u copied to \"%s/textures\".\n",
+		       textures.textureCount, texturesCopied, options.outputDir);
+	}
+	if (failedCount != 0) {
+		printf("%u failures.\n", failedCount);
+	}
+
+	free_jobs(&jobs);
+	o3d_texreg_free(&textures);
+	close_archives();
+	return (failedCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
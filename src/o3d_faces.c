@@ -0,0 +1,125 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_faces.c
+ * Created on: 17/10/26
+ * Brief: Split (hot/cold) in-memory layout of the O3D faces, one aligned stream per field.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_faces.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * o3d_face_streams_build() / o3d_face_streams_free():
+ * ======================================================== */
+
+static inline size_t faces_align16(size_t size) {
+	return (size + 15) & ~(size_t)15;
+}
+
+bool o3d_face_streams_build(o3d_face_streams_t * streams, const o3d_model_t * o3d, o3d_arena_t * arena) {
+	assert(streams != NULL);
+	assert(o3d     != NULL);
+
+	memset(streams, 0, sizeof(*streams));
+
+	const uint32_t faceCount = o3d->faceCount;
+	if (faceCount == 0) {
+		return o3d_set_error("Model has no faces!");
+	}
+
+	// Largest elements first; each stream starts 16 aligned.
+	const size_t texCoordBytes = faces_align16(faceCount * sizeof(streams->texCoords[0]));
+	const size_t indexBytes    = faces_align16(faceCount * sizeof(streams->indexes[0]));
+	const size_t colorBytes    = faces_align16(faceCount * sizeof(streams->colors[0]));
+	const size_t flagBytes     = faces_align16(faceCount * sizeof(streams->flags[0]));
+	const size_t texNumBytes   = faces_align16(faceCount * sizeof(streams->texNumbers[0]));
+	const size_t blockBytes    = texCoordBytes + indexBytes + colorBytes + flagBytes + texNumBytes;
+
+	uint8_t * block;
+	if (arena != NULL) {
+		block = o3d_arena_alloc(arena, blockBytes);
+	} else {
+		block = malloc(blockBytes);
+		streams->memBlock = block;
+	}
+
+	if (block == NULL) {
+		return o3d_set_error("Unable to malloc face streams!");
+	}
+
+	uint8_t * p = block;
+	streams->texCoords  = (o3d_texcoord_t (*)[4])p; p += texCoordBytes;
+	streams->indexes    = (o3d_face_indexes_t *)p;  p += indexBytes;
+	streams->colors     = (o3d_color_t *)p;         p += colorBytes;
+	streams->flags      = (uint32_t *)p;            p += flagBytes;
+	streams->texNumbers = (uint16_t *)p;
+	streams->faceCount  = faceCount;
+
+	// Faces are packed structures, so copy the fields out with memcpy.
+	const o3d_face_t * faces = o3d->faces;
+	for (uint32_t f = 0; f < faceCount; ++f) {
+		memcpy(&streams->indexes[f],   faces[f].index,     sizeof(streams->indexes[f]));
+		memcpy(streams->texCoords[f],  faces[f].texCoords, sizeof(streams->texCoords[f]));
+		memcpy(&streams->colors[f],    &faces[f].color,    sizeof(streams->colors[f]));
+		memcpy(&streams->flags[f],     &faces[f].unknown,  sizeof(streams->flags[f]));
+		memcpy(&streams->texNumbers[f], &faces[f].texNumber, sizeof(streams->texNumbers[f]));
+	}
+
+	return true;
+}
+
+void o3d_face_streams_free(o3d_face_streams_t * streams) {
+	if (streams == NULL) {
+		return;
+	}
+
+	free(streams->memBlock);
+	memset(streams, 0, sizeof(*streams));
+}
+
+/* ========================================================
+ * o3d_face_streams_validate():
+ * ======================================================== */
+
+uint32_t o3d_face_streams_validate(const o3d_face_streams_t * streams, uint32_t vertexCount, uint8_t * validFaces) {
+	assert(streams != NULL);
+
+	uint32_t validCount = 0;
+	for (uint32_t f = 0; f < streams->faceCount; ++f) {
+		const bool valid = o3d_face_is_valid(&streams->indexes[f], vertexCount);
+		if (validFaces != NULL) {
+			validFaces[f] = (uint8_t)valid;
+		}
+		validCount += valid;
+	}
+	return validCount;
+}
+
+/* ========================================================
+ * o3d_face_streams_triangle_count():
+ * ======================================================== */
+
+uint32_t o3d_face_streams_triangle_count(const o3d_face_streams_t * streams, uint32_t vertexCount) {
+	assert(streams != NULL);
+
+	uint32_t triangleCount = 0;
+	for (uint32_t f = 0; f < streams->faceCount; ++f) {
+		uint8_t corners[4];
+		const uint32_t cornerCount = o3d_face_corners(&streams->indexes[f], vertexCount, corners);
+		if (cornerCount != 0) {
+			triangleCount += cornerCount - 2;
+		}
+	}
+	return triangleCount;
+}
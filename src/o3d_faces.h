@@ -0,0 +1,115 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_faces.h
+ * Created on: 17/10/26
+ * Brief: Split (hot/cold) in-memory layout of the O3D faces, one aligned stream per field.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_FACES_H
+#define DARKSTONE_O3D_FACES_H
+
+#include "o3d.h"
+
+/* ========================================================
+ * Face streams:
+ * ======================================================== */
+
+/*
+ * Vertex indexes of a face, same as o3d_face_t::index.
+ * index[3] is O3D_INVALID_FACE_INDEX for triangles.
+ */
+typedef struct o3d_face_indexes {
+	uint16_t index[4];
+} o3d_face_indexes_t;
+
+/*
+ * The fields of o3d_face_t in separate arrays (all [0, faceCount)), so
+ * that passes over the topology only read the 8 bytes of indexes per
+ * face instead of the whole 50 byte record, and the floats are aligned.
+ */
+typedef struct o3d_face_streams {
+	o3d_face_indexes_t * indexes;     // Hot: topology.
+	uint16_t           * texNumbers;  // Hot: grouping/sorting.
+	o3d_texcoord_t    (* texCoords)[4];
+	o3d_color_t        * colors;
+	uint32_t           * flags;       // o3d_face_t::unknown.
+	void               * memBlock;    // Single allocation for all the streams. Null if in an arena.
+	uint32_t             faceCount;
+} o3d_face_streams_t;
+
+/* ========================================================
+ * Face stream functions:
+ * ======================================================== */
+
+/*
+ * Splits the faces of a model into streams. The memory comes from
+ * `arena` if not null, in which case freeing the streams is optional.
+ */
+bool o3d_face_streams_build(o3d_face_streams_t * streams, const o3d_model_t * o3d, o3d_arena_t * arena);
+
+/*
+ * Frees the streams, if they are not in an arena.
+ */
+void o3d_face_streams_free(o3d_face_streams_t * streams);
+
+/*
+ * Checks the faces with o3d_face_corners(): against `vertexCount` and for
+ * too few distinct vertexes. Writes 1 (valid) or 0 per face to `validFaces`
+ * if not null.
+ * Returns the number of valid faces. Only reads the index stream.
+ */
+uint32_t o3d_face_streams_validate(const o3d_face_streams_t * streams, uint32_t vertexCount, uint8_t * validFaces);
+
+/*
+ * Number of triangles after collapsing the repeated corners and splitting
+ * the quads, counting only the valid faces.
+ */
+uint32_t o3d_face_streams_triangle_count(const o3d_face_streams_t * streams, uint32_t vertexCount);
+
+/*
+ * Face helpers. Only read the index stream.
+ */
+static inline bool o3d_face_is_quad(const o3d_face_indexes_t * face) {
+	return face->index[3] != O3D_INVALID_FACE_INDEX;
+}
+
+/*
+ * Corners (0 to 3, in order) left after dropping the ones that repeat the vertex
+ * of the corner before them, so the quad a,b,c,c is the triangle a,b,c. Returns
+ * how many, 3 or 4, or 0 if the face can't be drawn: an index out of range, fewer
+ * than 3 distinct vertexes or a quad folded onto itself (opposite corners equal).
+ */
+static inline uint32_t o3d_face_corners(const o3d_face_indexes_t * face, uint32_t vertexCount, uint8_t corners[4]) {
+	const uint32_t cornerCount = o3d_face_is_quad(face) ? 4 : 3;
+	uint32_t count = 0;
+	for (uint32_t c = 0; c < cornerCount; ++c) {
+		if (face->index[c] >= vertexCount) {
+			return 0;
+		}
+		if (face->index[c] != face->index[(c == 0) ? (cornerCount - 1) : (c - 1)]) {
+			corners[count++] = (uint8_t)c;
+		}
+	}
+	if (count < 3) {
+		return 0;
+	}
+	if (count == 4 && (face->index[0] == face->index[2] || face->index[1] == face->index[3])) {
+		return 0;
+	}
+	return count;
+}
+
+static inline bool o3d_face_is_valid(const o3d_face_indexes_t * face, uint32_t vertexCount) {
+	uint8_t corners[4];
+	return o3d_face_corners(face, vertexCount, corners) != 0;
+}
+
+#endif // DARKSTONE_O3D_FACES_H
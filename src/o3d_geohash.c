@@ -0,0 +1,289 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_geohash.c
+ * Created on: 17/10/26
+ * Brief: Canonical geometry hashing of O3D models and clustering of duplicate meshes for instancing.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_geohash.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Hashing helpers:
+ * ======================================================== */
+
+static inline uint64_t geohash_mix(uint64_t h, uint32_t word) {
+	uint64_t k = (uint64_t)word * 0x9E3779B97F4A7C15ull;
+	k ^= k >> 29;
+	h ^= k;
+	h  = (h << 27) | (h >> 37);
+	return (h * 0x87C37B91114253D5ull) + 0x52DCE729ull;
+}
+
+static inline uint64_t geohash_finalize(uint64_t h) {
+	// MurmurHash3 fmix64.
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+static inline uint32_t geohash_float_bits(float f) {
+	// Normalize -0 to +0 so they hash the same.
+	if (f == 0.0f) {
+		f = 0.0f;
+	}
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+static inline uint32_t geohash_corner_count(const o3d_face_t * face) {
+	return (face->index[3] != O3D_INVALID_FACE_INDEX) ? 4 : 3;
+}
+
+static uint64_t geohash_topology(uint64_t h, const o3d_model_t * o3d) {
+	h = geohash_mix(h, o3d->vertexCount);
+	h = geohash_mix(h, o3d->faceCount);
+	for (uint32_t f = 0; f < o3d->faceCount; ++f) {
+		const o3d_face_t * face = &o3d->faces[f];
+		h = geohash_mix(h, (uint32_t)face->index[0] | ((uint32_t)face->index[1] << 16));
+		h = geohash_mix(h, (uint32_t)face->index[2] | ((uint32_t)face->index[3] << 16));
+		h = geohash_mix(h, face->texNumber);
+	}
+	return h;
+}
+
+/* ========================================================
+ * o3d_geometry_hash() / o3d_topology_hash():
+ * ======================================================== */
+
+uint64_t o3d_geometry_hash(const o3d_model_t * o3d) {
+	assert(o3d != NULL);
+
+	uint64_t h = geohash_topology(0x2545F4914F6CDD1Dull, o3d);
+
+	for (uint32_t v = 0; v < o3d->vertexCount; ++v) {
+		h = geohash_mix(h, geohash_float_bits(o3d->vertexes[v].x));
+		h = geohash_mix(h, geohash_float_bits(o3d->vertexes[v].y));
+		h = geohash_mix(h, geohash_float_bits(o3d->vertexes[v].z));
+	}
+
+	for (uint32_t f = 0; f < o3d->faceCount; ++f) {
+		const o3d_face_t * face = &o3d->faces[f];
+
+		// Faces are packed structures, so copy out to avoid unaligned access.
+		o3d_texcoord_t uvs[4];
+		uint32_t colorBits;
+		memcpy(uvs, face->texCoords, sizeof(uvs));
+		memcpy(&colorBits, &face->color, sizeof(colorBits));
+
+		// The 4th UV of a triangle is unused, so not part of the geometry.
+		const uint32_t cornerCount = geohash_corner_count(face);
+		for (uint32_t c = 0; c < cornerCount; ++c) {
+			h = geohash_mix(h, geohash_float_bits(uvs[c].u));
+			h = geohash_mix(h, geohash_float_bits(uvs[c].v));
+		}
+		h = geohash_mix(h, colorBits);
+	}
+
+	return geohash_finalize(h);
+}
+
+uint64_t o3d_topology_hash(const o3d_model_t * o3d) {
+	assert(o3d != NULL);
+	return geohash_finalize(geohash_topology(0x9E6C63D0676A9A99ull, o3d));
+}
+
+/* ========================================================
+ * Model comparison:
+ * ======================================================== */
+
+//
+// True if `b` is `a` translated by `offset` (the difference of the
+// AABB minimums), within `epsilon`. Also outputs the largest error.
+//
+static bool geohash_models_match(const o3d_model_t * a, const o3d_model_t * b, float epsilon,
+                                 float offset[3], float * maxError) {
+	if (a->vertexCount != b->vertexCount || a->faceCount != b->faceCount) {
+		return false;
+	}
+
+	for (uint32_t f = 0; f < a->faceCount; ++f) {
+		const o3d_face_t * fa = &a->faces[f];
+		const o3d_face_t * fb = &b->faces[f];
+
+		if (memcmp(fa->index, fb->index, sizeof(fa->index)) != 0 ||
+		    memcmp(&fa->color, &fb->color, sizeof(fa->color)) != 0 ||
+		    fa->texNumber != fb->texNumber) {
+			return false;
+		}
+
+		o3d_texcoord_t uvA[4], uvB[4];
+		memcpy(uvA, fa->texCoords, sizeof(uvA));
+		memcpy(uvB, fb->texCoords, sizeof(uvB));
+
+		const uint32_t cornerCount = geohash_corner_count(fa);
+		for (uint32_t c = 0; c < cornerCount; ++c) {
+			if (fabsf(uvA[c].u - uvB[c].u) > O3D_DEDUPE_UV_EPSILON ||
+			    fabsf(uvA[c].v - uvB[c].v) > O3D_DEDUPE_UV_EPSILON) {
+				return false;
+			}
+		}
+	}
+
+	offset[0] = b->aabb.mins.x - a->aabb.mins.x;
+	offset[1] = b->aabb.mins.y - a->aabb.mins.y;
+	offset[2] = b->aabb.mins.z - a->aabb.mins.z;
+
+	float worst = 0.0f;
+	for (uint32_t v = 0; v < a->vertexCount; ++v) {
+		const o3d_vertex_t * va = &a->vertexes[v];
+		const o3d_vertex_t * vb = &b->vertexes[v];
+
+		const float dx = fabsf((vb->x - offset[0]) - va->x);
+		const float dy = fabsf((vb->y - offset[1]) - va->y);
+		const float dz = fabsf((vb->z - offset[2]) - va->z);
+
+		worst = (dx > worst) ? dx : worst;
+		worst = (dy > worst) ? dy : worst;
+		worst = (dz > worst) ? dz : worst;
+		if (worst > epsilon) {
+			return false;
+		}
+	}
+
+	*maxError = worst;
+	return true;
+}
+
+/* ========================================================
+ * o3d_dedupe_build():
+ * ======================================================== */
+
+typedef struct geohash_sort_key {
+	uint64_t topologyHash;
+	uint32_t model;
+} geohash_sort_key_t;
+
+static int geohash_sort_keys(const void * a, const void * b) {
+	const geohash_sort_key_t * ka = a;
+	const geohash_sort_key_t * kb = b;
+	if (ka->topologyHash != kb->topologyHash) {
+		return (ka->topologyHash < kb->topologyHash) ? -1 : 1;
+	}
+	// Input order inside a run, so the first model of a cluster is the unique.
+	return (ka->model < kb->model) ? -1 : ((ka->model > kb->model) ? 1 : 0);
+}
+
+bool o3d_dedupe_build(o3d_dedupe_t * dedupe, const o3d_model_t * models, uint32_t modelCount, float epsilon) {
+	assert(dedupe != NULL);
+	assert(models != NULL || modelCount == 0);
+	assert(epsilon >= 0.0f);
+
+	memset(dedupe, 0, sizeof(*dedupe));
+
+	if (modelCount == 0) {
+		return o3d_set_error("No models to deduplicate!");
+	}
+
+	dedupe->entries = calloc(modelCount, sizeof(dedupe->entries[0]));
+	geohash_sort_key_t * keys = malloc(modelCount * sizeof(keys[0]));
+	uint32_t * uniques = malloc(modelCount * sizeof(uniques[0]));
+
+	if (dedupe->entries == NULL || keys == NULL || uniques == NULL) {
+		free(keys);
+		free(uniques);
+		o3d_dedupe_free(dedupe);
+		return o3d_set_error("Unable to malloc dedupe table!");
+	}
+
+	dedupe->entryCount = modelCount;
+	for (uint32_t m = 0; m < modelCount; ++m) {
+		o3d_dedupe_entry_t * entry = &dedupe->entries[m];
+		entry->geometryHash = o3d_geometry_hash(&models[m]);
+		entry->topologyHash = o3d_topology_hash(&models[m]);
+		keys[m].topologyHash = entry->topologyHash;
+		keys[m].model = m;
+	}
+
+	// Only models with the same topology can match, so compare within runs.
+	qsort(keys, modelCount, sizeof(keys[0]), &geohash_sort_keys);
+
+	for (uint32_t first = 0; first < modelCount; ) {
+		uint32_t end = first + 1;
+		while (end < modelCount && keys[end].topologyHash == keys[first].topologyHash) {
+			++end;
+		}
+
+		uint32_t uniqueCount = 0;
+		for (uint32_t k = first; k < end; ++k) {
+			const uint32_t m = keys[k].model;
+			o3d_dedupe_entry_t * entry = &dedupe->entries[m];
+
+			entry->match = O3D_DEDUPE_UNIQUE;
+			entry->uniqueModel = m;
+
+			for (uint32_t u = 0; u < uniqueCount; ++u) {
+				const uint32_t candidate = uniques[u];
+				float offset[3], maxError;
+				if (!geohash_models_match(&models[candidate], &models[m], epsilon, offset, &maxError)) {
+					continue;
+				}
+
+				const bool exact = (entry->geometryHash == dedupe->entries[candidate].geometryHash) &&
+				                   (offset[0] == 0.0f && offset[1] == 0.0f && offset[2] == 0.0f && maxError == 0.0f);
+
+				entry->match       = exact ? O3D_DEDUPE_EXACT : O3D_DEDUPE_NEAR;
+				entry->uniqueModel = candidate;
+				entry->offset[0]   = offset[0];
+				entry->offset[1]   = offset[1];
+				entry->offset[2]   = offset[2];
+				entry->maxError    = maxError;
+				break;
+			}
+
+			if (entry->match == O3D_DEDUPE_UNIQUE) {
+				uniques[uniqueCount++] = m;
+				dedupe->uniqueCount++;
+			} else if (entry->match == O3D_DEDUPE_EXACT) {
+				dedupe->exactCount++;
+			} else {
+				dedupe->nearCount++;
+			}
+		}
+
+		first = end;
+	}
+
+	free(keys);
+	free(uniques);
+	return true;
+}
+
+/* ========================================================
+ * o3d_dedupe_free():
+ * ======================================================== */
+
+void o3d_dedupe_free(o3d_dedupe_t * dedupe) {
+	if (dedupe == NULL) {
+		return;
+	}
+
+	free(dedupe->entries);
+	memset(dedupe, 0, sizeof(*dedupe));
+}
@@ -0,0 +1,90 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_geohash.h
+ * Created on: 17/10/26
+ * Brief: Canonical geometry hashing of O3D models and clustering of duplicate meshes for instancing.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_GEOHASH_H
+#define DARKSTONE_O3D_GEOHASH_H
+
+#include "o3d.h"
+
+/* ========================================================
+ * Geometry hashes:
+ * ======================================================== */
+
+/*
+ * Hash of the geometry only: vertex positions, face indexes, UVs, colors and
+ * texNumbers. The header words and o3d_face_t::unknown are left out, as is
+ * the sign of zeros, so copies differing only in those hash the same.
+ */
+uint64_t o3d_geometry_hash(const o3d_model_t * o3d);
+
+/*
+ * Hash of the topology only: vertex/face counts, face indexes and texNumbers.
+ * Meshes that can be near-duplicates of each other always share this hash.
+ */
+uint64_t o3d_topology_hash(const o3d_model_t * o3d);
+
+/* ========================================================
+ * Duplicate clustering / instancing table:
+ * ======================================================== */
+
+/*
+ * How a model relates to the unique mesh it was clustered with.
+ */
+typedef enum o3d_dedupe_match {
+	O3D_DEDUPE_UNIQUE,     // First of its cluster, the one to keep.
+	O3D_DEDUPE_EXACT,      // Same geometry hash as the unique.
+	O3D_DEDUPE_NEAR        // Same topology; positions within tolerance after the offset.
+} o3d_dedupe_match_t;
+
+/*
+ * Instancing table entry, one per input model, in input order.
+ * The model is drawn as: unique model translated by `offset`.
+ */
+typedef struct o3d_dedupe_entry {
+	uint64_t           geometryHash;
+	uint64_t           topologyHash;
+	uint32_t           uniqueModel;  // Index of the input model to use instead of this one.
+	o3d_dedupe_match_t match;
+	float              offset[3];    // This model's AABB mins minus the unique's.
+	float              maxError;     // Largest position difference left after the offset.
+} o3d_dedupe_entry_t;
+
+typedef struct o3d_dedupe {
+	o3d_dedupe_entry_t * entries;
+	uint32_t             entryCount;
+	uint32_t             uniqueCount;
+	uint32_t             exactCount;
+	uint32_t             nearCount;
+} o3d_dedupe_t;
+
+/*
+ * Clusters identical and near-identical models. Near-identical models share
+ * faces, UVs (within O3D_DEDUPE_UV_EPSILON texels), colors and texNumbers,
+ * and their positions match within `epsilon` once translated to the same
+ * AABB minimum, so a piece repeated at a different place in a level is
+ * also detected. Zero `epsilon` only matches translated exact copies.
+ * The models aren't referenced after this returns.
+ */
+bool o3d_dedupe_build(o3d_dedupe_t * dedupe, const o3d_model_t * models, uint32_t modelCount, float epsilon);
+
+/*
+ * Frees the instancing table.
+ */
+void o3d_dedupe_free(o3d_dedupe_t * dedupe);
+
+// UV tolerance of near matches, in raw O3D units (texels of a 256^2 texture).
+#define O3D_DEDUPE_UV_EPSILON (1.0f / 64.0f)
+
+#endif // DARKSTONE_O3D_GEOHASH_H
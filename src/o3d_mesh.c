@@ -0,0 +1,456 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_mesh.c
+ * Created on: 17/10/26
+ * Brief: Indexed triangle meshes "cooked" from Darkstone O3D models.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_mesh.h"
+#include "o3d_vcache.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Corner welding hash table:
+ * ======================================================== */
+
+enum { MESH_HASH_EMPTY = UINT32_MAX };
+
+typedef struct mesh_corner_key {
+	uint32_t positionId;
+	uint32_t uBits;
+	uint32_t vBits;
+	uint32_t colorBits;
+	uint32_t texNumber;
+} mesh_corner_key_t;
+
+static inline uint32_t mesh_float_bits(float f) {
+	// Normalize -0 to +0 so they weld together.
+	if (f == 0.0f) {
+		f = 0.0f;
+	}
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+static inline uint32_t mesh_hash_combine(uint32_t h, uint32_t k) {
+	// MurmurHash3 mixing step.
+	k *= 0xCC9E2D51u;
+	k  = (k << 15) | (k >> 17);
+	k *= 0x1B873593u;
+	h ^= k;
+	h  = (h << 13) | (h >> 19);
+	return (h * 5u) + 0xE6546B64u;
+}
+
+static inline uint32_t mesh_hash_key(const mesh_corner_key_t * key) {
+	uint32_t h = 0x9747B28Cu;
+	h = mesh_hash_combine(h, key->positionId);
+	h = mesh_hash_combine(h, key->uBits);
+	h = mesh_hash_combine(h, key->vBits);
+	h = mesh_hash_combine(h, key->colorBits);
+	h = mesh_hash_combine(h, key->texNumber);
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	return h;
+}
+
+static inline uint32_t mesh_next_pow2(uint32_t x) {
+	uint32_t p = 1;
+	while (p < x) {
+		p <<= 1;
+	}
+	return p;
+}
+
+/* ========================================================
+ * o3d_mesh_build():
+ * ======================================================== */
+
+bool o3d_mesh_build(o3d_mesh_t * mesh, const o3d_model_t * o3d) {
+	assert(mesh != NULL);
+	assert(o3d  != NULL);
+
+	memset(mesh, 0, sizeof(*mesh));
+
+	o3d_face_streams_t streams;
+	if (!o3d_face_streams_build(&streams, o3d, NULL)) {
+		return false;
+	}
+
+	const bool success = o3d_mesh_build_from_streams(mesh, &streams, o3d);
+	o3d_face_streams_free(&streams);
+	return success;
+}
+
+bool o3d_mesh_build_from_streams(o3d_mesh_t * mesh, const o3d_face_streams_t * streams, const o3d_model_t * o3d) {
+	assert(mesh    != NULL);
+	assert(streams != NULL);
+	assert(o3d     != NULL);
+
+	memset(mesh, 0, sizeof(*mesh));
+
+	const o3d_vertex_t * verts = o3d->vertexes;
+	const uint32_t faceCount   = streams->faceCount;
+	const uint32_t vertCount   = o3d->vertexCount;
+
+	if (faceCount == 0) {
+		return o3d_set_error("Model has no faces!");
+	}
+
+	// Topology pass first, over the index stream only,
+	// so the buffers below can be sized exactly.
+	uint8_t * validFaces = malloc(faceCount * sizeof(validFaces[0]));
+	if (validFaces == NULL) {
+		return o3d_set_error("Unable to malloc mesh build buffers!");
+	}
+
+	// Faces with repeated corners are drawn with the ones left (o3d_face_corners()).
+	uint32_t maxCorners = 0;
+	for (uint32_t f = 0; f < faceCount; ++f) {
+		uint8_t faceCorners[4];
+		validFaces[f] = (uint8_t)o3d_face_corners(&streams->indexes[f], vertCount, faceCorners);
+		if (validFaces[f] != 0) {
+			maxCorners += (validFaces[f] == 4) ? 6 : 3;
+		}
+	}
+
+	if (maxCorners == 0) {
+		free(validFaces);
+		return o3d_set_error("Model has no valid faces!");
+	}
+
+	const uint32_t hashSize = mesh_next_pow2(maxCorners * 2);
+	uint32_t * hashTable = malloc(hashSize * sizeof(hashTable[0]));
+	mesh_corner_key_t * keys = malloc(maxCorners * sizeof(keys[0]));
+
+	mesh->vertexes    = malloc(maxCorners * sizeof(mesh->vertexes[0]));
+	mesh->positionIds = malloc(maxCorners * sizeof(mesh->positionIds[0]));
+	mesh->indexes     = malloc(maxCorners * sizeof(mesh->indexes[0]));
+	mesh->texNumbers  = malloc((maxCorners / 3) * sizeof(mesh->texNumbers[0]));
+
+	if (hashTable == NULL || keys == NULL || mesh->vertexes == NULL ||
+	    mesh->positionIds == NULL || mesh->indexes == NULL || mesh->texNumbers == NULL) {
+		free(validFaces);
+		free(hashTable);
+		free(keys);
+		o3d_mesh_free(mesh);
+		return o3d_set_error("Unable to malloc mesh build buffers!");
+	}
+
+	memset(hashTable, 0xFF, hashSize * sizeof(hashTable[0]));
+
+	uint32_t vertexCount = 0;
+	uint32_t indexCount  = 0;
+
+	// Quads are split as 0,1,3 and 3,1,2, like the viewer does.
+	static const int TRI_CORNERS[3]  = { 0, 1, 2 };
+	static const int QUAD_CORNERS[6] = { 0, 1, 3, 3, 1, 2 };
+
+	for (uint32_t f = 0; f < faceCount; ++f) {
+		if (validFaces[f] == 0) {
+			continue;
+		}
+
+		const o3d_face_indexes_t * face = &streams->indexes[f];
+		uint8_t faceCorners[4];
+		const bool isQuad = (o3d_face_corners(face, vertCount, faceCorners) == 4);
+
+		const int * corners = isQuad ? QUAD_CORNERS : TRI_CORNERS;
+		const int cornerCount = isQuad ? 6 : 3;
+
+		const o3d_color_t color = streams->colors[f];
+		const uint16_t texNumber = streams->texNumbers[f];
+
+		for (int c = 0; c < cornerCount; ++c) {
+			const int corner = faceCorners[corners[c]];
+			const o3d_texcoord_t uv = streams->texCoords[f][corner];
+
+			mesh_corner_key_t key;
+			key.positionId = face->index[corner];
+			key.uBits      = mesh_float_bits(uv.u);
+			key.vBits      = mesh_float_bits(uv.v);
+			memcpy(&key.colorBits, &color, sizeof(key.colorBits));
+			key.texNumber  = texNumber;
+
+			// Linear probing:
+			uint32_t slot = mesh_hash_key(&key) & (hashSize - 1);
+			for (;;) {
+				const uint32_t existing = hashTable[slot];
+				if (existing == MESH_HASH_EMPTY) {
+					const o3d_vertex_t * xyz = &verts[key.positionId];
+					o3d_mesh_vertex_t * mv = &mesh->vertexes[vertexCount];
+
+					mv->px    = xyz->x;
+					mv->py    = xyz->y;
+					mv->pz    = xyz->z;
+					mv->u     = uv.u * O3D_TEXCOORD_SCALE;
+					mv->v     = uv.v * O3D_TEXCOORD_SCALE;
+					mv->color = color;
+
+					mesh->positionIds[vertexCount] = key.positionId;
+					keys[vertexCount] = key;
+					hashTable[slot] = vertexCount;
+					mesh->indexes[indexCount++] = vertexCount++;
+					break;
+				}
+
+				if (memcmp(&keys[existing], &key, sizeof(key)) == 0) {
+					mesh->indexes[indexCount++] = existing;
+					break;
+				}
+
+				slot = (slot + 1) & (hashSize - 1);
+			}
+		}
+
+		mesh->texNumbers[(indexCount / 3) - 1] = texNumber;
+		if (isQuad) {
+			mesh->texNumbers[(indexCount / 3) - 2] = texNumber;
+		}
+	}
+
+	free(validFaces);
+	free(hashTable);
+	free(keys);
+	assert(indexCount == maxCorners);
+
+	// Indexes were sized exactly. Give back the excess vertexes
+	// (shrinking never fails in practice, but keep the original
+	// block if it does).
+	o3d_mesh_vertex_t * shrunkVerts = realloc(mesh->vertexes, vertexCount * sizeof(mesh->vertexes[0]));
+	uint32_t * shrunkIds = realloc(mesh->positionIds, vertexCount * sizeof(mesh->positionIds[0]));
+
+	if (shrunkVerts != NULL) { mesh->vertexes    = shrunkVerts; }
+	if (shrunkIds   != NULL) { mesh->positionIds = shrunkIds;   }
+
+	mesh->vertexCount   = vertexCount;
+	mesh->indexCount    = indexCount;
+	mesh->positionCount = vertCount;
+	mesh->aabb          = o3d->aabb;
+	return true;
+}
+
+/* ========================================================
+ * o3d_mesh_group_by_texture():
+ * ======================================================== */
+
+static int mesh_sort_by_key(const void * a, const void * b) {
+	const uint64_t ka = *(const uint64_t *)a;
+	const uint64_t kb = *(const uint64_t *)b;
+	return (ka < kb) ? -1 : ((ka > kb) ? 1 : 0);
+}
+
+static void mesh_update_group_vertex_ranges(o3d_mesh_t * mesh) {
+	for (uint32_t g = 0; g < mesh->groupCount; ++g) {
+		o3d_mesh_group_t * group = &mesh->groups[g];
+		if (group->indexCount == 0) {
+			group->firstVertex = 0; // Emptied by the simplifier.
+			group->vertexCount = 0;
+			continue;
+		}
+
+		uint32_t minVertex = UINT32_MAX;
+		uint32_t maxVertex = 0;
+
+		for (uint32_t i = 0; i < group->indexCount; ++i) {
+			const uint32_t v = mesh->indexes[group->firstIndex + i];
+			minVertex = (v < minVertex) ? v : minVertex;
+			maxVertex = (v > maxVertex) ? v : maxVertex;
+		}
+
+		group->firstVertex = minVertex;
+		group->vertexCount = (maxVertex - minVertex) + 1;
+	}
+}
+
+bool o3d_mesh_group_by_texture(o3d_mesh_t * mesh) {
+	assert(mesh != NULL);
+
+	const uint32_t triCount = o3d_mesh_triangle_count(mesh);
+	if (triCount == 0) {
+		return o3d_set_error("Can't group an empty mesh!");
+	}
+
+	// The triangle number in the low bits keeps the sort stable.
+	uint64_t * keys = malloc(triCount * sizeof(keys[0]));
+	uint32_t * newIndexes = malloc(mesh->indexCount * sizeof(newIndexes[0]));
+	if (keys == NULL || newIndexes == NULL) {
+		free(keys);
+		free(newIndexes);
+		return o3d_set_error("Unable to malloc mesh grouping buffers!");
+	}
+
+	uint32_t groupCount = 0;
+	for (uint32_t t = 0; t < triCount; ++t) {
+		keys[t] = ((uint64_t)mesh->texNumbers[t] << 32) | t;
+	}
+
+	qsort(keys, triCount, sizeof(keys[0]), &mesh_sort_by_key);
+
+	for (uint32_t t = 0; t < triCount; ++t) {
+		const uint32_t srcTri = (uint32_t)(keys[t] & UINT32_MAX);
+		newIndexes[(t * 3) + 0] = mesh->indexes[(srcTri * 3) + 0];
+		newIndexes[(t * 3) + 1] = mesh->indexes[(srcTri * 3) + 1];
+		newIndexes[(t * 3) + 2] = mesh->indexes[(srcTri * 3) + 2];
+
+		if (t == 0 || (keys[t] >> 32) != (keys[t - 1] >> 32)) {
+			++groupCount;
+		}
+	}
+
+	o3d_mesh_group_t * groups = calloc(groupCount, sizeof(groups[0]));
+	if (groups == NULL) {
+		free(keys);
+		free(newIndexes);
+		return o3d_set_error("Unable to malloc mesh groups!");
+	}
+
+	uint32_t g = 0;
+	for (uint32_t t = 0; t < triCount; ++t) {
+		const uint16_t texNumber = (uint16_t)(keys[t] >> 32);
+		if (t != 0 && texNumber != mesh->texNumbers[t - 1]) {
+			++g;
+		}
+		if (groups[g].indexCount == 0) {
+			groups[g].texNumber  = texNumber;
+			groups[g].firstIndex = t * 3;
+		}
+		groups[g].indexCount += 3;
+		mesh->texNumbers[t] = texNumber;
+	}
+
+	memcpy(mesh->indexes, newIndexes, mesh->indexCount * sizeof(newIndexes[0]));
+	free(newIndexes);
+	free(keys);
+
+	free(mesh->groups);
+	mesh->groups     = groups;
+	mesh->groupCount = groupCount;
+
+	mesh_update_group_vertex_ranges(mesh);
+	return true;
+}
+
+/* ========================================================
+ * o3d_mesh_optimize():
+ * ======================================================== */
+
+static bool mesh_optimize_triangles(o3d_mesh_t * mesh, uint32_t * triOrder, uint16_t * tempTexNums) {
+	if (mesh->groupCount != 0) {
+		// Each group is a separate draw, so keep triangles inside it.
+		// The texNumbers are all the same within a group, no need to permute them.
+		for (uint32_t g = 0; g < mesh->groupCount; ++g) {
+			const o3d_mesh_group_t * group = &mesh->groups[g];
+			if (!o3d_vcache_optimize_triangles(&mesh->indexes[group->firstIndex],
+			                                   group->indexCount, mesh->vertexCount, NULL)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	const uint32_t triCount = o3d_mesh_triangle_count(mesh);
+	if (!o3d_vcache_optimize_triangles(mesh->indexes, mesh->indexCount, mesh->vertexCount, triOrder)) {
+		return false;
+	}
+
+	for (uint32_t t = 0; t < triCount; ++t) {
+		tempTexNums[t] = mesh->texNumbers[triOrder[t]];
+	}
+	memcpy(mesh->texNumbers, tempTexNums, triCount * sizeof(tempTexNums[0]));
+	return true;
+}
+
+bool o3d_mesh_optimize(o3d_mesh_t * mesh) {
+	assert(mesh != NULL);
+
+	const uint32_t triCount = o3d_mesh_triangle_count(mesh);
+	if (triCount == 0) {
+		return true;
+	}
+
+	uint32_t * triOrder     = malloc(triCount * sizeof(triOrder[0]));
+	uint32_t * vertexRemap  = malloc(mesh->vertexCount * sizeof(vertexRemap[0]));
+	uint16_t * newTexNums   = malloc(triCount * sizeof(newTexNums[0]));
+	o3d_mesh_vertex_t * newVerts = malloc(mesh->vertexCount * sizeof(newVerts[0]));
+	uint32_t * newIds       = malloc(mesh->vertexCount * sizeof(newIds[0]));
+
+	bool success = false;
+	if (triOrder == NULL || vertexRemap == NULL || newTexNums == NULL || newVerts == NULL || newIds == NULL) {
+		o3d_set_error("Unable to malloc mesh optimization buffers!");
+		goto BAIL;
+	}
+
+	// Triangle order first, since the fetch order depends on it.
+	if (!mesh_optimize_triangles(mesh, triOrder, newTexNums)) {
+		goto BAIL;
+	}
+
+	uint32_t newVertexCount = 0;
+	if (!o3d_vcache_optimize_fetch(mesh->indexes, mesh->indexCount, mesh->vertexCount, vertexRemap, &newVertexCount)) {
+		goto BAIL;
+	}
+
+	for (uint32_t v = 0; v < mesh->vertexCount; ++v) {
+		const uint32_t newIndex = vertexRemap[v];
+		if (newIndex != O3D_VCACHE_UNUSED_VERTEX) {
+			newVerts[newIndex] = mesh->vertexes[v];
+			newIds[newIndex]   = mesh->positionIds[v];
+		}
+	}
+
+	// Swap in the reordered arrays; old ones freed below.
+	o3d_mesh_vertex_t * oldVerts = mesh->vertexes;
+	uint32_t * oldIds = mesh->positionIds;
+
+	mesh->vertexes    = newVerts;
+	mesh->positionIds = newIds;
+	mesh->vertexCount = newVertexCount;
+
+	newVerts = oldVerts;
+	newIds   = oldIds;
+	success  = true;
+
+	// Vertexes never span groups (texNumber is part of the weld key),
+	// so after the fetch reorder each group has a contiguous range.
+	mesh_update_group_vertex_ranges(mesh);
+
+BAIL:
+	free(triOrder);
+	free(vertexRemap);
+	free(newTexNums);
+	free(newVerts);
+	free(newIds);
+	return success;
+}
+
+/* ========================================================
+ * o3d_mesh_free():
+ * ======================================================== */
+
+void o3d_mesh_free(o3d_mesh_t * mesh) {
+	if (mesh == NULL) {
+		return;
+	}
+
+	free(mesh->vertexes);
+	free(mesh->indexes);
+	free(mesh->texNumbers);
+	free(mesh->positionIds);
+	free(mesh->groups);
+
+	memset(mesh, 0, sizeof(*mesh));
+}
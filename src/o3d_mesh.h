@@ -0,0 +1,116 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_mesh.h
+ * Created on: 17/10/26
+ * Brief: Indexed triangle meshes "cooked" from Darkstone O3D models.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_MESH_H
+#define DARKSTONE_O3D_MESH_H
+
+#include "o3d.h"
+#include "o3d_faces.h"
+
+/* ========================================================
+ * Cooked mesh data structures:
+ * ======================================================== */
+
+/*
+ * A unique corner of the model. O3D faces store UVs and colors
+ * per face, not per vertex, so the same position can appear in
+ * several mesh vertexes if the faces sharing it disagree on the
+ * other attributes (UV seams, color or texture boundaries).
+ */
+typedef struct o3d_mesh_vertex {
+	float       px, py, pz;    // Position, as read from the O3D.
+	float       u, v;          // Texture coordinates, already scaled by O3D_TEXCOORD_SCALE.
+	o3d_color_t color;         // Face color (BGRA).
+} o3d_mesh_vertex_t;
+
+/*
+ * Contiguous range of triangles sharing the same texture.
+ * See o3d_mesh_group_by_texture().
+ */
+typedef struct o3d_mesh_group {
+	uint32_t texNumber;            // Texture/material of all the triangles in the range.
+	uint32_t firstIndex;           // Range in o3d_mesh_t::indexes.
+	uint32_t indexCount;
+	uint32_t firstVertex;          // Range of vertexes referenced by the group.
+	uint32_t vertexCount;
+} o3d_mesh_group_t;
+
+/*
+ * Indexed triangle list. Quadrilateral faces are split in two
+ * triangles (0,1,3 and 3,1,2, same as the viewer does).
+ */
+typedef struct o3d_mesh {
+	o3d_mesh_vertex_t * vertexes;
+	uint32_t          * indexes;       // 3 per triangle.
+	uint16_t          * texNumbers;    // 1 per triangle. Texture/material of the source face.
+	uint32_t          * positionIds;   // 1 per vertex. Index of the source O3D position.
+	o3d_mesh_group_t  * groups;        // Null until o3d_mesh_group_by_texture() is called.
+	uint32_t            vertexCount;
+	uint32_t            indexCount;
+	uint32_t            positionCount; // Vertex count of the source O3D.
+	uint32_t            groupCount;
+	o3d_aabb_t          aabb;
+} o3d_mesh_t;
+
+/* ========================================================
+ * Mesh functions:
+ * ======================================================== */
+
+/*
+ * Builds an indexed triangle mesh from the faces of an O3D model,
+ * merging face corners that share position, UV, color and texture.
+ * Repeated corners are collapsed (o3d_face_corners()), so a quad a,b,c,c
+ * gives the triangle a,b,c. Faces with out-of-range indexes or fewer than
+ * 3 distinct vertexes are skipped.
+ * You can still call o3d_mesh_free() even if this fails.
+ */
+bool o3d_mesh_build(o3d_mesh_t * mesh, const o3d_model_t * o3d);
+
+/*
+ * Same, but reads the faces from split streams (see o3d_faces.h), which is
+ * what o3d_mesh_build() does internally. Only the vertexes and AABB are used
+ * from `o3d`. Use this to avoid splitting the faces again if you have them.
+ */
+bool o3d_mesh_build_from_streams(o3d_mesh_t * mesh, const o3d_face_streams_t * streams, const o3d_model_t * o3d);
+
+/*
+ * Sorts the triangles by texNumber (stable) and fills in the mesh groups,
+ * one per distinct texture, so each can be drawn with a single call.
+ */
+bool o3d_mesh_group_by_texture(o3d_mesh_t * mesh);
+
+/*
+ * Reorders the triangles for post-transform vertex cache reuse and
+ * then the vertexes for fetch locality. Both preserve the triangles
+ * and the per-triangle texNumbers. See o3d_vcache.h.
+ *
+ * If the mesh is grouped, triangles are only reordered inside their
+ * group, and each group ends up with a contiguous range of vertexes.
+ */
+bool o3d_mesh_optimize(o3d_mesh_t * mesh);
+
+/*
+ * Frees the memory allocated by o3d_mesh_build().
+ */
+void o3d_mesh_free(o3d_mesh_t * mesh);
+
+/*
+ * Number of triangles in the mesh.
+ */
+static inline uint32_t o3d_mesh_triangle_count(const o3d_mesh_t * mesh) {
+	return mesh->indexCount / 3;
+}
+
+#endif // DARKSTONE_O3D_MESH_H
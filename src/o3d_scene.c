@@ -0,0 +1,609 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_scene.c
+ * Created on: 17/10/26
+ * Brief: Scene container for a level's O3D models, with a loose octree over the instances.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_scene.h"
+#include "file_utils.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Transforms / bounds:
+ * ======================================================== */
+
+void o3d_transform_identity(o3d_transform_t * xform) {
+	assert(xform != NULL);
+	memset(xform, 0, sizeof(*xform));
+	xform->m[0][0] = 1.0f;
+	xform->m[1][1] = 1.0f;
+	xform->m[2][2] = 1.0f;
+}
+
+static void scene_transform_aabb(const o3d_transform_t * xform, const o3d_aabb_t * in, o3d_aabb_t * out) {
+	// Transform the center, then the extents by the absolute
+	// matrix, which gives the tightest AABB of the rotated box.
+	const float center[3] = {
+		(in->mins.x + in->maxs.x) * 0.5f,
+		(in->mins.y + in->maxs.y) * 0.5f,
+		(in->mins.z + in->maxs.z) * 0.5f
+	};
+	const float extent[3] = {
+		(in->maxs.x - in->mins.x) * 0.5f,
+		(in->maxs.y - in->mins.y) * 0.5f,
+		(in->maxs.z - in->mins.z) * 0.5f
+	};
+
+	float newCenter[3], newExtent[3];
+	for (int row = 0; row < 3; ++row) {
+		const float * m = xform->m[row];
+		newCenter[row] = (m[0] * center[0]) + (m[1] * center[1]) + (m[2] * center[2]) + m[3];
+		newExtent[row] = (fabsf(m[0]) * extent[0]) + (fabsf(m[1]) * extent[1]) + (fabsf(m[2]) * extent[2]);
+	}
+
+	out->mins.x = newCenter[0] - newExtent[0];
+	out->mins.y = newCenter[1] - newExtent[1];
+	out->mins.z = newCenter[2] - newExtent[2];
+	out->maxs.x = newCenter[0] + newExtent[0];
+	out->maxs.y = newCenter[1] + newExtent[1];
+	out->maxs.z = newCenter[2] + newExtent[2];
+}
+
+/* ========================================================
+ * o3d_scene_init() / o3d_scene_free():
+ * ======================================================== */
+
+void o3d_scene_init(o3d_scene_t * scene) {
+	assert(scene != NULL);
+	memset(scene, 0, sizeof(*scene));
+}
+
+void o3d_scene_free(o3d_scene_t * scene) {
+	if (scene == NULL) {
+		return;
+	}
+
+	for (uint32_t m = 0; m < scene->modelCount; ++m) {
+		o3d_free(&scene->models[m]);
+		free(scene->modelNames[m]);
+	}
+
+	free(scene->models);
+	free(scene->modelNames);
+	free(scene->instances);
+	free(scene->nodes);
+	free(scene->nodeInstances);
+	o3d_arena_free(&scene->modelArena);
+	memset(scene, 0, sizeof(*scene));
+}
+
+/* ========================================================
+ * o3d_scene_add_model():
+ * ======================================================== */
+
+bool o3d_scene_add_model(o3d_scene_t * scene, o3d_model_t * o3d, const char * name, uint32_t * modelIndex) {
+	assert(scene != NULL);
+	assert(o3d   != NULL);
+
+	if (scene->modelCount == scene->modelCapacity) {
+		const uint32_t newCapacity = (scene->modelCapacity != 0) ? (scene->modelCapacity * 2) : 64;
+		o3d_model_t * models = realloc(scene->models, newCapacity * sizeof(models[0]));
+		if (models == NULL) {
+			return o3d_set_error("Unable to realloc scene models!");
+		}
+		scene->models = models;
+
+		char ** names = realloc(scene->modelNames, newCapacity * sizeof(names[0]));
+		if (names == NULL) {
+			return o3d_set_error("Unable to realloc scene model names!");
+		}
+		scene->modelNames = names;
+		scene->modelCapacity = newCapacity;
+	}
+
+	char * nameCopy = NULL;
+	if (name != NULL) {
+		const size_t len = strlen(name);
+		nameCopy = malloc(len + 1);
+		if (nameCopy == NULL) {
+			return o3d_set_error("Unable to malloc model name!");
+		}
+		memcpy(nameCopy, name, len + 1);
+	}
+
+	if (modelIndex != NULL) {
+		*modelIndex = scene->modelCount;
+	}
+
+	scene->models[scene->modelCount] = *o3d;
+	scene->modelNames[scene->modelCount] = nameCopy;
+	scene->modelCount++;
+
+	memset(o3d, 0, sizeof(*o3d));
+	return true;
+}
+
+/* ========================================================
+ * o3d_scene_add_instance():
+ * ======================================================== */
+
+bool o3d_scene_add_instance(o3d_scene_t * scene, uint32_t modelIndex, const o3d_transform_t * xform,
+                            uint32_t * instanceIndex) {
+	assert(scene != NULL);
+
+	if (modelIndex >= scene->modelCount) {
+		return o3d_set_error("Invalid model index for scene instance!");
+	}
+
+	if (scene->instanceCount == scene->instanceCapacity) {
+		const uint32_t newCapacity = (scene->instanceCapacity != 0) ? (scene->instanceCapacity * 2) : 64;
+		o3d_instance_t * instances = realloc(scene->instances, newCapacity * sizeof(instances[0]));
+		if (instances == NULL) {
+			return o3d_set_error("Unable to realloc scene instances!");
+		}
+		scene->instances = instances;
+		scene->instanceCapacity = newCapacity;
+	}
+
+	o3d_instance_t * inst = &scene->instances[scene->instanceCount];
+	if (xform != NULL) {
+		inst->transform = *xform;
+	} else {
+		o3d_transform_identity(&inst->transform);
+	}
+
+	inst->modelIndex = modelIndex;
+	scene_transform_aabb(&inst->transform, &scene->models[modelIndex].aabb, &inst->worldBounds);
+
+	if (instanceIndex != NULL) {
+		*instanceIndex = scene->instanceCount;
+	}
+	scene->instanceCount++;
+	return true;
+}
+
+/* ========================================================
+ * o3d_scene_load_directory():
+ * ======================================================== */
+
+bool o3d_scene_load_directory(o3d_scene_t * scene, const char * path) {
+	assert(scene != NULL);
+	assert(path  != NULL);
+
+	file_list_t files;
+	memset(&files, 0, sizeof(files));
+
+	if (!file_list_add_path(&files, path, ".O3D")) {
+		file_list_free(&files);
+		return o3d_set_error("Can't read scene directory!");
+	}
+
+	file_list_sort(&files);
+	bool allLoaded = true;
+
+	for (uint32_t f = 0; f < files.count; ++f) {
+		o3d_model_t o3d;
+		memset(&o3d, 0, sizeof(o3d));
+
+		if (!o3d_load_from_file_ex(&o3d, files.paths[f], &scene->modelArena)) {
+			o3d_free(&o3d);
+			allLoaded = false;
+			continue;
+		}
+
+		uint32_t modelIndex;
+		if (!o3d_scene_add_model(scene, &o3d, files.paths[f], &modelIndex) ||
+		    !o3d_scene_add_instance(scene, modelIndex, NULL, NULL)) {
+			o3d_free(&o3d);
+			file_list_free(&files);
+			return false;
+		}
+	}
+
+	file_list_free(&files);
+
+	if (!o3d_scene_build_index(scene)) {
+		return false;
+	}
+	if (!allLoaded) {
+		return o3d_set_error("Some of the scene models failed to load!");
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3d_scene_build_index():
+ * ======================================================== */
+
+static bool scene_new_node(o3d_scene_t * scene, uint32_t * nodeCapacity, const float center[3],
+                           float halfSize, uint32_t * nodeIndex) {
+	if (scene->nodeCount == *nodeCapacity) {
+		const uint32_t newCapacity = (*nodeCapacity != 0) ? (*nodeCapacity * 2) : 64;
+		o3d_scene_node_t * nodes = realloc(scene->nodes, newCapacity * sizeof(nodes[0]));
+		if (nodes == NULL) {
+			return o3d_set_error("Unable to realloc scene nodes!");
+		}
+		scene->nodes = nodes;
+		*nodeCapacity = newCapacity;
+	}
+
+	o3d_scene_node_t * node = &scene->nodes[scene->nodeCount];
+	memset(node, 0, sizeof(*node));
+	node->center[0] = center[0];
+	node->center[1] = center[1];
+	node->center[2] = center[2];
+	node->halfSize  = halfSize;
+
+	*nodeIndex = scene->nodeCount++;
+	return true;
+}
+
+bool o3d_scene_build_index(o3d_scene_t * scene) {
+	assert(scene != NULL);
+
+	free(scene->nodes);
+	free(scene->nodeInstances);
+	scene->nodes = NULL;
+	scene->nodeInstances = NULL;
+	scene->nodeCount = 0;
+	scene->depth = 0;
+
+	if (scene->instanceCount == 0) {
+		memset(&scene->bounds, 0, sizeof(scene->bounds));
+		return true;
+	}
+
+	o3d_aabb_t * bounds = &scene->bounds;
+	*bounds = scene->instances[0].worldBounds;
+	for (uint32_t i = 1; i < scene->instanceCount; ++i) {
+		const o3d_aabb_t * b = &scene->instances[i].worldBounds;
+		bounds->mins.x = fminf(bounds->mins.x, b->mins.x);
+		bounds->mins.y = fminf(bounds->mins.y, b->mins.y);
+		bounds->mins.z = fminf(bounds->mins.z, b->mins.z);
+		bounds->maxs.x = fmaxf(bounds->maxs.x, b->maxs.x);
+		bounds->maxs.y = fmaxf(bounds->maxs.y, b->maxs.y);
+		bounds->maxs.z = fmaxf(bounds->maxs.z, b->maxs.z);
+	}
+
+	// Root cell is the cube around the scene bounds.
+	const float rootCenter[3] = {
+		(bounds->mins.x + bounds->maxs.x) * 0.5f,
+		(bounds->mins.y + bounds->maxs.y) * 0.5f,
+		(bounds->mins.z + bounds->maxs.z) * 0.5f
+	};
+	float rootHalf = fmaxf(bounds->maxs.x - bounds->mins.x,
+	                 fmaxf(bounds->maxs.y - bounds->mins.y, bounds->maxs.z - bounds->mins.z)) * 0.5f;
+	if (rootHalf <= 0.0f) {
+		rootHalf = 1.0f;
+	}
+
+	uint32_t * instanceNode = malloc(scene->instanceCount * sizeof(instanceNode[0]));
+	scene->nodeInstances = malloc(scene->instanceCount * sizeof(scene->nodeInstances[0]));
+	uint32_t nodeCapacity = 0;
+	uint32_t rootIndex;
+
+	if (instanceNode == NULL || scene->nodeInstances == NULL ||
+	    !scene_new_node(scene, &nodeCapacity, rootCenter, rootHalf, &rootIndex)) {
+		free(instanceNode);
+		return o3d_set_error("Unable to malloc scene index!");
+	}
+
+	//
+	// Each instance goes in the deepest level whose cells are at least
+	// as large as the instance, in the cell containing the instance center.
+	// With the loose bounds doubling each cell, the instance always fits.
+	//
+	for (uint32_t i = 0; i < scene->instanceCount; ++i) {
+		const o3d_aabb_t * b = &scene->instances[i].worldBounds;
+		const float center[3] = {
+			(b->mins.x + b->maxs.x) * 0.5f,
+			(b->mins.y + b->maxs.y) * 0.5f,
+			(b->mins.z + b->maxs.z) * 0.5f
+		};
+		const float objectHalf = fmaxf(b->maxs.x - b->mins.x,
+		                         fmaxf(b->maxs.y - b->mins.y, b->maxs.z - b->mins.z)) * 0.5f;
+
+		uint32_t nodeIndex = rootIndex;
+		uint32_t depth = 1;
+
+		while (depth < O3D_SCENE_MAX_DEPTH && (scene->nodes[nodeIndex].halfSize * 0.5f) >= objectHalf) {
+			const o3d_scene_node_t * node = &scene->nodes[nodeIndex];
+			const uint32_t octant = ((center[0] >= node->center[0]) ? 1 : 0) |
+			                        ((center[1] >= node->center[1]) ? 2 : 0) |
+			                        ((center[2] >= node->center[2]) ? 4 : 0);
+
+			if (node->children[octant] == 0) {
+				const float childHalf = node->halfSize * 0.5f;
+				const float childCenter[3] = {
+					node->center[0] + ((octant & 1) ? childHalf : -childHalf),
+					node->center[1] + ((octant & 2) ? childHalf : -childHalf),
+					node->center[2] + ((octant & 4) ? childHalf : -childHalf)
+				};
+
+				uint32_t childIndex;
+				if (!scene_new_node(scene, &nodeCapacity, childCenter, childHalf, &childIndex)) {
+					free(instanceNode);
+					return false;
+				}
+				scene->nodes[nodeIndex].children[octant] = childIndex; // `node` may have moved.
+			}
+
+			nodeIndex = scene->nodes[nodeIndex].children[octant];
+			++depth;
+		}
+
+		instanceNode[i] = nodeIndex;
+		scene->nodes[nodeIndex].instanceCount++;
+		if (depth > scene->depth) {
+			scene->depth = depth;
+		}
+	}
+
+	// Counting sort of the instances by node, so each node has a contiguous range:
+	uint32_t offset = 0;
+	for (uint32_t n = 0; n < scene->nodeCount; ++n) {
+		scene->nodes[n].firstInstance = offset;
+		offset += scene->nodes[n].instanceCount;
+		scene->nodes[n].instanceCount = 0;
+	}
+	for (uint32_t i = 0; i < scene->instanceCount; ++i) {
+		o3d_scene_node_t * node = &scene->nodes[instanceNode[i]];
+		scene->nodeInstances[node->firstInstance + node->instanceCount++] = i;
+	}
+
+	free(instanceNode);
+	return true;
+}
+
+/* ========================================================
+ * Queries:
+ * ======================================================== */
+
+typedef enum scene_overlap {
+	SCENE_OUTSIDE,
+	SCENE_INTERSECTS,
+	SCENE_INSIDE
+} scene_overlap_t;
+
+typedef enum scene_query_type {
+	SCENE_QUERY_BOX,
+	SCENE_QUERY_SPHERE,
+	SCENE_QUERY_FRUSTUM
+} scene_query_type_t;
+
+typedef struct scene_query {
+	scene_query_type_t    type;
+	float                 mins[3];    // Box
+	float                 maxs[3];
+	float                 center[3];  // Sphere
+	float                 radius;
+	const o3d_frustum_t * frustum;    // Frustum
+	uint32_t            * results;
+	uint32_t              maxResults;
+	uint32_t              count;
+} scene_query_t;
+
+static scene_overlap_t scene_query_test(const scene_query_t * query, const float mins[3], const float maxs[3]) {
+	switch (query->type) {
+	case SCENE_QUERY_BOX : {
+		for (int i = 0; i < 3; ++i) {
+			if (maxs[i] < query->mins[i] || mins[i] > query->maxs[i]) {
+				return SCENE_OUTSIDE;
+			}
+		}
+		for (int i = 0; i < 3; ++i) {
+			if (mins[i] < query->mins[i] || maxs[i] > query->maxs[i]) {
+				return SCENE_INTERSECTS;
+			}
+		}
+		return SCENE_INSIDE;
+	}
+	case SCENE_QUERY_SPHERE : {
+		float nearSq = 0.0f;
+		float farSq  = 0.0f;
+		for (int i = 0; i < 3; ++i) {
+			const float dMin = query->center[i] - mins[i];
+			const float dMax = maxs[i] - query->center[i];
+			const float dNear = fmaxf(fmaxf(-dMin, -dMax), 0.0f);
+			const float dFar  = fmaxf(fabsf(dMin), fabsf(dMax));
+			nearSq += dNear * dNear;
+			farSq  += dFar  * dFar;
+		}
+		const float radiusSq = query->radius * query->radius;
+		if (nearSq > radiusSq) {
+			return SCENE_OUTSIDE;
+		}
+		return (farSq <= radiusSq) ? SCENE_INSIDE : SCENE_INTERSECTS;
+	}
+	case SCENE_QUERY_FRUSTUM : {
+		scene_overlap_t result = SCENE_INSIDE;
+		for (int p = 0; p < 6; ++p) {
+			const float * plane = query->frustum->planes[p];
+			// Box corners farthest along and against the plane normal:
+			float pos = plane[3];
+			float neg = plane[3];
+			for (int i = 0; i < 3; ++i) {
+				pos += plane[i] * ((plane[i] >= 0.0f) ? maxs[i] : mins[i]);
+				neg += plane[i] * ((plane[i] >= 0.0f) ? mins[i] : maxs[i]);
+			}
+			if (pos < 0.0f) {
+				return SCENE_OUTSIDE;
+			}
+			if (neg < 0.0f) {
+				result = SCENE_INTERSECTS;
+			}
+		}
+		return result;
+	}
+	default :
+		assert(false && "Invalid scene query type!");
+		return SCENE_OUTSIDE;
+	} // switch (query->type)
+}
+
+static inline void scene_query_emit(scene_query_t * query, uint32_t instanceIndex) {
+	if (query->count < query->maxResults) {
+		query->results[query->count] = instanceIndex;
+	}
+	query->count++;
+}
+
+//
+// Walks the octree, skipping the nodes whose loose bounds are outside
+// the volume. Below a node that is fully inside, nothing is tested.
+//
+static uint32_t scene_run_query(const o3d_scene_t * scene, scene_query_t * query) {
+	if (scene->nodeCount == 0) {
+		return 0;
+	}
+
+	struct {
+		uint32_t node;
+		bool     inside;
+	} stack[8 * O3D_SCENE_MAX_DEPTH];
+	uint32_t stackSize = 0;
+
+	stack[stackSize].node   = 0;
+	stack[stackSize].inside = false;
+	++stackSize;
+
+	while (stackSize != 0) {
+		--stackSize;
+		const o3d_scene_node_t * node = &scene->nodes[stack[stackSize].node];
+		bool inside = stack[stackSize].inside;
+
+		if (!inside) {
+			const float loose = node->halfSize * 2.0f;
+			const float mins[3] = { node->center[0] - loose, node->center[1] - loose, node->center[2] - loose };
+			const float maxs[3] = { node->center[0] + loose, node->center[1] + loose, node->center[2] + loose };
+
+			const scene_overlap_t overlap = scene_query_test(query, mins, maxs);
+			if (overlap == SCENE_OUTSIDE) {
+				continue;
+			}
+			inside = (overlap == SCENE_INSIDE);
+		}
+
+		for (uint32_t i = 0; i < node->instanceCount; ++i) {
+			const uint32_t instanceIndex = scene->nodeInstances[node->firstInstance + i];
+			if (!inside) {
+				const o3d_aabb_t * b = &scene->instances[instanceIndex].worldBounds;
+				const float mins[3] = { b->mins.x, b->mins.y, b->mins.z };
+				const float maxs[3] = { b->maxs.x, b->maxs.y, b->maxs.z };
+				if (scene_query_test(query, mins, maxs) == SCENE_OUTSIDE) {
+					continue;
+				}
+			}
+			scene_query_emit(query, instanceIndex);
+		}
+
+		for (int c = 0; c < 8; ++c) {
+			if (node->children[c] != 0) {
+				assert(stackSize < 8 * O3D_SCENE_MAX_DEPTH);
+				stack[stackSize].node   = node->children[c];
+				stack[stackSize].inside = inside;
+				++stackSize;
+			}
+		}
+	}
+
+	return query->count;
+}
+
+uint32_t o3d_scene_query_box(const o3d_scene_t * scene, const o3d_aabb_t * box,
+                             uint32_t * results, uint32_t maxResults) {
+	assert(scene != NULL);
+	assert(box   != NULL);
+	assert(results != NULL || maxResults == 0);
+
+	scene_query_t query;
+	memset(&query, 0, sizeof(query));
+	query.type       = SCENE_QUERY_BOX;
+	query.mins[0]    = box->mins.x;
+	query.mins[1]    = box->mins.y;
+	query.mins[2]    = box->mins.z;
+	query.maxs[0]    = box->maxs.x;
+	query.maxs[1]    = box->maxs.y;
+	query.maxs[2]    = box->maxs.z;
+	query.results    = results;
+	query.maxResults = maxResults;
+	return scene_run_query(scene, &query);
+}
+
+uint32_t o3d_scene_query_sphere(const o3d_scene_t * scene, const o3d_vertex_t * center, float radius,
+                                uint32_t * results, uint32_t maxResults) {
+	assert(scene  != NULL);
+	assert(center != NULL);
+	assert(results != NULL || maxResults == 0);
+
+	scene_query_t query;
+	memset(&query, 0, sizeof(query));
+	query.type       = SCENE_QUERY_SPHERE;
+	query.center[0]  = center->x;
+	query.center[1]  = center->y;
+	query.center[2]  = center->z;
+	query.radius     = radius;
+	query.results    = results;
+	query.maxResults = maxResults;
+	return scene_run_query(scene, &query);
+}
+
+uint32_t o3d_scene_query_frustum(const o3d_scene_t * scene, const o3d_frustum_t * frustum,
+                                 uint32_t * results, uint32_t maxResults) {
+	assert(scene   != NULL);
+	assert(frustum != NULL);
+	assert(results != NULL || maxResults == 0);
+
+	scene_query_t query;
+	memset(&query, 0, sizeof(query));
+	query.type       = SCENE_QUERY_FRUSTUM;
+	query.frustum    = frustum;
+	query.results    = results;
+	query.maxResults = maxResults;
+	return scene_run_query(scene, &query);
+}
+
+/* ========================================================
+ * o3d_frustum_from_matrix():
+ * ======================================================== */
+
+void o3d_frustum_from_matrix(o3d_frustum_t * frustum, const float viewProj[16]) {
+	assert(frustum  != NULL);
+	assert(viewProj != NULL);
+
+	// Gribb & Hartmann. Rows of a column-major matrix:
+	#define ROW(r, c) viewProj[((c) * 4) + (r)]
+	for (int c = 0; c < 4; ++c) {
+		frustum->planes[0][c] = ROW(3, c) + ROW(0, c); // Left
+		frustum->planes[1][c] = ROW(3, c) - ROW(0, c); // Right
+		frustum->planes[2][c] = ROW(3, c) + ROW(1, c); // Bottom
+		frustum->planes[3][c] = ROW(3, c) - ROW(1, c); // Top
+		frustum->planes[4][c] = ROW(3, c) + ROW(2, c); // Near
+		frustum->planes[5][c] = ROW(3, c) - ROW(2, c); // Far
+	}
+	#undef ROW
+
+	for (int p = 0; p < 6; ++p) {
+		float * plane = frustum->planes[p];
+		const float len = sqrtf((plane[0] * plane[0]) + (plane[1] * plane[1]) + (plane[2] * plane[2]));
+		if (len > 0.0f) {
+			plane[0] /= len;
+			plane[1] /= len;
+			plane[2] /= len;
+			plane[3] /= len;
+		}
+	}
+}
@@ -0,0 +1,150 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_scene.h
+ * Created on: 17/10/26
+ * Brief: Scene container for a level's O3D models, with a loose octree over the instances.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_SCENE_H
+#define DARKSTONE_O3D_SCENE_H
+
+#include "o3d.h"
+
+/* ========================================================
+ * Scene data structures:
+ * ======================================================== */
+
+/*
+ * Affine transform, 3x4 row-major: rows are the X, Y, Z
+ * outputs and the last column is the translation.
+ */
+typedef struct o3d_transform {
+	float m[3][4];
+} o3d_transform_t;
+
+/*
+ * A placement of one of the scene models.
+ */
+typedef struct o3d_instance {
+	o3d_transform_t transform;
+	o3d_aabb_t      worldBounds; // Model AABB, transformed.
+	uint32_t        modelIndex;  // Into o3d_scene_t::models.
+} o3d_instance_t;
+
+/*
+ * View frustum as six planes pointing inwards (a point
+ * is inside if a*x + b*y + c*z + d >= 0 for all planes).
+ */
+typedef struct o3d_frustum {
+	float planes[6][4];
+} o3d_frustum_t;
+
+/*
+ * Loose octree node. Cells are cubes; the loose bounds are twice the
+ * size of the cell, so an instance always goes into the single node
+ * of the level matching its size that contains its center.
+ */
+typedef struct o3d_scene_node {
+	float    center[3];
+	float    halfSize;           // Of the tight cell. The loose bounds are center +/- 2 * halfSize.
+	uint32_t children[8];        // Zero for no child (the root is never a child).
+	uint32_t firstInstance;      // Range in o3d_scene_t::nodeInstances.
+	uint32_t instanceCount;
+} o3d_scene_node_t;
+
+typedef struct o3d_scene {
+	o3d_model_t      * models;
+	char            ** modelNames;     // Source filenames, or the names given to o3d_scene_add_model().
+	o3d_instance_t   * instances;
+	o3d_scene_node_t * nodes;          // nodes[0] is the root. Valid after o3d_scene_build_index().
+	uint32_t         * nodeInstances;  // Instance indexes, grouped by node.
+	uint32_t           modelCount;
+	uint32_t           modelCapacity;
+	uint32_t           instanceCount;
+	uint32_t           instanceCapacity;
+	uint32_t           nodeCount;
+	uint32_t           depth;
+	o3d_aabb_t         bounds;         // All the instances.
+	o3d_arena_t        modelArena;     // Memory of the models loaded by o3d_scene_load_directory().
+} o3d_scene_t;
+
+// Deepest octree level. Anything smaller than the cells at this depth shares them.
+enum { O3D_SCENE_MAX_DEPTH = 8 };
+
+/* ========================================================
+ * Scene functions:
+ * ======================================================== */
+
+/*
+ * Identity transform.
+ */
+void o3d_transform_identity(o3d_transform_t * xform);
+
+/*
+ * Clears the scene. Same as zeroing it.
+ */
+void o3d_scene_init(o3d_scene_t * scene);
+
+/*
+ * Frees all the models, instances and the index.
+ */
+void o3d_scene_free(o3d_scene_t * scene);
+
+/*
+ * Adds a model to the scene, which takes ownership of its memory (the
+ * struct is copied and `o3d` zeroed). Doesn't create any instances.
+ */
+bool o3d_scene_add_model(o3d_scene_t * scene, o3d_model_t * o3d, const char * name, uint32_t * modelIndex);
+
+/*
+ * Places a model. Null `xform` is the identity. The spatial
+ * index needs to be rebuilt after adding/removing instances.
+ */
+bool o3d_scene_add_instance(o3d_scene_t * scene, uint32_t modelIndex, const o3d_transform_t * xform,
+                            uint32_t * instanceIndex);
+
+/*
+ * Loads every O3D in the directory (recursively) and adds an instance
+ * of each, then builds the index. Models that fail to load are skipped,
+ * but still reported via o3d_get_last_error() and a false return.
+ * The models are allocated from the scene's arena, all freed at once.
+ *
+ * NOTE: The placement data of the level pieces is not known, so these
+ * instances get identity transforms. The level MESHES directories appear to
+ * hold models authored in level space already, so this assembles the level as is.
+ */
+bool o3d_scene_load_directory(o3d_scene_t * scene, const char * path);
+
+/*
+ * (Re)builds the loose octree over the instance AABBs.
+ */
+bool o3d_scene_build_index(o3d_scene_t * scene);
+
+/*
+ * Queries. Each writes the indexes of the instances overlapping the volume
+ * into `results`, up to `maxResults` of them, in no particular order, and
+ * returns the total number found (which may be more than `maxResults`).
+ * Tests are against the instance world AABBs, so results are conservative.
+ */
+uint32_t o3d_scene_query_box(const o3d_scene_t * scene, const o3d_aabb_t * box,
+                             uint32_t * results, uint32_t maxResults);
+uint32_t o3d_scene_query_sphere(const o3d_scene_t * scene, const o3d_vertex_t * center, float radius,
+                                uint32_t * results, uint32_t maxResults);
+uint32_t o3d_scene_query_frustum(const o3d_scene_t * scene, const o3d_frustum_t * frustum,
+                                 uint32_t * results, uint32_t maxResults);
+
+/*
+ * Extracts the frustum planes from a column-major (OpenGL style)
+ * view-projection matrix, as used by the viewer.
+ */
+void o3d_frustum_from_matrix(o3d_frustum_t * frustum, const float viewProj[16]);
+
+#endif // DARKSTONE_O3D_SCENE_H
@@ -0,0 +1,688 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_simplify.c
+ * Created on: 17/10/26
+ * Brief: Quadric error metric mesh simplification and LOD chain generation.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_simplify.h"
+#include "o3d_vcache.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Quadrics:
+ * ======================================================== */
+
+// Symmetric 4x4 matrix of a plane quadric, upper triangle only.
+typedef struct simp_quadric {
+	double a2, ab, ac, ad;
+	double     b2, bc, bd;
+	double         c2, cd;
+	double             d2;
+} simp_quadric_t;
+
+static inline void simp_quadric_add_plane(simp_quadric_t * q, double a, double b, double c, double d) {
+	q->a2 += a * a; q->ab += a * b; q->ac += a * c; q->ad += a * d;
+	q->b2 += b * b; q->bc += b * c; q->bd += b * d;
+	q->c2 += c * c; q->cd += c * d;
+	q->d2 += d * d;
+}
+
+static inline void simp_quadric_add(simp_quadric_t * q, const simp_quadric_t * other) {
+	q->a2 += other->a2; q->ab += other->ab; q->ac += other->ac; q->ad += other->ad;
+	q->b2 += other->b2; q->bc += other->bc; q->bd += other->bd;
+	q->c2 += other->c2; q->cd += other->cd;
+	q->d2 += other->d2;
+}
+
+static inline float simp_quadric_error(const simp_quadric_t * q, const o3d_mesh_vertex_t * v) {
+	const double x = v->px, y = v->py, z = v->pz;
+	const double err =
+		(q->a2 * x * x) + (2.0 * q->ab * x * y) + (2.0 * q->ac * x * z) + (2.0 * q->ad * x) +
+		(q->b2 * y * y) + (2.0 * q->bc * y * z) + (2.0 * q->bd * y) +
+		(q->c2 * z * z) + (2.0 * q->cd * z) +
+		 q->d2;
+	return (err > 0.0) ? (float)err : 0.0f;
+}
+
+static inline void simp_triangle_normal(const o3d_mesh_vertex_t * v0, const o3d_mesh_vertex_t * v1,
+                                        const o3d_mesh_vertex_t * v2, float n[3]) {
+	const float e1[3] = { v1->px - v0->px, v1->py - v0->py, v1->pz - v0->pz };
+	const float e2[3] = { v2->px - v0->px, v2->py - v0->py, v2->pz - v0->pz };
+	n[0] = (e1[1] * e2[2]) - (e1[2] * e2[1]);
+	n[1] = (e1[2] * e2[0]) - (e1[0] * e2[2]);
+	n[2] = (e1[0] * e2[1]) - (e1[1] * e2[0]);
+}
+
+/* ========================================================
+ * Simplification context:
+ * ======================================================== */
+
+typedef struct simp_candidate {
+	float    cost;
+	uint32_t from;  // Vertex removed.
+	uint32_t to;    // Vertex it collapses onto.
+} simp_candidate_t;
+
+/*
+ * Working memory shared by all the groups/LODs of a mesh.
+ * Arrays sized by vertex count are indexed by mesh vertex.
+ */
+typedef struct simp_context {
+	const o3d_mesh_t * mesh;
+	simp_quadric_t   * quadrics;
+	uint32_t         * remap;
+	uint32_t         * stamp;      // Pass number that last touched the vertex.
+	uint32_t         * linkMark;   // Scratch marks of simp_collapse_breaks_link().
+	uint8_t          * locked;
+	uint8_t          * sharedPos;  // Vertex position is shared with another vertex (seam/boundary).
+	uint32_t         * adjStart;   // Vertex -> triangle adjacency (CSR).
+	uint32_t         * adjCount;
+	uint32_t         * adjList;
+	uint64_t         * edgeTable;  // Directed edge hash set for the border detection.
+	simp_candidate_t * candidates;
+	uint32_t           passCounter;
+	uint32_t           linkCounter;
+} simp_context_t;
+
+static void simp_context_free(simp_context_t * ctx) {
+	free(ctx->quadrics);
+	free(ctx->remap);
+	free(ctx->stamp);
+	free(ctx->linkMark);
+	free(ctx->locked);
+	free(ctx->sharedPos);
+	free(ctx->adjStart);
+	free(ctx->adjCount);
+	free(ctx->adjList);
+	free(ctx->edgeTable);
+	free(ctx->candidates);
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+static uint32_t simp_edge_table_size(uint32_t indexCount) {
+	// Smallest power of two holding twice the directed edges (one per index),
+	// so the linear probing runs at a load factor of 0.5 at most.
+	uint32_t size = 1;
+	while (size < indexCount * 2) {
+		size <<= 1;
+	}
+	return size;
+}
+
+static bool simp_context_init(simp_context_t * ctx, const o3d_mesh_t * mesh) {
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->mesh = mesh;
+
+	const uint32_t vertexCount = mesh->vertexCount;
+	const uint32_t indexCount  = mesh->indexCount;
+
+	ctx->quadrics   = malloc(vertexCount * sizeof(ctx->quadrics[0]));
+	ctx->remap      = malloc(vertexCount * sizeof(ctx->remap[0]));
+	ctx->stamp      = calloc(vertexCount, sizeof(ctx->stamp[0]));
+	ctx->linkMark   = calloc(vertexCount, sizeof(ctx->linkMark[0]));
+	ctx->locked     = malloc(vertexCount * sizeof(ctx->locked[0]));
+	ctx->sharedPos  = calloc(vertexCount, sizeof(ctx->sharedPos[0]));
+	ctx->adjStart   = malloc((vertexCount + 1) * sizeof(ctx->adjStart[0]));
+	ctx->adjCount   = malloc(vertexCount * sizeof(ctx->adjCount[0]));
+	ctx->adjList    = malloc(indexCount * sizeof(ctx->adjList[0]));
+	ctx->edgeTable  = malloc(simp_edge_table_size(indexCount) * sizeof(ctx->edgeTable[0]));
+	ctx->candidates = malloc(indexCount * 2 * sizeof(ctx->candidates[0]));
+
+	uint32_t * posUseCount = calloc(mesh->positionCount, sizeof(posUseCount[0]));
+
+	if (ctx->quadrics == NULL || ctx->remap == NULL || ctx->stamp == NULL || ctx->linkMark == NULL ||
+	    ctx->locked == NULL || ctx->sharedPos == NULL || ctx->adjStart == NULL || ctx->adjCount == NULL || ctx->adjList == NULL ||
+	    ctx->edgeTable == NULL || ctx->candidates == NULL || posUseCount == NULL) {
+		free(posUseCount);
+		simp_context_free(ctx);
+		return o3d_set_error("Unable to malloc simplification buffers!");
+	}
+
+	// Vertexes sharing a position with another vertex sit on a UV seam,
+	// color break or texture boundary. Those never move.
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		assert(mesh->positionIds[v] < mesh->positionCount);
+		posUseCount[mesh->positionIds[v]]++;
+	}
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		ctx->sharedPos[v] = (posUseCount[mesh->positionIds[v]] > 1);
+	}
+
+	free(posUseCount);
+	return true;
+}
+
+/* ========================================================
+ * Border detection:
+ * ======================================================== */
+
+static inline uint32_t simp_hash_edge(uint64_t key) {
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33;
+	return (uint32_t)key;
+}
+
+static void simp_lock_borders(simp_context_t * ctx, const uint32_t * tris, uint32_t indexCount) {
+	const uint32_t tableSize = simp_edge_table_size(indexCount);
+	const uint64_t EMPTY = UINT64_MAX;
+	uint64_t * table = ctx->edgeTable;
+
+	for (uint32_t i = 0; i < tableSize; ++i) {
+		table[i] = EMPTY;
+	}
+
+	// Insert all directed edges.
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		const uint32_t a = tris[i];
+		const uint32_t b = tris[(i % 3 == 2) ? (i - 2) : (i + 1)];
+		const uint64_t key = ((uint64_t)a << 32) | b;
+
+		uint32_t slot = simp_hash_edge(key) & (tableSize - 1);
+		while (table[slot] != EMPTY && table[slot] != key) {
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		if (table[slot] == key) {
+			// Same directed edge twice: non-manifold or flipped. Don't touch it.
+			ctx->locked[a] = 1;
+			ctx->locked[b] = 1;
+		}
+		table[slot] = key;
+	}
+
+	// An edge without its twin is on an open border.
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		const uint32_t a = tris[i];
+		const uint32_t b = tris[(i % 3 == 2) ? (i - 2) : (i + 1)];
+		const uint64_t twin = ((uint64_t)b << 32) | a;
+
+		uint32_t slot = simp_hash_edge(twin) & (tableSize - 1);
+		while (table[slot] != EMPTY && table[slot] != twin) {
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		if (table[slot] == EMPTY) {
+			ctx->locked[a] = 1;
+			ctx->locked[b] = 1;
+		}
+	}
+}
+
+/* ========================================================
+ * Vertex/triangle adjacency:
+ * ======================================================== */
+
+static void simp_build_adjacency(simp_context_t * ctx, const uint32_t * tris, uint32_t indexCount) {
+	// Only the entries of vertexes referenced by `tris` are valid afterwards.
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		ctx->adjCount[tris[i]] = 0;
+	}
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		ctx->adjCount[tris[i]]++;
+	}
+
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		const uint32_t v = tris[i];
+		if (ctx->adjCount[v] != 0) {
+			ctx->adjStart[v] = offset;
+			offset += ctx->adjCount[v];
+			ctx->adjCount[v] = 0; // Refilled below.
+		}
+	}
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		const uint32_t v = tris[i];
+		ctx->adjList[ctx->adjStart[v] + ctx->adjCount[v]++] = i / 3;
+	}
+}
+
+/* ========================================================
+ * Collapse validation:
+ * ======================================================== */
+
+static bool simp_collapse_flips(const simp_context_t * ctx, const uint32_t * tris, uint32_t from, uint32_t to) {
+	const o3d_mesh_vertex_t * verts = ctx->mesh->vertexes;
+	const uint32_t * adj = &ctx->adjList[ctx->adjStart[from]];
+	const uint32_t count = ctx->adjCount[from];
+
+	for (uint32_t n = 0; n < count; ++n) {
+		const uint32_t * tri = &tris[adj[n] * 3];
+		if (tri[0] == to || tri[1] == to || tri[2] == to) {
+			continue; // Goes away with the collapse.
+		}
+
+		float oldN[3], newN[3];
+		simp_triangle_normal(&verts[tri[0]], &verts[tri[1]], &verts[tri[2]], oldN);
+		simp_triangle_normal(
+			&verts[(tri[0] == from) ? to : tri[0]],
+			&verts[(tri[1] == from) ? to : tri[1]],
+			&verts[(tri[2] == from) ? to : tri[2]], newN);
+
+		const float dot    = (oldN[0] * newN[0]) + (oldN[1] * newN[1]) + (oldN[2] * newN[2]);
+		const float oldLen = sqrtf((oldN[0] * oldN[0]) + (oldN[1] * oldN[1]) + (oldN[2] * oldN[2]));
+		const float newLen = sqrtf((newN[0] * newN[0]) + (newN[1] * newN[1]) + (newN[2] * newN[2]));
+
+		// Reject flipped or nearly degenerate results (more than ~75 degrees of rotation).
+		if (newLen <= 0.0f || dot <= 0.25f * oldLen * newLen) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//
+// Link condition: the only vertexes next to both ends of the edge may be the
+// ones opposite to it, in the (at most two) triangles that share the edge.
+// Any other common neighbor would get two edges to the merged vertex, pinching
+// the surface together (e.g. the two sides of a thin wall) or making it
+// non-manifold.
+//
+static bool simp_collapse_breaks_link(simp_context_t * ctx, const uint32_t * tris, uint32_t from, uint32_t to) {
+	ctx->linkCounter += 2;
+	if (ctx->linkCounter < 2) {
+		// Wrapped around: old marks could match again.
+		memset(ctx->linkMark, 0, ctx->mesh->vertexCount * sizeof(ctx->linkMark[0]));
+		ctx->linkCounter = 2;
+	}
+	const uint32_t neighborOfTo = ctx->linkCounter;      // Set on the one-ring of `to`.
+	const uint32_t opposite     = ctx->linkCounter + 1;  // Then on the vertexes opposite to the edge.
+
+	const uint32_t * toAdj = &ctx->adjList[ctx->adjStart[to]];
+	for (uint32_t n = 0; n < ctx->adjCount[to]; ++n) {
+		const uint32_t * tri = &tris[toAdj[n] * 3];
+		for (int k = 0; k < 3; ++k) {
+			ctx->linkMark[tri[k]] = neighborOfTo;
+		}
+	}
+
+	const uint32_t * fromAdj = &ctx->adjList[ctx->adjStart[from]];
+	const uint32_t fromCount = ctx->adjCount[from];
+	uint32_t edgeTris = 0;
+
+	for (uint32_t n = 0; n < fromCount; ++n) {
+		const uint32_t * tri = &tris[fromAdj[n] * 3];
+		if (tri[0] == to || tri[1] == to || tri[2] == to) {
+			for (int k = 0; k < 3; ++k) {
+				if (tri[k] != from && tri[k] != to) {
+					ctx->linkMark[tri[k]] = opposite;
+				}
+			}
+			++edgeTris;
+		}
+	}
+	if (edgeTris > 2) {
+		return true; // Non-manifold edge.
+	}
+
+	for (uint32_t n = 0; n < fromCount; ++n) {
+		const uint32_t * tri = &tris[fromAdj[n] * 3];
+		for (int k = 0; k < 3; ++k) {
+			if (tri[k] != from && tri[k] != to && ctx->linkMark[tri[k]] == neighborOfTo) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static int simp_sort_by_cost(const void * a, const void * b) {
+	const float ca = ((const simp_candidate_t *)a)->cost;
+	const float cb = ((const simp_candidate_t *)b)->cost;
+	return (ca < cb) ? -1 : ((ca > cb) ? 1 : 0);
+}
+
+/* ========================================================
+ * simp_simplify_range():
+ * ======================================================== */
+
+//
+// Simplifies one group. `tris` is both input and output,
+// returns the new index count. Works in passes: each pass
+// sorts all the possible collapses by cost, then applies
+// as many independent ones as it can, cheapest first.
+//
+static uint32_t simp_simplify_range(simp_context_t * ctx, uint32_t * tris, uint32_t indexCount,
+                                    uint32_t targetIndexCount, float maxError, float * outError) {
+	const o3d_mesh_vertex_t * verts = ctx->mesh->vertexes;
+	const float maxCost = (maxError >= 0.0f) ? (maxError * maxError) : INFINITY;
+	float worstCost = 0.0f;
+
+	// Reset the per-vertex state of this range:
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		const uint32_t v = tris[i];
+		memset(&ctx->quadrics[v], 0, sizeof(ctx->quadrics[v]));
+		ctx->remap[v]  = v;
+		ctx->locked[v] = ctx->sharedPos[v];
+	}
+
+	simp_lock_borders(ctx, tris, indexCount);
+
+	// Plane quadrics of the faces around each vertex:
+	for (uint32_t i = 0; i < indexCount; i += 3) {
+		const o3d_mesh_vertex_t * v0 = &verts[tris[i + 0]];
+		float n[3];
+		simp_triangle_normal(v0, &verts[tris[i + 1]], &verts[tris[i + 2]], n);
+
+		const float len = sqrtf((n[0] * n[0]) + (n[1] * n[1]) + (n[2] * n[2]));
+		if (len <= 0.0f) {
+			continue;
+		}
+
+		const double a = n[0] / len, b = n[1] / len, c = n[2] / len;
+		const double d = -((a * v0->px) + (b * v0->py) + (c * v0->pz));
+		for (int k = 0; k < 3; ++k) {
+			simp_quadric_add_plane(&ctx->quadrics[tris[i + k]], a, b, c, d);
+		}
+	}
+
+	while (indexCount > targetIndexCount) {
+		simp_build_adjacency(ctx, tris, indexCount);
+
+		uint32_t candidateCount = 0;
+		for (uint32_t i = 0; i < indexCount; ++i) {
+			const uint32_t a = tris[i];
+			const uint32_t b = tris[(i % 3 == 2) ? (i - 2) : (i + 1)];
+
+			// Interior edges are seen from both triangles, so each direction gets added once.
+			if (!ctx->locked[a]) {
+				simp_candidate_t * cand = &ctx->candidates[candidateCount++];
+				cand->cost = simp_quadric_error(&ctx->quadrics[a], &verts[b]);
+				cand->from = a;
+				cand->to   = b;
+			}
+		}
+
+		if (candidateCount == 0) {
+			break;
+		}
+
+		qsort(ctx->candidates, candidateCount, sizeof(ctx->candidates[0]), &simp_sort_by_cost);
+
+		const uint32_t pass = ++ctx->passCounter;
+		const uint32_t trisToRemove = (indexCount - targetIndexCount) / 3;
+		uint32_t trisRemoved = 0;
+		uint32_t collapses = 0;
+
+		for (uint32_t c = 0; c < candidateCount && trisRemoved < trisToRemove; ++c) {
+			const simp_candidate_t * cand = &ctx->candidates[c];
+			if (cand->cost > maxCost) {
+				break;
+			}
+
+			const uint32_t from = cand->from;
+			const uint32_t to   = cand->to;
+
+			if (ctx->stamp[from] == pass || ctx->stamp[to] == pass) {
+				continue; // Neighborhood already changed this pass.
+			}
+			if (simp_collapse_breaks_link(ctx, tris, from, to) || simp_collapse_flips(ctx, tris, from, to)) {
+				continue;
+			}
+
+			// Freeze the whole one-ring, so the tests
+			// above stay valid for the rest of the pass.
+			const uint32_t * adj = &ctx->adjList[ctx->adjStart[from]];
+			for (uint32_t n = 0; n < ctx->adjCount[from]; ++n) {
+				const uint32_t * tri = &tris[adj[n] * 3];
+				ctx->stamp[tri[0]] = pass;
+				ctx->stamp[tri[1]] = pass;
+				ctx->stamp[tri[2]] = pass;
+				trisRemoved += (tri[0] == to || tri[1] == to || tri[2] == to);
+			}
+
+			ctx->remap[from] = to;
+			simp_quadric_add(&ctx->quadrics[to], &ctx->quadrics[from]);
+			worstCost = (cand->cost > worstCost) ? cand->cost : worstCost;
+			++collapses;
+		}
+
+		if (collapses == 0) {
+			break;
+		}
+
+		// Apply the remap and drop the triangles that collapsed:
+		uint32_t newCount = 0;
+		for (uint32_t i = 0; i < indexCount; i += 3) {
+			const uint32_t a = ctx->remap[tris[i + 0]];
+			const uint32_t b = ctx->remap[tris[i + 1]];
+			const uint32_t c = ctx->remap[tris[i + 2]];
+
+			if (a != b && b != c && a != c) {
+				tris[newCount++] = a;
+				tris[newCount++] = b;
+				tris[newCount++] = c;
+			}
+		}
+		indexCount = newCount;
+	}
+
+	*outError = (sqrtf(worstCost) > *outError) ? sqrtf(worstCost) : *outError;
+	return indexCount;
+}
+
+/* ========================================================
+ * simp_simplify_lod():
+ * ======================================================== */
+
+//
+// Simplifies every group of `src` (or the whole of it if ungrouped)
+// into `lod`. Targets are relative to the source mesh groups.
+//
+static bool simp_simplify_lod(simp_context_t * ctx, const uint32_t * srcIndexes, const o3d_mesh_group_t * srcGroups,
+                              uint32_t srcIndexCount, uint32_t groupCount, float targetRatio, float maxError,
+                              o3d_lod_t * lod) {
+	const o3d_mesh_t * mesh = ctx->mesh;
+	memset(lod, 0, sizeof(*lod));
+
+	lod->indexes = malloc(srcIndexCount * sizeof(lod->indexes[0]));
+	if (lod->indexes == NULL) {
+		return o3d_set_error("Unable to malloc LOD indexes!");
+	}
+
+	if (groupCount != 0) {
+		lod->groups = malloc(groupCount * sizeof(lod->groups[0]));
+		if (lod->groups == NULL) {
+			o3d_lod_free(lod);
+			return o3d_set_error("Unable to malloc LOD groups!");
+		}
+		lod->groupCount = groupCount;
+	}
+
+	const uint32_t rangeCount = (groupCount != 0) ? groupCount : 1;
+	uint32_t outIndexCount = 0;
+
+	for (uint32_t g = 0; g < rangeCount; ++g) {
+		const uint32_t first = (groupCount != 0) ? srcGroups[g].firstIndex : 0;
+		const uint32_t count = (groupCount != 0) ? srcGroups[g].indexCount : srcIndexCount;
+		const uint32_t fullCount = (mesh->groupCount != 0) ? mesh->groups[g].indexCount : mesh->indexCount;
+
+		uint32_t target = (uint32_t)((float)(fullCount / 3) * targetRatio) * 3;
+		if (target < 3) {
+			target = 3;
+		}
+
+		uint32_t * tris = &lod->indexes[outIndexCount];
+		memcpy(tris, &srcIndexes[first], count * sizeof(tris[0]));
+
+		const uint32_t newCount = (count > target) ?
+			simp_simplify_range(ctx, tris, count, target, maxError, &lod->error) : count;
+
+		if (groupCount != 0) {
+			lod->groups[g] = srcGroups[g];
+			lod->groups[g].firstIndex = outIndexCount;
+			lod->groups[g].indexCount = newCount;
+		}
+		outIndexCount += newCount;
+	}
+
+	lod->indexCount = outIndexCount;
+	return true;
+}
+
+/* ========================================================
+ * o3d_simplify():
+ * ======================================================== */
+
+bool o3d_simplify(const o3d_mesh_t * mesh, float targetRatio, float maxError, o3d_lod_t * lod) {
+	assert(mesh != NULL);
+	assert(lod  != NULL);
+
+	memset(lod, 0, sizeof(*lod));
+	if (mesh->indexCount == 0) {
+		return o3d_set_error("Can't simplify an empty mesh!");
+	}
+
+	simp_context_t ctx;
+	if (!simp_context_init(&ctx, mesh)) {
+		return false;
+	}
+
+	const bool success = simp_simplify_lod(&ctx, mesh->indexes, mesh->groups, mesh->indexCount,
+	                                       mesh->groupCount, targetRatio, maxError, lod);
+	simp_context_free(&ctx);
+	return success;
+}
+
+/* ========================================================
+ * o3d_simplify_lod_chain():
+ * ======================================================== */
+
+bool o3d_simplify_lod_chain(const o3d_mesh_t * mesh, const float * ratios, uint32_t lodCount, o3d_lod_t * lods) {
+	assert(mesh   != NULL);
+	assert(ratios != NULL);
+	assert(lods   != NULL);
+	assert(lodCount <= O3D_MAX_LODS);
+
+	memset(lods, 0, lodCount * sizeof(lods[0]));
+	if (mesh->indexCount == 0) {
+		return o3d_set_error("Can't simplify an empty mesh!");
+	}
+
+	simp_context_t ctx;
+	if (!simp_context_init(&ctx, mesh)) {
+		return false;
+	}
+
+	bool success = true;
+	for (uint32_t l = 0; l < lodCount && success; ++l) {
+		// Each LOD starts from the previous one; much
+		// cheaper than going from the full mesh every time.
+		const uint32_t         * srcIndexes = (l == 0) ? mesh->indexes    : lods[l - 1].indexes;
+		const o3d_mesh_group_t * srcGroups  = (l == 0) ? mesh->groups     : lods[l - 1].groups;
+		const uint32_t           srcCount   = (l == 0) ? mesh->indexCount : lods[l - 1].indexCount;
+
+		success = simp_simplify_lod(&ctx, srcIndexes, srcGroups, srcCount,
+		                            mesh->groupCount, ratios[l], -1.0f, &lods[l]);
+		if (!success) {
+			break;
+		}
+
+		if (l != 0 && lods[l - 1].error > lods[l].error) {
+			lods[l].error = lods[l - 1].error; // Errors accumulate down the chain.
+		}
+
+		// Keep the draws of each LOD cache friendly as well:
+		const uint32_t rangeCount = (lods[l].groupCount != 0) ? lods[l].groupCount : 1;
+		for (uint32_t g = 0; g < rangeCount && success; ++g) {
+			const uint32_t first = (lods[l].groupCount != 0) ? lods[l].groups[g].firstIndex : 0;
+			const uint32_t count = (lods[l].groupCount != 0) ? lods[l].groups[g].indexCount : lods[l].indexCount;
+			success = o3d_vcache_optimize_triangles(&lods[l].indexes[first], count, mesh->vertexCount, NULL);
+		}
+	}
+
+	simp_context_free(&ctx);
+
+	if (!success) {
+		for (uint32_t l = 0; l < lodCount; ++l) {
+			o3d_lod_free(&lods[l]);
+		}
+	}
+	return success;
+}
+
+/* ========================================================
+ * o3d_lod_to_mesh():
+ * ======================================================== */
+
+bool o3d_lod_to_mesh(const o3d_mesh_t * mesh, const o3d_lod_t * lod, o3d_mesh_t * out) {
+	assert(mesh != NULL);
+	assert(lod  != NULL);
+	assert(out  != NULL);
+
+	memset(out, 0, sizeof(*out));
+
+	const uint32_t triCount = lod->indexCount / 3;
+	if (triCount == 0) {
+		return o3d_set_error("LOD has no triangles!");
+	}
+
+	out->vertexes    = malloc(mesh->vertexCount * sizeof(out->vertexes[0]));
+	out->positionIds = malloc(mesh->vertexCount * sizeof(out->positionIds[0]));
+	out->indexes     = malloc(lod->indexCount * sizeof(out->indexes[0]));
+	out->texNumbers  = malloc(triCount * sizeof(out->texNumbers[0]));
+	out->groups      = (lod->groupCount != 0) ? malloc(lod->groupCount * sizeof(out->groups[0])) : NULL;
+
+	// Texture of each vertex. Vertexes never span textures, since the texNumber is part of the weld key.
+	uint16_t * vertexTex = malloc(mesh->vertexCount * sizeof(vertexTex[0]));
+
+	if (out->vertexes == NULL || out->positionIds == NULL || out->indexes == NULL ||
+	    out->texNumbers == NULL || (lod->groupCount != 0 && out->groups == NULL) || vertexTex == NULL) {
+		free(vertexTex);
+		o3d_mesh_free(out);
+		return o3d_set_error("Unable to malloc LOD mesh!");
+	}
+
+	for (uint32_t i = 0; i < mesh->indexCount; ++i) {
+		vertexTex[mesh->indexes[i]] = mesh->texNumbers[i / 3];
+	}
+	for (uint32_t t = 0; t < triCount; ++t) {
+		out->texNumbers[t] = vertexTex[lod->indexes[t * 3]];
+	}
+	free(vertexTex);
+
+	memcpy(out->vertexes,    mesh->vertexes,    mesh->vertexCount * sizeof(out->vertexes[0]));
+	memcpy(out->positionIds, mesh->positionIds, mesh->vertexCount * sizeof(out->positionIds[0]));
+	memcpy(out->indexes,     lod->indexes,      lod->indexCount   * sizeof(out->indexes[0]));
+	if (lod->groupCount != 0) {
+		memcpy(out->groups, lod->groups, lod->groupCount * sizeof(out->groups[0]));
+	}
+
+	out->vertexCount   = mesh->vertexCount;
+	out->indexCount    = lod->indexCount;
+	out->positionCount = mesh->positionCount;
+	out->groupCount    = lod->groupCount;
+	out->aabb          = mesh->aabb;
+
+	// Drops the vertexes no longer referenced.
+	if (!o3d_mesh_optimize(out)) {
+		o3d_mesh_free(out);
+		return false;
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3d_lod_free():
+ * ======================================================== */
+
+void o3d_lod_free(o3d_lod_t * lod) {
+	if (lod == NULL) {
+		return;
+	}
+
+	free(lod->indexes);
+	free(lod->groups);
+	memset(lod, 0, sizeof(*lod));
+}
@@ -0,0 +1,78 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_simplify.h
+ * Created on: 17/10/26
+ * Brief: Quadric error metric mesh simplification and LOD chain generation.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_SIMPLIFY_H
+#define DARKSTONE_O3D_SIMPLIFY_H
+
+#include "o3d_mesh.h"
+
+/* ========================================================
+ * LOD data:
+ * ======================================================== */
+
+/*
+ * A simplified version of a mesh. LODs only have their own index
+ * buffer; they reference the vertexes of the source mesh, so the
+ * whole chain shares one vertex buffer. Use o3d_lod_to_mesh() to
+ * get a standalone, compacted mesh instead.
+ */
+typedef struct o3d_lod {
+	uint32_t         * indexes;    // Into the source mesh vertexes.
+	o3d_mesh_group_t * groups;     // Same groups as the source mesh, with the new ranges. May be null.
+	uint32_t           indexCount;
+	uint32_t           groupCount; // Zero if the source mesh wasn't grouped.
+	float              error;      // Largest deviation introduced, in model units (approximate).
+} o3d_lod_t;
+
+enum { O3D_MAX_LODS = 8 };
+
+/* ========================================================
+ * Simplification functions:
+ * ======================================================== */
+
+/*
+ * Simplifies the mesh by half-edge collapses ordered by the quadric error
+ * (Garland & Heckbert). Collapses move a vertex onto one of its neighbors,
+ * so no new vertexes are created and the attributes stay valid.
+ *
+ * Vertexes on open borders of the indexed topology are locked in place.
+ * Since o3d_mesh_build() splits vertexes wherever the UV, color or texture
+ * changes, this keeps the UV seams and the texNumber boundaries intact.
+ * Groups are simplified separately, so triangles never change group.
+ *
+ * Stops at `targetRatio` of the source triangle count, or earlier if the next
+ * collapse would exceed `maxError` (model units; pass a negative to ignore).
+ */
+bool o3d_simplify(const o3d_mesh_t * mesh, float targetRatio, float maxError, o3d_lod_t * lod);
+
+/*
+ * Builds `lodCount` LODs, each from the previous one, at the given ratios of the
+ * source triangle count (decreasing, e.g.: 0.5, 0.25, 0.125). The index buffer of
+ * each LOD is also optimized for the vertex cache. Free each with o3d_lod_free().
+ */
+bool o3d_simplify_lod_chain(const o3d_mesh_t * mesh, const float * ratios, uint32_t lodCount, o3d_lod_t * lods);
+
+/*
+ * Makes a standalone mesh from a LOD, copying only the vertexes it references.
+ * The output is optimized with o3d_mesh_optimize(), ready for o3dc_write_file().
+ */
+bool o3d_lod_to_mesh(const o3d_mesh_t * mesh, const o3d_lod_t * lod, o3d_mesh_t * out);
+
+/*
+ * Frees the index buffer and groups of a LOD.
+ */
+void o3d_lod_free(o3d_lod_t * lod);
+
+#endif // DARKSTONE_O3D_SIMPLIFY_H
@@ -0,0 +1,303 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_soa.c
+ * Created on: 17/10/26
+ * Brief: Structure-of-arrays view of O3D vertex positions, for SIMD-friendly geometry processing.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_soa.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// No shuffles needed with SoA, each register is 4 vertexes of the same axis.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define O3D_SOA_USE_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define O3D_SOA_USE_SSE 0
+#endif
+
+/* ========================================================
+ * o3d_vertex_soa_build() / o3d_vertex_soa_free():
+ * ======================================================== */
+
+bool o3d_vertex_soa_build(o3d_vertex_soa_t * soa, const o3d_vertex_t * vertexes, uint32_t count, o3d_arena_t * arena) {
+	assert(soa      != NULL);
+	assert(vertexes != NULL || count == 0);
+
+	memset(soa, 0, sizeof(*soa));
+
+	if (count == 0) {
+		return o3d_set_error("No vertexes to build a SoA from!");
+	}
+
+	const uint32_t paddedCount = (count + (O3D_SOA_WIDTH - 1)) & ~(uint32_t)(O3D_SOA_WIDTH - 1);
+	const size_t arrayBytes = (size_t)paddedCount * sizeof(float);
+	const size_t blockBytes = (arrayBytes * 3) + O3D_SOA_ALIGNMENT;
+
+	uint8_t * block;
+	if (arena != NULL) {
+		block = o3d_arena_alloc(arena, blockBytes);
+	} else {
+		block = malloc(blockBytes);
+		soa->memBlock = block;
+	}
+
+	if (block == NULL) {
+		return o3d_set_error("Unable to malloc SoA vertexes!");
+	}
+
+	// The array size is a multiple of the alignment, so aligning the first is enough.
+	const uintptr_t aligned = ((uintptr_t)block + (O3D_SOA_ALIGNMENT - 1)) & ~(uintptr_t)(O3D_SOA_ALIGNMENT - 1);
+	soa->x = (float *)aligned;
+	soa->y = soa->x + paddedCount;
+	soa->z = soa->y + paddedCount;
+	soa->count = count;
+	soa->paddedCount = paddedCount;
+
+	for (uint32_t v = 0; v < count; ++v) {
+		soa->x[v] = vertexes[v].x;
+		soa->y[v] = vertexes[v].y;
+		soa->z[v] = vertexes[v].z;
+	}
+	for (uint32_t v = count; v < paddedCount; ++v) {
+		soa->x[v] = vertexes[count - 1].x;
+		soa->y[v] = vertexes[count - 1].y;
+		soa->z[v] = vertexes[count - 1].z;
+	}
+
+	return true;
+}
+
+void o3d_vertex_soa_free(o3d_vertex_soa_t * soa) {
+	if (soa == NULL) {
+		return;
+	}
+
+	free(soa->memBlock);
+	memset(soa, 0, sizeof(*soa));
+}
+
+/* ========================================================
+ * o3d_load_from_file_soa():
+ * ======================================================== */
+
+bool o3d_load_from_file_soa(o3d_model_t * o3d, o3d_vertex_soa_t * soa, const char * filename, o3d_arena_t * arena) {
+	assert(soa != NULL);
+
+	memset(soa, 0, sizeof(*soa));
+
+	if (!o3d_load_from_file_ex(o3d, filename, arena)) {
+		return false;
+	}
+
+	if (!o3d_vertex_soa_build(soa, o3d->vertexes, o3d->vertexCount, arena)) {
+		o3d_free(o3d);
+		return false;
+	}
+
+	return true;
+}
+
+/* ========================================================
+ * o3d_vertex_soa_bounds():
+ * ======================================================== */
+
+#if O3D_SOA_USE_SSE
+static inline float soa_hmin(__m128 v) {
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+
+static inline float soa_hmax(__m128 v) {
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+#endif // O3D_SOA_USE_SSE
+
+void o3d_vertex_soa_bounds(const o3d_vertex_soa_t * soa, o3d_aabb_t * aabb) {
+	assert(soa  != NULL);
+	assert(aabb != NULL);
+	assert(soa->paddedCount != 0);
+
+	#if O3D_SOA_USE_SSE
+	// Two independent accumulators per axis (8 vertexes per iteration).
+	__m128 minX0 = _mm_load_ps(soa->x), minX1 = minX0, maxX0 = minX0, maxX1 = minX0;
+	__m128 minY0 = _mm_load_ps(soa->y), minY1 = minY0, maxY0 = minY0, maxY1 = minY0;
+	__m128 minZ0 = _mm_load_ps(soa->z), minZ1 = minZ0, maxZ0 = minZ0, maxZ1 = minZ0;
+
+	for (uint32_t v = 0; v < soa->paddedCount; v += O3D_SOA_WIDTH) {
+		const __m128 x0 = _mm_load_ps(&soa->x[v]), x1 = _mm_load_ps(&soa->x[v + 4]);
+		const __m128 y0 = _mm_load_ps(&soa->y[v]), y1 = _mm_load_ps(&soa->y[v + 4]);
+		const __m128 z0 = _mm_load_ps(&soa->z[v]), z1 = _mm_load_ps(&soa->z[v + 4]);
+
+		minX0 = _mm_min_ps(minX0, x0); minX1 = _mm_min_ps(minX1, x1);
+		maxX0 = _mm_max_ps(maxX0, x0); maxX1 = _mm_max_ps(maxX1, x1);
+		minY0 = _mm_min_ps(minY0, y0); minY1 = _mm_min_ps(minY1, y1);
+		maxY0 = _mm_max_ps(maxY0, y0); maxY1 = _mm_max_ps(maxY1, y1);
+		minZ0 = _mm_min_ps(minZ0, z0); minZ1 = _mm_min_ps(minZ1, z1);
+		maxZ0 = _mm_max_ps(maxZ0, z0); maxZ1 = _mm_max_ps(maxZ1, z1);
+	}
+
+	aabb->mins.x = soa_hmin(_mm_min_ps(minX0, minX1));
+	aabb->mins.y = soa_hmin(_mm_min_ps(minY0, minY1));
+	aabb->mins.z = soa_hmin(_mm_min_ps(minZ0, minZ1));
+	aabb->maxs.x = soa_hmax(_mm_max_ps(maxX0, maxX1));
+	aabb->maxs.y = soa_hmax(_mm_max_ps(maxY0, maxY1));
+	aabb->maxs.z = soa_hmax(_mm_max_ps(maxZ0, maxZ1));
+	#else // !O3D_SOA_USE_SSE
+	float minX = soa->x[0], minY = soa->y[0], minZ = soa->z[0];
+	float maxX = minX, maxY = minY, maxZ = minZ;
+
+	for (uint32_t v = 0; v < soa->paddedCount; ++v) {
+		minX = (soa->x[v] < minX) ? soa->x[v] : minX;
+		minY = (soa->y[v] < minY) ? soa->y[v] : minY;
+		minZ = (soa->z[v] < minZ) ? soa->z[v] : minZ;
+		maxX = (soa->x[v] > maxX) ? soa->x[v] : maxX;
+		maxY = (soa->y[v] > maxY) ? soa->y[v] : maxY;
+		maxZ = (soa->z[v] > maxZ) ? soa->z[v] : maxZ;
+	}
+
+	aabb->mins.x = minX; aabb->mins.y = minY; aabb->mins.z = minZ;
+	aabb->maxs.x = maxX; aabb->maxs.y = maxY; aabb->maxs.z = maxZ;
+	#endif // O3D_SOA_USE_SSE
+}
+
+/* ========================================================
+ * o3d_vertex_soa_weld():
+ * ======================================================== */
+
+typedef struct soa_weld_cell {
+	int32_t  key[3];
+	uint32_t vertex;  // UINT32_MAX if the slot is empty.
+} soa_weld_cell_t;
+
+static inline uint32_t soa_hash_cell(const int32_t key[3]) {
+	uint32_t h = (uint32_t)key[0] * 73856093u;
+	h ^= (uint32_t)key[1] * 19349663u;
+	h ^= (uint32_t)key[2] * 83492791u;
+	h ^= h >> 15;
+	return h * 0x2C1B3C6Du;
+}
+
+static inline int32_t soa_float_key(float f) {
+	// Normalize -0 to +0 so they weld together.
+	if (f == 0.0f) {
+		f = 0.0f;
+	}
+	int32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+static inline int32_t soa_cell_coord(float f, float invCellSize) {
+	const float c = floorf(f * invCellSize);
+	// Clamp so the cast is defined. Cells this far out are all merged, which is harmless.
+	if (c < -1073741824.0f) { return -1073741824; }
+	if (c >  1073741824.0f) { return  1073741824; }
+	return (int32_t)c;
+}
+
+static inline soa_weld_cell_t * soa_find_cell(soa_weld_cell_t * cells, uint32_t mask, const int32_t key[3]) {
+	uint32_t slot = soa_hash_cell(key) & mask;
+	for (;;) {
+		soa_weld_cell_t * cell = &cells[slot];
+		if (cell->vertex == UINT32_MAX ||
+		    (cell->key[0] == key[0] && cell->key[1] == key[1] && cell->key[2] == key[2])) {
+			return cell;
+		}
+		slot = (slot + 1) & mask;
+	}
+}
+
+uint32_t o3d_vertex_soa_weld(const o3d_vertex_soa_t * soa, float epsilon, uint32_t * remap) {
+	assert(soa   != NULL);
+	assert(remap != NULL || soa->count == 0);
+	assert(epsilon >= 0.0f);
+
+	uint32_t capacity = 16;
+	while (capacity < soa->count * 2) {
+		capacity <<= 1;
+	}
+
+	soa_weld_cell_t * cells = malloc(capacity * sizeof(cells[0]));
+	if (cells == NULL) {
+		o3d_set_error("Unable to malloc SoA weld table!");
+		return 0;
+	}
+	for (uint32_t c = 0; c < capacity; ++c) {
+		cells[c].vertex = UINT32_MAX;
+	}
+
+	const uint32_t mask = capacity - 1;
+	uint32_t uniqueCount = 0;
+
+	if (epsilon == 0.0f) {
+		// Exact: the cell key is the position itself.
+		for (uint32_t v = 0; v < soa->count; ++v) {
+			const int32_t key[3] = { soa_float_key(soa->x[v]), soa_float_key(soa->y[v]), soa_float_key(soa->z[v]) };
+			soa_weld_cell_t * cell = soa_find_cell(cells, mask, key);
+			if (cell->vertex == UINT32_MAX) {
+				memcpy(cell->key, key, sizeof(key));
+				cell->vertex = v;
+				++uniqueCount;
+			}
+			remap[v] = cell->vertex;
+		}
+	} else {
+		// Grid with cells the size of epsilon. Two kept vertexes are never in
+		// the same cell (they'd be within epsilon), so each cell holds one and
+		// a match can only be in the 3x3x3 cells around the vertex.
+		const float invCellSize = 1.0f / epsilon;
+		for (uint32_t v = 0; v < soa->count; ++v) {
+			const float px = soa->x[v], py = soa->y[v], pz = soa->z[v];
+			const int32_t key[3] = { soa_cell_coord(px, invCellSize), soa_cell_coord(py, invCellSize), soa_cell_coord(pz, invCellSize) };
+
+			uint32_t match = UINT32_MAX;
+			for (int dz = -1; dz <= 1 && match == UINT32_MAX; ++dz) {
+				for (int dy = -1; dy <= 1 && match == UINT32_MAX; ++dy) {
+					for (int dx = -1; dx <= 1 && match == UINT32_MAX; ++dx) {
+						const int32_t near[3] = { key[0] + dx, key[1] + dy, key[2] + dz };
+						const soa_weld_cell_t * cell = soa_find_cell(cells, mask, near);
+						if (cell->vertex == UINT32_MAX) {
+							continue;
+						}
+						const uint32_t k = cell->vertex;
+						if (fabsf(soa->x[k] - px) <= epsilon && fabsf(soa->y[k] - py) <= epsilon && fabsf(soa->z[k] - pz) <= epsilon) {
+							match = k;
+						}
+					}
+				}
+			}
+
+			if (match == UINT32_MAX) {
+				soa_weld_cell_t * cell = soa_find_cell(cells, mask, key);
+				if (cell->vertex == UINT32_MAX) {
+					memcpy(cell->key, key, sizeof(key));
+					cell->vertex = v;
+				}
+				// Else only through rounding at the cell edges. Vertex v is still
+				// kept, it just can't be matched by later vertexes.
+				match = v;
+				++uniqueCount;
+			}
+			remap[v] = match;
+		}
+	}
+
+	free(cells);
+	return uniqueCount;
+}
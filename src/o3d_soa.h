@@ -0,0 +1,80 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_soa.h
+ * Created on: 17/10/26
+ * Brief: Structure-of-arrays view of O3D vertex positions, for SIMD-friendly geometry processing.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_SOA_H
+#define DARKSTONE_O3D_SOA_H
+
+#include "o3d.h"
+
+/* ========================================================
+ * SoA vertex data:
+ * ======================================================== */
+
+/*
+ * Positions split in one array per axis. Each array is aligned to
+ * O3D_SOA_ALIGNMENT and padded to a multiple of O3D_SOA_WIDTH with
+ * copies of the last vertex, so kernels can always run full width
+ * without a scalar tail and the padding never changes the bounds.
+ */
+typedef struct o3d_vertex_soa {
+	float    * x;
+	float    * y;
+	float    * z;
+	void     * memBlock;     // Single allocation for the three arrays. Null if in an arena.
+	uint32_t   count;        // Real vertexes.
+	uint32_t   paddedCount;  // Array lengths.
+} o3d_vertex_soa_t;
+
+// 8 lanes (one AVX register, two SSE registers).
+enum {
+	O3D_SOA_WIDTH     = 8,
+	O3D_SOA_ALIGNMENT = 32
+};
+
+/* ========================================================
+ * SoA functions:
+ * ======================================================== */
+
+/*
+ * Splits `count` positions into a new SoA. The memory comes from `arena`
+ * if not null, in which case o3d_vertex_soa_free() is optional.
+ */
+bool o3d_vertex_soa_build(o3d_vertex_soa_t * soa, const o3d_vertex_t * vertexes, uint32_t count, o3d_arena_t * arena);
+
+/*
+ * Loads an O3D model and also splits its positions into `soa`,
+ * both allocated from `arena` if not null. See o3d_load_from_file_ex().
+ */
+bool o3d_load_from_file_soa(o3d_model_t * o3d, o3d_vertex_soa_t * soa, const char * filename, o3d_arena_t * arena);
+
+/*
+ * Frees the arrays, if they are not in an arena.
+ */
+void o3d_vertex_soa_free(o3d_vertex_soa_t * soa);
+
+/*
+ * AABB of all the positions. Undefined for an empty SoA.
+ */
+void o3d_vertex_soa_bounds(const o3d_vertex_soa_t * soa, o3d_aabb_t * aabb);
+
+/*
+ * Welds positions closer than `epsilon` on all axes (exact matches only if
+ * zero). remap[i] gets the index of the first vertex welded with vertex i,
+ * which is `i` itself for the ones kept. Returns the number of unique positions,
+ * or zero if out of memory. `remap` must hold `count` entries.
+ */
+uint32_t o3d_vertex_soa_weld(const o3d_vertex_soa_t * soa, float epsilon, uint32_t * remap);
+
+#endif // DARKSTONE_O3D_SOA_H
@@ -0,0 +1,188 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_testrig.c
+ * Created on: 17/10/26
+ * Brief: Procedural skeleton, skin and clip to exercise the animation runtime without game data.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_testrig.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+static const float TESTRIG_PI = 3.14159265358979323846f;
+
+/* ========================================================
+ * o3d_testrig_build_skeleton():
+ * ======================================================== */
+
+static int testrig_longest_axis(const o3d_aabb_t * aabb) {
+	const float ex = aabb->maxs.x - aabb->mins.x;
+	const float ey = aabb->maxs.y - aabb->mins.y;
+	const float ez = aabb->maxs.z - aabb->mins.z;
+	if (ex >= ey && ex >= ez) {
+		return 0;
+	}
+	return (ey >= ez) ? 1 : 2;
+}
+
+bool o3d_testrig_build_skeleton(o3d_skeleton_t * skeleton, const o3d_aabb_t * aabb, uint32_t jointCount) {
+	assert(skeleton != NULL);
+	assert(aabb     != NULL);
+
+	if (!o3d_skeleton_alloc(skeleton, jointCount)) {
+		return false;
+	}
+
+	const int axis = testrig_longest_axis(aabb);
+	const float mins[3] = { aabb->mins.x, aabb->mins.y, aabb->mins.z };
+	const float maxs[3] = { aabb->maxs.x, aabb->maxs.y, aabb->maxs.z };
+
+	for (uint32_t j = 0; j < jointCount; ++j) {
+		// Down the middle of the box, from one end to the other.
+		float pos[3];
+		for (int i = 0; i < 3; ++i) {
+			pos[i] = (mins[i] + maxs[i]) * 0.5f;
+		}
+		const float t = (jointCount > 1) ? ((float)j / (float)(jointCount - 1)) : 0.0f;
+		pos[axis] = mins[axis] + ((maxs[axis] - mins[axis]) * t);
+
+		skeleton->parents[j] = (int32_t)j - 1;
+		skeleton->bindPositions[j].x = pos[0];
+		skeleton->bindPositions[j].y = pos[1];
+		skeleton->bindPositions[j].z = pos[2];
+
+		// The bind pose has no rotations, so the inverse is just the negated position.
+		o3d_transform_identity(&skeleton->inverseBind[j]);
+		skeleton->inverseBind[j].m[0][3] = -pos[0];
+		skeleton->inverseBind[j].m[1][3] = -pos[1];
+		skeleton->inverseBind[j].m[2][3] = -pos[2];
+	}
+
+	return true;
+}
+
+/* ========================================================
+ * o3d_testrig_build_skin():
+ * ======================================================== */
+
+static inline float testrig_distance_sqr(const o3d_vertex_t * a, const o3d_vertex_t * b) {
+	const float dx = a->x - b->x;
+	const float dy = a->y - b->y;
+	const float dz = a->z - b->z;
+	return (dx * dx) + (dy * dy) + (dz * dz);
+}
+
+bool o3d_testrig_build_skin(o3d_skin_t * skin, const o3d_skeleton_t * skeleton,
+                            const o3d_vertex_t * positions, uint32_t vertexCount) {
+	assert(skin      != NULL);
+	assert(skeleton  != NULL);
+	assert(positions != NULL || vertexCount == 0);
+
+	if (skeleton->jointCount == 0) {
+		memset(skin, 0, sizeof(*skin));
+		return o3d_set_error("Nothing to skin!");
+	}
+	if (!o3d_skin_alloc(skin, positions, vertexCount)) {
+		return false;
+	}
+
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		uint32_t nearest[2] = { 0, 0 };
+		float    distSqr[2] = { FLT_MAX, FLT_MAX };
+
+		for (uint32_t j = 0; j < skeleton->jointCount; ++j) {
+			const float d = testrig_distance_sqr(&positions[v], &skeleton->bindPositions[j]);
+			if (d < distSqr[0]) {
+				nearest[1] = nearest[0];
+				distSqr[1] = distSqr[0];
+				nearest[0] = j;
+				distSqr[0] = d;
+			} else if (d < distSqr[1]) {
+				nearest[1] = j;
+				distSqr[1] = d;
+			}
+		}
+
+		o3d_skin_weights_t * w = &skin->weights[v];
+		memset(w, 0, sizeof(*w));
+		w->joints[0] = (uint8_t)nearest[0];
+		w->joints[1] = (uint8_t)nearest[1];
+
+		// Inverse distance: the closer joint gets the other's share.
+		if (skeleton->jointCount == 1) {
+			w->weights[0] = 1.0f;
+		} else {
+			const float d0 = sqrtf(distSqr[0]);
+			const float d1 = sqrtf(distSqr[1]);
+			w->weights[0] = ((d0 + d1) > 0.0f) ? (d1 / (d0 + d1)) : 1.0f;
+			w->weights[1] = 1.0f - w->weights[0];
+		}
+	}
+
+	return true;
+}
+
+/* ========================================================
+ * o3d_testrig_build_clip():
+ * ======================================================== */
+
+bool o3d_testrig_build_clip(o3d_anim_clip_t * clip, const o3d_skeleton_t * skeleton,
+                            float duration, uint32_t keyCount, float maxDegrees) {
+	assert(clip     != NULL);
+	assert(skeleton != NULL);
+
+	if (!(duration > 0.0f)) {
+		memset(clip, 0, sizeof(*clip));
+		return o3d_set_error("Bad animation clip duration!");
+	}
+
+	if (!o3d_anim_clip_alloc(clip, skeleton->jointCount, keyCount, (float)(keyCount - 1) / duration)) {
+		return false;
+	}
+
+	// Bend around the axis following the chain's, which is the longest of its box.
+	const o3d_vertex_t * first = &skeleton->bindPositions[0];
+	const o3d_vertex_t * last  = &skeleton->bindPositions[skeleton->jointCount - 1];
+	const float chain[3] = { fabsf(last->x - first->x), fabsf(last->y - first->y), fabsf(last->z - first->z) };
+	const int chainAxis = (chain[0] >= chain[1] && chain[0] >= chain[2]) ? 0 : ((chain[1] >= chain[2]) ? 1 : 2);
+	const int bendAxis  = (chainAxis + 1) % 3;
+
+	const float maxRadians = maxDegrees * (TESTRIG_PI / 180.0f);
+
+	for (uint32_t k = 0; k < keyCount; ++k) {
+		// Whole cycles over the clip, so the last key matches the first.
+		const float cycle = ((float)k / (float)(keyCount - 1)) * 2.0f * TESTRIG_PI;
+		const size_t base = (size_t)k * clip->paddedJointCount;
+
+		for (uint32_t j = 0; j < skeleton->jointCount; ++j) {
+			const float angle = maxRadians * sinf(cycle - ((float)j * 0.5f));
+			const float s = sinf(angle * 0.5f);
+			const float c = cosf(angle * 0.5f);
+
+			clip->keys.rotX[base + j] = (bendAxis == 0) ? s : 0.0f;
+			clip->keys.rotY[base + j] = (bendAxis == 1) ? s : 0.0f;
+			clip->keys.rotZ[base + j] = (bendAxis == 2) ? s : 0.0f;
+			clip->keys.rotW[base + j] = c;
+
+			// Bind offset from the parent, which has no rotation at the bind pose.
+			const int32_t parent = skeleton->parents[j];
+			const o3d_vertex_t * pos = &skeleton->bindPositions[j];
+			clip->keys.posX[base + j] = pos->x - ((parent >= 0) ? skeleton->bindPositions[parent].x : 0.0f);
+			clip->keys.posY[base + j] = pos->y - ((parent >= 0) ? skeleton->bindPositions[parent].y : 0.0f);
+			clip->keys.posZ[base + j] = pos->z - ((parent >= 0) ? skeleton->bindPositions[parent].z : 0.0f);
+		}
+	}
+
+	return true;
+}
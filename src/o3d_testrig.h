@@ -0,0 +1,53 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_testrig.h
+ * Created on: 17/10/26
+ * Brief: Procedural skeleton, skin and clip to exercise the animation runtime without game data.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_TESTRIG_H
+#define DARKSTONE_O3D_TESTRIG_H
+
+#include "o3d_anim.h"
+
+/* ========================================================
+ * Test rig:
+ *
+ * Stand-in for the .SKA/.B3D/.ANB loaders, which don't exist
+ * yet (see o3d_anim.h). Nothing here comes from the game: the
+ * rig is a chain of joints down the longest axis of a model,
+ * each vertex weighted to the nearest two, and a swaying loop
+ * to play on it. It's only meant for testing and measuring
+ * the animation runtime on the models we can read. Drop it
+ * once the real data loads.
+ * ======================================================== */
+
+/*
+ * Builds a chain of `jointCount` joints, each the parent of the next, evenly
+ * spaced along the longest axis of `aabb`, from its mins to its maxs.
+ */
+bool o3d_testrig_build_skeleton(o3d_skeleton_t * skeleton, const o3d_aabb_t * aabb, uint32_t jointCount);
+
+/*
+ * Binds each vertex to its two nearest joints, weighted by the inverse of the distance.
+ */
+bool o3d_testrig_build_skin(o3d_skin_t * skin, const o3d_skeleton_t * skeleton,
+                            const o3d_vertex_t * positions, uint32_t vertexCount);
+
+/*
+ * Swaying loop for a skeleton from o3d_testrig_build_skeleton(): every joint keeps
+ * its bind offset and bends around an axis perpendicular to the chain, by up to
+ * `maxDegrees`, with a phase lag down the chain. `keyCount` keys over `duration` seconds.
+ */
+bool o3d_testrig_build_clip(o3d_anim_clip_t * clip, const o3d_skeleton_t * skeleton,
+                            float duration, uint32_t keyCount, float maxDegrees);
+
+#endif // DARKSTONE_O3D_TESTRIG_H
@@ -0,0 +1,298 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_texcache.c
+ * Created on: 17/10/26
+ * Brief: Cache of textures cooked from the game's images, with precomputed mipmaps, BC1/BC3 or RGBA8.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_texcache.h"
+#include "image.h"
+#include "o3d.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { TEXCACHE_MAX_SIZE = 1 << (O3D_TEXCACHE_MAX_MIPS - 1) };
+
+/* ========================================================
+ * o3d_texcache_default_params() / o3d_texcache_level_size():
+ * ======================================================== */
+
+void o3d_texcache_default_params(o3d_texcache_params_t * params) {
+	assert(params != NULL);
+
+	params->format      = O3D_TEXCACHE_FORMAT_AUTO;
+	params->threadCount = 0;
+	params->alphaRef    = O3D_TEXCACHE_DEFAULT_ALPHA_REF;
+}
+
+size_t o3d_texcache_level_size(uint32_t format, uint32_t width, uint32_t height) {
+	if (format == O3D_TEXCACHE_FORMAT_RGBA8) {
+		return (size_t)width * height * 4;
+	}
+	return bc_image_size((bc_format_t)format, width, height);
+}
+
+/* ========================================================
+ * o3d_texcache_filename():
+ * ======================================================== */
+
+void o3d_texcache_filename(char * buffer, size_t bufferSize, const char * sourceFilename) {
+	assert(buffer != NULL && bufferSize != 0);
+	assert(sourceFilename != NULL);
+
+	snprintf(buffer, bufferSize, "%s%s", sourceFilename, O3D_TEXCACHE_EXTENSION);
+}
+
+/* ========================================================
+ * o3d_texcache_cook():
+ * ======================================================== */
+
+static uint32_t texcache_mip_dim(uint32_t size, uint32_t level) {
+	const uint32_t dim = size >> level;
+	return (dim != 0) ? dim : 1;
+}
+
+static double texcache_rmse(const uint8_t * a, const uint8_t * b, size_t byteCount) {
+	double sum = 0.0;
+	for (size_t i = 0; i < byteCount; ++i) {
+		const double diff = (double)a[i] - (double)b[i];
+		sum += diff * diff;
+	}
+	return sqrt(sum / (double)byteCount);
+}
+
+static bool texcache_write(const char * sourceFilename, const o3d_texcache_header_t * header,
+                           const uint8_t * levels, size_t levelsSize) {
+	char filename[1024];
+	o3d_texcache_filename(filename, sizeof(filename), sourceFilename);
+
+	FILE * fileOut = fopen(filename, "wb");
+	if (fileOut == NULL) {
+		return o3d_set_error("Can't open output O3TC file!");
+	}
+
+	bool success = fwrite(header, sizeof(*header), 1, fileOut) == 1;
+	success = success && fwrite(levels, 1, levelsSize, fileOut) == levelsSize;
+	success = (fclose(fileOut) == 0) && success;
+
+	if (!success) {
+		return o3d_set_error("Failed to write O3TC file data!");
+	}
+	return true;
+}
+
+// Compresses (or copies) one level and returns where the next one goes.
+static uint8_t * texcache_store_level(const o3d_texcache_params_t * params, uint32_t format,
+                                      const image_t * level, uint8_t * dest) {
+	if (format == O3D_TEXCACHE_FORMAT_RGBA8) {
+		memcpy(dest, level->pixels, (size_t)level->width * level->height * 4);
+	} else {
+		bc_encode_image((bc_format_t)format, level->pixels, level->width, level->height, dest, params->threadCount);
+	}
+	return dest + o3d_texcache_level_size(format, level->width, level->height);
+}
+
+bool o3d_texcache_cook(const char * sourceFilename, const o3d_texcache_params_t * params,
+                       o3d_texcache_stats_t * stats) {
+	assert(sourceFilename != NULL);
+
+	// Should be a static assert instead...
+	assert(sizeof(o3d_texcache_header_t) == 32);
+
+	o3d_texcache_params_t defaultParams;
+	if (params == NULL) {
+		o3d_texcache_default_params(&defaultParams);
+		params = &defaultParams;
+	}
+
+	o3d_texcache_header_t header;
+	memset(&header, 0, sizeof(header));
+
+	if (!file_get_info(sourceFilename, &header.sourceSize, &header.sourceTime)) {
+		return o3d_set_error("Can't find the source image file!");
+	}
+
+	image_t source;
+	if (!image_load_from_file(&source, sourceFilename)) {
+		return false;
+	}
+
+	if (source.width > TEXCACHE_MAX_SIZE || source.height > TEXCACHE_MAX_SIZE) {
+		image_free(&source);
+		return o3d_set_error("Image is too big to cook!");
+	}
+
+	uint32_t format = params->format;
+	if (format == O3D_TEXCACHE_FORMAT_AUTO) {
+		format = bc_image_has_alpha(source.pixels, source.width, source.height) ? BC_FORMAT_BC3 : BC_FORMAT_BC1;
+	} else if (format != BC_FORMAT_BC1 && format != BC_FORMAT_BC3 && format != O3D_TEXCACHE_FORMAT_RGBA8) {
+		image_free(&source);
+		return o3d_set_error("Bad cooked texture format!");
+	}
+
+	header.magic    = O3D_TEXCACHE_MAGIC;
+	header.version  = O3D_TEXCACHE_VERSION;
+	header.format   = (uint16_t)format;
+	header.width    = (uint16_t)source.width;
+	header.height   = (uint16_t)source.height;
+	header.mipCount = (uint16_t)image_mip_count(source.width, source.height);
+
+	image_t mips[O3D_TEXCACHE_MAX_MIPS];
+	if (!image_build_mips(mips, header.mipCount - 1, &source, params->alphaRef)) {
+		image_free(&source);
+		return false;
+	}
+
+	uint64_t rgbaBytes  = 0;
+	size_t   levelsSize = 0;
+	for (uint32_t m = 0; m < header.mipCount; ++m) {
+		const image_t * level = (m == 0) ? &source : &mips[m - 1];
+		levelsSize += o3d_texcache_level_size(format, level->width, level->height);
+		rgbaBytes  += (uint64_t)level->width * level->height * 4;
+	}
+
+	bool success = true;
+	uint8_t * levels = malloc(levelsSize);
+	if (levels == NULL) {
+		success = o3d_set_error("Unable to malloc cooked texture!");
+	}
+
+	double rmse = 0.0;
+	if (success) {
+		uint8_t * dest = levels;
+		for (uint32_t m = 0; m < header.mipCount; ++m) {
+			dest = texcache_store_level(params, format, (m == 0) ? &source : &mips[m - 1], dest);
+		}
+
+		// Error of the top level, which is what the compression costs up close.
+		if (format != O3D_TEXCACHE_FORMAT_RGBA8) {
+			const size_t byteCount = (size_t)source.width * source.height * 4;
+			uint8_t * decoded = malloc(byteCount);
+			if (decoded != NULL) {
+				bc_decode_image((bc_format_t)format, levels, source.width, source.height, decoded);
+				rmse = texcache_rmse(source.pixels, decoded, byteCount);
+				free(decoded);
+			}
+		}
+
+		success = texcache_write(sourceFilename, &header, levels, levelsSize);
+	}
+
+	if (success && stats != NULL) {
+		stats->format      = format;
+		stats->width       = header.width;
+		stats->height      = header.height;
+		stats->mipCount    = header.mipCount;
+		stats->rgbaBytes   = rgbaBytes;
+		stats->cookedBytes = sizeof(header) + levelsSize;
+		stats->rmse        = rmse;
+	}
+
+	for (uint32_t m = 0; m + 1 < header.mipCount; ++m) {
+		image_free(&mips[m]);
+	}
+	image_free(&source);
+	free(levels);
+	return success;
+}
+
+/* ========================================================
+ * o3d_texcache_open() / o3d_texcache_close():
+ * ======================================================== */
+
+bool o3d_texcache_open(o3d_texcache_image_t * image, const char * sourceFilename) {
+	assert(image != NULL);
+	assert(sourceFilename != NULL);
+
+	memset(image, 0, sizeof(*image));
+
+	uint64_t sourceSize;
+	int64_t  sourceTime;
+	if (!file_get_info(sourceFilename, &sourceSize, &sourceTime)) {
+		return o3d_set_error("Can't find the source image file!");
+	}
+
+	char filename[1024];
+	o3d_texcache_filename(filename, sizeof(filename), sourceFilename);
+
+	if (!file_map_open(&image->map, filename)) {
+		file_map_close(&image->map);
+		return o3d_set_error("Can't open input O3TC file!");
+	}
+
+	o3d_texcache_header_t header;
+	if (image->map.size < sizeof(header)) {
+		o3d_texcache_close(image);
+		return o3d_set_error("O3TC file is too small to have a header!");
+	}
+
+	memcpy(&header, image->map.data, sizeof(header));
+	if (header.magic != O3D_TEXCACHE_MAGIC || header.version != O3D_TEXCACHE_VERSION ||
+	   (header.format != BC_FORMAT_BC1 && header.format != BC_FORMAT_BC3 && header.format != O3D_TEXCACHE_FORMAT_RGBA8)) {
+		o3d_texcache_close(image);
+		return o3d_set_error("Not an O3TC file or unsupported version!");
+	}
+
+	if (header.sourceSize != sourceSize || header.sourceTime != sourceTime) {
+		o3d_texcache_close(image);
+		return o3d_set_error("Cooked texture is out of date!");
+	}
+
+	if (header.width == 0 || header.height == 0 ||
+	    header.mipCount != image_mip_count(header.width, header.height) ||
+	    header.mipCount > O3D_TEXCACHE_MAX_MIPS) {
+		o3d_texcache_close(image);
+		return o3d_set_error("Bad O3TC image dimensions!");
+	}
+
+	image->format   = header.format;
+	image->width    = header.width;
+	image->height   = header.height;
+	image->mipCount = header.mipCount;
+
+	uint64_t offset = sizeof(header);
+	for (uint32_t m = 0; m < image->mipCount; ++m) {
+		image->mips[m]     = image->map.data + offset;
+		image->mipSizes[m] = (uint32_t)o3d_texcache_level_size(image->format, texcache_mip_dim(image->width, m),
+		                                                       texcache_mip_dim(image->height, m));
+		offset += image->mipSizes[m];
+	}
+
+	if (offset != image->map.size) {
+		o3d_texcache_close(image);
+		return o3d_set_error("O3TC file size mismatch! File truncated?");
+	}
+	return true;
+}
+
+void o3d_texcache_close(o3d_texcache_image_t * image) {
+	if (image == NULL) {
+		return;
+	}
+
+	file_map_close(&image->map);
+	memset(image, 0, sizeof(*image));
+}
+
+/* ========================================================
+ * o3d_texcache_is_current():
+ * ======================================================== */
+
+bool o3d_texcache_is_current(const char * sourceFilename) {
+	o3d_texcache_image_t image;
+	const bool current = o3d_texcache_open(&image, sourceFilename);
+	o3d_texcache_close(&image);
+	return current;
+}
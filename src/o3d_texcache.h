@@ -0,0 +1,157 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_texcache.h
+ * Created on: 17/10/26
+ * Brief: Cache of textures cooked from the game's images, with precomputed mipmaps, BC1/BC3 or RGBA8.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_TEXCACHE_H
+#define DARKSTONE_O3D_TEXCACHE_H
+
+#include "bcn.h"
+#include "file_utils.h"
+
+/* ========================================================
+ * Cooked textures:
+ *
+ * Each source image gets a cooked copy next to it, named
+ * after it with an extra extension: "K0015_KNIGHT.TGA.O3TC".
+ * The copy has the whole mipmap chain, precomputed in linear
+ * space (see image_build_mips()), compressed to BC1, or BC3 if
+ * the image has any alpha, or kept as RGBA8. The levels are
+ * stored back to back, so once the file is mapped each one is
+ * passed as-is to glCompressedTexImage2D() or glTexImage2D(),
+ * with no decoding or mipmap generation at load time. Cooking
+ * runs entirely on the CPU, so it can be done offline, on
+ * machines without a GPU.
+ *
+ * The size and modification time of the source are saved
+ * in the header, so a source edited after cooking is noticed
+ * and the copy ignored until cooked again.
+ * ======================================================== */
+
+//
+// O3TC file, byte-order: LITTLE ENDIAN.
+//
+// +----------------------+
+// | o3d_texcache_header_t|
+// |----------------------|
+// | mip level 0          | <- o3d_texcache_level_size(format, width, height)
+// | mip level 1          | <- Half the size, down to 1x1.
+// | ...                  |
+// +----------------------+
+//
+
+#define O3D_TEXCACHE_MAGIC     0x4354334Fu // "O3TC" in file byte order.
+#define O3D_TEXCACHE_EXTENSION ".O3TC"
+
+enum {
+	O3D_TEXCACHE_VERSION      = 2,
+	O3D_TEXCACHE_MAX_MIPS     = 16,   // Up to 32768x32768.
+
+	// Formats, besides the BC_FORMAT_* ones:
+	O3D_TEXCACHE_FORMAT_AUTO  = 0,    // Only for cooking: BC3 if the image has alpha, BC1 otherwise.
+	O3D_TEXCACHE_FORMAT_RGBA8 = 8     // Uncompressed, for GLs without S3TC or lossless copies.
+};
+
+#define O3D_TEXCACHE_DEFAULT_ALPHA_REF 0.5f
+
+typedef struct o3d_texcache_header {
+	uint32_t magic;             // O3D_TEXCACHE_MAGIC
+	uint16_t version;           // O3D_TEXCACHE_VERSION
+	uint16_t format;            // bc_format_t or O3D_TEXCACHE_FORMAT_RGBA8
+	uint16_t width;             // Of level 0.
+	uint16_t height;
+	uint16_t mipCount;          // Full chain, down to 1x1.
+	uint16_t reserved;
+	uint64_t sourceSize;        // Of the source image file when cooked.
+	int64_t  sourceTime;        // Modification time of the source, in seconds.
+} o3d_texcache_header_t;
+
+/*
+ * Cooked texture mapped from its file. The levels point into the mapping.
+ */
+typedef struct o3d_texcache_image {
+	file_map_t      map;
+	uint32_t        format;     // bc_format_t or O3D_TEXCACHE_FORMAT_RGBA8
+	uint32_t        width;
+	uint32_t        height;
+	uint32_t        mipCount;
+	const uint8_t * mips[O3D_TEXCACHE_MAX_MIPS];
+	uint32_t        mipSizes[O3D_TEXCACHE_MAX_MIPS];
+} o3d_texcache_image_t;
+
+/*
+ * Cooking options.
+ */
+typedef struct o3d_texcache_params {
+	uint32_t format;            // bc_format_t, O3D_TEXCACHE_FORMAT_AUTO or O3D_TEXCACHE_FORMAT_RGBA8.
+	uint32_t threadCount;       // Threads compressing the blocks, 0 for all the CPUs.
+	float    alphaRef;          // Alpha test reference whose coverage the mipmaps keep. 0 to disable.
+} o3d_texcache_params_t;
+
+/*
+ * Results of cooking one texture, for reporting.
+ */
+typedef struct o3d_texcache_stats {
+	uint32_t    format;
+	uint32_t    width;
+	uint32_t    height;
+	uint32_t    mipCount;
+	uint64_t    rgbaBytes;      // Uncompressed RGBA8 size, mipmaps included.
+	uint64_t    cookedBytes;    // Cooked file size, mipmaps included.
+	double      rmse;           // Root mean squared error of level 0, over all 4 channels. 0 for RGBA8.
+} o3d_texcache_stats_t;
+
+/* ========================================================
+ * Texture cache functions:
+ * ======================================================== */
+
+/*
+ * Fills in the defaults: automatic format, all CPUs, O3D_TEXCACHE_DEFAULT_ALPHA_REF.
+ */
+void o3d_texcache_default_params(o3d_texcache_params_t * params);
+
+/*
+ * Size of one level: bc_image_size() for the BC formats, width * height * 4 for RGBA8.
+ */
+size_t o3d_texcache_level_size(uint32_t format, uint32_t width, uint32_t height);
+
+/*
+ * Name of the cooked copy of a source image: the source filename plus O3D_TEXCACHE_EXTENSION.
+ */
+void o3d_texcache_filename(char * buffer, size_t bufferSize, const char * sourceFilename);
+
+/*
+ * Loads the source image, builds the mipmaps, compresses them and writes
+ * the cooked copy. Null `params` for the defaults. `stats` may be null.
+ */
+bool o3d_texcache_cook(const char * sourceFilename, const o3d_texcache_params_t * params,
+                       o3d_texcache_stats_t * stats);
+
+/*
+ * True if the source image has a cooked copy that is up to date.
+ */
+bool o3d_texcache_is_current(const char * sourceFilename);
+
+/*
+ * Maps the cooked copy of a source image. Fails if there is none,
+ * it is invalid or the source changed after it was cooked.
+ * You can still call o3d_texcache_close() even if this fails.
+ */
+bool o3d_texcache_open(o3d_texcache_image_t * image, const char * sourceFilename);
+
+/*
+ * Unmaps the cooked texture and clears the struct.
+ */
+void o3d_texcache_close(o3d_texcache_image_t * image);
+
+#endif // DARKSTONE_O3D_TEXCACHE_H
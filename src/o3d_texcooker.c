@@ -0,0 +1,186 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_texcooker.c
+ * Created on: 17/10/26
+ * Brief: Command-line tool to cook the game textures (mipmaps, BC1/BC3) for the cooked texture cache.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "file_utils.h"
+#include "o3d.h"
+#include "o3d_texcache.h"
+#include "parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Command line options:
+ * ======================================================== */
+
+static struct {
+	o3d_texcache_params_t params;
+	bool                  cookAll; // Also the ones already up to date.
+	bool                  verbose;
+} options;
+
+static void print_usage(const char * progName) {
+	printf(
+		"\n"
+		"Usage:\n"
+		"$ %s [options] <tga_file | directory> [more files or directories...]\n"
+		"  Builds the mipmaps of each texture (in linear space, keeping the alpha test\n"
+		"  coverage), compresses them to BC1 (opaque) or BC3 (with alpha) and writes\n"
+		"  them next to the source as <name>" O3D_TEXCACHE_EXTENSION ".\n"
+		"  The viewer uploads these instead of the source images when they are up to date.\n"
+		"  Directories are scanned recursively for TGA files. No GPU is needed.\n"
+		"\n"
+		"Options:\n"
+		"  -f <fmt>  Force the format for all textures: bc1, bc3 or rgba8 (default picks per texture).\n"
+		"  -c <ref>  Alpha test reference whose coverage the mipmaps keep (default %.2f, 0 = off).\n"
+		"  -j <n>    Number of threads compressing the blocks (default is one per CPU).\n"
+		"  -a        Cook all the textures, even the ones already up to date.\n"
+		"  -v        Print the size and error of every texture cooked.\n"
+		"\n"
+		"Usage:\n"
+		"$ %s --help | -h\n"
+		"  Prints this help text.\n"
+		"\n",
+	progName, (double)O3D_TEXCACHE_DEFAULT_ALPHA_REF, progName);
+}
+
+static bool parse_format(const char * name, uint32_t * format) {
+	if (strcmp(name, "bc1") == 0) {
+		*format = BC_FORMAT_BC1;
+		return true;
+	}
+	if (strcmp(name, "bc3") == 0) {
+		*format = BC_FORMAT_BC3;
+		return true;
+	}
+	if (strcmp(name, "rgba8") == 0) {
+		*format = O3D_TEXCACHE_FORMAT_RGBA8;
+		return true;
+	}
+	return false;
+}
+
+static const char * format_name(uint32_t format) {
+	switch (format) {
+	case BC_FORMAT_BC1             : return "BC1";
+	case BC_FORMAT_BC3             : return "BC3";
+	case O3D_TEXCACHE_FORMAT_RGBA8 : return "RGBA8";
+	default                        : return "?";
+	} // switch (format)
+}
+
+/* ========================================================
+ * main():
+ * ======================================================== */
+
+int main(int argc, const char * argv[]) {
+	if (argc < 2) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Printing help is not treated as an error.
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+		print_usage(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	o3d_texcache_default_params(&options.params);
+	options.cookAll = false;
+	options.verbose = false;
+
+	file_list_t files;
+	memset(&files, 0, sizeof(files));
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-f") == 0 && (i + 1) < argc) {
+			if (!parse_format(argv[++i], &options.params.format)) {
+				fprintf(stderr, "Unknown format \"%s\"! Use bc1, bc3 or rgba8.\n", argv[i]);
+				file_list_free(&files);
+				return EXIT_FAILURE;
+			}
+		} else if (strcmp(argv[i], "-j") == 0 && (i + 1) < argc) {
+			const int count = atoi(argv[++i]);
+			options.params.threadCount = (count > 0) ? (uint32_t)count : 0;
+		} else if (strcmp(argv[i], "-c") == 0 && (i + 1) < argc) {
+			const double alphaRef = atof(argv[++i]);
+			options.params.alphaRef = (alphaRef > 0.0 && alphaRef < 1.0) ? (float)alphaRef : 0.0f;
+		} else if (strcmp(argv[i], "-a") == 0) {
+			options.cookAll = true;
+		} else if (strcmp(argv[i], "-v") == 0) {
+			options.verbose = true;
+		} else if (!file_list_add_path(&files, argv[i], ".TGA")) {
+			fprintf(stderr, "Can't read input path \"%s\"!\n", argv[i]);
+		}
+	}
+
+	if (files.count == 0) {
+		fprintf(stderr, "No textures to cook!\n");
+		file_list_free(&files);
+		return EXIT_FAILURE;
+	}
+	file_list_sort(&files);
+
+	// Files go one at a time, each one compressed by all the threads.
+	uint32_t cookedCount  = 0;
+	uint32_t skippedCount = 0;
+	uint32_t failedCount  = 0;
+	uint64_t rgbaBytes    = 0;
+	uint64_t cookedBytes  = 0;
+	uint32_t formatCounts[3] = { 0, 0, 0 };
+
+	const double startTime = clock_seconds();
+
+	for (uint32_t f = 0; f < files.count; ++f) {
+		const char * filename = files.paths[f];
+		if (!options.cookAll && o3d_texcache_is_current(filename)) {
+			skippedCount++;
+			continue;
+		}
+
+		o3d_texcache_stats_t stats;
+		if (!o3d_texcache_cook(filename, &options.params, &stats)) {
+			fprintf(stderr, "Failed to cook \"%s\": %s\n", filename, o3d_get_last_error());
+			failedCount++;
+			continue;
+		}
+
+		if (options.verbose) {
+			printf("%s: %s %ux%u, %u mips, %.1f KB -> %.1f KB, RMSE %.2f\n", filename, format_name(stats.format),
+			       stats.width, stats.height, stats.mipCount, (double)stats.rgbaBytes / 1024.0,
+			       (double)stats.cookedBytes / 1024.0, stats.rmse);
+		}
+
+		cookedCount++;
+		rgbaBytes   += stats.rgbaBytes;
+		cookedBytes += stats.cookedBytes;
+		formatCounts[(stats.format == BC_FORMAT_BC1) ? 0 : ((stats.format == BC_FORMAT_BC3) ? 1 : 2)]++;
+	}
+
+	const double endTime = clock_seconds();
+
+	printf("%u textures cooked (%u BC1, %u BC3, %u RGBA8), %u up to date, %u failed, in %.2f s with %u threads.\n",
+	       cookedCount, formatCounts[0], formatCounts[1], formatCounts[2], skippedCount, failedCount,
+	       endTime - startTime, (options.params.threadCount != 0) ? options.params.threadCount : parallel_cpu_count());
+	if (cookedCount != 0) {
+		printf("RGBA8 size: %.2f MB, cooked: %.2f MB (%.1f%%)\n",
+		       (double)rgbaBytes / (1024.0 * 1024.0), (double)cookedBytes / (1024.0 * 1024.0),
+		       ((double)cookedBytes / (double)rgbaBytes) * 100.0);
+	}
+
+	file_list_free(&files);
+	return (failedCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,462 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_texpack.c
+ * Created on: 17/10/26
+ * Brief: Packs the game textures into texture array layers and padded atlases, to cut texture binds.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_texpack.h"
+#include "file_utils.h"
+#include "o3d.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * o3d_texpack_build() helpers:
+ * ======================================================== */
+
+static int texpack_compare_size(const void * a, const void * b) {
+	const o3d_texpack_entry_t * ea = a;
+	const o3d_texpack_entry_t * eb = b;
+	if (ea->width  != eb->width)  { return (ea->width  < eb->width)  ? -1 : 1; }
+	if (ea->height != eb->height) { return (ea->height < eb->height) ? -1 : 1; }
+	return (int)ea->texNumber - (int)eb->texNumber;
+}
+
+// Tallest first, which is what keeps the shelves tight.
+static int texpack_compare_height(const void * a, const void * b) {
+	const o3d_texpack_entry_t * ea = a;
+	const o3d_texpack_entry_t * eb = b;
+	if (ea->height != eb->height) { return (ea->height > eb->height) ? -1 : 1; }
+	if (ea->width  != eb->width)  { return (ea->width  > eb->width)  ? -1 : 1; }
+	return (int)ea->texNumber - (int)eb->texNumber;
+}
+
+static int texpack_compare_tex_number(const void * a, const void * b) {
+	const o3d_texpack_entry_t * ea = a;
+	const o3d_texpack_entry_t * eb = b;
+	return (int)ea->texNumber - (int)eb->texNumber;
+}
+
+static o3d_texpack_page_t * texpack_new_page(o3d_texpack_t * pack, uint32_t width, uint32_t height, uint16_t flags) {
+	o3d_texpack_page_t * page = &pack->pages[pack->pageCount++];
+	page->width      = (uint16_t)width;
+	page->height     = (uint16_t)height;
+	page->layerCount = 1;
+	page->flags      = flags;
+	return page;
+}
+
+/*
+ * Shelf packing of the textures left out of the array pages. Every
+ * page gets the same square size, except when the atlas fits in a
+ * single layer, which is then cropped to the area used.
+ */
+static void texpack_build_atlases(o3d_texpack_t * pack, o3d_texpack_entry_t * items, uint32_t itemCount,
+                                  const o3d_texpack_params_t * params) {
+	qsort(items, itemCount, sizeof(*items), &texpack_compare_height);
+
+	const uint32_t pad  = params->padding;
+	const uint32_t size = params->atlasSize;
+
+	o3d_texpack_page_t * page = NULL;
+	uint32_t shelfX = 0;
+	uint32_t shelfY = 0;
+	uint32_t shelfHeight = 0;
+	uint32_t usedWidth = 0;
+
+	for (uint32_t i = 0; i < itemCount; ++i) {
+		const uint32_t itemWidth  = items[i].width  + (pad * 2);
+		const uint32_t itemHeight = items[i].height + (pad * 2);
+
+		if (shelfX + itemWidth > size) {
+			shelfY += shelfHeight;
+			shelfX = 0;
+			shelfHeight = 0;
+		}
+		if (page == NULL || shelfY + itemHeight > size) {
+			if (page == NULL || page->layerCount == params->maxLayers) {
+				page = texpack_new_page(pack, size, size, O3D_TEXPACK_PAGE_ATLAS);
+			} else {
+				page->layerCount++;
+			}
+			shelfX = 0;
+			shelfY = 0;
+			shelfHeight = 0;
+			usedWidth = 0;
+		}
+
+		items[i].page  = (uint16_t)(page - pack->pages);
+		items[i].layer = (uint16_t)(page->layerCount - 1);
+		items[i].x     = (uint16_t)(shelfX + pad);
+		items[i].y     = (uint16_t)(shelfY + pad);
+
+		shelfX += itemWidth;
+		shelfHeight = (itemHeight > shelfHeight) ? itemHeight : shelfHeight;
+		usedWidth = (shelfX > usedWidth) ? shelfX : usedWidth;
+	}
+
+	// Only the last page can have room left. Rounded up to 4 texels, to keep the rows aligned for the uploads.
+	if (page != NULL && page->layerCount == 1) {
+		page->width  = (uint16_t)((usedWidth + 3) & ~3u);
+		page->height = (uint16_t)((shelfY + shelfHeight + 3) & ~3u);
+	}
+}
+
+/* ========================================================
+ * o3d_texpack_default_params():
+ * ======================================================== */
+
+void o3d_texpack_default_params(o3d_texpack_params_t * params) {
+	assert(params != NULL);
+	params->atlasSize      = O3D_TEXPACK_DEFAULT_ATLAS_SIZE;
+	params->padding        = O3D_TEXPACK_DEFAULT_PADDING;
+	params->minArrayLayers = O3D_TEXPACK_DEFAULT_MIN_LAYERS;
+	params->maxLayers      = O3D_TEXPACK_MAX_LAYERS;
+}
+
+/* ========================================================
+ * o3d_texpack_build():
+ * ======================================================== */
+
+bool o3d_texpack_build(o3d_texpack_t * pack, const o3d_texpack_entry_t * textures,
+                       uint32_t textureCount, const o3d_texpack_params_t * params) {
+	assert(pack != NULL);
+	assert(textures != NULL || textureCount == 0);
+
+	memset(pack, 0, sizeof(*pack));
+
+	o3d_texpack_params_t defaults;
+	if (params == NULL) {
+		o3d_texpack_default_params(&defaults);
+		params = &defaults;
+	}
+
+	if (params->atlasSize == 0 || params->atlasSize > O3D_TEXPACK_MAX_SIZE ||
+	    params->padding * 2 >= params->atlasSize ||
+	    params->maxLayers == 0 || params->maxLayers > UINT16_MAX) {
+		return o3d_set_error("Bad texture pack parameters!");
+	}
+	if (textureCount == 0) {
+		return o3d_set_error("No textures to pack!");
+	}
+
+	for (uint32_t t = 0; t < textureCount; ++t) {
+		if (textures[t].width == 0 || textures[t].height == 0 ||
+		    textures[t].width > O3D_TEXPACK_MAX_SIZE || textures[t].height > O3D_TEXPACK_MAX_SIZE) {
+			return o3d_set_error("Bad texture size for packing!");
+		}
+	}
+
+	// Every page holds at least one texture, so that is also the most pages there can be.
+	pack->entries = malloc(textureCount * sizeof(o3d_texpack_entry_t));
+	pack->pages   = malloc(textureCount * sizeof(o3d_texpack_page_t));
+	o3d_texpack_entry_t * atlasItems = malloc(textureCount * sizeof(o3d_texpack_entry_t));
+
+	if (pack->entries == NULL || pack->pages == NULL || atlasItems == NULL) {
+		free(atlasItems);
+		o3d_texpack_free(pack);
+		return o3d_set_error("Unable to malloc texture pack!");
+	}
+
+	o3d_texpack_entry_t * sorted = pack->entries;
+	for (uint32_t t = 0; t < textureCount; ++t) {
+		sorted[t] = textures[t];
+		sorted[t].page = sorted[t].layer = sorted[t].x = sorted[t].y = sorted[t].reserved = 0;
+	}
+	qsort(sorted, textureCount, sizeof(*sorted), &texpack_compare_size);
+
+	pack->padding = params->padding;
+	uint32_t atlasItemCount = 0;
+	uint32_t entryCount = 0;
+
+	// Runs of the same size become array pages, one texture per layer.
+	// Textures too big for the atlas get arrays too, even if alone.
+	// Entries are written over the sorted inputs, never ahead of the one being read.
+	for (uint32_t first = 0; first < textureCount;) {
+		const uint32_t width  = sorted[first].width;
+		const uint32_t height = sorted[first].height;
+
+		uint32_t last = first + 1;
+		while (last < textureCount && sorted[last].width == width && sorted[last].height == height) {
+			++last;
+		}
+
+		const bool tooBig = (width + params->padding * 2 > params->atlasSize) ||
+		                    (height + params->padding * 2 > params->atlasSize);
+
+		if ((last - first) >= params->minArrayLayers || tooBig) {
+			o3d_texpack_page_t * page = NULL;
+			for (uint32_t t = first; t < last; ++t) {
+				if (page == NULL || page->layerCount == params->maxLayers) {
+					page = texpack_new_page(pack, width, height, 0);
+				} else {
+					page->layerCount++;
+				}
+				o3d_texpack_entry_t * entry = &pack->entries[entryCount++];
+				*entry = sorted[t];
+				entry->page  = (uint16_t)(page - pack->pages);
+				entry->layer = (uint16_t)(page->layerCount - 1);
+			}
+		} else {
+			memcpy(&atlasItems[atlasItemCount], &sorted[first], (last - first) * sizeof(o3d_texpack_entry_t));
+			atlasItemCount += (last - first);
+		}
+		first = last;
+	}
+
+	texpack_build_atlases(pack, atlasItems, atlasItemCount, params);
+	memcpy(&pack->entries[entryCount], atlasItems, atlasItemCount * sizeof(o3d_texpack_entry_t));
+	entryCount += atlasItemCount;
+	free(atlasItems);
+
+	assert(entryCount == textureCount);
+	pack->entryCount = entryCount;
+	qsort(pack->entries, entryCount, sizeof(o3d_texpack_entry_t), &texpack_compare_tex_number);
+
+	for (uint32_t e = 1; e < entryCount; ++e) {
+		if (pack->entries[e].texNumber == pack->entries[e - 1].texNumber) {
+			o3d_texpack_free(pack);
+			return o3d_set_error("Duplicate texNumber in the textures to pack!");
+		}
+	}
+	return true;
+}
+
+void o3d_texpack_free(o3d_texpack_t * pack) {
+	if (pack == NULL) {
+		return;
+	}
+
+	free(pack->pages);
+	free(pack->entries);
+	memset(pack, 0, sizeof(*pack));
+}
+
+/* ========================================================
+ * o3d_texpack_find() / o3d_texpack_remap_uv():
+ * ======================================================== */
+
+const o3d_texpack_entry_t * o3d_texpack_find(const o3d_texpack_t * pack, uint32_t texNumber) {
+	assert(pack != NULL);
+
+	if (texNumber > UINT16_MAX || pack->entryCount == 0) {
+		return NULL;
+	}
+
+	o3d_texpack_entry_t key;
+	memset(&key, 0, sizeof(key));
+	key.texNumber = (uint16_t)texNumber;
+	return bsearch(&key, pack->entries, pack->entryCount, sizeof(key), &texpack_compare_tex_number);
+}
+
+void o3d_texpack_remap_uv(const o3d_texpack_t * pack, const o3d_texpack_entry_t * entry, float * u, float * v) {
+	assert(pack != NULL && entry != NULL);
+	assert(u != NULL && v != NULL);
+
+	const o3d_texpack_page_t * page = &pack->pages[entry->page];
+
+	// Back to texels of the source texture.
+	float texelU = *u / O3D_TEXCOORD_SCALE;
+	float texelV = *v / O3D_TEXCOORD_SCALE;
+
+	// Past the outermost texel centers, clamp to edge samples just the edge.
+	// In an atlas that has to be done here, or the neighbors would show.
+	if (page->flags & O3D_TEXPACK_PAGE_ATLAS) {
+		const float maxU = (float)entry->width  - 0.5f;
+		const float maxV = (float)entry->height - 0.5f;
+		texelU = (texelU < 0.5f) ? 0.5f : ((texelU > maxU) ? maxU : texelU);
+		texelV = (texelV < 0.5f) ? 0.5f : ((texelV > maxV) ? maxV : texelV);
+	}
+
+	*u = ((float)entry->x + texelU) / (float)page->width;
+	*v = ((float)entry->y + texelV) / (float)page->height;
+}
+
+/* ========================================================
+ * o3d_texpack_blit():
+ * ======================================================== */
+
+bool o3d_texpack_blit(const o3d_texpack_t * pack, const o3d_texpack_entry_t * entry,
+                      const image_t * image, uint8_t * layerPixels) {
+	assert(pack != NULL && entry != NULL);
+	assert(image != NULL && layerPixels != NULL);
+
+	if (image->width != entry->width || image->height != entry->height) {
+		return o3d_set_error("Texture size doesn't match the pack layout!");
+	}
+
+	const o3d_texpack_page_t * page = &pack->pages[entry->page];
+	const int32_t pad    = (page->flags & O3D_TEXPACK_PAGE_ATLAS) ? (int32_t)pack->padding : 0;
+	const int32_t width  = (int32_t)entry->width;
+	const int32_t height = (int32_t)entry->height;
+
+	// The padding repeats the edge texels, rows and columns.
+	for (int32_t y = -pad; y < height + pad; ++y) {
+		const int32_t srcY = (y < 0) ? 0 : ((y >= height) ? (height - 1) : y);
+		const uint8_t * src = image->pixels + ((size_t)srcY * (size_t)width * 4);
+		uint8_t * dest = layerPixels + ((((size_t)(entry->y + y) * page->width) + (size_t)(entry->x - pad)) * 4);
+
+		for (int32_t x = 0; x < pad; ++x, dest += 4) {
+			memcpy(dest, src, 4);
+		}
+		memcpy(dest, src, (size_t)width * 4);
+		dest += (size_t)width * 4;
+		for (int32_t x = 0; x < pad; ++x, dest += 4) {
+			memcpy(dest, src + ((size_t)(width - 1) * 4), 4);
+		}
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3d_texpack_write_file() / o3d_texpack_load_file():
+ * ======================================================== */
+
+bool o3d_texpack_write_file(const o3d_texpack_t * pack, const char * filename) {
+	assert(pack != NULL);
+	assert(filename != NULL && *filename != '\0');
+
+	// Should be static asserts instead...
+	assert(sizeof(o3d_texpack_header_t) == 16);
+	assert(sizeof(o3d_texpack_page_t)   == 8);
+	assert(sizeof(o3d_texpack_entry_t)  == 16);
+
+	o3d_texpack_header_t header;
+	memset(&header, 0, sizeof(header));
+
+	header.magic      = O3D_TEXPACK_MAGIC;
+	header.version    = O3D_TEXPACK_VERSION;
+	header.padding    = (uint16_t)pack->padding;
+	header.pageCount  = pack->pageCount;
+	header.entryCount = pack->entryCount;
+
+	FILE * fileOut = fopen(filename, "wb");
+	if (fileOut == NULL) {
+		return o3d_set_error("Can't open output O3TP file!");
+	}
+
+	bool success = fwrite(&header, sizeof(header), 1, fileOut) == 1;
+	success = success && fwrite(pack->pages, sizeof(o3d_texpack_page_t), pack->pageCount, fileOut) == pack->pageCount;
+	success = success && fwrite(pack->entries, sizeof(o3d_texpack_entry_t), pack->entryCount, fileOut) == pack->entryCount;
+	success = (fclose(fileOut) == 0) && success;
+
+	if (!success) {
+		return o3d_set_error("Failed to write O3TP file data!");
+	}
+	return true;
+}
+
+static bool texpack_validate(const o3d_texpack_t * pack) {
+	for (uint32_t p = 0; p < pack->pageCount; ++p) {
+		const o3d_texpack_page_t * page = &pack->pages[p];
+		if (page->width == 0 || page->height == 0 || page->layerCount == 0 ||
+		    page->width > O3D_TEXPACK_MAX_SIZE || page->height > O3D_TEXPACK_MAX_SIZE) {
+			return false;
+		}
+	}
+
+	for (uint32_t e = 0; e < pack->entryCount; ++e) {
+		const o3d_texpack_entry_t * entry = &pack->entries[e];
+		if (e != 0 && entry->texNumber <= pack->entries[e - 1].texNumber) {
+			return false;
+		}
+		if (entry->page >= pack->pageCount || entry->width == 0 || entry->height == 0) {
+			return false;
+		}
+
+		const o3d_texpack_page_t * page = &pack->pages[entry->page];
+		const uint32_t pad = (page->flags & O3D_TEXPACK_PAGE_ATLAS) ? pack->padding : 0;
+		if (entry->layer >= page->layerCount || entry->x < pad || entry->y < pad ||
+		    (uint32_t)entry->x + entry->width  + pad > page->width ||
+		    (uint32_t)entry->y + entry->height + pad > page->height) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool o3d_texpack_load_file(o3d_texpack_t * pack, const char * filename) {
+	assert(pack != NULL);
+	assert(filename != NULL && *filename != '\0');
+
+	memset(pack, 0, sizeof(*pack));
+
+	file_map_t map;
+	if (!file_map_open(&map, filename)) {
+		file_map_close(&map);
+		return o3d_set_error("Can't open input O3TP file!");
+	}
+
+	o3d_texpack_header_t header;
+	if (map.size < sizeof(header)) {
+		file_map_close(&map);
+		return o3d_set_error("O3TP file is too small to have a header!");
+	}
+
+	memcpy(&header, map.data, sizeof(header));
+	if (header.magic != O3D_TEXPACK_MAGIC || header.version != O3D_TEXPACK_VERSION) {
+		file_map_close(&map);
+		return o3d_set_error("Not an O3TP file or unsupported version!");
+	}
+
+	const uint64_t pagesSize   = (uint64_t)header.pageCount  * sizeof(o3d_texpack_page_t);
+	const uint64_t entriesSize = (uint64_t)header.entryCount * sizeof(o3d_texpack_entry_t);
+	if (header.pageCount == 0 || header.entryCount == 0 || sizeof(header) + pagesSize + entriesSize != map.size) {
+		file_map_close(&map);
+		return o3d_set_error("O3TP file size mismatch! File truncated?");
+	}
+
+	pack->pages   = malloc((size_t)pagesSize);
+	pack->entries = malloc((size_t)entriesSize);
+	if (pack->pages == NULL || pack->entries == NULL) {
+		file_map_close(&map);
+		o3d_texpack_free(pack);
+		return o3d_set_error("Unable to malloc texture pack!");
+	}
+
+	memcpy(pack->pages,   map.data + sizeof(header), (size_t)pagesSize);
+	memcpy(pack->entries, map.data + sizeof(header) + pagesSize, (size_t)entriesSize);
+	pack->pageCount  = header.pageCount;
+	pack->entryCount = header.entryCount;
+	pack->padding    = header.padding;
+	file_map_close(&map);
+
+	if (!texpack_validate(pack)) {
+		o3d_texpack_free(pack);
+		return o3d_set_error("Bad O3TP page or entry!");
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3d_texpack_layer_filename():
+ * ======================================================== */
+
+void o3d_texpack_layer_filename(char * buffer, size_t bufferSize, const char * layoutFilename,
+                                uint32_t page, uint32_t layer) {
+	assert(buffer != NULL && bufferSize != 0);
+	assert(layoutFilename != NULL);
+
+	// Drop the extension, if the last path component has one.
+	const char * dot = strrchr(layoutFilename, '.');
+	const char * slash = strrchr(layoutFilename, '/');
+	const char * backslash = strrchr(layoutFilename, '\\');
+	if (backslash > slash) {
+		slash = backslash;
+	}
+
+	const size_t baseLen = (dot != NULL && dot > slash) ? (size_t)(dot - layoutFilename) : strlen(layoutFilename);
+	snprintf(buffer, bufferSize, "%.*s_P%u_L%u.PNG", (int)baseLen, layoutFilename, page, layer);
+}
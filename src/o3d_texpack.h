@@ -0,0 +1,176 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_texpack.h
+ * Created on: 17/10/26
+ * Brief: Packs the game textures into texture array layers and padded atlases, to cut texture binds.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_TEXPACK_H
+#define DARKSTONE_O3D_TEXPACK_H
+
+#include "image.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ========================================================
+ * Texture pack layout:
+ *
+ * Textures are placed in pages, each page being one texture
+ * array (GL_TEXTURE_2D_ARRAY) with layers of the same size.
+ * Sizes shared by enough textures get array pages with one
+ * texture per layer. The rest are shelf packed into atlas
+ * pages, each texture with a border of replicated edge texels
+ * around it, so filtering and the first mipmaps don't bleed
+ * the neighbors in. A level can then be drawn binding each
+ * page once, selecting the layer per draw.
+ *
+ * O3D texture coordinates are texels of the texture they
+ * map (see o3d_face_t::texCoords), which is usually but not
+ * always 256x256. The layout keeps the real size of every
+ * texture, so the UVs are remapped with the right scale.
+ * ======================================================== */
+
+//
+// O3TP file, byte-order: LITTLE ENDIAN.
+//
+// +-----------------------+
+// | o3d_texpack_header_t  |
+// |-----------------------|
+// | o3d_texpack_page_t[]  | <- header.pageCount
+// |-----------------------|
+// | o3d_texpack_entry_t[] | <- header.entryCount, ascending texNumber.
+// +-----------------------+
+//
+// The pixels of each page layer are saved next to it, as
+// PNG images. See o3d_texpack_layer_filename().
+//
+
+#define O3D_TEXPACK_MAGIC 0x5054334Fu // "O3TP" in file byte order.
+
+enum {
+	O3D_TEXPACK_VERSION            = 1,
+	O3D_TEXPACK_DEFAULT_ATLAS_SIZE = 1024,
+	O3D_TEXPACK_DEFAULT_PADDING    = 4,
+	O3D_TEXPACK_DEFAULT_MIN_LAYERS = 2,
+	O3D_TEXPACK_MAX_LAYERS         = 256,   // Minimum GL_MAX_ARRAY_TEXTURE_LAYERS of GL 3.
+	O3D_TEXPACK_MAX_SIZE           = 8192,  // Largest page side.
+
+	// Set for atlas pages. Their entries are clamped and have padding.
+	O3D_TEXPACK_PAGE_ATLAS         = 1 << 0
+};
+
+typedef struct o3d_texpack_header {
+	uint32_t magic;             // O3D_TEXPACK_MAGIC
+	uint16_t version;           // O3D_TEXPACK_VERSION
+	uint16_t padding;           // Border of the atlas entries, in texels.
+	uint32_t pageCount;
+	uint32_t entryCount;
+} o3d_texpack_header_t;
+
+typedef struct o3d_texpack_page {
+	uint16_t width;             // Size of every layer.
+	uint16_t height;
+	uint16_t layerCount;
+	uint16_t flags;             // O3D_TEXPACK_PAGE_*
+} o3d_texpack_page_t;
+
+typedef struct o3d_texpack_entry {
+	uint16_t texNumber;         // See o3d_face_t::texNumber.
+	uint16_t page;
+	uint16_t layer;
+	uint16_t x;                 // Top-left texel in the layer, inside the padding.
+	uint16_t y;
+	uint16_t width;             // Size of the source texture.
+	uint16_t height;
+	uint16_t reserved;
+} o3d_texpack_entry_t;
+
+/*
+ * A layout, either built or loaded from an O3TP file.
+ */
+typedef struct o3d_texpack {
+	o3d_texpack_page_t  * pages;
+	o3d_texpack_entry_t * entries;    // Ascending texNumber.
+	uint32_t              pageCount;
+	uint32_t              entryCount;
+	uint32_t              padding;
+} o3d_texpack_t;
+
+typedef struct o3d_texpack_params {
+	uint32_t atlasSize;         // Side of the atlas pages. Bigger textures get their own page.
+	uint32_t padding;           // Border around each atlas entry.
+	uint32_t minArrayLayers;    // Sizes with at least this many textures get array pages.
+	uint32_t maxLayers;         // Pages are split when reaching this many layers.
+} o3d_texpack_params_t;
+
+/* ========================================================
+ * Texture pack functions:
+ * ======================================================== */
+
+/*
+ * Fills in the O3D_TEXPACK_DEFAULT_* parameters.
+ */
+void o3d_texpack_default_params(o3d_texpack_params_t * params);
+
+/*
+ * Computes the layout. Only texNumber, width and height of the `textures`
+ * are used; texNumbers must be unique. Null `params` for the defaults.
+ * You can still call o3d_texpack_free() even if this fails.
+ */
+bool o3d_texpack_build(o3d_texpack_t * pack, const o3d_texpack_entry_t * textures,
+                       uint32_t textureCount, const o3d_texpack_params_t * params);
+
+/*
+ * Frees the layout and clears the struct.
+ */
+void o3d_texpack_free(o3d_texpack_t * pack);
+
+/*
+ * Entry of a texNumber, or null if it isn't in the pack.
+ */
+const o3d_texpack_entry_t * o3d_texpack_find(const o3d_texpack_t * pack, uint32_t texNumber);
+
+/*
+ * Maps a mesh UV (scaled by O3D_TEXCOORD_SCALE, see o3d_mesh_vertex_t)
+ * of the entry's texture to the page layer. Atlas UVs are clamped to
+ * the texture, same as the GL_CLAMP_TO_EDGE the viewer uses.
+ */
+void o3d_texpack_remap_uv(const o3d_texpack_t * pack, const o3d_texpack_entry_t * entry, float * u, float * v);
+
+/*
+ * Copies the entry's texture, RGBA like image_t, into its place in
+ * `layerPixels` (the page width * height * 4 bytes of the entry's layer),
+ * filling the padding around it. Fails if the image size doesn't match.
+ */
+bool o3d_texpack_blit(const o3d_texpack_t * pack, const o3d_texpack_entry_t * entry,
+                      const image_t * image, uint8_t * layerPixels);
+
+/*
+ * Writes the layout to an O3TP file. The layer images are written separately.
+ */
+bool o3d_texpack_write_file(const o3d_texpack_t * pack, const char * filename);
+
+/*
+ * Loads and validates an O3TP file.
+ * You can still call o3d_texpack_free() even if this fails.
+ */
+bool o3d_texpack_load_file(o3d_texpack_t * pack, const char * filename);
+
+/*
+ * Name of the PNG image of a page layer, which is the layout
+ * filename without extension plus the indexes: "LEVEL1_P0_L3.PNG".
+ */
+void o3d_texpack_layer_filename(char * buffer, size_t bufferSize, const char * layoutFilename,
+                                uint32_t page, uint32_t layer);
+
+#endif // DARKSTONE_O3D_TEXPACK_H
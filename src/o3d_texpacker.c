@@ -0,0 +1,247 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_texpacker.c
+ * Created on: 17/10/26
+ * Brief: Command-line tool to pack the game textures into texture arrays and atlases.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "file_utils.h"
+#include "image.h"
+#include "o3d.h"
+#include "o3d_texpack.h"
+#include "o3d_texreg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * Command line options:
+ * ======================================================== */
+
+enum { MAX_PATH_LEN = 1024 };
+
+static struct {
+	o3d_texpack_params_t params;
+	o3d_texreg_variant_t variant;
+	bool                 verbose;
+} options;
+
+static void print_usage(const char * progName) {
+	printf(
+		"\n"
+		"Usage:\n"
+		"$ %s [options] <texture_dir> <layout.O3TP>\n"
+		"  Packs the textures found in the directory (the Kxyzw_/Rxyzw_ TGAs)\n"
+		"  into texture array pages, one texture per layer for the sizes shared\n"
+		"  by several of them, and padded atlases for the rest. Writes the layout\n"
+		"  and a PNG image of every page layer next to it (LAYOUT_P<n>_L<n>.PNG).\n"
+		"  Cook with 'o3d_cooker -w -t <layout>' to get the matching UVs, or\n"
+		"  view with 'o3d_viewer --texpack <layout>'.\n"
+		"\n"
+		"Options:\n"
+		"  -a <n>  Atlas page size (default %d).\n"
+		"  -p <n>  Padding around each atlas texture, in texels (default %d).\n"
+		"  -m <n>  Textures of the same size needed for an array page (default %d).\n"
+		"  -r      Prefer the R textures when both variants exist (default is K).\n"
+		"  -v      Print where every texture was placed.\n"
+		"\n"
+		"Usage:\n"
+		"$ %s --help | -h\n"
+		"  Prints this help text.\n"
+		"\n",
+	progName, O3D_TEXPACK_DEFAULT_ATLAS_SIZE, O3D_TEXPACK_DEFAULT_PADDING,
+	O3D_TEXPACK_DEFAULT_MIN_LAYERS, progName);
+}
+
+/* ========================================================
+ * write_layer_images():
+ * ======================================================== */
+
+// `images` are indexed like the pack entries.
+static bool write_layer_images(const o3d_texpack_t * pack, const image_t * images, const char * layoutFilename) {
+	for (uint32_t p = 0; p < pack->pageCount; ++p) {
+		const o3d_texpack_page_t * page = &pack->pages[p];
+		const size_t layerSize = (size_t)page->width * page->height * 4;
+
+		// Unused atlas areas are left transparent black.
+		uint8_t * layerPixels = malloc(layerSize);
+		if (layerPixels == NULL) {
+			fprintf(stderr, "Out of memory!\n");
+			return false;
+		}
+
+		for (uint32_t l = 0; l < page->layerCount; ++l) {
+			memset(layerPixels, 0, layerSize);
+
+			for (uint32_t e = 0; e < pack->entryCount; ++e) {
+				const o3d_texpack_entry_t * entry = &pack->entries[e];
+				if (entry->page == p && entry->layer == l && !o3d_texpack_blit(pack, entry, &images[e], layerPixels)) {
+					fprintf(stderr, "Texture %04u: %s\n", entry->texNumber, o3d_get_last_error());
+				}
+			}
+
+			char imageFilename[MAX_PATH_LEN];
+			o3d_texpack_layer_filename(imageFilename, sizeof(imageFilename), layoutFilename, p, l);
+
+			if (!image_write_png(imageFilename, layerPixels, page->width, page->height)) {
+				fprintf(stderr, "Failed to write \"%s\": %s\n", imageFilename, o3d_get_last_error());
+				free(layerPixels);
+				return false;
+			}
+		}
+		free(layerPixels);
+	}
+	return true;
+}
+
+/* ========================================================
+ * main():
+ * ======================================================== */
+
+int main(int argc, const char * argv[]) {
+	if (argc < 2) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Printing help is not treated as an error.
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+		print_usage(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	o3d_texpack_default_params(&options.params);
+	options.variant = O3D_TEXREG_K;
+	options.verbose = false;
+
+	const char * textureDir     = NULL;
+	const char * layoutFilename = NULL;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-a") == 0 && (i + 1) < argc) {
+			const int size = atoi(argv[++i]);
+			options.params.atlasSize = (size > 0) ? (uint32_t)size : O3D_TEXPACK_DEFAULT_ATLAS_SIZE;
+		} else if (strcmp(argv[i], "-p") == 0 && (i + 1) < argc) {
+			const int padding = atoi(argv[++i]);
+			options.params.padding = (padding > 0) ? (uint32_t)padding : 0;
+		} else if (strcmp(argv[i], "-m") == 0 && (i + 1) < argc) {
+			const int count = atoi(argv[++i]);
+			options.params.minArrayLayers = (count > 0) ? (uint32_t)count : 1;
+		} else if (strcmp(argv[i], "-r") == 0) {
+			options.variant = O3D_TEXREG_R;
+		} else if (strcmp(argv[i], "-v") == 0) {
+			options.verbose = true;
+		} else if (textureDir == NULL) {
+			textureDir = argv[i];
+		} else if (layoutFilename == NULL) {
+			layoutFilename = argv[i];
+		} else {
+			fprintf(stderr, "Ignoring extra argument \"%s\".\n", argv[i]);
+		}
+	}
+
+	if (textureDir == NULL || layoutFilename == NULL) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	o3d_texreg_t registry;
+	o3d_texreg_init(&registry);
+	if (!o3d_texreg_build_from_directory(&registry, textureDir)) {
+		fprintf(stderr, "Failed to scan textures in \"%s\": %s\n", textureDir, o3d_get_last_error());
+		o3d_texreg_free(&registry);
+		return EXIT_FAILURE;
+	}
+
+	o3d_texpack_entry_t * textures = calloc(registry.entryCount + 1, sizeof(textures[0]));
+	image_t * images = calloc(registry.entryCount + 1, sizeof(images[0]));
+	if (textures == NULL || images == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		free(textures);
+		free(images);
+		o3d_texreg_free(&registry);
+		return EXIT_FAILURE;
+	}
+
+	// One texture per texNumber, the same ones the viewer would pick.
+	uint32_t textureCount = 0;
+	uint32_t failedCount  = 0;
+	uint64_t sourceBytes  = 0;
+
+	for (uint32_t texNumber = 0; texNumber < registry.entryCount; ++texNumber) {
+		const char * name = o3d_texreg_find_any(&registry, texNumber, options.variant);
+		if (name == NULL) {
+			continue;
+		}
+		if (!image_load_from_file(&images[textureCount], name)) {
+			fprintf(stderr, "Failed to load \"%s\": %s\n", name, o3d_get_last_error());
+			failedCount++;
+			continue;
+		}
+		textures[textureCount].texNumber = (uint16_t)texNumber;
+		textures[textureCount].width     = (uint16_t)images[textureCount].width;
+		textures[textureCount].height    = (uint16_t)images[textureCount].height;
+		sourceBytes += (uint64_t)images[textureCount].width * images[textureCount].height * 4;
+		textureCount++;
+	}
+
+	o3d_texpack_t pack;
+	int exitCode = (failedCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if (!o3d_texpack_build(&pack, textures, textureCount, &options.params)) {
+		fprintf(stderr, "Failed to pack the textures: %s\n", o3d_get_last_error());
+		exitCode = EXIT_FAILURE;
+	} else {
+		// The entries come out sorted by texNumber, which is also the order the images were loaded in.
+		uint64_t packedBytes = 0;
+		uint32_t layerCount  = 0;
+		for (uint32_t p = 0; p < pack.pageCount; ++p) {
+			const o3d_texpack_page_t * page = &pack.pages[p];
+			packedBytes += (uint64_t)page->width * page->height * 4 * page->layerCount;
+			layerCount  += page->layerCount;
+
+			if (options.verbose) {
+				printf("Page %u: %s %ux%u, %u layers\n", p, (page->flags & O3D_TEXPACK_PAGE_ATLAS) ? "atlas" : "array",
+				       page->width, page->height, page->layerCount);
+			}
+		}
+		if (options.verbose) {
+			for (uint32_t e = 0; e < pack.entryCount; ++e) {
+				const o3d_texpack_entry_t * entry = &pack.entries[e];
+				printf("    %04u %4ux%-4u -> page %u, layer %u at (%u, %u)\n", entry->texNumber,
+				       entry->width, entry->height, entry->page, entry->layer, entry->x, entry->y);
+			}
+		}
+
+		printf("%u textures (%u failed) packed in %u pages, %u layers: %u texture binds instead of %u.\n",
+		       textureCount, failedCount, pack.pageCount, layerCount, pack.pageCount, textureCount);
+		printf("Texture size: %.2f MB, packed: %.2f MB (%.1f%%)\n",
+		       (double)sourceBytes / (1024.0 * 1024.0), (double)packedBytes / (1024.0 * 1024.0),
+		       ((double)packedBytes / (double)sourceBytes) * 100.0);
+
+		if (!write_layer_images(&pack, images, layoutFilename) || !o3d_texpack_write_file(&pack, layoutFilename)) {
+			fprintf(stderr, "Failed to write the texture pack \"%s\": %s\n", layoutFilename, o3d_get_last_error());
+			exitCode = EXIT_FAILURE;
+		} else {
+			printf("Texture pack written to \"%s\".\n", layoutFilename);
+		}
+	}
+
+	for (uint32_t t = 0; t < textureCount; ++t) {
+		image_free(&images[t]);
+	}
+	o3d_texpack_free(&pack);
+	o3d_texreg_free(&registry);
+	free(textures);
+	free(images);
+	return exitCode;
+}
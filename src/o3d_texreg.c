@@ -0,0 +1,226 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_texreg.c
+ * Created on: 17/10/26
+ * Brief: Texture registry mapping O3D face texNumbers to the texture filenames.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_texreg.h"
+#include "file_utils.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * o3d_texreg_init() / o3d_texreg_free():
+ * ======================================================== */
+
+void o3d_texreg_init(o3d_texreg_t * reg) {
+	assert(reg != NULL);
+	memset(reg, 0, sizeof(*reg));
+}
+
+void o3d_texreg_free(o3d_texreg_t * reg) {
+	if (reg == NULL) {
+		return;
+	}
+
+	free(reg->entries);
+	free(reg->stringPool);
+	memset(reg, 0, sizeof(*reg));
+}
+
+/* ========================================================
+ * texreg_parse_name():
+ * ======================================================== */
+
+//
+// "path/to/K0015_KNIGHT.TGA" => texNumber 15, variant K.
+//
+static bool texreg_parse_name(const char * path, uint32_t * texNumber, o3d_texreg_variant_t * variant) {
+	// MTF paths use backslashes, unpacked ones forward slashes.
+	const char * name = path;
+	for (const char * p = path; *p != '\0'; ++p) {
+		if (*p == '/' || *p == '\\') {
+			name = p + 1;
+		}
+	}
+
+	const char prefix = (char)toupper((unsigned char)name[0]);
+	if (prefix == 'K') {
+		*variant = O3D_TEXREG_K;
+	} else if (prefix == 'R') {
+		*variant = O3D_TEXREG_R;
+	} else {
+		return false;
+	}
+
+	uint32_t number = 0;
+	for (int i = 1; i <= 4; ++i) {
+		if (!isdigit((unsigned char)name[i])) {
+			return false;
+		}
+		number = (number * 10) + (uint32_t)(name[i] - '0');
+	}
+
+	if (name[5] != '_' || !file_has_extension(name, ".TGA")) {
+		return false;
+	}
+
+	*texNumber = number;
+	return true;
+}
+
+/* ========================================================
+ * o3d_texreg_add():
+ * ======================================================== */
+
+bool o3d_texreg_add(o3d_texreg_t * reg, const char * path) {
+	assert(reg  != NULL);
+	assert(path != NULL);
+
+	uint32_t texNumber;
+	o3d_texreg_variant_t variant;
+	if (!texreg_parse_name(path, &texNumber, &variant)) {
+		return true; // Not a texture.
+	}
+
+	if (texNumber >= reg->entryCount) {
+		// Grow straight to the largest possible size, it is
+		// only ~80KB and saves reallocating as we go.
+		const uint32_t newCount = O3D_TEXREG_MAX_TEX_NUMBER + 1;
+		if (reg->entries == NULL) {
+			reg->entries = calloc(newCount, sizeof(reg->entries[0]));
+			if (reg->entries == NULL) {
+				return o3d_set_error("Unable to malloc texture registry!");
+			}
+		}
+		reg->entryCount = texNumber + 1;
+	}
+
+	o3d_texreg_entry_t * entry = &reg->entries[texNumber];
+	if (entry->nameOffsets[variant] != 0) {
+		reg->duplicateCount++;
+		return true;
+	}
+
+	const uint32_t len = (uint32_t)strlen(path) + 1;
+	if (reg->stringPoolSize + len > reg->stringPoolCapacity) {
+		uint32_t newCapacity = (reg->stringPoolCapacity != 0) ? (reg->stringPoolCapacity * 2) : 4096;
+		while (newCapacity < reg->stringPoolSize + len) {
+			newCapacity *= 2;
+		}
+		char * pool = realloc(reg->stringPool, newCapacity);
+		if (pool == NULL) {
+			return o3d_set_error("Unable to realloc texture registry names!");
+		}
+		reg->stringPool = pool;
+		reg->stringPoolCapacity = newCapacity;
+	}
+
+	memcpy(&reg->stringPool[reg->stringPoolSize], path, len);
+	entry->nameOffsets[variant] = reg->stringPoolSize + 1;
+	reg->stringPoolSize += len;
+	reg->textureCount++;
+	return true;
+}
+
+/* ========================================================
+ * o3d_texreg_build_from_mtf():
+ * ======================================================== */
+
+bool o3d_texreg_build_from_mtf(o3d_texreg_t * reg, const mtf_file_t * mtf) {
+	assert(reg != NULL);
+	assert(mtf != NULL);
+
+	// The TOC is sorted, so the first-one-wins rule is deterministic.
+	for (uint32_t e = 0; e < mtf->fileEntryCount; ++e) {
+		if (!o3d_texreg_add(reg, mtf->fileEntries[e].filename)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* ========================================================
+ * o3d_texreg_build_from_directory():
+ * ======================================================== */
+
+bool o3d_texreg_build_from_directory(o3d_texreg_t * reg, const char * path) {
+	assert(reg  != NULL);
+	assert(path != NULL);
+
+	file_list_t files;
+	memset(&files, 0, sizeof(files));
+
+	if (!file_list_add_path(&files, path, ".TGA")) {
+		file_list_free(&files);
+		return o3d_set_error("Can't read texture directory!");
+	}
+
+	file_list_sort(&files);
+	bool success = true;
+	for (uint32_t f = 0; f < files.count && success; ++f) {
+		success = o3d_texreg_add(reg, files.paths[f]);
+	}
+
+	file_list_free(&files);
+	return success;
+}
+
+/* ========================================================
+ * o3d_model_tex_numbers():
+ * ======================================================== */
+
+static int texreg_sort_u16(const void * a, const void * b) {
+	return (int)(*(const uint16_t *)a) - (int)(*(const uint16_t *)b);
+}
+
+uint32_t o3d_model_tex_numbers(const o3d_model_t * o3d, uint16_t * texNumbers, uint32_t * faceCounts, uint32_t maxCount) {
+	assert(o3d != NULL);
+	assert(texNumbers != NULL || maxCount == 0);
+
+	if (o3d->faceCount == 0) {
+		return 0;
+	}
+
+	uint16_t * sorted = malloc(o3d->faceCount * sizeof(sorted[0]));
+	if (sorted == NULL) {
+		o3d_set_error("Unable to malloc texNumbers!");
+		return 0;
+	}
+
+	for (uint32_t f = 0; f < o3d->faceCount; ++f) {
+		sorted[f] = o3d->faces[f].texNumber;
+	}
+	qsort(sorted, o3d->faceCount, sizeof(sorted[0]), &texreg_sort_u16);
+
+	uint32_t distinct = 0;
+	for (uint32_t f = 0; f < o3d->faceCount; ) {
+		uint32_t run = 1;
+		while (f + run < o3d->faceCount && sorted[f + run] == sorted[f]) {
+			++run;
+		}
+		if (distinct < maxCount) {
+			texNumbers[distinct] = sorted[f];
+			if (faceCounts != NULL) {
+				faceCounts[distinct] = run;
+			}
+		}
+		++distinct;
+		f += run;
+	}
+
+	free(sorted);
+	return distinct;
+}
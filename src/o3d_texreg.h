@@ -0,0 +1,120 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_texreg.h
+ * Created on: 17/10/26
+ * Brief: Texture registry mapping O3D face texNumbers to the texture filenames.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_TEXREG_H
+#define DARKSTONE_O3D_TEXREG_H
+
+#include "o3d.h"
+#include "mtf.h"
+
+/* ========================================================
+ * Texture registry:
+ * ======================================================== */
+
+/*
+ * Texture filenames follow "Kxyzw_NAME.TGA" or "Rxyzw_NAME.TGA", where
+ * xyzw is the texNumber of the faces using it (see o3d_face_t). Both
+ * variants are kept; which is used for what is still not clear.
+ */
+typedef enum o3d_texreg_variant {
+	O3D_TEXREG_K,
+	O3D_TEXREG_R,
+	O3D_TEXREG_VARIANT_COUNT
+} o3d_texreg_variant_t;
+
+/*
+ * Dense array indexed by texNumber. The names are offsets into one
+ * string pool, plus one (zero means no texture of that variant).
+ */
+typedef struct o3d_texreg_entry {
+	uint32_t nameOffsets[O3D_TEXREG_VARIANT_COUNT];
+} o3d_texreg_entry_t;
+
+typedef struct o3d_texreg {
+	o3d_texreg_entry_t * entries;         // [0, entryCount), entryCount = highest texNumber seen + 1.
+	char               * stringPool;
+	uint32_t             entryCount;
+	uint32_t             stringPoolSize;
+	uint32_t             stringPoolCapacity;
+	uint32_t             textureCount;    // Names registered.
+	uint32_t             duplicateCount;  // Names ignored because the texNumber/variant was already taken.
+} o3d_texreg_t;
+
+// texNumbers have 4 decimal digits in the filenames.
+enum { O3D_TEXREG_MAX_TEX_NUMBER = 9999 };
+
+/* ========================================================
+ * Registry functions:
+ * ======================================================== */
+
+/*
+ * Clears the registry. Same as zeroing it.
+ */
+void o3d_texreg_init(o3d_texreg_t * reg);
+
+/*
+ * Frees the entries and the names.
+ */
+void o3d_texreg_free(o3d_texreg_t * reg);
+
+/*
+ * Registers `path` if its filename matches the texture naming pattern,
+ * otherwise ignores it. Only fails if out of memory. The first path
+ * registered for a texNumber/variant wins.
+ */
+bool o3d_texreg_add(o3d_texreg_t * reg, const char * path);
+
+/*
+ * Registers every TGA in the table of contents of an MTF archive.
+ * The names are the archive paths, as in mtf_file_entry_t::filename.
+ */
+bool o3d_texreg_build_from_mtf(o3d_texreg_t * reg, const mtf_file_t * mtf);
+
+/*
+ * Registers every TGA under a directory, scanned recursively.
+ * Typically the output of the MTF unpacker.
+ */
+bool o3d_texreg_build_from_directory(o3d_texreg_t * reg, const char * path);
+
+/*
+ * Filename of the texture for `texNumber`, or null if not registered.
+ */
+static inline const char * o3d_texreg_find(const o3d_texreg_t * reg, uint32_t texNumber, o3d_texreg_variant_t variant) {
+	if (texNumber >= reg->entryCount) {
+		return NULL;
+	}
+	const uint32_t offset = reg->entries[texNumber].nameOffsets[variant];
+	return (offset != 0) ? &reg->stringPool[offset - 1] : NULL;
+}
+
+/*
+ * Same, but falls back to the other variant if the preferred one is missing.
+ */
+static inline const char * o3d_texreg_find_any(const o3d_texreg_t * reg, uint32_t texNumber, o3d_texreg_variant_t preferred) {
+	const char * name = o3d_texreg_find(reg, texNumber, preferred);
+	if (name == NULL) {
+		name = o3d_texreg_find(reg, texNumber, (preferred == O3D_TEXREG_K) ? O3D_TEXREG_R : O3D_TEXREG_K);
+	}
+	return name;
+}
+
+/*
+ * Gathers the distinct texNumbers used by the model's faces, in ascending order.
+ * Writes up to `maxCount` and returns the total number of distinct texNumbers.
+ * `faceCounts` is optional; if given, it gets the number of faces using each.
+ */
+uint32_t o3d_model_tex_numbers(const o3d_model_t * o3d, uint16_t * texNumbers, uint32_t * faceCounts, uint32_t maxCount);
+
+#endif // DARKSTONE_O3D_TEXREG_H
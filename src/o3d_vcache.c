@@ -0,0 +1,348 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_vcache.c
+ * Created on: 17/10/26
+ * Brief: Post-transform vertex cache and vertex fetch optimization for indexed triangle lists.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "o3d_vcache.h"
+#include "o3d.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================
+ * o3d_vcache_analyze():
+ * ======================================================== */
+
+void o3d_vcache_analyze(o3d_vcache_stats_t * stats, const uint32_t * indexes,
+                        uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize) {
+	assert(stats != NULL);
+	assert(indexes != NULL || indexCount == 0);
+	assert(cacheSize != 0);
+
+	memset(stats, 0, sizeof(*stats));
+	stats->triangleCount = indexCount / 3;
+
+	if (stats->triangleCount == 0 || vertexCount == 0) {
+		return;
+	}
+
+	// A vertex is in the FIFO if it was inserted less than
+	// `cacheSize` misses ago. Zero means never inserted, so
+	// the clock starts at `cacheSize + 1` to keep that invalid.
+	uint32_t * insertTime = calloc(vertexCount, sizeof(insertTime[0]));
+	if (insertTime == NULL) {
+		return;
+	}
+
+	uint32_t clock = cacheSize + 1;
+	uint32_t referencedCount = 0;
+
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		const uint32_t v = indexes[i];
+		assert(v < vertexCount);
+
+		if (insertTime[v] == 0) {
+			++referencedCount;
+		}
+		if (clock - insertTime[v] > cacheSize) {
+			insertTime[v] = clock++;
+			stats->transformedCount++;
+		}
+	}
+
+	free(insertTime);
+
+	stats->acmr = (float)stats->transformedCount / (float)stats->triangleCount;
+	stats->atvr = (float)stats->transformedCount / (float)referencedCount;
+}
+
+/* ========================================================
+ * Forsyth vertex scoring:
+ * ======================================================== */
+
+//
+// Constants from Tom Forsyth's original article:
+//   https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+//
+// The simulated cache is an LRU a bit larger than the
+// real FIFO, which gives better results on most hardware.
+//
+enum {
+	FORSYTH_CACHE_SIZE   = 32,
+	FORSYTH_MAX_VALENCE  = 32,
+	FORSYTH_NO_TRIANGLE  = UINT32_MAX
+};
+
+static const float FORSYTH_CACHE_DECAY_POWER   = 1.5f;
+static const float FORSYTH_LAST_TRI_SCORE      = 0.75f;
+static const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+static const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+typedef struct forsyth_tables {
+	float cacheScore[FORSYTH_CACHE_SIZE];
+	float valenceScore[FORSYTH_MAX_VALENCE + 1];
+} forsyth_tables_t;
+
+static void forsyth_init_tables(forsyth_tables_t * tables) {
+	for (int i = 0; i < FORSYTH_CACHE_SIZE; ++i) {
+		if (i < 3) {
+			// The vertexes used by the last triangle get a fixed score
+			// regardless of position, so the order they were added in
+			// doesn't bias the next pick.
+			tables->cacheScore[i] = FORSYTH_LAST_TRI_SCORE;
+		} else {
+			const float scaler = 1.0f / (float)(FORSYTH_CACHE_SIZE - 3);
+			const float score  = 1.0f - (float)(i - 3) * scaler;
+			tables->cacheScore[i] = powf(score, FORSYTH_CACHE_DECAY_POWER);
+		}
+	}
+
+	tables->valenceScore[0] = 0.0f;
+	for (int i = 1; i <= FORSYTH_MAX_VALENCE; ++i) {
+		// Bonus points for having a low number of triangles left, so
+		// lone vertexes are finished quickly instead of left behind.
+		tables->valenceScore[i] = FORSYTH_VALENCE_BOOST_SCALE * powf((float)i, -FORSYTH_VALENCE_BOOST_POWER);
+	}
+}
+
+static inline float forsyth_vertex_score(const forsyth_tables_t * tables, int cachePos, uint32_t liveTris) {
+	if (liveTris == 0) {
+		return -1.0f; // No triangle needs this vertex anymore.
+	}
+
+	float score = (cachePos >= 0) ? tables->cacheScore[cachePos] : 0.0f;
+	score += tables->valenceScore[(liveTris < FORSYTH_MAX_VALENCE) ? liveTris : FORSYTH_MAX_VALENCE];
+	return score;
+}
+
+/* ========================================================
+ * o3d_vcache_optimize_triangles():
+ * ======================================================== */
+
+bool o3d_vcache_optimize_triangles(uint32_t * indexes, uint32_t indexCount,
+                                   uint32_t vertexCount, uint32_t * triangleOrder) {
+	assert(indexes != NULL || indexCount == 0);
+	assert((indexCount % 3) == 0);
+
+	const uint32_t triCount = indexCount / 3;
+	if (triCount <= 1 || vertexCount == 0) {
+		if (triangleOrder != NULL && triCount == 1) {
+			triangleOrder[0] = 0;
+		}
+		return true;
+	}
+
+	// All the working memory is allocated in a single block.
+	const size_t bytesNeeded =
+		(sizeof(uint32_t) * (vertexCount + 1)) + // vtxTriStart
+		(sizeof(uint32_t) *  vertexCount)      + // vtxTriCount
+		(sizeof(int32_t)  *  vertexCount)      + // vtxCachePos
+		(sizeof(float)    *  vertexCount)      + // vtxScore
+		(sizeof(uint32_t) *  indexCount)       + // vtxTriList
+		(sizeof(float)    *  triCount)         + // triScore
+		(sizeof(uint32_t) *  indexCount)       + // outIndexes
+		(sizeof(uint32_t) *  triCount)         + // outOrder
+		(sizeof(uint8_t)  *  triCount);          // triEmitted
+
+	uint8_t * memBlock = malloc(bytesNeeded);
+	if (memBlock == NULL) {
+		return o3d_set_error("Unable to malloc vertex cache optimizer memory!");
+	}
+
+	uint8_t * ptr = memBlock;
+	uint32_t * vtxTriStart = (uint32_t *)ptr; ptr += sizeof(uint32_t) * (vertexCount + 1);
+	uint32_t * vtxTriCount = (uint32_t *)ptr; ptr += sizeof(uint32_t) * vertexCount;
+	int32_t  * vtxCachePos = (int32_t  *)ptr; ptr += sizeof(int32_t)  * vertexCount;
+	float    * vtxScore    = (float    *)ptr; ptr += sizeof(float)    * vertexCount;
+	uint32_t * vtxTriList  = (uint32_t *)ptr; ptr += sizeof(uint32_t) * indexCount;
+	float    * triScore    = (float    *)ptr; ptr += sizeof(float)    * triCount;
+	uint32_t * outIndexes  = (uint32_t *)ptr; ptr += sizeof(uint32_t) * indexCount;
+	uint32_t * outOrder    = (uint32_t *)ptr; ptr += sizeof(uint32_t) * triCount;
+	uint8_t  * triEmitted  = (uint8_t  *)ptr;
+
+	forsyth_tables_t tables;
+	forsyth_init_tables(&tables);
+
+	// Vertex -> triangle adjacency, as a flat list (counting sort).
+	memset(vtxTriCount, 0, sizeof(uint32_t) * vertexCount);
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		assert(indexes[i] < vertexCount);
+		vtxTriCount[indexes[i]]++;
+	}
+
+	vtxTriStart[0] = 0;
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		vtxTriStart[v + 1] = vtxTriStart[v] + vtxTriCount[v];
+		vtxTriCount[v] = 0;
+	}
+
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		const uint32_t v = indexes[i];
+		vtxTriList[vtxTriStart[v] + vtxTriCount[v]++] = i / 3;
+	}
+
+	// Initial scores:
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		vtxCachePos[v] = -1;
+		vtxScore[v] = forsyth_vertex_score(&tables, -1, vtxTriCount[v]);
+	}
+
+	uint32_t bestTri = FORSYTH_NO_TRIANGLE;
+	float bestScore = -1.0f;
+
+	for (uint32_t t = 0; t < triCount; ++t) {
+		const uint32_t * tri = &indexes[t * 3];
+		triScore[t] = vtxScore[tri[0]] + vtxScore[tri[1]] + vtxScore[tri[2]];
+		triEmitted[t] = 0;
+
+		if (triScore[t] > bestScore) {
+			bestScore = triScore[t];
+			bestTri = t;
+		}
+	}
+
+	// Simulated LRU. A couple extra slots for the vertexes pushed out by each new triangle.
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+	uint32_t newCache[FORSYTH_CACHE_SIZE + 3];
+	uint32_t cacheCount = 0;
+	uint32_t scanCursor = 0;
+
+	for (uint32_t outTri = 0; outTri < triCount; ++outTri) {
+
+		// Nothing useful left in the cache, restart from the next
+		// triangle not yet emitted. It doesn't need to be the best
+		// overall, this keeps the whole thing linear.
+		if (bestTri == FORSYTH_NO_TRIANGLE) {
+			while (triEmitted[scanCursor]) {
+				++scanCursor;
+			}
+			bestTri = scanCursor;
+		}
+
+		const uint32_t * tri = &indexes[bestTri * 3];
+		outIndexes[(outTri * 3) + 0] = tri[0];
+		outIndexes[(outTri * 3) + 1] = tri[1];
+		outIndexes[(outTri * 3) + 2] = tri[2];
+		outOrder[outTri] = bestTri;
+		triEmitted[bestTri] = 1;
+
+		// Remove the triangle from the live lists of its vertexes:
+		for (int c = 0; c < 3; ++c) {
+			const uint32_t v = tri[c];
+			uint32_t * list  = &vtxTriList[vtxTriStart[v]];
+			const uint32_t count = vtxTriCount[v];
+
+			for (uint32_t i = 0; i < count; ++i) {
+				if (list[i] == bestTri) {
+					list[i] = list[count - 1];
+					vtxTriCount[v]--;
+					break;
+				}
+			}
+		}
+
+		// New cache is the triangle vertexes followed by the previous contents:
+		uint32_t newCount = 0;
+		for (int c = 0; c < 3; ++c) {
+			bool dup = false;
+			for (uint32_t i = 0; i < newCount; ++i) {
+				dup |= (newCache[i] == tri[c]);
+			}
+			if (!dup) {
+				newCache[newCount++] = tri[c];
+			}
+		}
+		for (uint32_t i = 0; i < cacheCount; ++i) {
+			const uint32_t v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				newCache[newCount++] = v;
+			}
+		}
+
+		// Update the vertex scores, including those that just fell out:
+		for (uint32_t i = 0; i < newCount; ++i) {
+			const uint32_t v = newCache[i];
+			vtxCachePos[v] = (i < FORSYTH_CACHE_SIZE) ? (int32_t)i : -1;
+			vtxScore[v] = forsyth_vertex_score(&tables, vtxCachePos[v], vtxTriCount[v]);
+		}
+
+		// And the triangles touching them. Pick the next best from these.
+		bestTri = FORSYTH_NO_TRIANGLE;
+		bestScore = -1.0f;
+
+		for (uint32_t i = 0; i < newCount; ++i) {
+			const uint32_t v = newCache[i];
+			const uint32_t * list = &vtxTriList[vtxTriStart[v]];
+			const uint32_t count  = vtxTriCount[v];
+
+			for (uint32_t n = 0; n < count; ++n) {
+				const uint32_t t = list[n];
+				const uint32_t * adj = &indexes[t * 3];
+				triScore[t] = vtxScore[adj[0]] + vtxScore[adj[1]] + vtxScore[adj[2]];
+
+				if (triScore[t] > bestScore) {
+					bestScore = triScore[t];
+					bestTri = t;
+				}
+			}
+		}
+
+		cacheCount = (newCount < FORSYTH_CACHE_SIZE) ? newCount : FORSYTH_CACHE_SIZE;
+		memcpy(cache, newCache, cacheCount * sizeof(cache[0]));
+	}
+
+	memcpy(indexes, outIndexes, indexCount * sizeof(indexes[0]));
+	if (triangleOrder != NULL) {
+		memcpy(triangleOrder, outOrder, triCount * sizeof(triangleOrder[0]));
+	}
+
+	free(memBlock);
+	return true;
+}
+
+/* ========================================================
+ * o3d_vcache_optimize_fetch():
+ * ======================================================== */
+
+bool o3d_vcache_optimize_fetch(uint32_t * indexes, uint32_t indexCount, uint32_t vertexCount,
+                               uint32_t * vertexRemap, uint32_t * newVertexCount) {
+	assert(indexes != NULL || indexCount == 0);
+	assert(vertexRemap != NULL);
+	assert(newVertexCount != NULL);
+
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		vertexRemap[v] = O3D_VCACHE_UNUSED_VERTEX;
+	}
+
+	uint32_t nextVertex = 0;
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		const uint32_t v = indexes[i];
+		if (v >= vertexCount) {
+			return o3d_set_error("Vertex index out of range in o3d_vcache_optimize_fetch()!");
+		}
+
+		if (vertexRemap[v] == O3D_VCACHE_UNUSED_VERTEX) {
+			vertexRemap[v] = nextVertex++;
+		}
+	}
+
+	// Only touch the indexes once we know they are all valid.
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		indexes[i] = vertexRemap[indexes[i]];
+	}
+
+	*newVertexCount = nextVertex;
+	return true;
+}
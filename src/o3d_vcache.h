@@ -0,0 +1,82 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: o3d_vcache.h
+ * Created on: 17/10/26
+ * Brief: Post-transform vertex cache and vertex fetch optimization for indexed triangle lists.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_O3D_VCACHE_H
+#define DARKSTONE_O3D_VCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ========================================================
+ * Vertex cache statistics:
+ * ======================================================== */
+
+/*
+ * Results of simulating a FIFO post-transform cache.
+ *
+ * ACMR: Average Cache Miss Ratio. Vertexes transformed per triangle.
+ *       Ranges from 3.0 (no reuse at all) down to ~0.5 for a regular grid.
+ *
+ * ATVR: Average Transformed Vertex Ratio. Vertexes transformed per vertex
+ *       referenced. 1.0 is the optimum; every vertex shaded exactly once.
+ */
+typedef struct o3d_vcache_stats {
+	float    acmr;
+	float    atvr;
+	uint32_t transformedCount;
+	uint32_t triangleCount;
+} o3d_vcache_stats_t;
+
+// Cache size used for the statistics if you don't have a
+// better number. Matches the typical FIFO of older GPUs.
+enum { O3D_VCACHE_DEFAULT_FIFO_SIZE = 16 };
+
+// Marks vertexes not referenced by any triangle in o3d_vcache_optimize_fetch().
+enum { O3D_VCACHE_UNUSED_VERTEX = UINT32_MAX };
+
+/* ========================================================
+ * Optimization functions:
+ * ======================================================== */
+
+/*
+ * Simulate a FIFO vertex cache of `cacheSize` entries over the triangle list.
+ */
+void o3d_vcache_analyze(o3d_vcache_stats_t * stats, const uint32_t * indexes,
+                        uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize);
+
+/*
+ * Reorders the triangles in place using Tom Forsyth's "Linear-Speed Vertex Cache
+ * Optimisation" scoring. Runs in roughly linear time in the triangle count.
+ *
+ * `triangleOrder` is optional. If not null, it must hold indexCount/3 entries and
+ * receives the source triangle of each output triangle, so that per-triangle data
+ * can be permuted to match: newTri[i] = oldTri[triangleOrder[i]].
+ */
+bool o3d_vcache_optimize_triangles(uint32_t * indexes, uint32_t indexCount,
+                                   uint32_t vertexCount, uint32_t * triangleOrder);
+
+/*
+ * Renumbers the vertexes in the order they are first referenced by the triangles,
+ * so the vertex fetches walk memory linearly. Indexes are rewritten in place.
+ *
+ * `vertexRemap` must hold `vertexCount` entries and receives the new position of
+ * each old vertex (O3D_VCACHE_UNUSED_VERTEX if not referenced). Apply it to your
+ * vertex arrays with newVerts[vertexRemap[i]] = oldVerts[i]. Returns the number of
+ * referenced vertexes in `newVertexCount`.
+ */
+bool o3d_vcache_optimize_fetch(uint32_t * indexes, uint32_t indexCount, uint32_t vertexCount,
+                               uint32_t * vertexRemap, uint32_t * newVertexCount);
+
+#endif // DARKSTONE_O3D_VCACHE_H
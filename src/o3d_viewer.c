@@ -14,8 +14,19 @@
  * is included in the resulting source code.
  * ================================================================================================ */
 
+#include "asset_cache.h"
+#include "file_utils.h"
 #include "gl_utils.h"
 #include "o3d.h"
+#include "o3d_anim.h"
+#include "o3d_animpack.h"
+#include "o3d_batch.h"
+#include "o3d_cooked.h"
+#include "o3d_testrig.h"
+#include "o3d_texpack.h"
+#include "o3d_texreg.h"
+#include "parallel.h"
+#include "sw_raster.h"
 
 /* ========================================================
  * Application context data / helper constants:
@@ -26,6 +37,7 @@ enum { WINDOW_WIDTH = 800, WINDOW_HEIGHT = 600 };
 
 // Available render modes. Cycle through
 // them by clicking the right mouse button.
+// Same values as sw_render_mode_t and basic.frag.
 enum {
 	RENDER_TEXTURED      = 0,
 	RENDER_WIREFRAME     = 1,
@@ -42,13 +54,34 @@ static const char * renderModeStrings[RENDER_MODE_COUNT] = {
 	"Default Color"
 };
 
-// O3D texture coordinates seem to be scaled by the size
-// of the texture map (assuming all textures are 256^2 pixels).
-static const float TEXCOORD_SCALE = (1.0f / 256.0f);
-
 // Amount to move forward/back when zooming with the mouse wheel.
 static const float ZOOM_AMOUNT = 0.1f;
 
+// Procedural test rig of the animation playback mode (see o3d_testrig.h).
+enum { ANIM_JOINT_COUNT = 6, ANIM_KEY_COUNT = 31 };
+static const float ANIM_DURATION    = 2.0f;  // Seconds per sway cycle.
+static const float ANIM_MAX_DEGREES = 12.0f; // Bend of each joint.
+
+// Offscreen benchmark (--benchmark): one full orbit around the model over the
+// measured frames, after a few untimed ones to get shaders and buffers resident.
+enum { BENCHMARK_DEFAULT_FRAMES = 300, BENCHMARK_WARMUP_FRAMES = 10 };
+
+/*
+ * Range of the VBO drawn with one texture (one mesh group).
+ * A null texture handle means the shared viewer.texture.
+ * The texture belongs to the asset cache, via textureAsset.
+ * Batches in the texture pack use texPage/texLayer instead.
+ */
+typedef struct viewer_batch {
+	uint32_t      texNumber;
+	uint32_t      firstVertex;
+	uint32_t      vertexCount;
+	gl_texture_t  texture;
+	asset_t     * textureAsset;
+	int           texPage;   // -1 if not in the texture pack.
+	int           texLayer;
+} viewer_batch_t;
+
 /*
  * Application context:
  */
@@ -59,7 +92,14 @@ static struct {
 	// Current loaded model and aux render data:
 	const char  * modelFileName;
 	const char  * textureFileName;
-	o3d_model_t   o3d;
+	const char  * texPackFileName;
+	o3d_texpack_t texPack;
+	o3d_scene_t   scene;
+	o3d_mesh_t    mesh;
+	bool          uvsInTexPack; // Cooked with a texture pack (O3DC_FLAG_TEXPACK).
+	o3d_texreg_t  texRegistry;
+	asset_cache_t * assets;
+	uint32_t      faceCount;
 	o3d_vertex_t  centerPoint;
 	o3d_vertex_t  vertexSum;
 	float         modelScale;
@@ -69,10 +109,35 @@ static struct {
 	int           renderMode;
 
 	// GL render data:
+	viewer_batch_t * batches;
+	uint32_t      batchCount;
 	gl_vbo_t      vbo;
 	gl_texture_t  texture;
+	gl_texture_array_t * texPages; // One per texPack page.
 	gl_program_t  program;
 
+	// Animation playback (--animate):
+	bool            animate;
+	float           animStartTime;
+	double          animClockStart;
+	o3d_skeleton_t  skeleton;
+	o3d_skin_t      skin;
+	o3d_anim_clip_t clip;
+	o3d_animpack_clip_t packedClip; // What is played; `clip` is its source.
+	o3d_anim_pose_t pose;
+	o3d_vertex_t  * skinnedPositions;
+	uint32_t      * drawToMesh;     // Mesh vertex of each draw vertex.
+	gl_draw_vertex_t * animVerts;   // Copy of the VBO, updated with the skinned positions.
+	uint32_t        animVertCount;
+
+	// Offscreen benchmark (--benchmark):
+	const char    * benchmarkFileName;
+	int             benchmarkFrames;
+	int             benchmarkFrame;  // Warm-up frames included.
+	double        * frameTimes;      // Milliseconds from the first GL call of the frame to glFinish().
+	double        * gpuTimes;        // GL_TIME_ELAPSED, in milliseconds. Null without GL 3.3.
+	GLuint          timerQuery;
+
 	// Render matrices:
 	VmathMatrix4  modelToWorldMatrix;
 	VmathMatrix4  viewMatrix;
@@ -99,21 +164,23 @@ static struct {
  * ======================================================== */
 
 static void refresh_window_title(void) {
-	if (viewer.o3d.vertexes != NULL) {
+	if (viewer.mesh.vertexes != NULL) {
 		if (viewer.renderMode == RENDER_TEXTURED) {
 			set_window_title(
-				"Darkstone O3D Model Viewer -- %s -- %u verts, %u faces -- %s (%s)",
+				"Darkstone O3D Model Viewer -- %s -- %u verts, %u faces, %u batches -- %s (%s)",
 				viewer.modelFileName,
-				viewer.o3d.vertexCount,
-				viewer.o3d.faceCount,
+				viewer.mesh.vertexCount,
+				viewer.faceCount,
+				viewer.batchCount,
 				renderModeStrings[viewer.renderMode],
 				viewer.textureFileName);
 		} else {
 			set_window_title(
-				"Darkstone O3D Model Viewer -- %s -- %u verts, %u faces -- %s",
+				"Darkstone O3D Model Viewer -- %s -- %u verts, %u faces, %u batches -- %s",
 				viewer.modelFileName,
-				viewer.o3d.vertexCount,
-				viewer.o3d.faceCount,
+				viewer.mesh.vertexCount,
+				viewer.faceCount,
+				viewer.batchCount,
 				renderModeStrings[viewer.renderMode]);
 		}
 	} else {
@@ -121,14 +188,13 @@ static void refresh_window_title(void) {
 	}
 }
 
-static void set_gl_vert(gl_draw_vertex_t * glVert, const o3d_vertex_t * o3dVert,
-                        const o3d_color_t * o3dColor, const o3d_texcoord_t * o3dTexCoords,
+static void set_gl_vert(gl_draw_vertex_t * glVert, const o3d_mesh_vertex_t * meshVert,
                         float nx, float ny, float nz) {
 
 	// Scale to a more manageable size. Darkstone models used a big scale.
-	glVert->px = o3dVert->x * viewer.modelScale;
-	glVert->py = o3dVert->y * viewer.modelScale;
-	glVert->pz = o3dVert->z * viewer.modelScale;
+	glVert->px = meshVert->px * viewer.modelScale;
+	glVert->py = meshVert->py * viewer.modelScale;
+	glVert->pz = meshVert->pz * viewer.modelScale;
 
 	viewer.vertexSum.x += glVert->px;
 	viewer.vertexSum.y += glVert->py;
@@ -143,31 +209,77 @@ static void set_gl_vert(gl_draw_vertex_t * glVert, const o3d_vertex_t * o3dVert,
 	glVert->nz = nz;
 
 	// O3D stores it as BGR, it seems.
-	glVert->r = (float)(o3dColor->r * (1.0f / 255.0f));
-	glVert->g = (float)(o3dColor->g * (1.0f / 255.0f));
-	glVert->b = (float)(o3dColor->b * (1.0f / 255.0f));
+	glVert->r = (float)(meshVert->color.r * (1.0f / 255.0f));
+	glVert->g = (float)(meshVert->color.g * (1.0f / 255.0f));
+	glVert->b = (float)(meshVert->color.b * (1.0f / 255.0f));
 
-	// UVs stored scaled by the size in pixels of the texture map.
-	glVert->u = o3dTexCoords->u * TEXCOORD_SCALE;
-	glVert->v = o3dTexCoords->v * TEXCOORD_SCALE;
+	// Already divided by the texture size when the mesh was built.
+	glVert->u = meshVert->u;
+	glVert->v = meshVert->v;
 }
 
-static void setup_model_vbo(void) {
+static int compare_batches_by_page(const void * a, const void * b) {
+	const viewer_batch_t * batchA = a;
+	const viewer_batch_t * batchB = b;
+	if (batchA->texPage != batchB->texPage) {
+		return (batchA->texPage < batchB->texPage) ? -1 : 1;
+	}
+	return (batchA->texNumber < batchB->texNumber) ? -1 : (batchA->texNumber > batchB->texNumber);
+}
+
+// Moves the UVs of the packed batches into their page layer, then sorts
+// the batches by page, so each page is bound once when drawing.
+static void apply_texture_pack(gl_draw_vertex_t * vboVerts) {
+	if (viewer.texPack.entryCount == 0) {
+		return;
+	}
+
+	uint32_t packedCount = 0;
+	for (uint32_t b = 0; b < viewer.batchCount; ++b) {
+		viewer_batch_t * batch = &viewer.batches[b];
+		const o3d_texpack_entry_t * entry = o3d_texpack_find(&viewer.texPack, batch->texNumber);
+		if (entry == NULL) {
+			continue;
+		}
+
+		batch->texPage  = entry->page;
+		batch->texLayer = entry->layer;
+		packedCount++;
+
+		if (viewer.uvsInTexPack) {
+			continue; // The cooker already remapped them.
+		}
+		for (uint32_t v = batch->firstVertex; v < batch->firstVertex + batch->vertexCount; ++v) {
+			o3d_texpack_remap_uv(&viewer.texPack, entry, &vboVerts[v].u, &vboVerts[v].v);
+		}
+	}
+
+	qsort(viewer.batches, viewer.batchCount, sizeof(viewer.batches[0]), &compare_batches_by_page);
+	printf("%u of %u batches in the texture pack (%u pages).\n", packedCount, viewer.batchCount, viewer.texPack.pageCount);
+}
+
+// Expands the batched mesh into the draw vertexes, filling in the batches.
+static gl_draw_vertex_t * build_draw_vertexes(uint32_t * vertCount) {
 	// Shortcut variables:
-	const o3d_model_t  * o3d   = &viewer.o3d;
-	const o3d_face_t   * faces = o3d->faces;
-	const o3d_vertex_t * verts = o3d->vertexes;
-	const uint32_t faceCount   = o3d->faceCount;
-	const uint32_t vertCount   = o3d->vertexCount;
-
-	// Triangular faces will require only 3 verts, but
-	// a quadrilateral face will have to be split into
-	// two triangles, so allocate for the worst case
-	// where all faces are made of quads.
-	const uint32_t vboSize = faceCount * 6;
+	const o3d_mesh_t * mesh = &viewer.mesh;
+	const o3d_mesh_vertex_t * verts = mesh->vertexes;
+	const uint32_t * indexes = mesh->indexes;
+
+	// The barycentric wireframe needs unshared vertexes, so the
+	// triangles are expanded, but still in batch order, so each
+	// texture is a single contiguous draw.
+	const uint32_t vboSize = mesh->indexCount;
 	gl_draw_vertex_t * vboVerts = malloc(sizeof(vboVerts[0]) * vboSize);
 
-	if (vboVerts == NULL) {
+	viewer.batchCount = mesh->groupCount;
+	viewer.batches = calloc(viewer.batchCount, sizeof(viewer.batches[0]));
+
+	// Skinning updates the mesh vertexes, which then get expanded again.
+	if (viewer.animate) {
+		viewer.drawToMesh = malloc(sizeof(viewer.drawToMesh[0]) * vboSize);
+	}
+
+	if (vboVerts == NULL || viewer.batches == NULL || (viewer.animate && viewer.drawToMesh == NULL)) {
 		fatal_error("Unable to malloc temp VBO data! Out-of-memory!");
 	}
 
@@ -176,48 +288,25 @@ static void setup_model_vbo(void) {
 	viewer.vertexSum.z = 0.0f;
 
 	uint32_t finalVertCount = 0;
-	uint32_t i0, i1, i2, i3;
-
-	for (uint32_t f = 0; f < faceCount; ++f) {
-		const o3d_face_t * face = &faces[f];
 
-		if (face->index[3] == O3D_INVALID_FACE_INDEX) {
-			// Triangle face
-			i0 = face->index[0];
-			i1 = face->index[1];
-			i2 = face->index[2];
+	for (uint32_t g = 0; g < mesh->groupCount; ++g) {
+		const o3d_mesh_group_t * group = &mesh->groups[g];
+		viewer_batch_t * batch = &viewer.batches[g];
 
-			if (i0 >= vertCount || i1 >= vertCount || i2 >= vertCount) {
-				printf("WARNING: Bad face indexing at #%u ( %u, %u, %u )!\n", f, i0, i1, i2);
-				continue;
-			}
+		batch->texNumber   = group->texNumber;
+		batch->firstVertex = finalVertCount;
+		batch->vertexCount = group->indexCount;
+		batch->texPage     = -1;
+		batch->texLayer    = -1;
 
-			set_gl_vert(&vboVerts[finalVertCount++], &verts[i0], &face->color, &face->texCoords[0], 1.0f, 0.0f, 0.0f);
-			set_gl_vert(&vboVerts[finalVertCount++], &verts[i1], &face->color, &face->texCoords[1], 0.0f, 1.0f, 0.0f);
-			set_gl_vert(&vboVerts[finalVertCount++], &verts[i2], &face->color, &face->texCoords[2], 0.0f, 0.0f, 1.0f);
-			assert(finalVertCount <= vboSize);
-		} else {
-			// Quadrilateral face (break into two tris)
-			i0 = face->index[0];
-			i1 = face->index[1];
-			i2 = face->index[2];
-			i3 = face->index[3];
-
-			if (i0 >= vertCount || i1 >= vertCount || i2 >= vertCount || i3 >= vertCount) {
-				printf("WARNING: Bad face indexing at #%u ( %u, %u, %u, %u )!\n", f, i0, i1, i2, i3);
-				continue;
-			}
-
-			// First triangle: 0,1,3
-			set_gl_vert(&vboVerts[finalVertCount++], &verts[i0], &face->color, &face->texCoords[0], 1.0f, 0.0f, 0.0f);
-			set_gl_vert(&vboVerts[finalVertCount++], &verts[i1], &face->color, &face->texCoords[1], 0.0f, 1.0f, 0.0f);
-			set_gl_vert(&vboVerts[finalVertCount++], &verts[i3], &face->color, &face->texCoords[3], 0.0f, 0.0f, 1.0f);
-			assert(finalVertCount <= vboSize);
+		if (viewer.drawToMesh != NULL) {
+			memcpy(&viewer.drawToMesh[finalVertCount], &indexes[group->firstIndex], group->indexCount * sizeof(uint32_t));
+		}
 
-			// First triangle: 3,1,2
-			set_gl_vert(&vboVerts[finalVertCount++], &verts[i3], &face->color, &face->texCoords[3], 1.0f, 0.0f, 0.0f);
-			set_gl_vert(&vboVerts[finalVertCount++], &verts[i1], &face->color, &face->texCoords[1], 0.0f, 1.0f, 0.0f);
-			set_gl_vert(&vboVerts[finalVertCount++], &verts[i2], &face->color, &face->texCoords[2], 0.0f, 0.0f, 1.0f);
+		for (uint32_t i = group->firstIndex; i < group->firstIndex + group->indexCount; i += 3) {
+			set_gl_vert(&vboVerts[finalVertCount++], &verts[indexes[i + 0]], 1.0f, 0.0f, 0.0f);
+			set_gl_vert(&vboVerts[finalVertCount++], &verts[indexes[i + 1]], 0.0f, 1.0f, 0.0f);
+			set_gl_vert(&vboVerts[finalVertCount++], &verts[indexes[i + 2]], 0.0f, 0.0f, 1.0f);
 			assert(finalVertCount <= vboSize);
 		}
 	}
@@ -233,39 +322,333 @@ static void setup_model_vbo(void) {
 		vboVerts[v].pz -= viewer.centerPoint.z;
 	}
 
-	viewer.vbo = create_gl_vbo(vboVerts, finalVertCount, NULL, 0);
+	apply_texture_pack(vboVerts);
+
+	*vertCount = finalVertCount;
+	return vboVerts;
+}
+
+// Rigs the loaded mesh for the animation playback mode. There are no loaders
+// for the game's .SKA/.ANB files yet, so this is the procedural test rig.
+static bool setup_animation(void) {
+	const o3d_mesh_t * mesh = &viewer.mesh;
+
+	o3d_vertex_t * bindPositions = malloc(sizeof(bindPositions[0]) * mesh->vertexCount);
+	viewer.skinnedPositions = malloc(sizeof(viewer.skinnedPositions[0]) * mesh->vertexCount);
+	if (bindPositions == NULL || viewer.skinnedPositions == NULL) {
+		free(bindPositions);
+		printf("Unable to malloc the animation vertexes!\n");
+		return false;
+	}
+
+	for (uint32_t v = 0; v < mesh->vertexCount; ++v) {
+		bindPositions[v].x = mesh->vertexes[v].px;
+		bindPositions[v].y = mesh->vertexes[v].py;
+		bindPositions[v].z = mesh->vertexes[v].pz;
+	}
+
+	o3d_animpack_stats_t stats;
+	const bool success = o3d_testrig_build_skeleton(&viewer.skeleton, &mesh->aabb, ANIM_JOINT_COUNT) &&
+	                     o3d_testrig_build_skin(&viewer.skin, &viewer.skeleton, bindPositions, mesh->vertexCount) &&
+	                     o3d_testrig_build_clip(&viewer.clip, &viewer.skeleton, ANIM_DURATION, ANIM_KEY_COUNT, ANIM_MAX_DEGREES) &&
+	                     o3d_animpack_build(&viewer.packedClip, &viewer.clip, NULL, &stats) &&
+	                     o3d_anim_pose_init(&viewer.pose, &viewer.skeleton);
+	free(bindPositions);
+
+	if (!success) {
+		printf("Failed to set up the animation: %s\n", o3d_get_last_error());
+		return false;
+	}
+
+	printf("Animating the test rig (not game data): %u joints, %u keys over %.1f s.\n", viewer.skeleton.jointCount,
+	       viewer.clip.keyCount, (double)viewer.clip.duration);
+	printf("Packed clip: %zu -> %zu bytes, %u of %u keys kept in %u segments, max error %.2f degrees.\n",
+	       stats.rawBytes, stats.packedBytes, stats.packedKeys, stats.rawKeys, viewer.packedClip.segmentCount,
+	       (double)stats.maxRotError * (180.0 / 3.14159265358979323846));
+	return true;
+}
+
+// Poses and skins the mesh at `time`, then moves the draw vertexes to match.
+static void animate_draw_vertexes(gl_draw_vertex_t * vboVerts, uint32_t vertCount, float time) {
+	o3d_anim_instance_t instance;
+	instance.skeleton         = &viewer.skeleton;
+	instance.clip             = &viewer.clip;
+	instance.packedClip       = &viewer.packedClip;
+	instance.skin             = &viewer.skin;
+	instance.pose             = &viewer.pose;
+	instance.skinnedPositions = viewer.skinnedPositions;
+	instance.time             = time;
+
+	if (!o3d_anim_update_instances(&instance, 1, 0)) {
+		return;
+	}
+
+	// Same scale and recentering as set_gl_vert() and build_draw_vertexes().
+	for (uint32_t v = 0; v < vertCount; ++v) {
+		const o3d_vertex_t * pos = &viewer.skinnedPositions[viewer.drawToMesh[v]];
+		vboVerts[v].px = (pos->x * viewer.modelScale) - viewer.centerPoint.x;
+		vboVerts[v].py = (pos->y * viewer.modelScale) - viewer.centerPoint.y;
+		vboVerts[v].pz = (pos->z * viewer.modelScale) - viewer.centerPoint.z;
+	}
+}
+
+static void free_animation(void) {
+	o3d_anim_pose_free(&viewer.pose);
+	o3d_animpack_free(&viewer.packedClip);
+	o3d_anim_clip_free(&viewer.clip);
+	o3d_skin_free(&viewer.skin);
+	o3d_skeleton_free(&viewer.skeleton);
+	free(viewer.skinnedPositions);
+	free(viewer.drawToMesh);
+	free(viewer.animVerts);
+	viewer.skinnedPositions = NULL;
+	viewer.drawToMesh       = NULL;
+	viewer.animVerts        = NULL;
+}
+
+static void setup_model_vbo(void) {
+	uint32_t vertCount;
+	gl_draw_vertex_t * vboVerts = build_draw_vertexes(&vertCount);
+
+	viewer.vbo = create_gl_vbo(vboVerts, (int)vertCount, NULL, 0);
 	setup_gl_vertex_format();
 
-	free(vboVerts);
+	// Animated, the vertexes are kept to rewrite the positions every frame.
+	if (viewer.animate) {
+		viewer.animVerts     = vboVerts;
+		viewer.animVertCount = vertCount;
+	} else {
+		free(vboVerts);
+	}
 }
 
-static void import_model(void) {
+/*
+ * Textures loaded through the asset cache. Freed by the cache,
+ * which is only ever used from the main (GL context) thread.
+ */
+static bool load_texture_asset(void * userData, const char * path, const uint8_t * fileData, size_t fileSize,
+                               asset_load_result_t * result) {
+	(void)userData;
+
+	gl_texture_t * tex = malloc(sizeof(*tex));
+	if (tex == NULL) {
+		return o3d_set_error("Unable to malloc texture!");
+	}
+
+	// A cooked copy next to the texture (see o3d_texcooker) skips both
+	// decoding it and generating the mipmaps.
+	if (load_gl_texture_cooked(tex, path, &result->gpuBytes)) {
+		result->data     = tex;
+		result->cpuBytes = sizeof(*tex);
+		return true;
+	}
+
+	*tex = load_gl_texture_from_memory(fileData, fileSize, path);
+	if (tex->texHandle == 0) {
+		free(tex);
+		return o3d_set_error("Failed to decode texture image!");
+	}
+
+	// RGBA8 plus the mipmap chain.
+	result->data     = tex;
+	result->cpuBytes = sizeof(*tex);
+	result->gpuBytes = ((size_t)tex->width * tex->height * 4 * 4) / 3;
+	return true;
+}
+
+static void unload_texture_asset(void * userData, void * assetData) {
+	(void)userData;
+	free_gl_texture(assetData);
+	free(assetData);
+}
+
+static const asset_loader_t textureLoader = {
+	"texture",
+	&load_texture_asset,
+	&unload_texture_asset,
+	NULL
+};
+
+static void load_batch_textures(const char * dirPath) {
+	// Each batch gets the texture registered for its texNumber.
+	// Missing ones are drawn with the default texture instead.
+	o3d_texreg_init(&viewer.texRegistry);
+	if (!o3d_texreg_build_from_directory(&viewer.texRegistry, dirPath)) {
+		printf("Failed to scan textures in \"%s\": %s\n", dirPath, o3d_get_last_error());
+		return;
+	}
+
+	// The registry names are paths on disk already, so the cache reads them as-is.
+	viewer.assets = asset_cache_create(ASSET_CACHE_UNLIMITED, ASSET_CACHE_UNLIMITED);
+	if (viewer.assets == NULL || !asset_cache_add_directory(viewer.assets, "")) {
+		printf("Failed to create the asset cache: %s\n", o3d_get_last_error());
+		return;
+	}
+
+	for (uint32_t b = 0; b < viewer.batchCount; ++b) {
+		viewer_batch_t * batch = &viewer.batches[b];
+		const char * name = o3d_texreg_find_any(&viewer.texRegistry, batch->texNumber, O3D_TEXREG_K);
+
+		if (batch->texPage >= 0) {
+			continue; // Drawn from the texture pack.
+		}
+
+		printf("texNumber %04u: %u faces -> %s\n", batch->texNumber, batch->vertexCount / 3,
+		       (name != NULL) ? name : "(not found)");
+
+		if (name != NULL) {
+			batch->textureAsset = asset_cache_acquire(viewer.assets, &textureLoader, name);
+			if (batch->textureAsset != NULL) {
+				batch->texture = *(const gl_texture_t *)asset_get_data(batch->textureAsset);
+			}
+		}
+	}
+
+	asset_cache_stats_t stats;
+	asset_cache_get_stats(viewer.assets, &stats);
+	printf("%u textures registered from \"%s\", %u loaded (%.2f MB).\n", viewer.texRegistry.textureCount, dirPath,
+	       stats.assetCount, (double)stats.gpuBytes / (1024.0 * 1024.0));
+}
+
+// One GL texture array per page, from the layer images next to the layout.
+static void load_texture_pack_pages(void) {
+	viewer.texPages = calloc(viewer.texPack.pageCount + 1, sizeof(viewer.texPages[0]));
+	if (viewer.texPages == NULL) {
+		fatal_error("Unable to malloc the texture pack pages! Out-of-memory!");
+	}
+
+	for (uint32_t p = 0; p < viewer.texPack.pageCount; ++p) {
+		const o3d_texpack_page_t * page = &viewer.texPack.pages[p];
+		viewer.texPages[p] = create_gl_texture_array(page->width, page->height, page->layerCount);
+
+		for (uint32_t l = 0; l < page->layerCount; ++l) {
+			char layerFileName[1024];
+			o3d_texpack_layer_filename(layerFileName, sizeof(layerFileName), viewer.texPackFileName, p, l);
+
+			// Missing or mismatched layers are left undefined (black).
+			image_t image;
+			if (!image_load_from_file(&image, layerFileName)) {
+				printf("WARNING: Unable to load texture pack layer \"%s\": %s\n", layerFileName, o3d_get_last_error());
+				continue;
+			}
+			if (image.width == page->width && image.height == page->height) {
+				upload_gl_texture_array_layer(&viewer.texPages[p], l, image.pixels);
+			} else {
+				printf("WARNING: Texture pack layer \"%s\" has the wrong size!\n", layerFileName);
+			}
+			image_free(&image);
+		}
+
+		generate_gl_texture_array_mipmaps(&viewer.texPages[p]);
+	}
+
+	printf("Texture pack \"%s\": %u textures in %u pages.\n", viewer.texPackFileName,
+	       viewer.texPack.entryCount, viewer.texPack.pageCount);
+}
+
+// A cooked .O3DC (see o3d_cooker -w) is already batched and optimized, so it skips the scene.
+static bool load_cooked_model(void) {
+	o3dc_file_t cooked;
+	if (!o3dc_load_from_file(&cooked, viewer.modelFileName) || !o3dc_build_mesh(&cooked, &viewer.mesh)) {
+		printf("Failed to load O3DC \"%s\": %s\n", viewer.modelFileName, o3d_get_last_error());
+		o3dc_close(&cooked);
+		return false;
+	}
+
+	viewer.uvsInTexPack = (cooked.header->flags & O3DC_FLAG_TEXPACK) != 0;
+	viewer.faceCount = o3d_mesh_triangle_count(&viewer.mesh);
+	o3dc_close(&cooked);
+
+	if (viewer.uvsInTexPack && viewer.texPackFileName == NULL) {
+		printf("WARNING: \"%s\" was cooked for a texture pack; pass the layout with --texpack.\n", viewer.modelFileName);
+	}
+
+	printf("Cooked model: %u vertexes, %u triangles in %u batches.\n",
+			viewer.mesh.vertexCount,
+			viewer.faceCount,
+			viewer.mesh.groupCount);
+	return true;
+}
+
+static bool load_model_or_level(void) {
+	o3d_scene_init(&viewer.scene);
+
+	if (file_has_extension(viewer.modelFileName, ".O3DC")) {
+		return load_cooked_model();
+	}
+
+	// A directory is a level: every model in it, merged into the same batches.
+	if (file_is_directory(viewer.modelFileName)) {
+		if (!o3d_scene_load_directory(&viewer.scene, viewer.modelFileName)) {
+			printf("WARNING: Some models failed to load: %s\n", o3d_get_last_error());
+		}
+	} else {
+		o3d_model_t o3d;
+		if (!o3d_load_from_file(&o3d, viewer.modelFileName)) {
+			printf("Failed to load O3D \"%s\": %s\n", viewer.modelFileName, o3d_get_last_error());
+			return false;
+		}
+		uint32_t modelIndex;
+		if (!o3d_scene_add_model(&viewer.scene, &o3d, viewer.modelFileName, &modelIndex) ||
+		    !o3d_scene_add_instance(&viewer.scene, modelIndex, NULL, NULL)) {
+			o3d_free(&o3d);
+			printf("Failed to set up the model: %s\n", o3d_get_last_error());
+			return false;
+		}
+	}
+
+	if (!o3d_batch_build_scene(&viewer.mesh, &viewer.scene)) {
+		printf("Failed to build the draw batches for \"%s\": %s\n", viewer.modelFileName, o3d_get_last_error());
+		return false;
+	}
+
+	viewer.faceCount = 0;
+	for (uint32_t m = 0; m < viewer.scene.modelCount; ++m) {
+		viewer.faceCount += viewer.scene.models[m].faceCount;
+	}
+
+	printf("%u models, %u instances merged into %u batches.\n",
+			viewer.scene.modelCount,
+			viewer.scene.instanceCount,
+			viewer.mesh.groupCount);
+	return true;
+}
+
+// Loads the model and sets the scale and camera. Nothing GL related, shared with the headless mode.
+static bool setup_model_and_view(void) {
 	if (viewer.modelFileName == NULL || *viewer.modelFileName == '\0') {
-		fatal_error("No valid filename provided!");
+		printf("No valid filename provided!\n");
+		return false;
+	}
+
+	if (!load_model_or_level()) {
+		return false;
 	}
 
-	if (!o3d_load_from_file(&viewer.o3d, viewer.modelFileName)) {
-		fatal_error("Failed to load O3D \"%s\": %s", viewer.modelFileName, o3d_get_last_error());
+	if (viewer.animate && !setup_animation()) {
+		return false;
+	}
+
+	// Batches found in the pack are drawn from its pages instead of the textures.
+	if (viewer.texPackFileName != NULL && !o3d_texpack_load_file(&viewer.texPack, viewer.texPackFileName)) {
+		printf("WARNING: Failed to load texture pack \"%s\": %s\n", viewer.texPackFileName, o3d_get_last_error());
+		o3d_texpack_free(&viewer.texPack);
 	}
 
 	printf("Model imported successfully...\n");
 	printf("AABB.mins  = ( %+f, %+f, %+f )\n",
-			viewer.o3d.aabb.mins.x,
-			viewer.o3d.aabb.mins.y,
-			viewer.o3d.aabb.mins.z);
+			viewer.mesh.aabb.mins.x,
+			viewer.mesh.aabb.mins.y,
+			viewer.mesh.aabb.mins.z);
 	printf("AABB.maxs  = ( %+f, %+f, %+f )\n",
-			viewer.o3d.aabb.maxs.x,
-			viewer.o3d.aabb.maxs.y,
-			viewer.o3d.aabb.maxs.z);
-	printf("OBJ.center = ( %+f, %+f, %+f )\n",
-			viewer.o3d.centerPoint.x,
-			viewer.o3d.centerPoint.y,
-			viewer.o3d.centerPoint.z);
+			viewer.mesh.aabb.maxs.x,
+			viewer.mesh.aabb.maxs.y,
+			viewer.mesh.aabb.maxs.z);
 
 	// Get the distance between the min/max points:
 	VmathVector3 vmin, vmax, dist;
-	vmathV3MakeFromElems(&vmin, viewer.o3d.aabb.mins.x, viewer.o3d.aabb.mins.y, viewer.o3d.aabb.mins.z);
-	vmathV3MakeFromElems(&vmax, viewer.o3d.aabb.maxs.x, viewer.o3d.aabb.maxs.y, viewer.o3d.aabb.maxs.z);
+	vmathV3MakeFromElems(&vmin, viewer.mesh.aabb.mins.x, viewer.mesh.aabb.mins.y, viewer.mesh.aabb.mins.z);
+	vmathV3MakeFromElems(&vmax, viewer.mesh.aabb.maxs.x, viewer.mesh.aabb.maxs.y, viewer.mesh.aabb.maxs.z);
 	vmathV3Sub(&dist, &vmin, &vmax);
 
 	// Scale the model by the length of this distance.
@@ -285,6 +668,13 @@ static void import_model(void) {
 
 	vmathM4MakeIdentity(&viewer.modelToWorldMatrix);
 	vmathM4Mul(&viewer.vpMatrix, &viewer.projMatrix, &viewer.viewMatrix);
+	return true;
+}
+
+static void import_model(void) {
+	if (!setup_model_and_view()) {
+		fatal_error("Unable to import \"%s\"!", (viewer.modelFileName != NULL) ? viewer.modelFileName : "");
+	}
 
 	printf("Setting up OpenGL Vertex Buffers...\n");
 	setup_model_vbo();
@@ -302,13 +692,25 @@ static void import_model(void) {
 		fatal_error("Failed to create the GL render program! Unable to proceed.");
 	}
 
-	// Use a default texture if none was provided.
-	if (viewer.textureFileName == NULL) {
-		viewer.textureFileName = "checkerboard.png";
+	// If given a directory, each batch uses its own texture from it,
+	// with the default for any missing. Otherwise all share the one given.
+	if (viewer.textureFileName != NULL && file_is_directory(viewer.textureFileName)) {
+		load_batch_textures(viewer.textureFileName);
+		viewer.texture = load_gl_texture_from_file("checkerboard.png");
+	} else {
+		// Use a default texture if none was provided.
+		if (viewer.textureFileName == NULL) {
+			viewer.textureFileName = "checkerboard.png";
+		}
+		viewer.texture = load_gl_texture_from_file(viewer.textureFileName);
+	}
+
+	if (viewer.texPack.pageCount != 0) {
+		load_texture_pack_pages();
 	}
-	viewer.texture = load_gl_texture_from_file(viewer.textureFileName);
 
 	refresh_window_title();
+	viewer.animClockStart = clock_seconds();
 
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
@@ -321,30 +723,46 @@ static void import_model(void) {
  * Application callbacks:
  * ======================================================== */
 
+static void setup_benchmark(void);
+static void free_benchmark(void);
+
 static void initialize(void) {
 	printf("---- O3D viewer starting up. Model file: \"%s\" ----\n", viewer.modelFileName);
 	printf("GL_VENDOR:  %s\n", glGetString(GL_VENDOR));
 	printf("GL_VERSION: %s\n", glGetString(GL_VERSION));
 	printf("GL_SHADING_LANGUAGE_VERSION: %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
 	import_model();
+
+	if (viewer.benchmarkFileName != NULL) {
+		setup_benchmark();
+	}
 }
 
 static void shutdown(void) {
 	printf("Exiting...\n");
-	o3d_free(&viewer.o3d);
+	for (uint32_t b = 0; b < viewer.batchCount; ++b) {
+		if (viewer.batches[b].textureAsset != NULL) {
+			asset_cache_release(viewer.assets, viewer.batches[b].textureAsset);
+		}
+	}
+	asset_cache_destroy(viewer.assets);
+	for (uint32_t p = 0; p < viewer.texPack.pageCount && viewer.texPages != NULL; ++p) {
+		free_gl_texture_array(&viewer.texPages[p]);
+	}
+	free(viewer.texPages);
+	o3d_texpack_free(&viewer.texPack);
+	free(viewer.batches);
+	free_animation();
+	free_benchmark();
+	o3d_mesh_free(&viewer.mesh);
+	o3d_scene_free(&viewer.scene);
+	o3d_texreg_free(&viewer.texRegistry);
 	free_gl_texture(&viewer.texture);
 	free_gl_program(&viewer.program);
 	free_gl_vbo(&viewer.vbo);
 }
 
-static void draw_frame(void) {
-	if (mouse.leftButtonDown) {
-		viewer.degreesRotationY += mouse.deltaX;
-		viewer.degreesRotationZ += mouse.deltaY;
-		mouse.deltaX = 0;
-		mouse.deltaY = 0;
-	}
-
+static void update_mvp_matrix(void) {
 	VmathMatrix4 matTranslation;
 	VmathMatrix4 matRotation;
 
@@ -359,17 +777,228 @@ static void draw_frame(void) {
 
 	vmathM4Mul(&viewer.modelToWorldMatrix, &matTranslation, &matRotation);
 	vmathM4Mul(&viewer.mvpMatrix, &viewer.vpMatrix, &viewer.modelToWorldMatrix);
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, viewer.texture.texHandle);
+static void draw_frame(void) {
+	if (mouse.leftButtonDown) {
+		viewer.degreesRotationY += mouse.deltaX;
+		viewer.degreesRotationZ += mouse.deltaY;
+		mouse.deltaX = 0;
+		mouse.deltaY = 0;
+	}
+
+	update_mvp_matrix();
 
 	glBindVertexArray(viewer.vbo.vaHandle);
 	glUseProgram(viewer.program.progHandle);
 
+	if (viewer.animate) {
+		const float time = viewer.animStartTime + (float)(clock_seconds() - viewer.animClockStart);
+		animate_draw_vertexes(viewer.animVerts, viewer.animVertCount, time);
+		glBindBuffer(GL_ARRAY_BUFFER, viewer.vbo.vbHandle);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)(viewer.animVertCount * sizeof(gl_draw_vertex_t)), viewer.animVerts);
+	}
+
 	glUniformMatrix4fv(viewer.program.u_mvpMatrix, 1, GL_FALSE, (const float *)&viewer.mvpMatrix);
 	glUniform1i(viewer.program.u_renderModeFlag, viewer.renderMode);
 
-	glDrawArrays((viewer.renderMode == RENDER_WIREFRAME) ? GL_LINE_STRIP : GL_TRIANGLES, 0, viewer.vbo.vertCount);
+	// One draw per texture, for the whole model or level. Packed batches
+	// are sorted by page, so each page array is bound once and only the
+	// layer changes between their draws.
+	const GLenum primitive = (viewer.renderMode == RENDER_WIREFRAME) ? GL_LINE_STRIP : GL_TRIANGLES;
+	int boundPage = -1;
+
+	for (uint32_t b = 0; b < viewer.batchCount; ++b) {
+		const viewer_batch_t * batch = &viewer.batches[b];
+
+		if (batch->texPage >= 0) {
+			if (batch->texPage != boundPage) {
+				glActiveTexture(GL_TEXTURE1);
+				glBindTexture(GL_TEXTURE_2D_ARRAY, viewer.texPages[batch->texPage].texHandle);
+				boundPage = batch->texPage;
+			}
+			glUniform1i(viewer.program.u_texLayer, batch->texLayer);
+		} else {
+			const GLuint texHandle = (batch->texture.texHandle != 0) ? batch->texture.texHandle : viewer.texture.texHandle;
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, texHandle);
+			glUniform1i(viewer.program.u_texLayer, -1);
+		}
+		glDrawArrays(primitive, (GLint)batch->firstVertex, (GLsizei)batch->vertexCount);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/* ========================================================
+ * Offscreen benchmark:
+ * ======================================================== */
+
+static void setup_benchmark(void) {
+	viewer.frameTimes = calloc((size_t)viewer.benchmarkFrames, sizeof(double));
+	if (viewer.frameTimes == NULL) {
+		fatal_error("Out of memory for the benchmark frame times!");
+	}
+
+	// Timer queries are core in GL 3.3; the viewer only asks for 3.2.
+	if (gl3wIsSupported(3, 3)) {
+		viewer.gpuTimes = calloc((size_t)viewer.benchmarkFrames, sizeof(double));
+		glGenQueries(1, &viewer.timerQuery);
+	}
+
+	printf("Benchmarking %d frames (after %d warm-up frames), GPU timer queries %s...\n",
+	       viewer.benchmarkFrames, BENCHMARK_WARMUP_FRAMES, (viewer.gpuTimes != NULL) ? "on" : "not supported");
+}
+
+static void free_benchmark(void) {
+	if (viewer.timerQuery != 0) {
+		glDeleteQueries(1, &viewer.timerQuery);
+		viewer.timerQuery = 0;
+	}
+	free(viewer.frameTimes);
+	free(viewer.gpuTimes);
+	viewer.frameTimes = NULL;
+	viewer.gpuTimes   = NULL;
+}
+
+static int compare_doubles(const void * a, const void * b) {
+	const double da = *(const double *)a;
+	const double db = *(const double *)b;
+	return (da < db) ? -1 : ((da > db) ? 1 : 0);
+}
+
+static void write_json_string(FILE * file, const char * str) {
+	fputc('"', file);
+	for (const char * p = (str != NULL) ? str : ""; *p != '\0'; ++p) {
+		if (*p == '"' || *p == '\\') {
+			fputc('\\', file);
+			fputc(*p, file);
+		} else if ((unsigned char)*p < 0x20) {
+			fprintf(file, "\\u%04x", (unsigned)*p);
+		} else {
+			fputc(*p, file);
+		}
+	}
+	fputc('"', file);
+}
+
+// Mean, min, max and percentiles (nearest rank) of one set of timings.
+static void write_json_timing_stats(FILE * file, const char * name, const double * times, int count) {
+	double * sorted = malloc((size_t)count * sizeof(double));
+	if (sorted == NULL) {
+		fatal_error("Out of memory for the benchmark stats!");
+	}
+	memcpy(sorted, times, (size_t)count * sizeof(double));
+	qsort(sorted, (size_t)count, sizeof(double), &compare_doubles);
+
+	double sum = 0.0;
+	for (int i = 0; i < count; ++i) {
+		sum += sorted[i];
+	}
+
+	static const int percentiles[] = { 50, 95, 99 };
+	fprintf(file, "  \"%s\": { \"mean\": %.4f, \"min\": %.4f, \"max\": %.4f", name,
+	        sum / count, sorted[0], sorted[count - 1]);
+	for (size_t p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); ++p) {
+		const int rank = (percentiles[p] * count + 99) / 100; // ceil(p% * count), 1-based.
+		fprintf(file, ", \"p%d\": %.4f", percentiles[p], sorted[(rank > 0) ? (rank - 1) : 0]);
+	}
+	fprintf(file, " },\n");
+	free(sorted);
+}
+
+static void write_json_timings(FILE * file, const char * name, const double * times, int count) {
+	fprintf(file, "  \"%s\": [", name);
+	for (int i = 0; i < count; ++i) {
+		fprintf(file, "%s%.4f", (i != 0) ? ", " : "", times[i]);
+	}
+	fprintf(file, "]");
+}
+
+static bool write_benchmark_results(const char * jsonFileName) {
+	FILE * file = fopen(jsonFileName, "wt");
+	if (file == NULL) {
+		return false;
+	}
+
+	const int count = viewer.benchmarkFrames;
+	double totalMs = 0.0;
+	for (int i = 0; i < count; ++i) {
+		totalMs += viewer.frameTimes[i];
+	}
+
+	fprintf(file, "{\n  \"model\": ");
+	write_json_string(file, viewer.modelFileName);
+	fprintf(file, ",\n  \"gl_vendor\": ");
+	write_json_string(file, (const char *)glGetString(GL_VENDOR));
+	fprintf(file, ",\n  \"gl_renderer\": ");
+	write_json_string(file, (const char *)glGetString(GL_RENDERER));
+	fprintf(file, ",\n  \"gl_version\": ");
+	write_json_string(file, (const char *)glGetString(GL_VERSION));
+	fprintf(file, ",\n  \"render_mode\": ");
+	write_json_string(file, renderModeStrings[viewer.renderMode]);
+	fprintf(file, ",\n");
+
+	fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n", viewer.app.windowWidth, viewer.app.windowHeight);
+	fprintf(file, "  \"frames\": %d,\n  \"warmup_frames\": %d,\n", count, BENCHMARK_WARMUP_FRAMES);
+	fprintf(file, "  \"vertexes\": %u,\n  \"batches\": %u,\n  \"instances\": %u,\n",
+	        viewer.vbo.vertCount, viewer.batchCount, viewer.scene.instanceCount);
+	fprintf(file, "  \"fps\": %.2f,\n", (totalMs > 0.0) ? (count * 1000.0 / totalMs) : 0.0);
+
+	write_json_timing_stats(file, "frame_ms", viewer.frameTimes, count);
+	if (viewer.gpuTimes != NULL) {
+		write_json_timing_stats(file, "gpu_ms", viewer.gpuTimes, count);
+	} else {
+		fprintf(file, "  \"gpu_ms\": null,\n");
+	}
+
+	write_json_timings(file, "frame_times_ms", viewer.frameTimes, count);
+	if (viewer.gpuTimes != NULL) {
+		fprintf(file, ",\n");
+		write_json_timings(file, "gpu_times_ms", viewer.gpuTimes, count);
+	}
+	fprintf(file, "\n}\n");
+
+	const bool success = (ferror(file) == 0);
+	fclose(file);
+	return success;
+}
+
+// Draw callback of the benchmark: the scripted orbit, timed.
+static void draw_benchmark_frame(void) {
+	const int frame = viewer.benchmarkFrame - BENCHMARK_WARMUP_FRAMES;
+	const bool timed = (frame >= 0 && frame < viewer.benchmarkFrames);
+
+	viewer.degreesRotationY = (frame >= 0) ? (360.0f * (float)frame / (float)viewer.benchmarkFrames) : 0.0f;
+
+	// glFinish() makes the CPU time cover the GPU work too, frame by frame.
+	const double startTime = clock_seconds();
+	if (timed && viewer.timerQuery != 0) {
+		glBeginQuery(GL_TIME_ELAPSED, viewer.timerQuery);
+	}
+
+	draw_frame();
+
+	if (timed && viewer.timerQuery != 0) {
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+	glFinish();
+
+	if (timed) {
+		viewer.frameTimes[frame] = (clock_seconds() - startTime) * 1000.0;
+		if (viewer.timerQuery != 0) {
+			GLuint64 elapsedNs = 0;
+			glGetQueryObjectui64v(viewer.timerQuery, GL_QUERY_RESULT, &elapsedNs);
+			viewer.gpuTimes[frame] = (double)elapsedNs / 1000000.0;
+		}
+	}
+
+	if (++viewer.benchmarkFrame == BENCHMARK_WARMUP_FRAMES + viewer.benchmarkFrames) {
+		CHECK_GL_ERRORS();
+		if (!write_benchmark_results(viewer.benchmarkFileName)) {
+			fatal_error("Failed to write the benchmark results to \"%s\"!", viewer.benchmarkFileName);
+		}
+		printf("Benchmark results written to \"%s\".\n", viewer.benchmarkFileName);
+	}
 }
 
 /* ========================================================
@@ -434,32 +1063,210 @@ static void mouse_button_callback(GLFWwindow * window, int button, int action, i
 	}
 }
 
+/* ========================================================
+ * Headless rendering (software rasterizer):
+ * ======================================================== */
+
+// Loads an image for the software rasterizer, or leaves it empty (drawn white) if it fails.
+static void load_headless_image(image_t * image, const char * filename) {
+	if (!image_load_from_file(image, filename)) {
+		printf("WARNING: Unable to load texture image \"%s\": %s\n", filename, o3d_get_last_error());
+	}
+}
+
+//
+// Same model, camera and modes as the window, drawn on the CPU (see sw_raster.h)
+// and saved as a PNG, so previews and render tests don't need a GPU or display.
+//
+static bool render_headless(const char * pngFileName) {
+	if (!setup_model_and_view()) {
+		return false;
+	}
+
+	uint32_t vertCount;
+	gl_draw_vertex_t * verts = build_draw_vertexes(&vertCount);
+
+	if (viewer.animate) {
+		animate_draw_vertexes(verts, vertCount, viewer.animStartTime);
+	}
+
+	sw_batch_t * swBatches = calloc(viewer.batchCount + 1, sizeof(swBatches[0]));
+	image_t * images = calloc(viewer.batchCount + 1, sizeof(images[0]));
+	if (swBatches == NULL || images == NULL) {
+		free(swBatches);
+		free(images);
+		free(verts);
+		printf("Unable to malloc the headless batches!\n");
+		return false;
+	}
+
+	// Same texture choice as import_model(). The last image is the shared default.
+	image_t * defaultImage = &images[viewer.batchCount];
+	const bool textureDir = (viewer.textureFileName != NULL && file_is_directory(viewer.textureFileName));
+
+	if (textureDir) {
+		o3d_texreg_init(&viewer.texRegistry);
+		if (!o3d_texreg_build_from_directory(&viewer.texRegistry, viewer.textureFileName)) {
+			printf("Failed to scan textures in \"%s\": %s\n", viewer.textureFileName, o3d_get_last_error());
+		}
+		load_headless_image(defaultImage, "checkerboard.png");
+	} else {
+		load_headless_image(defaultImage, (viewer.textureFileName != NULL) ? viewer.textureFileName : "checkerboard.png");
+	}
+
+	for (uint32_t b = 0; b < viewer.batchCount; ++b) {
+		const viewer_batch_t * batch = &viewer.batches[b];
+		swBatches[b].firstVertex = batch->firstVertex;
+		swBatches[b].vertexCount = batch->vertexCount;
+		swBatches[b].texture     = defaultImage;
+
+		// Packed batches sample the layer image, so the output matches the window.
+		if (batch->texPage >= 0) {
+			char layerFileName[1024];
+			o3d_texpack_layer_filename(layerFileName, sizeof(layerFileName), viewer.texPackFileName,
+			                           (uint32_t)batch->texPage, (uint32_t)batch->texLayer);
+			load_headless_image(&images[b], layerFileName);
+			if (images[b].pixels != NULL) {
+				swBatches[b].texture = &images[b];
+			}
+			continue;
+		}
+
+		const char * name = textureDir ? o3d_texreg_find_any(&viewer.texRegistry, batch->texNumber, O3D_TEXREG_K) : NULL;
+		if (name != NULL) {
+			load_headless_image(&images[b], name);
+			if (images[b].pixels != NULL) {
+				swBatches[b].texture = &images[b];
+			}
+		}
+	}
+
+	update_mvp_matrix();
+
+	sw_framebuffer_t fb;
+	bool success = sw_framebuffer_init(&fb, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+	if (success) {
+		sw_framebuffer_clear(&fb, viewer.app.clearScrColor);
+
+		const double startTime = clock_seconds();
+		success = sw_draw(&fb, verts, swBatches, viewer.batchCount, (const float *)&viewer.mvpMatrix,
+		                  (sw_render_mode_t)viewer.renderMode, 0);
+		const double endTime = clock_seconds();
+
+		if (success) {
+			printf("Rendered %u vertexes in %.2f ms (%s, %ux%u, %u threads).\n", vertCount,
+			       (endTime - startTime) * 1000.0, renderModeStrings[viewer.renderMode],
+			       fb.width, fb.height, parallel_cpu_count());
+			success = image_write_png(pngFileName, fb.color, fb.width, fb.height);
+		}
+	}
+
+	if (success) {
+		printf("Wrote \"%s\".\n", pngFileName);
+	} else {
+		printf("Headless rendering failed: %s\n", o3d_get_last_error());
+	}
+
+	sw_framebuffer_free(&fb);
+	for (uint32_t i = 0; i <= viewer.batchCount; ++i) {
+		image_free(&images[i]);
+	}
+	free(images);
+	free(swBatches);
+	free(verts);
+
+	free(viewer.batches);
+	free_animation();
+	free_benchmark();
+	o3d_mesh_free(&viewer.mesh);
+	o3d_scene_free(&viewer.scene);
+	o3d_texreg_free(&viewer.texRegistry);
+	o3d_texpack_free(&viewer.texPack);
+	return success;
+}
+
 /* ========================================================
  * main():
  * ======================================================== */
 
+static bool parse_render_mode(const char * name, int * mode) {
+	static const char * names[RENDER_MODE_COUNT] = { "textured", "wireframe", "color", "default" };
+	for (int m = 0; m < RENDER_MODE_COUNT; ++m) {
+		if (strcmp(name, names[m]) == 0) {
+			*mode = m;
+			return true;
+		}
+	}
+	return false;
+}
+
 int main(int argc, const char * argv[]) {
-	if (argc < 2) {
+	const char * headlessFileName = NULL;
+
+	// Set a couple defaults...
+	viewer.renderMode = RENDER_DEFAULT_COLOR;
+	viewer.modelZ     = -1.0f;
+
+	// Options come before the file names.
+	int argIndex = 1;
+	bool badArgs = false;
+	while (argIndex < argc && argv[argIndex][0] == '-' && argv[argIndex][1] == '-') {
+		const char * opt = argv[argIndex++];
+		if (strcmp(opt, "--headless") == 0 && argIndex < argc) {
+			headlessFileName = argv[argIndex++];
+		} else if (strcmp(opt, "--benchmark") == 0 && argIndex < argc) {
+			viewer.benchmarkFileName = argv[argIndex++];
+		} else if (strcmp(opt, "--frames") == 0 && argIndex < argc) {
+			viewer.benchmarkFrames = atoi(argv[argIndex++]);
+			badArgs = (viewer.benchmarkFrames <= 0) || badArgs;
+		} else if (strcmp(opt, "--texpack") == 0 && argIndex < argc) {
+			viewer.texPackFileName = argv[argIndex++];
+		} else if (strcmp(opt, "--animate") == 0 && argIndex < argc) {
+			viewer.animate = true;
+			viewer.animStartTime = (float)atof(argv[argIndex++]);
+		} else if (strcmp(opt, "--mode") == 0 && argIndex < argc) {
+			badArgs = !parse_render_mode(argv[argIndex++], &viewer.renderMode) || badArgs;
+		} else {
+			badArgs = true;
+		}
+	}
+
+	// Both replace the interactive window, each in its own way.
+	if (headlessFileName != NULL && viewer.benchmarkFileName != NULL) {
+		badArgs = true;
+	}
+	// Only the benchmark counts frames.
+	if (viewer.benchmarkFrames != 0 && viewer.benchmarkFileName == NULL) {
+		badArgs = true;
+	}
+
+	if (badArgs || argIndex >= argc) {
 		printf(
 			"Not enough arguments! Specify a file to view.\n"
 			" Usage:\n"
-			" $ %s <o3d_file> [texture_filename]\n\n",
-		argv[0]);
+			" $ %s [options] <o3d_file | o3dc_file | level_dir> [texture_filename | texture_dir]\n"
+			" Options:\n"
+			"  --headless <out.png>  Render on the CPU to a PNG image instead of opening a window.\n"
+			"  --animate <time>      Play the procedural test rig (not game animations) from <time>\n"
+			"                        seconds. The headless image is the pose at <time>.\n"
+			"  --mode <mode>         Render mode: textured, wireframe, color or default.\n"
+			"  --texpack <layout>    Draw the textures from a texture pack (see o3d_texpacker).\n"
+			"  --benchmark <json>    Render an orbit around the model in a hidden window, with no\n"
+			"                        vsync, and write the frame timings to a JSON file.\n"
+			"  --frames <n>          Frames timed by --benchmark (default %d).\n\n",
+		argv[0], BENCHMARK_DEFAULT_FRAMES);
 		return EXIT_FAILURE;
 	}
 
 	// The O3D file:
-	viewer.modelFileName = argv[1];
+	viewer.modelFileName = argv[argIndex];
 
 	// Optionally, a texture to apply:
-	if (argc >= 3) {
-		viewer.textureFileName = argv[2];
+	if (argIndex + 1 < argc) {
+		viewer.textureFileName = argv[argIndex + 1];
 	}
 
-	// Set a couple defaults...
-	viewer.renderMode = RENDER_DEFAULT_COLOR;
-	viewer.modelZ     = -1.0f;
-
 	viewer.app.windowWidth         = WINDOW_WIDTH;
 	viewer.app.windowHeight        = WINDOW_HEIGHT;
 	viewer.app.windowTitle         = "Darkstone O3D Model Viewer";
@@ -475,5 +1282,18 @@ int main(int argc, const char * argv[]) {
 	viewer.app.mouseScrollCallback = &mouse_scroll_callback;
 	viewer.app.useCustomCursor     = true;
 
+	if (viewer.benchmarkFileName != NULL) {
+		if (viewer.benchmarkFrames <= 0) {
+			viewer.benchmarkFrames = BENCHMARK_DEFAULT_FRAMES;
+		}
+		viewer.app.hidden         = true;
+		viewer.app.frameLimit     = BENCHMARK_WARMUP_FRAMES + viewer.benchmarkFrames;
+		viewer.app.onDrawCallback = &draw_benchmark_frame;
+	}
+
+	if (headlessFileName != NULL) {
+		return render_headless(headlessFileName) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	init_glfw_app(&viewer.app);
 }
@@ -0,0 +1,109 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: parallel.c
+ * Created on: 17/10/26
+ * Brief: Minimal parallel-for over a set of independent jobs, using POSIX threads.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "parallel.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// NOTE: pthreads and sysconf() are POSIX. On Windows this
+// will need the native thread API or a pthreads port.
+#include <pthread.h>
+#include <unistd.h>
+
+enum { PARALLEL_MAX_THREADS = 64 };
+
+typedef struct parallel_context {
+	parallel_job_f   jobFunc;
+	void           * userData;
+	uint32_t         jobCount;
+	atomic_uint      nextJob;
+} parallel_context_t;
+
+/* ========================================================
+ * parallel_cpu_count():
+ * ======================================================== */
+
+uint32_t parallel_cpu_count(void) {
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (uint32_t)count : 1;
+}
+
+/* ========================================================
+ * parallel_worker():
+ * ======================================================== */
+
+static void * parallel_worker(void * arg) {
+	parallel_context_t * ctx = arg;
+	for (;;) {
+		const uint32_t job = atomic_fetch_add(&ctx->nextJob, 1);
+		if (job >= ctx->jobCount) {
+			break;
+		}
+		ctx->jobFunc(ctx->userData, job);
+	}
+	return NULL;
+}
+
+/* ========================================================
+ * parallel_for():
+ * ======================================================== */
+
+bool parallel_for(uint32_t jobCount, uint32_t threadCount, parallel_job_f jobFunc, void * userData) {
+	assert(jobFunc != NULL);
+
+	if (threadCount == 0) {
+		threadCount = parallel_cpu_count();
+	}
+	if (threadCount > jobCount) {
+		threadCount = jobCount;
+	}
+	if (threadCount > PARALLEL_MAX_THREADS) {
+		threadCount = PARALLEL_MAX_THREADS;
+	}
+
+	parallel_context_t ctx;
+	ctx.jobFunc  = jobFunc;
+	ctx.userData = userData;
+	ctx.jobCount = jobCount;
+	atomic_init(&ctx.nextJob, 0);
+
+	if (threadCount <= 1) {
+		parallel_worker(&ctx);
+		return true;
+	}
+
+	// The calling thread also works, so spawn one less.
+	pthread_t threads[PARALLEL_MAX_THREADS];
+	uint32_t started = 0;
+	bool success = true;
+
+	for (uint32_t t = 0; t < threadCount - 1; ++t) {
+		if (pthread_create(&threads[started], NULL, &parallel_worker, &ctx) != 0) {
+			success = false;
+			break;
+		}
+		++started;
+	}
+
+	parallel_worker(&ctx);
+
+	for (uint32_t t = 0; t < started; ++t) {
+		pthread_join(threads[t], NULL);
+	}
+
+	return success;
+}
@@ -0,0 +1,44 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: parallel.h
+ * Created on: 17/10/26
+ * Brief: Minimal parallel-for over a set of independent jobs, using POSIX threads.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_PARALLEL_H
+#define DARKSTONE_PARALLEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Job callback. Called once for each index in [0, jobCount),
+ * from any of the worker threads, in no particular order.
+ */
+typedef void (* parallel_job_f)(void * userData, uint32_t jobIndex);
+
+/*
+ * Number of CPUs online. Never less than 1.
+ */
+uint32_t parallel_cpu_count(void);
+
+/*
+ * Runs `jobFunc` for every job index and waits for all of them to finish.
+ * Workers grab the next unprocessed index as they go, so uneven job sizes
+ * balance out. `threadCount` of 0 uses parallel_cpu_count(). With a single
+ * thread (or job), everything runs on the calling thread.
+ *
+ * Returns false only if the threads couldn't be started, in which
+ * case the remaining jobs still run on the calling thread.
+ */
+bool parallel_for(uint32_t jobCount, uint32_t threadCount, parallel_job_f jobFunc, void * userData);
+
+#endif // DARKSTONE_PARALLEL_H
@@ -0,0 +1,310 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: pcm.c
+ * Created on: 17/10/26
+ * Brief: Batch PCM processing: conversion to float, resampling and peak/RMS levels, with SIMD.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "pcm.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+// The integer to float conversions need SSE2, which every x86-64 CPU has.
+#if defined(__SSE2__) || defined(_M_X64)
+	#define PCM_USE_SSE2 1
+	#include <emmintrin.h>
+#else
+	#define PCM_USE_SSE2 0
+#endif
+
+enum {
+	PCM_LEVELS_BLOCK = 4096 // Samples summed in float before going into the double total.
+};
+
+/* ========================================================
+ * pcm_to_float():
+ * ======================================================== */
+
+static void pcm_u8_to_float(const uint8_t * src, size_t count, float * dest) {
+	const float scale = 1.0f / 128.0f;
+	size_t i = 0;
+
+#if PCM_USE_SSE2
+	const __m128i zero    = _mm_setzero_si128();
+	const __m128i bias    = _mm_set1_epi16(128);
+	const __m128  vscale  = _mm_set1_ps(scale);
+	for (; i + 16 <= count; i += 16) {
+		const __m128i bytes = _mm_loadu_si128((const __m128i *)(src + i));
+		const __m128i lo16  = _mm_sub_epi16(_mm_unpacklo_epi8(bytes, zero), bias);
+		const __m128i hi16  = _mm_sub_epi16(_mm_unpackhi_epi8(bytes, zero), bias);
+		_mm_storeu_ps(dest + i +  0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo16, lo16), 16)), vscale));
+		_mm_storeu_ps(dest + i +  4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo16, lo16), 16)), vscale));
+		_mm_storeu_ps(dest + i +  8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi16, hi16), 16)), vscale));
+		_mm_storeu_ps(dest + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi16, hi16), 16)), vscale));
+	}
+#endif // PCM_USE_SSE2
+
+	for (; i < count; ++i) {
+		dest[i] = (float)((int)src[i] - 128) * scale;
+	}
+}
+
+static void pcm_s16_to_float(const uint8_t * src, size_t count, float * dest) {
+	const float scale = 1.0f / 32768.0f;
+	size_t i = 0;
+
+#if PCM_USE_SSE2
+	const __m128 vscale = _mm_set1_ps(scale);
+	for (; i + 8 <= count; i += 8) {
+		// Duplicating each 16 bits lane then shifting right sign extends it.
+		const __m128i words = _mm_loadu_si128((const __m128i *)(src + (i * 2)));
+		const __m128i lo32  = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+		const __m128i hi32  = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+		_mm_storeu_ps(dest + i + 0, _mm_mul_ps(_mm_cvtepi32_ps(lo32), vscale));
+		_mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi32), vscale));
+	}
+#endif // PCM_USE_SSE2
+
+	for (; i < count; ++i) {
+		const uint8_t * p = src + (i * 2);
+		dest[i] = (float)(int16_t)(p[0] | (p[1] << 8)) * scale;
+	}
+}
+
+static void pcm_s24_to_float(const uint8_t * src, size_t count, float * dest) {
+	const float scale = 1.0f / 8388608.0f;
+	for (size_t i = 0; i < count; ++i, src += 3) {
+		// Into the top 24 bits, then an arithmetic shift back down.
+		const int32_t sample = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24)) >> 8;
+		dest[i] = (float)sample * scale;
+	}
+}
+
+static void pcm_s32_to_float(const uint8_t * src, size_t count, float * dest) {
+	const double scale = 1.0 / 2147483648.0;
+	for (size_t i = 0; i < count; ++i, src += 4) {
+		const int32_t sample = (int32_t)((uint32_t)src[0] | ((uint32_t)src[1] << 8) |
+		                                 ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24));
+		dest[i] = (float)(sample * scale);
+	}
+}
+
+void pcm_to_float(const wav_info_t * info, uint32_t firstFrame, uint32_t frameCount, float * dest) {
+
+	assert(info != NULL);
+	assert(dest != NULL);
+	assert(firstFrame <= info->frameCount && frameCount <= info->frameCount - firstFrame);
+
+	const uint8_t * src = info->samples + ((size_t)firstFrame * info->bytesPerFrame);
+	const size_t count  = (size_t)frameCount * info->channels;
+
+	if (info->format == WAV_FORMAT_FLOAT) {
+		memcpy(dest, src, count * sizeof(float));
+		return;
+	}
+
+	switch (info->bitsPerSample) {
+	case 8 :
+		pcm_u8_to_float(src, count, dest);
+		break;
+	case 16 :
+		pcm_s16_to_float(src, count, dest);
+		break;
+	case 24 :
+		pcm_s24_to_float(src, count, dest);
+		break;
+	case 32 :
+		pcm_s32_to_float(src, count, dest);
+		break;
+	default :
+		assert(false && "Bad bitsPerSample! wav_read_info() rejects it.");
+		break;
+	} // switch (info->bitsPerSample)
+}
+
+/* ========================================================
+ * pcm_resampled_frame_count():
+ * ======================================================== */
+
+uint32_t pcm_resampled_frame_count(uint32_t srcFrames, uint32_t srcRate, uint32_t destRate) {
+	assert(srcRate != 0 && destRate != 0);
+	if (srcFrames == 0) {
+		return 0;
+	}
+	// Up to the last source frame, so the interpolation never runs past it.
+	return (uint32_t)(((uint64_t)(srcFrames - 1) * destRate) / srcRate) + 1;
+}
+
+/* ========================================================
+ * pcm_resample():
+ * ======================================================== */
+
+// Fraction part of a 32.32 fixed point source position.
+static inline float pcm_position_fraction(uint64_t position) {
+	return (float)(uint32_t)position * (1.0f / 4294967296.0f);
+}
+
+#if PCM_USE_SSE2
+//
+// Mono and stereo, 4 output frames at a time. Each source frame is loaded
+// along with the one after it (8 or 16 contiguous bytes), then the frames
+// are transposed to interpolate all of their samples in one go. Stops at
+// the first group reaching the last source frame, which has no next one.
+// Returns the frames done; `*position` is advanced past them.
+//
+static uint32_t pcm_resample_sse2(const float * src, uint32_t channels, uint32_t lastFrame, uint64_t step,
+                                  uint32_t destFrames, float * dest, uint64_t * position) {
+	uint64_t pos = *position;
+	uint32_t i = 0;
+
+	for (; i + 4 <= destFrames && (uint32_t)((pos + (3 * step)) >> 32) < lastFrame; i += 4) {
+		const float * frames[4];
+		float t[4];
+		for (int k = 0; k < 4; ++k, pos += step) {
+			frames[k] = src + ((size_t)(pos >> 32) * channels);
+			t[k] = pcm_position_fraction(pos);
+		}
+
+		if (channels == 1) {
+			// [a0 b0 a1 b1] and [a2 b2 a3 b3] to [a0 a1 a2 a3] and [b0 b1 b2 b3].
+			const __m128 p01 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)frames[0]), (const __m64 *)frames[1]);
+			const __m128 p23 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)frames[2]), (const __m64 *)frames[3]);
+			const __m128 a = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0));
+			const __m128 b = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1));
+			_mm_storeu_ps(dest + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_loadu_ps(t))));
+		} else {
+			// [aL aR bL bR] per frame; two output frames (4 samples) per store.
+			for (int k = 0; k < 4; k += 2) {
+				const __m128 p0 = _mm_loadu_ps(frames[k + 0]);
+				const __m128 p1 = _mm_loadu_ps(frames[k + 1]);
+				const __m128 a  = _mm_movelh_ps(p0, p1);
+				const __m128 b  = _mm_movehl_ps(p1, p0);
+				const __m128 tt = _mm_setr_ps(t[k], t[k], t[k + 1], t[k + 1]);
+				_mm_storeu_ps(dest + ((size_t)(i + k) * 2), _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), tt)));
+			}
+		}
+	}
+
+	*position = pos;
+	return i;
+}
+#endif // PCM_USE_SSE2
+
+void pcm_resample(const float * src, uint32_t srcFrames, uint32_t channels,
+                  uint32_t srcRate, uint32_t destRate, float * dest) {
+
+	assert(src  != NULL);
+	assert(dest != NULL);
+	assert(channels != 0);
+
+	const uint32_t destFrames = pcm_resampled_frame_count(srcFrames, srcRate, destRate);
+	if (destFrames == 0) {
+		return;
+	}
+
+	// Source position of each output frame in 32.32 fixed point.
+	const uint64_t step = ((uint64_t)srcRate << 32) / destRate;
+	const uint32_t lastFrame = srcFrames - 1;
+	uint64_t position = 0;
+	uint32_t i = 0;
+
+#if PCM_USE_SSE2
+	if (channels <= 2) {
+		i = pcm_resample_sse2(src, channels, lastFrame, step, destFrames, dest, &position);
+	}
+#endif // PCM_USE_SSE2
+
+	// All the channels of a frame together, so the source is read in order.
+	for (; i < destFrames; ++i, position += step) {
+		const uint32_t frame = (uint32_t)(position >> 32);
+		const uint32_t next  = (frame < lastFrame) ? (frame + 1) : lastFrame;
+		const float * a = src + ((size_t)frame * channels);
+		const float * b = src + ((size_t)next  * channels);
+		const float   t = pcm_position_fraction(position);
+		float * out = dest + ((size_t)i * channels);
+		for (uint32_t c = 0; c < channels; ++c) {
+			out[c] = a[c] + (b[c] - a[c]) * t;
+		}
+	}
+}
+
+/* ========================================================
+ * pcm_levels_add():
+ * ======================================================== */
+
+void pcm_levels_add(pcm_levels_t * levels, const float * samples, size_t count) {
+
+	assert(levels  != NULL);
+	assert(samples != NULL);
+
+	float peak = levels->peak;
+	levels->sampleCount += count;
+
+	// Float sums stay accurate over a block; the blocks add up in double.
+	while (count > 0) {
+		const size_t blockCount = (count < PCM_LEVELS_BLOCK) ? count : PCM_LEVELS_BLOCK;
+		float sum = 0.0f;
+		size_t i = 0;
+
+#if PCM_USE_SSE2
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		__m128 vpeak = _mm_set1_ps(peak);
+		__m128 vsum  = _mm_setzero_ps();
+		for (; i + 4 <= blockCount; i += 4) {
+			const __m128 x = _mm_loadu_ps(samples + i);
+			vpeak = _mm_max_ps(vpeak, _mm_and_ps(x, absMask));
+			vsum  = _mm_add_ps(vsum, _mm_mul_ps(x, x));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, vpeak);
+		peak = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, vsum);
+		sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif // PCM_USE_SSE2
+
+		for (; i < blockCount; ++i) {
+			const float x = samples[i];
+			peak = fmaxf(peak, fabsf(x));
+			sum += x * x;
+		}
+
+		levels->sumSquares += sum;
+		samples += blockCount;
+		count   -= blockCount;
+	}
+
+	levels->peak = peak;
+}
+
+/* ========================================================
+ * pcm_levels_rms():
+ * ======================================================== */
+
+float pcm_levels_rms(const pcm_levels_t * levels) {
+	assert(levels != NULL);
+	if (levels->sampleCount == 0) {
+		return 0.0f;
+	}
+	return (float)sqrt(levels->sumSquares / (double)levels->sampleCount);
+}
+
+/* ========================================================
+ * pcm_to_decibels():
+ * ======================================================== */
+
+float pcm_to_decibels(float amplitude) {
+	if (amplitude <= 1e-10f) {
+		return -200.0f;
+	}
+	return 20.0f * log10f(amplitude);
+}
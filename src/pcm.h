@@ -0,0 +1,82 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: pcm.h
+ * Created on: 17/10/26
+ * Brief: Batch PCM processing: conversion to float, resampling and peak/RMS levels, with SIMD.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_PCM_H
+#define DARKSTONE_PCM_H
+
+#include "wav.h"
+
+/*
+ * Samples are processed as interleaved floats in [-1, 1]. The conversion
+ * reads the frames in place, from a wav_info_t view, and the 8 and 16 bits
+ * formats (the common ones) go through SSE2 where available, as does the
+ * level meter. The resampler uses it for mono and stereo. The other sample
+ * sizes and channel counts are done one by one. Buffers don't need any
+ * particular alignment.
+ */
+
+/* ========================================================
+ * PCM levels:
+ * ======================================================== */
+
+/*
+ * Running peak and RMS, so long sounds can be measured a block at a time.
+ * Clear it with memset() before the first pcm_levels_add().
+ */
+typedef struct pcm_levels {
+	double   sumSquares;
+	uint64_t sampleCount;
+	float    peak;        // Largest absolute sample.
+} pcm_levels_t;
+
+/* ========================================================
+ * PCM functions:
+ * ======================================================== */
+
+/*
+ * Converts `frameCount` frames from `firstFrame` to interleaved floats
+ * (frameCount * channels of them). The range must be within the sound.
+ */
+void pcm_to_float(const wav_info_t * info, uint32_t firstFrame, uint32_t frameCount, float * dest);
+
+/*
+ * Frames that pcm_resample() produces for `srcFrames` frames between the two rates.
+ */
+uint32_t pcm_resampled_frame_count(uint32_t srcFrames, uint32_t srcRate, uint32_t destRate);
+
+/*
+ * Linear interpolation resampler, from `srcRate` to `destRate`, of interleaved
+ * frames. `dest` needs pcm_resampled_frame_count() frames. Made for analysis
+ * and previews: there is no low-pass, so downsampling aliases.
+ */
+void pcm_resample(const float * src, uint32_t srcFrames, uint32_t channels,
+                  uint32_t srcRate, uint32_t destRate, float * dest);
+
+/*
+ * Adds `count` samples (any channel layout) to the running levels.
+ */
+void pcm_levels_add(pcm_levels_t * levels, const float * samples, size_t count);
+
+/*
+ * Root mean square of all the samples added so far.
+ */
+float pcm_levels_rms(const pcm_levels_t * levels);
+
+/*
+ * Amplitude to decibels relative to full scale. Silence gives -200 dB.
+ */
+float pcm_to_decibels(float amplitude);
+
+#endif // DARKSTONE_PCM_H
@@ -0,0 +1,952 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: sw_raster.c
+ * Created on: 17/10/26
+ * Brief: Multithreaded, tiled CPU rasterizer for the viewer's vertex data, for headless rendering.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "sw_raster.h"
+#include "o3d.h"
+#include "parallel.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Edge functions are evaluated for 4 pixels of a row at once.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define SW_RASTER_USE_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define SW_RASTER_USE_SSE 0
+#endif
+
+/*
+ * How it works:
+ *
+ * 1) Setup: jobs of consecutive primitives are transformed, clipped,
+ *    culled and projected in parallel, each into its own array.
+ * 2) Binning: the primitives are appended to the list of every screen
+ *    tile their bounds touch, walking the jobs in order, so each list
+ *    keeps the draw order.
+ * 3) Raster: each tile is a job, drawing its list into its own pixels,
+ *    so no locking is needed for the color and depth buffers.
+ *
+ * Positions are snapped to 1/16 pixel and only triangles crossing the guard
+ * band (8K pixels each way) are actually clipped in X/Y. That keeps the edge
+ * setup exact in doubles, so the two triangles sharing an edge compute the
+ * exact negation of each other's edge function, and with the top-left rule
+ * every pixel center on a shared edge is drawn exactly once.
+ */
+
+enum {
+	SW_ATTR_COUNT     = 8,    // nx, ny, nz, r, g, b, u, v
+	SW_ATTR_NORMAL    = 0,
+	SW_ATTR_COLOR     = 3,
+	SW_ATTR_UV        = 6,
+	SW_PRIMS_PER_JOB  = 2048,
+	SW_GUARD_BAND     = 8192, // In pixels.
+	SW_SUBPIXEL_STEPS = 16,
+	SW_CLIP_PLANES    = 5,    // Near plane and the four guard band sides.
+	SW_MAX_CLIP_VERTS = 3 + SW_CLIP_PLANES
+};
+
+// Outcode bits. The first SW_CLIP_PLANES are the ones actually clipped.
+enum {
+	SW_OUT_NEAR     = 1 << 0,
+	SW_OUT_GUARD    = (1 << SW_CLIP_PLANES) - 1, // Any of the clipped planes.
+	SW_OUT_LEFT     = 1 << 5,
+	SW_OUT_RIGHT    = 1 << 6,
+	SW_OUT_BOTTOM   = 1 << 7,
+	SW_OUT_TOP      = 1 << 8,
+	SW_OUT_FAR      = 1 << 9
+};
+
+typedef struct sw_clip_vertex {
+	float pos[4];
+	float attr[SW_ATTR_COUNT];
+} sw_clip_vertex_t;
+
+typedef struct sw_triangle {
+	float           x[3];                    // Window position, snapped, top-left origin.
+	float           y[3];
+	float           z[3];                    // Window depth, [0,1].
+	float           invW[3];
+	float           attr[3][SW_ATTR_COUNT];  // Premultiplied by invW.
+	float           invArea;
+	int32_t         minX, minY, maxX, maxY;  // Pixels, inclusive.
+	const image_t * texture;
+} sw_triangle_t;
+
+typedef struct sw_line {
+	float           x[2];
+	float           y[2];
+	float           z[2];
+	int32_t         minX, minY, maxX, maxY;
+} sw_line_t;
+
+// A range of one batch, set up by one job.
+typedef struct sw_job {
+	const sw_batch_t * batch;
+	uint32_t           firstPrim;
+	uint32_t           primCount;
+} sw_job_t;
+
+// What a setup job produced. Only one array is used, depending on the mode.
+typedef struct sw_job_output {
+	sw_triangle_t * triangles;
+	sw_line_t     * lines;
+	uint32_t        count;
+	uint32_t        capacity;
+	bool            failed;
+} sw_job_output_t;
+
+typedef struct sw_context {
+	sw_framebuffer_t       * fb;
+	const gl_draw_vertex_t * vertexes;
+	const float            * mvp;
+	sw_render_mode_t         mode;
+	float                    guardX;
+	float                    guardY;
+
+	sw_job_t               * jobs;
+	sw_job_output_t        * outputs;
+	uint32_t                 jobCount;
+
+	uint32_t                 tilesX;
+	uint32_t                 tilesY;
+	uint32_t               * binStart; // tilesX * tilesY + 1 offsets into the bin arrays.
+	const sw_triangle_t   ** binTriangles;
+	const sw_line_t       ** binLines;
+} sw_context_t;
+
+/* ========================================================
+ * sw_framebuffer_init() / sw_framebuffer_free() / sw_framebuffer_clear():
+ * ======================================================== */
+
+bool sw_framebuffer_init(sw_framebuffer_t * fb, uint32_t width, uint32_t height) {
+	assert(fb != NULL);
+
+	memset(fb, 0, sizeof(*fb));
+
+	if (width == 0 || height == 0 || width > SW_MAX_FRAMEBUFFER_SIZE || height > SW_MAX_FRAMEBUFFER_SIZE) {
+		return o3d_set_error("Bad software framebuffer dimensions!");
+	}
+
+	const size_t pixelCount = (size_t)width * height;
+	fb->color  = malloc(pixelCount * 4);
+	fb->depth  = malloc(pixelCount * sizeof(float));
+	fb->width  = width;
+	fb->height = height;
+
+	if (fb->color == NULL || fb->depth == NULL) {
+		sw_framebuffer_free(fb);
+		return o3d_set_error("Unable to malloc software framebuffer!");
+	}
+	return true;
+}
+
+void sw_framebuffer_free(sw_framebuffer_t * fb) {
+	if (fb == NULL) {
+		return;
+	}
+
+	free(fb->color);
+	free(fb->depth);
+	memset(fb, 0, sizeof(*fb));
+}
+
+static uint8_t sw_to_unorm8(float c) {
+	if (!(c > 0.0f)) {
+		return 0;
+	}
+	if (c >= 1.0f) {
+		return 255;
+	}
+	return (uint8_t)(c * 255.0f + 0.5f);
+}
+
+void sw_framebuffer_clear(sw_framebuffer_t * fb, const float rgba[4]) {
+	assert(fb != NULL && fb->color != NULL);
+	assert(rgba != NULL);
+
+	const uint8_t clearColor[4] = {
+		sw_to_unorm8(rgba[0]), sw_to_unorm8(rgba[1]),
+		sw_to_unorm8(rgba[2]), sw_to_unorm8(rgba[3])
+	};
+
+	const size_t pixelCount = (size_t)fb->width * fb->height;
+	for (size_t p = 0; p < pixelCount; ++p) {
+		memcpy(&fb->color[p * 4], clearColor, 4);
+		fb->depth[p] = 1.0f;
+	}
+}
+
+/* ========================================================
+ * Vertex transform / clipping:
+ * ======================================================== */
+
+static void sw_fetch_vertex(const sw_context_t * ctx, uint32_t index, sw_clip_vertex_t * out) {
+	const gl_draw_vertex_t * v = &ctx->vertexes[index];
+	const float * m = ctx->mvp;
+
+	out->pos[0] = m[0] * v->px + m[4] * v->py + m[8]  * v->pz + m[12];
+	out->pos[1] = m[1] * v->px + m[5] * v->py + m[9]  * v->pz + m[13];
+	out->pos[2] = m[2] * v->px + m[6] * v->py + m[10] * v->pz + m[14];
+	out->pos[3] = m[3] * v->px + m[7] * v->py + m[11] * v->pz + m[15];
+
+	out->attr[SW_ATTR_NORMAL + 0] = v->nx;
+	out->attr[SW_ATTR_NORMAL + 1] = v->ny;
+	out->attr[SW_ATTR_NORMAL + 2] = v->nz;
+	out->attr[SW_ATTR_COLOR  + 0] = v->r;
+	out->attr[SW_ATTR_COLOR  + 1] = v->g;
+	out->attr[SW_ATTR_COLOR  + 2] = v->b;
+	out->attr[SW_ATTR_UV     + 0] = v->u;
+	out->attr[SW_ATTR_UV     + 1] = v->v;
+}
+
+// Signed distance to a clip plane, positive inside.
+static float sw_plane_dist(const sw_context_t * ctx, uint32_t plane, const float * pos) {
+	switch (plane) {
+	case 0  : return pos[2] + pos[3];
+	case 1  : return pos[0] + (ctx->guardX * pos[3]);
+	case 2  : return (ctx->guardX * pos[3]) - pos[0];
+	case 3  : return pos[1] + (ctx->guardY * pos[3]);
+	default : return (ctx->guardY * pos[3]) - pos[1];
+	} // switch (plane)
+}
+
+static uint32_t sw_outcode(const sw_context_t * ctx, const float * pos) {
+	uint32_t code = 0;
+	for (uint32_t p = 0; p < SW_CLIP_PLANES; ++p) {
+		if (sw_plane_dist(ctx, p, pos) < 0.0f) {
+			code |= 1u << p;
+		}
+	}
+	if (pos[0] < -pos[3]) { code |= SW_OUT_LEFT;   }
+	if (pos[0] >  pos[3]) { code |= SW_OUT_RIGHT;  }
+	if (pos[1] < -pos[3]) { code |= SW_OUT_BOTTOM; }
+	if (pos[1] >  pos[3]) { code |= SW_OUT_TOP;    }
+	if (pos[2] >  pos[3]) { code |= SW_OUT_FAR;    }
+	return code;
+}
+
+static void sw_lerp_vertex(sw_clip_vertex_t * out, const sw_clip_vertex_t * a, const sw_clip_vertex_t * b, float t) {
+	for (int i = 0; i < 4; ++i) {
+		out->pos[i] = a->pos[i] + (b->pos[i] - a->pos[i]) * t;
+	}
+	for (int i = 0; i < SW_ATTR_COUNT; ++i) {
+		out->attr[i] = a->attr[i] + (b->attr[i] - a->attr[i]) * t;
+	}
+}
+
+// Sutherland-Hodgman against the planes in `planeMask`. Returns the new vertex count in `verts`.
+static uint32_t sw_clip_polygon(const sw_context_t * ctx, sw_clip_vertex_t * verts, uint32_t count, uint32_t planeMask) {
+	sw_clip_vertex_t temp[SW_MAX_CLIP_VERTS];
+	sw_clip_vertex_t * in  = verts;
+	sw_clip_vertex_t * out = temp;
+
+	for (uint32_t p = 0; p < SW_CLIP_PLANES; ++p) {
+		if (!(planeMask & (1u << p))) {
+			continue;
+		}
+
+		uint32_t outCount = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			const sw_clip_vertex_t * cur  = &in[i];
+			const sw_clip_vertex_t * next = &in[(i + 1) % count];
+			const float dCur  = sw_plane_dist(ctx, p, cur->pos);
+			const float dNext = sw_plane_dist(ctx, p, next->pos);
+
+			if (dCur >= 0.0f) {
+				out[outCount++] = *cur;
+			}
+			if ((dCur >= 0.0f) != (dNext >= 0.0f)) {
+				sw_lerp_vertex(&out[outCount++], cur, next, dCur / (dCur - dNext));
+			}
+			assert(outCount <= SW_MAX_CLIP_VERTS);
+		}
+
+		sw_clip_vertex_t * swap = in;
+		in    = out;
+		out   = swap;
+		count = outCount;
+
+		if (count < 3) {
+			return 0;
+		}
+	}
+
+	if (in != verts) {
+		memcpy(verts, in, count * sizeof(verts[0]));
+	}
+	return count;
+}
+
+/* ========================================================
+ * Primitive setup:
+ * ======================================================== */
+
+static float sw_snap(float v) {
+	return floorf(v * SW_SUBPIXEL_STEPS + 0.5f) * (1.0f / SW_SUBPIXEL_STEPS);
+}
+
+static void sw_clamp_bounds(const sw_context_t * ctx, float minX, float minY, float maxX, float maxY, int32_t * bounds) {
+	// Pixel centers are at +0.5.
+	bounds[0] = (int32_t)ceilf(minX - 0.5f);
+	bounds[1] = (int32_t)ceilf(minY - 0.5f);
+	bounds[2] = (int32_t)floorf(maxX - 0.5f);
+	bounds[3] = (int32_t)floorf(maxY - 0.5f);
+
+	if (bounds[0] < 0) { bounds[0] = 0; }
+	if (bounds[1] < 0) { bounds[1] = 0; }
+	if (bounds[2] > (int32_t)ctx->fb->width  - 1) { bounds[2] = (int32_t)ctx->fb->width  - 1; }
+	if (bounds[3] > (int32_t)ctx->fb->height - 1) { bounds[3] = (int32_t)ctx->fb->height - 1; }
+}
+
+// Room for one more primitive. Flags the output as failed if out of memory.
+static bool sw_output_grow(sw_job_output_t * output, bool lines) {
+	if (output->count < output->capacity) {
+		return true;
+	}
+
+	const uint32_t newCapacity = (output->capacity != 0) ? (output->capacity * 2) : 256;
+	if (lines) {
+		sw_line_t * newLines = realloc(output->lines, newCapacity * sizeof(sw_line_t));
+		if (newLines == NULL) {
+			output->failed = true;
+			return false;
+		}
+		output->lines = newLines;
+	} else {
+		sw_triangle_t * newTriangles = realloc(output->triangles, newCapacity * sizeof(sw_triangle_t));
+		if (newTriangles == NULL) {
+			output->failed = true;
+			return false;
+		}
+		output->triangles = newTriangles;
+	}
+
+	output->capacity = newCapacity;
+	return true;
+}
+
+static void sw_setup_triangle(const sw_context_t * ctx, sw_job_output_t * output, const sw_clip_vertex_t * v0,
+                              const sw_clip_vertex_t * v1, const sw_clip_vertex_t * v2, const image_t * texture) {
+	const float halfW = 0.5f * (float)ctx->fb->width;
+	const float halfH = 0.5f * (float)ctx->fb->height;
+
+	float x[3], y[3], z[3], invW[3];
+	const sw_clip_vertex_t * v[3] = { v0, v1, v2 };
+
+	for (int i = 0; i < 3; ++i) {
+		invW[i] = 1.0f / v[i]->pos[3];
+		x[i] = sw_snap((v[i]->pos[0] * invW[i] + 1.0f) * halfW);
+		y[i] = sw_snap((1.0f - v[i]->pos[1] * invW[i]) * halfH); // Y down.
+		z[i] = (v[i]->pos[2] * invW[i]) * 0.5f + 0.5f;
+	}
+
+	// GL front faces are CCW with Y up, so clockwise (negative area) with Y down.
+	const double area = ((double)x[1] - x[0]) * ((double)y[2] - y[0]) - ((double)y[1] - y[0]) * ((double)x[2] - x[0]);
+	if (area >= 0.0) {
+		return;
+	}
+
+	int32_t bounds[4];
+	sw_clamp_bounds(ctx,
+		fminf(x[0], fminf(x[1], x[2])), fminf(y[0], fminf(y[1], y[2])),
+		fmaxf(x[0], fmaxf(x[1], x[2])), fmaxf(y[0], fmaxf(y[1], y[2])), bounds);
+
+	if (bounds[0] > bounds[2] || bounds[1] > bounds[3]) {
+		return; // Misses every pixel center.
+	}
+
+	if (!sw_output_grow(output, false)) {
+		return;
+	}
+
+	// Swapping the last two makes the area positive, so inside is where all edge functions are >= 0.
+	static const int order[3] = { 0, 2, 1 };
+
+	sw_triangle_t * tri = &output->triangles[output->count++];
+	for (int i = 0; i < 3; ++i) {
+		const int s = order[i];
+		tri->x[i]    = x[s];
+		tri->y[i]    = y[s];
+		tri->z[i]    = z[s];
+		tri->invW[i] = invW[s];
+		for (int a = 0; a < SW_ATTR_COUNT; ++a) {
+			tri->attr[i][a] = v[s]->attr[a] * invW[s];
+		}
+	}
+
+	tri->invArea = (float)(1.0 / -area);
+	tri->minX    = bounds[0];
+	tri->minY    = bounds[1];
+	tri->maxX    = bounds[2];
+	tri->maxY    = bounds[3];
+	tri->texture = texture;
+}
+
+static void sw_setup_triangles(const sw_context_t * ctx, const sw_job_t * job, sw_job_output_t * output) {
+	const uint32_t firstVertex = job->batch->firstVertex + (job->firstPrim * 3);
+
+	for (uint32_t t = 0; t < job->primCount; ++t) {
+		sw_clip_vertex_t verts[SW_MAX_CLIP_VERTS];
+		sw_fetch_vertex(ctx, firstVertex + (t * 3) + 0, &verts[0]);
+		sw_fetch_vertex(ctx, firstVertex + (t * 3) + 1, &verts[1]);
+		sw_fetch_vertex(ctx, firstVertex + (t * 3) + 2, &verts[2]);
+
+		const uint32_t c0 = sw_outcode(ctx, verts[0].pos);
+		const uint32_t c1 = sw_outcode(ctx, verts[1].pos);
+		const uint32_t c2 = sw_outcode(ctx, verts[2].pos);
+
+		if (c0 & c1 & c2) {
+			continue; // All outside the same plane.
+		}
+
+		const uint32_t clipMask = (c0 | c1 | c2) & SW_OUT_GUARD;
+		if (clipMask == 0) {
+			sw_setup_triangle(ctx, output, &verts[0], &verts[1], &verts[2], job->batch->texture);
+			continue;
+		}
+
+		const uint32_t count = sw_clip_polygon(ctx, verts, 3, clipMask);
+		for (uint32_t i = 2; i < count; ++i) {
+			sw_setup_triangle(ctx, output, &verts[0], &verts[i - 1], &verts[i], job->batch->texture);
+		}
+	}
+}
+
+static void sw_setup_lines(const sw_context_t * ctx, const sw_job_t * job, sw_job_output_t * output) {
+	const float halfW = 0.5f * (float)ctx->fb->width;
+	const float halfH = 0.5f * (float)ctx->fb->height;
+	const uint32_t firstVertex = job->batch->firstVertex + job->firstPrim;
+
+	for (uint32_t s = 0; s < job->primCount; ++s) {
+		sw_clip_vertex_t a, b;
+		sw_fetch_vertex(ctx, firstVertex + s + 0, &a);
+		sw_fetch_vertex(ctx, firstVertex + s + 1, &b);
+
+		const uint32_t ca = sw_outcode(ctx, a.pos);
+		const uint32_t cb = sw_outcode(ctx, b.pos);
+		if (ca & cb) {
+			continue;
+		}
+
+		// Liang-Barsky against the same planes the triangles are clipped to.
+		float t0 = 0.0f, t1 = 1.0f;
+		bool visible = true;
+		for (uint32_t p = 0; p < SW_CLIP_PLANES && visible; ++p) {
+			const float da = sw_plane_dist(ctx, p, a.pos);
+			const float db = sw_plane_dist(ctx, p, b.pos);
+			if (da < 0.0f && db < 0.0f) {
+				visible = false;
+			} else if (da < 0.0f) {
+				t0 = fmaxf(t0, da / (da - db));
+			} else if (db < 0.0f) {
+				t1 = fminf(t1, da / (da - db));
+			}
+			visible = visible && (t0 <= t1);
+		}
+		if (!visible) {
+			continue;
+		}
+
+		sw_clip_vertex_t ends[2];
+		sw_lerp_vertex(&ends[0], &a, &b, t0);
+		sw_lerp_vertex(&ends[1], &a, &b, t1);
+
+		if (!sw_output_grow(output, true)) {
+			return;
+		}
+
+		sw_line_t * line = &output->lines[output->count++];
+		for (int i = 0; i < 2; ++i) {
+			const float invW = 1.0f / ends[i].pos[3];
+			line->x[i] = (ends[i].pos[0] * invW + 1.0f) * halfW;
+			line->y[i] = (1.0f - ends[i].pos[1] * invW) * halfH;
+			line->z[i] = (ends[i].pos[2] * invW) * 0.5f + 0.5f;
+		}
+
+		int32_t bounds[4];
+		sw_clamp_bounds(ctx,
+			floorf(fminf(line->x[0], line->x[1])), floorf(fminf(line->y[0], line->y[1])),
+			ceilf(fmaxf(line->x[0], line->x[1])) + 1.0f, ceilf(fmaxf(line->y[0], line->y[1])) + 1.0f, bounds);
+
+		line->minX = bounds[0];
+		line->minY = bounds[1];
+		line->maxX = bounds[2];
+		line->maxY = bounds[3];
+
+		if (line->minX > line->maxX || line->minY > line->maxY) {
+			output->count--;
+		}
+	}
+}
+
+static void sw_setup_job(void * userData, uint32_t jobIndex) {
+	const sw_context_t * ctx = userData;
+	const sw_job_t * job = &ctx->jobs[jobIndex];
+	sw_job_output_t * output = &ctx->outputs[jobIndex];
+
+	if (ctx->mode == SW_RENDER_WIREFRAME) {
+		sw_setup_lines(ctx, job, output);
+	} else {
+		sw_setup_triangles(ctx, job, output);
+	}
+}
+
+/* ========================================================
+ * Shading:
+ * ======================================================== */
+
+static void sw_sample_bilinear(const image_t * texture, float u, float v, float * rgba) {
+	if (texture == NULL || texture->pixels == NULL) {
+		rgba[0] = rgba[1] = rgba[2] = rgba[3] = 1.0f;
+		return;
+	}
+
+	// Clamp to edge, texel centers at +0.5, like GL_LINEAR.
+	const float maxX = (float)(texture->width  - 1);
+	const float maxY = (float)(texture->height - 1);
+	float fx = u * (float)texture->width  - 0.5f;
+	float fy = v * (float)texture->height - 0.5f;
+	fx = (fx > 0.0f) ? ((fx < maxX) ? fx : maxX) : 0.0f;
+	fy = (fy > 0.0f) ? ((fy < maxY) ? fy : maxY) : 0.0f;
+
+	const uint32_t x0 = (uint32_t)fx;
+	const uint32_t y0 = (uint32_t)fy;
+	const uint32_t x1 = (x0 + 1 < texture->width)  ? (x0 + 1) : x0;
+	const uint32_t y1 = (y0 + 1 < texture->height) ? (y0 + 1) : y0;
+	const float tx = fx - (float)x0;
+	const float ty = fy - (float)y0;
+
+	const uint8_t * row0 = texture->pixels + ((size_t)y0 * texture->width * 4);
+	const uint8_t * row1 = texture->pixels + ((size_t)y1 * texture->width * 4);
+
+	for (int c = 0; c < 4; ++c) {
+		const float top    = row0[x0 * 4 + c] + (row0[x1 * 4 + c] - row0[x0 * 4 + c]) * tx;
+		const float bottom = row1[x0 * 4 + c] + (row1[x1 * 4 + c] - row1[x0 * 4 + c]) * tx;
+		rgba[c] = (top + (bottom - top) * ty) * (1.0f / 255.0f);
+	}
+}
+
+// Perspective correct attributes [first, first + count) from the three edge function values.
+static void sw_interpolate(const sw_triangle_t * tri, const float * w, int first, int count, float * out) {
+	const float l0 = w[0] * tri->invArea;
+	const float l1 = w[1] * tri->invArea;
+	const float l2 = w[2] * tri->invArea;
+	const float pw = 1.0f / (l0 * tri->invW[0] + l1 * tri->invW[1] + l2 * tri->invW[2]);
+
+	for (int a = 0; a < count; ++a) {
+		out[a] = (l0 * tri->attr[0][first + a] + l1 * tri->attr[1][first + a] + l2 * tri->attr[2][first + a]) * pw;
+	}
+}
+
+static float sw_smoothstep(float edge1, float x) {
+	if (!(edge1 > 0.0f)) {
+		return (x >= edge1) ? 1.0f : 0.0f;
+	}
+	float t = x / edge1;
+	t = (t > 0.0f) ? ((t < 1.0f) ? t : 1.0f) : 0.0f;
+	return t * t * (3.0f - 2.0f * t);
+}
+
+// The edge_factor() of basic.frag, with fwidth() taken from the neighboring pixels.
+static float sw_edge_factor(const sw_triangle_t * tri, const float * w, const float * edgeA, const float * edgeB) {
+	const float wdx[3] = { w[0] + edgeA[0], w[1] + edgeA[1], w[2] + edgeA[2] };
+	const float wdy[3] = { w[0] + edgeB[0], w[1] + edgeB[1], w[2] + edgeB[2] };
+
+	float n[3], ndx[3], ndy[3];
+	sw_interpolate(tri, w,   SW_ATTR_NORMAL, 3, n);
+	sw_interpolate(tri, wdx, SW_ATTR_NORMAL, 3, ndx);
+	sw_interpolate(tri, wdy, SW_ATTR_NORMAL, 3, ndy);
+
+	float factor = 1.0f;
+	for (int i = 0; i < 3; ++i) {
+		const float d = fabsf(ndx[i] - n[i]) + fabsf(ndy[i] - n[i]);
+		const float a = sw_smoothstep(d * 1.5f, n[i]);
+		factor = (a < factor) ? a : factor;
+	}
+	return factor;
+}
+
+static void sw_shade_pixel(const sw_context_t * ctx, const sw_triangle_t * tri, const float * w,
+                           const float * edgeA, const float * edgeB, size_t pixel) {
+	float rgba[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	switch (ctx->mode) {
+	case SW_RENDER_TEXTURED : {
+		float uv[2];
+		sw_interpolate(tri, w, SW_ATTR_UV, 2, uv);
+		sw_sample_bilinear(tri->texture, uv[0], uv[1], rgba);
+		break;
+	}
+	case SW_RENDER_O3D_COLOR :
+		sw_interpolate(tri, w, SW_ATTR_COLOR, 3, rgba);
+		break;
+	default : {
+		const float gray = 0.5f * sw_edge_factor(tri, w, edgeA, edgeB);
+		rgba[0] = rgba[1] = rgba[2] = gray;
+		break;
+	}
+	} // switch (ctx->mode)
+
+	uint8_t * dest = &ctx->fb->color[pixel * 4];
+	dest[0] = sw_to_unorm8(rgba[0]);
+	dest[1] = sw_to_unorm8(rgba[1]);
+	dest[2] = sw_to_unorm8(rgba[2]);
+	dest[3] = sw_to_unorm8(rgba[3]);
+}
+
+/* ========================================================
+ * Tile rasterization:
+ * ======================================================== */
+
+static void sw_raster_triangle(const sw_context_t * ctx, const sw_triangle_t * tri,
+                               int32_t tileX0, int32_t tileY0, int32_t tileX1, int32_t tileY1) {
+	const int32_t bx0 = (tri->minX > tileX0) ? tri->minX : tileX0;
+	const int32_t by0 = (tri->minY > tileY0) ? tri->minY : tileY0;
+	const int32_t bx1 = (tri->maxX < tileX1) ? tri->maxX : tileX1;
+	const int32_t by1 = (tri->maxY < tileY1) ? tri->maxY : tileY1;
+
+	if (bx0 > bx1 || by0 > by1) {
+		return;
+	}
+
+	// Edge i is the one opposite vertex i, relative to the tile origin. The constant
+	// term is exact in double (see the top of the file), so it rounds the same way
+	// for both triangles of a shared edge, just with the sign flipped.
+	float edgeA[3], edgeB[3], edgeC[3];
+	bool topLeft[3];
+	for (int i = 0; i < 3; ++i) {
+		const int j = (i + 1) % 3;
+		const int k = (i + 2) % 3;
+		edgeA[i]   = tri->y[j] - tri->y[k];
+		edgeB[i]   = tri->x[k] - tri->x[j];
+		edgeC[i]   = (float)((double)edgeA[i] * ((double)tileX0 - tri->x[j]) +
+		                     (double)edgeB[i] * ((double)tileY0 - tri->y[j]));
+		topLeft[i] = (edgeA[i] > 0.0f) || (edgeA[i] == 0.0f && edgeB[i] > 0.0f);
+	}
+
+	const uint32_t fbWidth = ctx->fb->width;
+	float * depthBuffer = ctx->fb->depth;
+
+	// Tiles start at multiples of 4, so these blocks never straddle two tiles.
+	const int32_t startX = bx0 & ~3;
+
+#if SW_RASTER_USE_SSE
+	const __m128 lanes = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	const __m128 zero  = _mm_setzero_ps();
+	__m128 vA[3];
+	for (int i = 0; i < 3; ++i) {
+		vA[i] = _mm_set1_ps(edgeA[i]);
+	}
+#endif // SW_RASTER_USE_SSE
+
+	for (int32_t y = by0; y <= by1; ++y) {
+		const float pyRel = (float)(y - tileY0) + 0.5f;
+		float rowC[3];
+		for (int i = 0; i < 3; ++i) {
+			rowC[i] = edgeB[i] * pyRel + edgeC[i];
+		}
+
+		for (int32_t x = startX; x <= bx1; x += 4) {
+			float w[3][4];
+			int mask;
+
+		#if SW_RASTER_USE_SSE
+			const __m128 pxRel = _mm_add_ps(_mm_set1_ps((float)(x - tileX0)), lanes);
+			mask = 0xF;
+			for (int i = 0; i < 3; ++i) {
+				const __m128 e = _mm_add_ps(_mm_mul_ps(vA[i], pxRel), _mm_set1_ps(rowC[i]));
+				const __m128 inside = topLeft[i] ? _mm_cmpge_ps(e, zero) : _mm_cmpgt_ps(e, zero);
+				mask &= _mm_movemask_ps(inside);
+				_mm_storeu_ps(w[i], e);
+			}
+		#else // !SW_RASTER_USE_SSE
+			mask = 0;
+			for (int l = 0; l < 4; ++l) {
+				const float pxRel = (float)(x - tileX0 + l) + 0.5f;
+				bool inside = true;
+				for (int i = 0; i < 3; ++i) {
+					w[i][l] = edgeA[i] * pxRel + rowC[i];
+					inside = inside && (topLeft[i] ? (w[i][l] >= 0.0f) : (w[i][l] > 0.0f));
+				}
+				mask |= inside ? (1 << l) : 0;
+			}
+		#endif // SW_RASTER_USE_SSE
+
+			if (mask == 0) {
+				continue;
+			}
+
+			for (int l = 0; l < 4; ++l) {
+				const int32_t pixelX = x + l;
+				if (!(mask & (1 << l)) || pixelX < bx0 || pixelX > bx1) {
+					continue;
+				}
+
+				const float pw[3] = { w[0][l], w[1][l], w[2][l] };
+				const float z = (pw[0] * tri->z[0] + pw[1] * tri->z[1] + pw[2] * tri->z[2]) * tri->invArea;
+
+				const size_t pixel = ((size_t)y * fbWidth) + (size_t)pixelX;
+				if (!(z < depthBuffer[pixel]) || z < 0.0f) {
+					continue;
+				}
+
+				depthBuffer[pixel] = z;
+				sw_shade_pixel(ctx, tri, pw, edgeA, edgeB, pixel);
+			}
+		}
+	}
+}
+
+static void sw_plot_line_pixel(const sw_context_t * ctx, int32_t x, int32_t y, float z) {
+	const size_t pixel = ((size_t)y * ctx->fb->width) + (size_t)x;
+	if (!(z < ctx->fb->depth[pixel]) || z < 0.0f) {
+		return;
+	}
+
+	// Same light green as basic.frag.
+	static const uint8_t lineColor[4] = { 204, 255, 204, 255 };
+	ctx->fb->depth[pixel] = z;
+	memcpy(&ctx->fb->color[pixel * 4], lineColor, 4);
+}
+
+//
+// One pixel per column (X major) or row (Y major), the one containing the line
+// at that pixel center. The segment end is left out, as with GL line strips, so
+// the shared vertex is not drawn twice. Each tile walks the same pixel centers
+// the whole line would, and only keeps its own.
+//
+static void sw_raster_line(const sw_context_t * ctx, const sw_line_t * line,
+                           int32_t tileX0, int32_t tileY0, int32_t tileX1, int32_t tileY1) {
+	const bool xMajor = fabsf(line->x[1] - line->x[0]) >= fabsf(line->y[1] - line->y[0]);
+
+	const float major0 = xMajor ? line->x[0] : line->y[0];
+	const float major1 = xMajor ? line->x[1] : line->y[1];
+	const float minor0 = xMajor ? line->y[0] : line->x[0];
+	const float minor1 = xMajor ? line->y[1] : line->x[1];
+	const float delta  = major1 - major0;
+
+	if (delta == 0.0f) {
+		return;
+	}
+
+	int32_t first, last;
+	if (delta > 0.0f) {
+		first = (int32_t)ceilf(major0 - 0.5f);
+		last  = (int32_t)ceilf(major1 - 0.5f) - 1;
+	} else {
+		first = (int32_t)floorf(major1 - 0.5f) + 1;
+		last  = (int32_t)floorf(major0 - 0.5f);
+	}
+
+	const int32_t tileMajor0 = xMajor ? tileX0 : tileY0;
+	const int32_t tileMajor1 = xMajor ? tileX1 : tileY1;
+	const int32_t tileMinor0 = xMajor ? tileY0 : tileX0;
+	const int32_t tileMinor1 = xMajor ? tileY1 : tileX1;
+
+	if (first < tileMajor0) { first = tileMajor0; }
+	if (last  > tileMajor1) { last  = tileMajor1; }
+
+	const float invDelta = 1.0f / delta;
+	for (int32_t m = first; m <= last; ++m) {
+		const float t = (((float)m + 0.5f) - major0) * invDelta;
+		const int32_t n = (int32_t)floorf(minor0 + (minor1 - minor0) * t);
+		if (n < tileMinor0 || n > tileMinor1) {
+			continue;
+		}
+
+		const float z = line->z[0] + (line->z[1] - line->z[0]) * t;
+		if (xMajor) {
+			sw_plot_line_pixel(ctx, m, n, z);
+		} else {
+			sw_plot_line_pixel(ctx, n, m, z);
+		}
+	}
+}
+
+static void sw_raster_tile(void * userData, uint32_t tileIndex) {
+	const sw_context_t * ctx = userData;
+
+	const int32_t tileX0 = (int32_t)(tileIndex % ctx->tilesX) * SW_TILE_SIZE;
+	const int32_t tileY0 = (int32_t)(tileIndex / ctx->tilesX) * SW_TILE_SIZE;
+	int32_t tileX1 = tileX0 + SW_TILE_SIZE - 1;
+	int32_t tileY1 = tileY0 + SW_TILE_SIZE - 1;
+	if (tileX1 > (int32_t)ctx->fb->width  - 1) { tileX1 = (int32_t)ctx->fb->width  - 1; }
+	if (tileY1 > (int32_t)ctx->fb->height - 1) { tileY1 = (int32_t)ctx->fb->height - 1; }
+
+	for (uint32_t b = ctx->binStart[tileIndex]; b < ctx->binStart[tileIndex + 1]; ++b) {
+		if (ctx->binLines != NULL) {
+			sw_raster_line(ctx, ctx->binLines[b], tileX0, tileY0, tileX1, tileY1);
+		} else {
+			sw_raster_triangle(ctx, ctx->binTriangles[b], tileX0, tileY0, tileX1, tileY1);
+		}
+	}
+}
+
+/* ========================================================
+ * sw_draw():
+ * ======================================================== */
+
+static bool sw_make_jobs(sw_context_t * ctx, const sw_batch_t * batches, uint32_t batchCount) {
+	const bool lines = (ctx->mode == SW_RENDER_WIREFRAME);
+
+	uint32_t jobCount = 0;
+	for (int pass = 0; pass < 2; ++pass) {
+		jobCount = 0;
+		for (uint32_t b = 0; b < batchCount; ++b) {
+			// A line strip through all the vertexes, or every 3 as a triangle.
+			uint32_t primCount = lines ? batches[b].vertexCount : (batches[b].vertexCount / 3);
+			if (lines && primCount != 0) {
+				primCount -= 1;
+			}
+
+			for (uint32_t first = 0; first < primCount; first += SW_PRIMS_PER_JOB) {
+				if (pass == 1) {
+					sw_job_t * job  = &ctx->jobs[jobCount];
+					job->batch      = &batches[b];
+					job->firstPrim  = first;
+					job->primCount  = ((primCount - first) < SW_PRIMS_PER_JOB) ? (primCount - first) : SW_PRIMS_PER_JOB;
+				}
+				++jobCount;
+			}
+		}
+
+		if (pass == 0) {
+			ctx->jobs    = calloc(jobCount + 1, sizeof(ctx->jobs[0]));
+			ctx->outputs = calloc(jobCount + 1, sizeof(ctx->outputs[0]));
+			if (ctx->jobs == NULL || ctx->outputs == NULL) {
+				return o3d_set_error("Unable to malloc rasterizer jobs!");
+			}
+		}
+	}
+
+	ctx->jobCount = jobCount;
+	return true;
+}
+
+static bool sw_bin_primitives(sw_context_t * ctx) {
+	const uint32_t tileCount = ctx->tilesX * ctx->tilesY;
+	const bool lines = (ctx->mode == SW_RENDER_WIREFRAME);
+
+	ctx->binStart = calloc(tileCount + 1, sizeof(ctx->binStart[0]));
+	uint32_t * cursor = malloc((tileCount + 1) * sizeof(cursor[0]));
+	if (ctx->binStart == NULL || cursor == NULL) {
+		free(cursor);
+		return o3d_set_error("Unable to malloc rasterizer bins!");
+	}
+
+	// Count, then place, in job order, so each bin is in draw order.
+	for (int pass = 0; pass < 2; ++pass) {
+		for (uint32_t j = 0; j < ctx->jobCount; ++j) {
+			const sw_job_output_t * output = &ctx->outputs[j];
+			for (uint32_t p = 0; p < output->count; ++p) {
+				const int32_t * bounds = lines ? &output->lines[p].minX : &output->triangles[p].minX;
+				const uint32_t tx0 = (uint32_t)bounds[0] / SW_TILE_SIZE;
+				const uint32_t ty0 = (uint32_t)bounds[1] / SW_TILE_SIZE;
+				const uint32_t tx1 = (uint32_t)bounds[2] / SW_TILE_SIZE;
+				const uint32_t ty1 = (uint32_t)bounds[3] / SW_TILE_SIZE;
+
+				for (uint32_t ty = ty0; ty <= ty1; ++ty) {
+					for (uint32_t tx = tx0; tx <= tx1; ++tx) {
+						const uint32_t tile = (ty * ctx->tilesX) + tx;
+						if (pass == 0) {
+							ctx->binStart[tile + 1]++;
+						} else if (lines) {
+							ctx->binLines[cursor[tile]++] = &output->lines[p];
+						} else {
+							ctx->binTriangles[cursor[tile]++] = &output->triangles[p];
+						}
+					}
+				}
+			}
+		}
+
+		if (pass == 0) {
+			for (uint32_t t = 0; t < tileCount; ++t) {
+				ctx->binStart[t + 1] += ctx->binStart[t];
+			}
+			memcpy(cursor, ctx->binStart, (tileCount + 1) * sizeof(cursor[0]));
+
+			const size_t entryCount = (size_t)ctx->binStart[tileCount] + 1;
+			if (lines) {
+				ctx->binLines = malloc(entryCount * sizeof(ctx->binLines[0]));
+			} else {
+				ctx->binTriangles = malloc(entryCount * sizeof(ctx->binTriangles[0]));
+			}
+			if (ctx->binLines == NULL && ctx->binTriangles == NULL) {
+				free(cursor);
+				return o3d_set_error("Unable to malloc rasterizer bins!");
+			}
+		}
+	}
+
+	free(cursor);
+	return true;
+}
+
+bool sw_draw(sw_framebuffer_t * fb, const gl_draw_vertex_t * vertexes, const sw_batch_t * batches,
+             uint32_t batchCount, const float mvp[16], sw_render_mode_t mode, uint32_t threadCount) {
+	assert(fb != NULL && fb->color != NULL);
+	assert(vertexes != NULL || batchCount == 0);
+	assert(batches  != NULL || batchCount == 0);
+	assert(mvp != NULL);
+
+	sw_context_t ctx;
+	memset(&ctx, 0, sizeof(ctx));
+
+	ctx.fb       = fb;
+	ctx.vertexes = vertexes;
+	ctx.mvp      = mvp;
+	ctx.mode     = mode;
+	ctx.tilesX   = (fb->width  + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+	ctx.tilesY   = (fb->height + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+
+	// Clip space extents of the guard band, from the framebuffer center.
+	ctx.guardX = ((2.0f * SW_GUARD_BAND) / (float)fb->width)  - 1.0f;
+	ctx.guardY = ((2.0f * SW_GUARD_BAND) / (float)fb->height) - 1.0f;
+
+	bool success = sw_make_jobs(&ctx, batches, batchCount);
+
+	if (success) {
+		parallel_for(ctx.jobCount, threadCount, &sw_setup_job, &ctx);
+		for (uint32_t j = 0; j < ctx.jobCount; ++j) {
+			if (ctx.outputs[j].failed) {
+				success = o3d_set_error("Unable to malloc rasterizer primitives!");
+				break;
+			}
+		}
+	}
+
+	if (success) {
+		success = sw_bin_primitives(&ctx);
+	}
+
+	if (success) {
+		parallel_for(ctx.tilesX * ctx.tilesY, threadCount, &sw_raster_tile, &ctx);
+	}
+
+	for (uint32_t j = 0; j < ctx.jobCount; ++j) {
+		free(ctx.outputs[j].triangles);
+		free(ctx.outputs[j].lines);
+	}
+	free(ctx.binTriangles);
+	free(ctx.binLines);
+	free(ctx.binStart);
+	free(ctx.outputs);
+	free(ctx.jobs);
+	return success;
+}
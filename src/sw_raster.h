@@ -0,0 +1,97 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: sw_raster.h
+ * Created on: 17/10/26
+ * Brief: Multithreaded, tiled CPU rasterizer for the viewer's vertex data, for headless rendering.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_SW_RASTER_H
+#define DARKSTONE_SW_RASTER_H
+
+#include "draw_vertex.h"
+#include "image.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ========================================================
+ * Software rasterizer data structures:
+ * ======================================================== */
+
+// Screen tiles are rasterized in parallel, one job each.
+enum { SW_TILE_SIZE = 64 };
+
+// Largest framebuffer side. Keeps the fixed guard band exact (see sw_raster.c).
+enum { SW_MAX_FRAMEBUFFER_SIZE = 4096 };
+
+/*
+ * Same modes and values as the viewer's, and with the same
+ * output as shaders/basic.frag, so the images can be compared.
+ */
+typedef enum sw_render_mode {
+	SW_RENDER_TEXTURED      = 0, // Texture color. Bilinear, clamped, no mipmaps.
+	SW_RENDER_WIREFRAME     = 1, // Light green line strip through every vertex of each batch.
+	SW_RENDER_O3D_COLOR     = 2, // Interpolated vertex color.
+	SW_RENDER_DEFAULT_COLOR = 3  // Gray with a dark outline around each triangle.
+} sw_render_mode_t;
+
+/*
+ * Range of vertexes drawn with one texture, like the viewer batches.
+ * Triangles are every 3 vertexes; CCW is front facing, back faces
+ * are culled. A null texture samples as opaque white.
+ */
+typedef struct sw_batch {
+	uint32_t        firstVertex;
+	uint32_t        vertexCount;
+	const image_t * texture;
+} sw_batch_t;
+
+/*
+ * RGBA8 color (top row first, like image_t) and float depth in [0,1].
+ */
+typedef struct sw_framebuffer {
+	uint8_t * color;
+	float   * depth;
+	uint32_t  width;
+	uint32_t  height;
+} sw_framebuffer_t;
+
+/* ========================================================
+ * Software rasterizer functions:
+ * ======================================================== */
+
+/*
+ * Allocates the color and depth buffers. Contents are undefined until cleared.
+ */
+bool sw_framebuffer_init(sw_framebuffer_t * fb, uint32_t width, uint32_t height);
+
+/*
+ * Frees the buffers and clears the struct. Null pointer is a no-op.
+ */
+void sw_framebuffer_free(sw_framebuffer_t * fb);
+
+/*
+ * Clears color to `rgba` (0 to 1 per channel) and depth to the far plane.
+ */
+void sw_framebuffer_clear(sw_framebuffer_t * fb, const float rgba[4]);
+
+/*
+ * Draws the batches, in order, with depth testing (less), into the framebuffer.
+ * `mvp` is a column-major matrix, as given to glUniformMatrix4fv(); clip space
+ * is the GL one. Triangles are clipped against the near plane and a guard band,
+ * snapped to 1/16 pixel and filled with the top-left rule, so shared edges have
+ * no gaps or double hits. Attributes are interpolated perspective correct.
+ * `threadCount` of 0 uses one thread per CPU (see parallel.h).
+ */
+bool sw_draw(sw_framebuffer_t * fb, const gl_draw_vertex_t * vertexes, const sw_batch_t * batches,
+             uint32_t batchCount, const float mvp[16], sw_render_mode_t mode, uint32_t threadCount);
+
+#endif // DARKSTONE_SW_RASTER_H
@@ -0,0 +1,322 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: tga.c
+ * Created on: 17/10/26
+ * Brief: Native TGA decoder for the game's textures, from memory into a caller supplied buffer.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "tga.h"
+#include "o3d.h"
+
+#include <assert.h>
+#include <string.h>
+
+// The swizzles are a single PSHUFB per 4 pixels with SSSE3. GCC/Clang compile
+// that path for SSSE3 regardless of the -m flags and pick it at runtime.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define TGA_USE_SSSE3     1
+	#define TGA_SSSE3_RUNTIME 1
+	#define TGA_TARGET_SSSE3  __attribute__((target("ssse3")))
+	#include <tmmintrin.h>
+#elif defined(__SSSE3__) || defined(__AVX__)
+	#define TGA_USE_SSSE3     1
+	#define TGA_SSSE3_RUNTIME 0
+	#define TGA_TARGET_SSSE3
+	#include <tmmintrin.h>
+#else
+	#define TGA_USE_SSSE3     0
+#endif
+
+enum {
+	TGA_HEADER_SIZE = 18,
+	TGA_MAX_PIXELS  = 0x10000000 // 256M pixels, keeps width * height * 4 within 32 bits.
+};
+
+// Image types:
+enum {
+	TGA_TYPE_TRUE_COLOR     = 2,
+	TGA_TYPE_GRAYSCALE      = 3,
+	TGA_TYPE_RLE_TRUE_COLOR = 10,
+	TGA_TYPE_RLE_GRAYSCALE  = 11
+};
+
+// Image descriptor bits:
+enum {
+	TGA_DESC_RIGHT_TO_LEFT = 1 << 4,
+	TGA_DESC_TOP_TO_BOTTOM = 1 << 5
+};
+
+/* ========================================================
+ * tga_read_info():
+ * ======================================================== */
+
+static uint32_t tga_read_u16(const uint8_t * bytes) {
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8);
+}
+
+bool tga_read_info(tga_info_t * info, const void * fileData, size_t fileSize) {
+	assert(info     != NULL);
+	assert(fileData != NULL);
+
+	memset(info, 0, sizeof(*info));
+
+	if (fileSize < TGA_HEADER_SIZE) {
+		return o3d_set_error("File too small for a TGA header!");
+	}
+
+	const uint8_t * header = fileData;
+	const uint32_t idLength     = header[0];
+	const uint32_t colorMapType = header[1];
+	const uint32_t imageType    = header[2];
+	const uint32_t width        = tga_read_u16(header + 12);
+	const uint32_t height       = tga_read_u16(header + 14);
+	const uint32_t bitsPerPixel = header[16];
+	const uint32_t descriptor   = header[17];
+
+	if (colorMapType != 0) {
+		return o3d_set_error("Color mapped TGAs not supported!");
+	}
+
+	switch (imageType) {
+	case TGA_TYPE_TRUE_COLOR :
+	case TGA_TYPE_RLE_TRUE_COLOR :
+		if (bitsPerPixel != 24 && bitsPerPixel != 32) {
+			return o3d_set_error("Only 24 and 32 bits true color TGAs supported!");
+		}
+		break;
+	case TGA_TYPE_GRAYSCALE :
+	case TGA_TYPE_RLE_GRAYSCALE :
+		if (bitsPerPixel != 8) {
+			return o3d_set_error("Only 8 bits grayscale TGAs supported!");
+		}
+		break;
+	default :
+		return o3d_set_error("Unsupported TGA image type!");
+	} // switch (imageType)
+
+	if (descriptor & TGA_DESC_RIGHT_TO_LEFT) {
+		return o3d_set_error("Right-to-left TGAs not supported!");
+	}
+	if (width == 0 || height == 0 || width * height > TGA_MAX_PIXELS) {
+		return o3d_set_error("Bad TGA image dimensions!");
+	}
+
+	info->width         = width;
+	info->height        = height;
+	info->bytesPerPixel = bitsPerPixel / 8;
+	info->dataOffset    = TGA_HEADER_SIZE + idLength;
+	info->rle           = (imageType == TGA_TYPE_RLE_TRUE_COLOR || imageType == TGA_TYPE_RLE_GRAYSCALE);
+	info->topDown       = (descriptor & TGA_DESC_TOP_TO_BOTTOM) != 0;
+
+	const size_t minDataSize = info->rle ? 2 : (size_t)width * height * info->bytesPerPixel;
+	if (info->dataOffset > fileSize || fileSize - info->dataOffset < minDataSize) {
+		return o3d_set_error("TGA pixel data is truncated!");
+	}
+	return true;
+}
+
+/* ========================================================
+ * Pixel swizzles:
+ * ======================================================== */
+
+// Converts `count` pixels of the file format to RGBA.
+typedef void (* tga_swizzle_f)(uint8_t * dest, const uint8_t * src, uint32_t count);
+
+static void tga_swizzle_gray(uint8_t * dest, const uint8_t * src, uint32_t count) {
+	for (uint32_t i = 0; i < count; ++i, dest += 4) {
+		dest[0] = dest[1] = dest[2] = src[i];
+		dest[3] = 0xFF;
+	}
+}
+
+static void tga_swizzle_bgr(uint8_t * dest, const uint8_t * src, uint32_t count) {
+	for (uint32_t i = 0; i < count; ++i, dest += 4, src += 3) {
+		dest[0] = src[2];
+		dest[1] = src[1];
+		dest[2] = src[0];
+		dest[3] = 0xFF;
+	}
+}
+
+static void tga_swizzle_bgra(uint8_t * dest, const uint8_t * src, uint32_t count) {
+	for (uint32_t i = 0; i < count; ++i, dest += 4, src += 4) {
+		dest[0] = src[2];
+		dest[1] = src[1];
+		dest[2] = src[0];
+		dest[3] = src[3];
+	}
+}
+
+#if TGA_USE_SSSE3
+
+TGA_TARGET_SSSE3 static void tga_swizzle_bgr_ssse3(uint8_t * dest, const uint8_t * src, uint32_t count) {
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i alpha   = _mm_set1_epi32((int)0xFF000000u);
+
+	// Each load of 4 pixels reads 16 bytes of which 12 are used, so stop
+	// while at least 6 pixels are left, not to read past the end of the source.
+	uint32_t i = 0;
+	for (; i + 6 <= count; i += 4, dest += 16, src += 12) {
+		const __m128i bgr = _mm_loadu_si128((const __m128i *)src);
+		_mm_storeu_si128((__m128i *)dest, _mm_or_si128(_mm_shuffle_epi8(bgr, shuffle), alpha));
+	}
+	tga_swizzle_bgr(dest, src, count - i);
+}
+
+TGA_TARGET_SSSE3 static void tga_swizzle_bgra_ssse3(uint8_t * dest, const uint8_t * src, uint32_t count) {
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8, dest += 32, src += 32) {
+		const __m128i bgra0 = _mm_loadu_si128((const __m128i *)src);
+		const __m128i bgra1 = _mm_loadu_si128((const __m128i *)(src + 16));
+		_mm_storeu_si128((__m128i *)dest,        _mm_shuffle_epi8(bgra0, shuffle));
+		_mm_storeu_si128((__m128i *)(dest + 16), _mm_shuffle_epi8(bgra1, shuffle));
+	}
+	tga_swizzle_bgra(dest, src, count - i);
+}
+
+static bool tga_cpu_has_ssse3(void) {
+#if TGA_SSSE3_RUNTIME
+	return __builtin_cpu_supports("ssse3");
+#else // !TGA_SSSE3_RUNTIME
+	return true;
+#endif // TGA_SSSE3_RUNTIME
+}
+
+#endif // TGA_USE_SSSE3
+
+static tga_swizzle_f tga_select_swizzle(uint32_t bytesPerPixel) {
+#if TGA_USE_SSSE3
+	if (tga_cpu_has_ssse3()) {
+		if (bytesPerPixel == 3) {
+			return &tga_swizzle_bgr_ssse3;
+		}
+		if (bytesPerPixel == 4) {
+			return &tga_swizzle_bgra_ssse3;
+		}
+	}
+#endif // TGA_USE_SSSE3
+
+	switch (bytesPerPixel) {
+	case 1  : return &tga_swizzle_gray;
+	case 3  : return &tga_swizzle_bgr;
+	case 4  : return &tga_swizzle_bgra;
+	default : return NULL;
+	} // switch (bytesPerPixel)
+}
+
+// Repeats one RGBA pixel `count` times.
+static void tga_fill(uint8_t * dest, const uint8_t rgba[4], uint32_t count) {
+	if (count == 0) {
+		return;
+	}
+
+	// Doubling the filled span keeps long runs to a few memcpy calls.
+	memcpy(dest, rgba, 4);
+	size_t filled = 4;
+	const size_t total = (size_t)count * 4;
+	while (filled < total) {
+		const size_t chunk = (filled < total - filled) ? filled : total - filled;
+		memcpy(dest + filled, dest, chunk);
+		filled += chunk;
+	}
+}
+
+/* ========================================================
+ * tga_decode():
+ * ======================================================== */
+
+static uint8_t * tga_dest_row(const tga_info_t * info, uint8_t * dest, size_t destPitch, uint32_t fileRow) {
+	const uint32_t y = info->topDown ? fileRow : (info->height - 1 - fileRow);
+	return dest + ((size_t)y * destPitch);
+}
+
+static bool tga_decode_rle(const tga_info_t * info, tga_swizzle_f swizzle, const uint8_t * src,
+                           const uint8_t * srcEnd, uint8_t * dest, size_t destPitch) {
+	const uint32_t bpp = info->bytesPerPixel;
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint8_t * row = tga_dest_row(info, dest, destPitch, 0);
+
+	// Packets may span several rows, so they are split at the row ends.
+	while (y < info->height) {
+		if (src >= srcEnd) {
+			return o3d_set_error("TGA RLE data is truncated!");
+		}
+
+		const uint32_t packet = *src++;
+		uint32_t count = (packet & 0x7F) + 1;
+
+		uint8_t runPixel[4];
+		if (packet & 0x80) {
+			if ((size_t)(srcEnd - src) < bpp) {
+				return o3d_set_error("TGA RLE data is truncated!");
+			}
+			swizzle(runPixel, src, 1);
+			src += bpp;
+		} else {
+			if ((size_t)(srcEnd - src) < (size_t)count * bpp) {
+				return o3d_set_error("TGA RLE data is truncated!");
+			}
+		}
+
+		while (count > 0) {
+			const uint32_t span = (count < info->width - x) ? count : (info->width - x);
+			if (packet & 0x80) {
+				tga_fill(row + ((size_t)x * 4), runPixel, span);
+			} else {
+				swizzle(row + ((size_t)x * 4), src, span);
+				src += (size_t)span * bpp;
+			}
+
+			count -= span;
+			x += span;
+			if (x == info->width) {
+				x = 0;
+				if (++y == info->height) {
+					break; // Whatever is left of the packet is junk past the image.
+				}
+				row = tga_dest_row(info, dest, destPitch, y);
+			}
+		}
+	}
+	return true;
+}
+
+bool tga_decode(const tga_info_t * info, const void * fileData, size_t fileSize, uint8_t * dest, size_t destPitch) {
+	assert(info     != NULL);
+	assert(fileData != NULL);
+	assert(dest     != NULL);
+	assert(destPitch >= (size_t)info->width * 4);
+	assert(info->dataOffset <= fileSize);
+
+	const tga_swizzle_f swizzle = tga_select_swizzle(info->bytesPerPixel);
+	if (swizzle == NULL) {
+		return o3d_set_error("Bad TGA pixel size!");
+	}
+
+	const uint8_t * src    = (const uint8_t *)fileData + info->dataOffset;
+	const uint8_t * srcEnd = (const uint8_t *)fileData + fileSize;
+
+	if (info->rle) {
+		return tga_decode_rle(info, swizzle, src, srcEnd, dest, destPitch);
+	}
+
+	// Size was checked by tga_read_info().
+	const size_t srcPitch = (size_t)info->width * info->bytesPerPixel;
+	assert((size_t)(srcEnd - src) >= srcPitch * info->height);
+
+	for (uint32_t y = 0; y < info->height; ++y, src += srcPitch) {
+		swizzle(tga_dest_row(info, dest, destPitch, y), src, info->width);
+	}
+	return true;
+}
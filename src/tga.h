@@ -0,0 +1,67 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: tga.h
+ * Created on: 17/10/26
+ * Brief: Native TGA decoder for the game's textures, from memory into a caller supplied buffer.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_TGA_H
+#define DARKSTONE_TGA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Darkstone's TGAs are all true color BGR or BGRA, some of them RLE
+ * compressed. Those, plus 8-bit grayscale, are what this decoder handles.
+ * Color mapped and 16-bit images are rejected by tga_read_info(), so the
+ * callers can fall back to the generic decoder in image.h for them.
+ *
+ * The BGR(A) to RGBA swizzle uses SSSE3 shuffles when the CPU has them.
+ * GCC and Clang builds check for it at runtime, so no -m flags are needed.
+ */
+
+/* ========================================================
+ * TGA image info:
+ * ======================================================== */
+
+typedef struct tga_info {
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytesPerPixel; // 1 (grayscale), 3 (BGR) or 4 (BGRA).
+	uint32_t dataOffset;    // Start of the pixel data, past the header and image id.
+	bool     rle;           // Run-length encoded pixel data.
+	bool     topDown;       // First row in the file is the top one.
+} tga_info_t;
+
+/* ========================================================
+ * TGA functions:
+ * ======================================================== */
+
+/*
+ * Parses and validates the header. Fails for anything that is not
+ * a supported TGA, which also makes it a reasonable format check,
+ * since TGAs have no magic number. Uncompressed data is size checked
+ * here too; RLE data can only be checked when decoded.
+ */
+bool tga_read_info(tga_info_t * info, const void * fileData, size_t fileSize);
+
+/*
+ * Decodes the image as RGBA8, top row first, into `dest`. Rows are
+ * `destPitch` bytes apart (at least width * 4), so it can write straight
+ * into a mapped GL pixel buffer or a region of a larger image. Only the
+ * image pixels are written. Fails on truncated RLE data, in which case
+ * `dest` is left partially written.
+ */
+bool tga_decode(const tga_info_t * info, const void * fileData, size_t fileSize, uint8_t * dest, size_t destPitch);
+
+#endif // DARKSTONE_TGA_H
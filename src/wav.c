@@ -0,0 +1,126 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: wav.c
+ * Created on: 17/10/26
+ * Brief: RIFF/WAVE parser returning the sample format and a view of the PCM data in place.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#include "wav.h"
+#include "o3d.h"
+
+#include <assert.h>
+#include <string.h>
+
+enum {
+	WAV_FORMAT_EXTENSIBLE = 0xFFFE,
+	WAV_FMT_MIN_SIZE      = 16,
+	WAV_FMT_EXT_SIZE      = 40  // Extensible: the sub-format GUID starts at byte 24.
+};
+
+// RIFF is little-endian, and the chunks are only 2 byte aligned, so read byte by byte.
+static inline uint16_t wav_read_u16(const uint8_t * p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t wav_read_u32(const uint8_t * p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* ========================================================
+ * wav_read_info():
+ * ======================================================== */
+
+bool wav_read_info(wav_info_t * info, const void * fileData, size_t fileSize) {
+
+	assert(info != NULL);
+	assert(fileData != NULL);
+
+	memset(info, 0, sizeof(*info));
+
+	const uint8_t * bytes = (const uint8_t *)fileData;
+	if (fileSize < 12 || memcmp(bytes, "RIFF", 4) != 0 || memcmp(bytes + 8, "WAVE", 4) != 0) {
+		return o3d_set_error("Not a RIFF WAVE file!");
+	}
+
+	const uint8_t * fmt = NULL;
+	size_t offset = 12;
+
+	// Chunks are an id, a size and the data, padded to an even size.
+	while (offset + 8 <= fileSize) {
+		const uint8_t * chunk = bytes + offset;
+		const uint32_t chunkSize = wav_read_u32(chunk + 4);
+		const size_t available = fileSize - (offset + 8);
+
+		if (memcmp(chunk, "fmt ", 4) == 0) {
+			if (chunkSize < WAV_FMT_MIN_SIZE || chunkSize > available) {
+				return o3d_set_error("Bad WAV format chunk!");
+			}
+			fmt = chunk + 8;
+
+			uint32_t format = wav_read_u16(fmt);
+			if (format == WAV_FORMAT_EXTENSIBLE) {
+				if (chunkSize < WAV_FMT_EXT_SIZE) {
+					return o3d_set_error("Bad WAV extensible format chunk!");
+				}
+				format = wav_read_u16(fmt + 24); // First 2 bytes of the sub-format GUID.
+			}
+
+			info->format        = format;
+			info->channels      = wav_read_u16(fmt + 2);
+			info->sampleRate    = wav_read_u32(fmt + 4);
+			info->bitsPerSample = wav_read_u16(fmt + 14);
+			info->bytesPerFrame = info->channels * (info->bitsPerSample / 8);
+
+			if (format != WAV_FORMAT_PCM && format != WAV_FORMAT_FLOAT) {
+				return o3d_set_error("Only PCM and float WAVs supported!");
+			}
+			if (info->channels == 0 || info->sampleRate == 0) {
+				return o3d_set_error("Bad WAV channel count or sample rate!");
+			}
+			if (format == WAV_FORMAT_FLOAT ? (info->bitsPerSample != 32) :
+			    (info->bitsPerSample != 8  && info->bitsPerSample != 16 &&
+			     info->bitsPerSample != 24 && info->bitsPerSample != 32)) {
+				return o3d_set_error("Unsupported WAV sample size!");
+			}
+		} else if (memcmp(chunk, "data", 4) == 0) {
+			if (fmt == NULL) {
+				return o3d_set_error("WAV data chunk before the format chunk!");
+			}
+
+			uint32_t dataSize = chunkSize;
+			if (dataSize > available) {
+				dataSize = (uint32_t)available;
+				info->truncated = true;
+			}
+
+			info->samples    = chunk + 8;
+			info->frameCount = dataSize / info->bytesPerFrame;
+			info->dataSize   = info->frameCount * info->bytesPerFrame;
+			return true;
+		}
+
+		offset += 8 + (size_t)chunkSize + (chunkSize & 1);
+	}
+
+	return o3d_set_error((fmt == NULL) ? "WAV file has no format chunk!" : "WAV file has no data chunk!");
+}
+
+/* ========================================================
+ * wav_duration():
+ * ======================================================== */
+
+double wav_duration(const wav_info_t * info) {
+	assert(info != NULL);
+	if (info->sampleRate == 0) {
+		return 0.0;
+	}
+	return (double)info->frameCount / (double)info->sampleRate;
+}
@@ -0,0 +1,73 @@
+/* ================================================================================================
+ * -*- C -*-
+ * File: wav.h
+ * Created on: 17/10/26
+ * Brief: RIFF/WAVE parser returning the sample format and a view of the PCM data in place.
+ *
+ * Source code licensed under the MIT license.
+ * Copyright (C) 2015 Guilherme R. Lampert
+ *
+ * This software is provided "as is" without express or implied
+ * warranties. You may freely copy and compile this source into
+ * applications you distribute provided that this copyright text
+ * is included in the resulting source code.
+ * ================================================================================================ */
+
+#ifndef DARKSTONE_WAV_H
+#define DARKSTONE_WAV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The sounds in DATA/SOUND and DATA/SFX are RIFF WAVE files. The parser
+ * works on the bytes of a whole file, in memory or mapped (an archive
+ * mapping works, see mtf_file_entry_is_compressed()), and returns where
+ * the sample frames are instead of copying them, so the callers convert
+ * or analyze them straight from the archive (see pcm.h).
+ *
+ * Integer PCM (8 bits unsigned, 16, 24 and 32 bits signed) and 32 bits
+ * float are supported, including their WAVE_FORMAT_EXTENSIBLE variants.
+ * Compressed encodings (ADPCM and such) are rejected by wav_read_info().
+ */
+
+/* ========================================================
+ * WAV sound info:
+ * ======================================================== */
+
+enum {
+	WAV_FORMAT_PCM   = 1,
+	WAV_FORMAT_FLOAT = 3
+};
+
+typedef struct wav_info {
+	const uint8_t * samples;       // Interleaved sample frames, inside the parsed data. Not aligned.
+	uint32_t        dataSize;      // Bytes at `samples`, a multiple of bytesPerFrame.
+	uint32_t        frameCount;    // dataSize / bytesPerFrame.
+	uint32_t        format;        // WAV_FORMAT_PCM or WAV_FORMAT_FLOAT.
+	uint32_t        channels;
+	uint32_t        sampleRate;    // Frames per second.
+	uint32_t        bitsPerSample; // 8, 16, 24 or 32.
+	uint32_t        bytesPerFrame; // channels * bitsPerSample / 8.
+	bool            truncated;     // The data chunk claimed more bytes than the file has.
+} wav_info_t;
+
+/* ========================================================
+ * WAV functions:
+ * ======================================================== */
+
+/*
+ * Walks the RIFF chunks for the format and the sample data. `info->samples`
+ * points into `fileData`, so it is valid for as long as that is. A data
+ * chunk cut short by the end of the file is accepted, with the frames that
+ * are there (`truncated` is set), since cut files are common in old games.
+ */
+bool wav_read_info(wav_info_t * info, const void * fileData, size_t fileSize);
+
+/*
+ * Length of the sound, in seconds.
+ */
+double wav_duration(const wav_info_t * info);
+
+#endif // DARKSTONE_WAV_H